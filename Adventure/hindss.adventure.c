@@ -5,8 +5,58 @@
  *	Description: This C program works in conjunction with the buildrooms program, which must be invoked 
  *			first in order to construct the room graph through which the player will move.
  *			This program provides the gameplay engine for the adventure game.
+ *
+ *			The newest hindss.rooms.* entry in . is played: the one the hindss.rooms.latest link
+ *			that buildrooms leaves behind points at, or failing that the entry with the latest
+ *			modification time, or the entry given with --graph. It may be the original directory of
+ *			room files, or a packed room file (see hindss.roomfile.h), which is mapped with
+ *			mmap and played in place. Rooms live in a room store (see hindss.roomstore.h):
+ *			connections are room indices, and typed room names are found through a hash
+ *			table of the room names, so a move costs one lookup whatever the graph's size.
+ *
+ *			Usage: adventure [--graph PATH] [--solve] [--lazy] [--cache ROOMS] [--no-time-file]
+ *			                 [--replay FILE | --walks N [--bias P] [--seed S] [--save FILE]]
+ *			                 [--serve SOCKET [--workers N] [--watch]] [--compact-path] [--trace FILE]
+ *			                 [--checkpoint FILE] [--restore FILE [--session N]]
+ *
+ *			--solve plays nothing: it finds a shortest path from START_ROOM to END_ROOM with a
+ *			bidirectional breadth first search over the room indices and prints it in the
+ *			game's path format, along with the number of rooms expanded and the time taken.
+ *
+ *			--lazy reads a packed room file a room at a time instead of loading it, keeping
+ *			at most ROOMS decoded rooms (default 4096). Entering a room reads its neighbors
+ *			ahead, and the cache's hit rate is printed on stderr at the end.
+ *
+ *			--replay FILE plays the move script in FILE (see hindss.replay.h) instead of reading
+ *			the player's moves, printing nothing per move. Each sequence must enter END_ROOM
+ *			on its last move after its expected number of steps; the totals and the moves
+ *			played per second are printed at the end. --walks N plays N random walks from
+ *			START_ROOM to END_ROOM instead, each step heading for END_ROOM with probability
+ *			--bias (default 0.5), from --seed, and --save FILE keeps them as a script.
+ *
+ *			--serve SOCKET hosts games instead of playing one, on a Unix socket with --workers
+ *			threads (default 4) sharing the loaded graph (see hindss.server.h). --watch reloads
+ *			the graph whenever a new one is complete (see hindss.graphwatch.h): buildrooms' next
+ *			output, or a rewrite of the --graph file or directory. Games that start afterwards
+ *			are played on the new graph; games in progress finish on theirs.
+ *
+ *			--checkpoint FILE saves the game to a session snapshot (see hindss.snapshot.h) when
+ *			the player types save, and when input runs out before END_ROOM. With --serve, every
+ *			game in progress is saved to FILE in one batch on SIGUSR1 and at shutdown.
+ *			--restore FILE resumes session N (default 0) of a snapshot: its room, its path and
+ *			the time it had been played for.
+ *
+ *			The player's path is kept as a log of room indices (see hindss.pathlog.h), varint
+ *			encoded with --compact-path. --trace FILE streams a game's path to a binary trace
+ *			file as it is played, which --replay also accepts, as a script of one sequence.
+ *
+ *			Typing time asks a timing thread that lives for the whole game for the time, which
+ *			it formats into a shared buffer for the main thread to print. It also writes it
+ *			to currentTime.txt once the main thread has it, unless --no-time-file is given.
  * ********************************************************************************************************/
 
+#define _GNU_SOURCE
+
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -16,415 +66,500 @@
 #include <string.h>
 #include <dirent.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <limits.h>
+#include "hindss.roomstore.h"
+#include "hindss.replay.h"
+#include "hindss.server.h"
+#include "hindss.pathlog.h"
+#include "hindss.snapshot.h"
 
 
-/* define a room struct to store data parsed from room files in room subdirectory */
+/* function signatures */
 
-struct Room {
+void* timeService(void*);
+void startTimeService(int);
+void stopTimeService();
+void threadTime();
+void engine(struct RoomStore*, struct PathLog*);
+int getMostRecentSubDirName(char*, size_t);
+int targetSubDir(const char*, char*);
+int runRound(struct RoomStore* store, uint32_t* current, char* bfr, size_t bfrLen, struct PathLog* path);
+int applyMove(struct RoomStore*, uint32_t*, const char*, struct PathLog*);
+void display(struct RoomStore*, uint32_t);
+void printPath(struct RoomStore*, struct PathLog*);
+void win();
+void strTruncLast(char*);
+int openGraph(char*, int, uint32_t, struct RoomStore*);
+void printCacheStats(struct RoomStore*);
+int solveMode(char*, int, uint32_t);
+int replayMode(char*, int, uint32_t, const char*, uint64_t, double, unsigned long long, const char*, int);
+int replayScript(struct RoomStore*, const struct MoveScript*, int);
+int serveMode(char*, int, int, const char*, int, const char*);
+uint64_t gameElapsedNs();
+int saveGame(struct RoomStore*, uint32_t, struct PathLog*);
+int restoreGame(const char*, uint64_t, struct RoomStore*, struct PathLog*);
+int solveShortestPath(const struct RoomStore*, uint32_t, uint32_t, uint32_t*, uint32_t*, unsigned long long*);
+
+/* declare and initialize a global mutex from the pthreads library, and the conditions the main thread and the timing
+   thread signal each other with */
 
-	char name[128];
-	int num;
-	char type[16];
-	int numNeighbors;	
-	char neighbors[6][128];
+pthread_mutex_t mutex_a = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t timeRequested = PTHREAD_COND_INITIALIZER;
+pthread_cond_t timeServed = PTHREAD_COND_INITIALIZER;
 
-};
+/* declare a second thread for timekeeping, which runs for the whole game */
 
-/* QueueNode and Queue structs used to track user's path */
+pthread_t timeThread;
 
-struct QueueNode {
+/* state shared with the timing thread under mutex_a: requests made and served so far, the formatted time of the last
+   one served, whether to also write it to currentTime.txt, and whether the thread should exit */
 
-	int value;
-	struct QueueNode* next;
+unsigned long timeRequests;
+unsigned long timeRequestsServed;
+char timeBuffer[128];
+int writeTimeFile;
+int stopTimeThreadWaiting;
 
-};
+/* the snapshot file typing save writes the game to, if any, when this run of the game started, and how long the game
+   had been played before it, which is carried over from the snapshot of a restored game */
+
+char* checkpointPath;
+struct timespec gameStarted;
+uint64_t elapsedBefore;
+
+
+int main(int argc, char** argv) {
+
+	struct option longOptions[] = {
+		{"solve", no_argument, NULL, 's'},
+		{"lazy", no_argument, NULL, 'l'},
+		{"cache", required_argument, NULL, 'c'},
+		{"graph", required_argument, NULL, 'g'},
+		{"no-time-file", no_argument, NULL, 'n'},
+		{"replay", required_argument, NULL, 'r'},
+		{"walks", required_argument, NULL, 'w'},
+		{"bias", required_argument, NULL, 'b'},
+		{"seed", required_argument, NULL, 'S'},
+		{"save", required_argument, NULL, 'o'},
+		{"serve", required_argument, NULL, 'v'},
+		{"workers", required_argument, NULL, 'k'},
+		{"trace", required_argument, NULL, 't'},
+		{"compact-path", no_argument, NULL, 'p'},
+		{"watch", no_argument, NULL, 'W'},
+		{"checkpoint", required_argument, NULL, 'C'},
+		{"restore", required_argument, NULL, 'R'},
+		{"session", required_argument, NULL, 'N'},
+		{NULL, 0, NULL, 0}
+	};
+
+	int opt;
+	int solve = 0;
+	char* graphOverride = NULL;
+	int lazy = 0;
+	int timeFile = 1;
+	char* replayPath = NULL;
+	char* savePath = NULL;
+	uint64_t walks = 0;
+	double bias = 0.5;
+	unsigned long long seed = (unsigned long long) time(NULL);
+	char* socketPath = NULL;
+	int numWorkers = SERVER_DEFAULT_WORKERS;
+	int watch = 0;
+	char* restorePath = NULL;
+	uint64_t sessionIndex = 0;
+	char* tracePath = NULL;
+	int pathEncoding = PATH_LOG_PLAIN;
+	int status = 0;
+	uint32_t cacheRooms = ROOM_CACHE_DEFAULT_ROOMS;
+
+	while ((opt = getopt_long(argc, argv, "", longOptions, NULL)) != -1) {
+
+		switch (opt) {
+			case 's': solve = 1; break;
+			case 'l': lazy = 1; break;
+			case 'c': cacheRooms = (uint32_t) strtoul(optarg, NULL, 10); break;
+			case 'g': graphOverride = optarg; break;
+			case 'n': timeFile = 0; break;
+			case 'r': replayPath = optarg; break;
+			case 'w': walks = strtoull(optarg, NULL, 10); break;
+			case 'b': bias = strtod(optarg, NULL); break;
+			case 'S': seed = strtoull(optarg, NULL, 0); break;
+			case 'o': savePath = optarg; break;
+			case 'v': socketPath = optarg; break;
+			case 'k': numWorkers = atoi(optarg); break;
+			case 't': tracePath = optarg; break;
+			case 'p': pathEncoding = PATH_LOG_COMPACT; break;
+			case 'W': watch = 1; break;
+			case 'C': checkpointPath = optarg; break;
+			case 'R': restorePath = optarg; break;
+			case 'N': sessionIndex = strtoull(optarg, NULL, 10); break;
+			default:
+				fprintf(stderr, "usage: %s [--graph PATH] [--solve] [--lazy] [--cache ROOMS] [--no-time-file]\n"
+					"       [--replay FILE | --walks N [--bias P] [--seed S] [--save FILE]]\n"
+					"       [--serve SOCKET [--workers N] [--watch]] [--compact-path] [--trace FILE]\n"
+					"       [--checkpoint FILE] [--restore FILE [--session N]]\n", argv[0]);
+				return 1;
+		}
 
-struct Queue {
+	}
 
-	int size;
-	struct QueueNode* first;
-	struct QueueNode* last;
+	/* only the server has games that start after the graph has changed */
 
-};
+	if (watch && socketPath == NULL) {
 
+		fprintf(stderr, "adventure: --watch needs --serve\n");
+		return 1;
 
-/* function signatures */
+	}
 
-void* wait(void*);
-void threadTime();
-void engine(struct Room*, struct Queue*, char*, DIR*);
-char* getMostRecentSubDirName();
-void targetSubDir(char*, char*);
-void readRooms(struct Room*, DIR*, char*);
-int runRound(struct Room* roomArr, struct Room** current, char* bfr, size_t bfrLen, struct Queue* path);
-void display(struct Room*);
-void pushQueue(struct Queue*, int);
-int popQueue(struct Queue*);
-void printPath(struct Room*, struct Queue*);
-void win();
-void cleanup(struct Room*, struct Queue*);
-void strTruncLast(char*);
+	/* a restored game is played here, whatever the server saved it from */
 
-/* declare and initialize a global mutex from the pthreads library */
+	if (restorePath != NULL && (socketPath != NULL || solve || replayPath != NULL || walks > 0)) {
 
-pthread_mutex_t mutex_a = PTHREAD_MUTEX_INITIALIZER;
+		fprintf(stderr, "adventure: --restore resumes an interactive game\n");
+		return 1;
 
-/* declare a second thread for timekeeping */
+	}
 
-pthread_t timeThread;
+	/* the solver needs neither the timing thread nor the name table */
 
-int stopTimeThreadWaiting;
+	if (solve) {
 
+		char graphName[PATH_MAX];
 
-int main() {
+		if (targetSubDir(graphOverride, graphName) != 0) {
 
-	/* lock mutex in the main thread */
+			return 1;
 
-	pthread_mutex_lock(&mutex_a);
+		}
 
-	/* start second thread */
+		return solveMode(graphName, lazy, cacheRooms);
 
-	stopTimeThreadWaiting = 0;
+	}
 
-	pthread_create(&timeThread, NULL, wait, &stopTimeThreadWaiting);
+	/* nor does the server, which shares one loaded graph among all its games */
 
-	/* declare variables */
+	if (socketPath != NULL) {
 
-	char roomDirName[128];
+		char graphName[PATH_MAX];
 
-	char prefix[128];
+		if (lazy) {
 
-	struct Room roomArr[7];
+			fprintf(stderr, "adventure: --serve cannot read rooms lazily\n");
+			return 1;
 
-	/* initialize queue to track user path */
+		}
 
-	struct Queue* path = malloc(sizeof(struct Queue));
+		if (targetSubDir(graphOverride, graphName) != 0) {
 
-	path->size = 0;
-	path->first = NULL;
-	path->last = NULL;
+			return 1;
 
-	/* set roomDirName and file prefix */
-  	
-	targetSubDir(roomDirName, prefix);
+		}
+
+		return serveMode(graphName, graphOverride == NULL, watch, socketPath, numWorkers, checkpointPath);
 
- 	/* open subdirectory with most recent timestamp */
+	}
 
-	DIR* roomDir = opendir(roomDirName);
+	/* neither do scripted games */
 
-	/* check room directory */
+	if (replayPath != NULL || walks > 0) {
 
-	if (roomDir) {
+		char graphName[PATH_MAX];
 
-		/* read rooms into room graph */
+		if (targetSubDir(graphOverride, graphName) != 0) {
 
-		readRooms(roomArr, roomDir, prefix);
+			return 1;
 
-		/* run engine with parameters */
+		}
 
-		engine(roomArr, path, prefix, roomDir);
+		return replayMode(graphName, lazy, cacheRooms, replayPath, walks, bias, seed, savePath, pathEncoding);
 
 	}
 
-	/* cleanup */	
+	/* start second thread */
 
-	if (roomDir) {
+	startTimeService(timeFile);
 
-		closedir(roomDir);
-	
-	}
+	/* declare variables */
 
-	cleanup(roomArr, path);
+	char roomDirName[PATH_MAX];
 
-	/* this will ensure that the timing thread does not print time when mutex is unlocked */
+	struct RoomStore store;
 
-	stopTimeThreadWaiting++;	
+	/* initialize the log of the user's path */
 
-	/* unlock the mutex and join timing thread to ensure that it completes execution */
-	
-	pthread_mutex_unlock(&mutex_a);
+	struct PathLog path;
 
-	pthread_join(timeThread, NULL);
+	initPathLog(&path, pathEncoding);
 
-	/* exit with status 0 */
+	/* set roomDirName, then load the packed room file or room directory it names */
+  	
+	if (targetSubDir(graphOverride, roomDirName) == 0 && openGraph(roomDirName, lazy, cacheRooms, &store) == 0) {
 
-	return 0;
+		/* index names for typed input unless rooms are read as they are needed */
 
-}
+		if (!lazy) {
 
+			indexRoomNames(&store);
 
-/* Returns a string containing the filename of the subdirectory most recently modified */
+		}
 
-char* getMostRecentSubDirName() {
+		/* resume a saved game if asked, then stream the path, restored rooms first, to a trace file if asked, then run
+		   engine with parameters */
 
-	// printf("** get most recent subdir **\n");
+		if ((restorePath == NULL || restoreGame(restorePath, sessionIndex, &store, &path) == 0)
+				&& (tracePath == NULL || tracePathLog(&path, tracePath) == 0)) {
 
-	/* perform stat() call on rooms directories in . to find most recent st_mtime from stat struct 
-	   referenced the "Manipulating Directories" page at https://oregonstate.instructure.com/courses/1662153/pages/2-dot-4-manipulating=directories */	
-	
-	struct dirent* newestDir;
-	DIR* workingDir = opendir(".");
+			engine(&store, &path);
 
-	int newestDirTime = -1;
+		}
+		else {
 
-	/* prefix for searching */
+			status = 1;
 
-	char prefix[32] = "hindss.rooms.";
-	char newestDirName[256];
-	memset(newestDirName, 0, sizeof(newestDirName));
+		}
 
-	struct dirent* entity;
-	struct stat attributes;
+		printCacheStats(&store);
 
-	if (workingDir > 0) {
+		closeRoomStore(&store);
 
-		/* iterate through each entity in . */
+	}
 
-		while ((entity = readdir(workingDir)) != NULL) {
+	/* cleanup, which completes the trace */	
 
-			/* if d_name of the entity has prefix as a substring */
+	if (closePathLog(&path) != 0) {
 
-			if (strstr(entity->d_name, prefix) != NULL) {
-				
-				/* store stat struct returned from call to stat on entity in attributes */
+		status = 1;
 
-				stat(entity->d_name, &attributes);
+	}
 
-				/* if entity being examined is the most recent examined so far */
+	/* wake the timing thread to exit, and join it to ensure that it completes execution */
 
-				if ((int) attributes.st_mtime > newestDirTime) {
-			
-					/* update newestDirTime, newestDirName, newestDir */
+	stopTimeService();
 
-					newestDirTime = (int) attributes.st_mtime;
-					memset(newestDirName, 0, sizeof(newestDirName));
+	/* exit with status 0 unless the game could not be restored or the trace could not be written */
 
-					strcpy(newestDirName, entity->d_name);
-					newestDir = entity;
-			
-				}
+	return status;
 
-			}	
+}
 
 
-		}
+/* Store the name of the most recently modified hindss.rooms.* entry in . in name. Each entry's modification time comes
+   from one statx() relative to the open directory that asks for nothing but the time. Returns 0, or -1 if there is no
+   entry */
 
-	}
+int getMostRecentSubDirName(char* name, size_t size) {
 
-	/* close . and return name of newest subdirectory */
+	DIR* workingDir = opendir(".");
 
-	closedir(workingDir);
+	struct dirent* entity;
+	struct statx attributes;
 
-	return newestDir->d_name;
+	long long newestSec = LLONG_MIN;
+	unsigned newestNsec = 0;
 
-}
+	/* prefix for searching */
 
+	const char prefix[] = "hindss.rooms.";
+	size_t prefixLen = sizeof(prefix) - 1;
 
-/* Store name of most recently modified subdirectory in roomDirName */
+	name[0] = 0;
 
-void targetSubDir(char* roomDirName, char* prefix) {
-	
-	// printf("** target most recent subdir **\n");
+	if (workingDir == NULL) {
 
-	memset(roomDirName, 0, sizeof(roomDirName));
-	memset(prefix, 0, sizeof(prefix));
+		perror(".");
+		return -1;
 
-	strcpy(prefix, getMostRecentSubDirName());
-	strcpy(roomDirName, prefix);
+	}
 
-	strcat(prefix, "/");
+	/* iterate through each entity in . */
 
-}
+	while ((entity = readdir(workingDir)) != NULL) {
 
+		/* entries that start with the prefix, other than the latest link and links being swapped in for it */
 
-/* Game engine */
+		if (strncmp(entity->d_name, prefix, prefixLen) != 0
+				|| strncmp(entity->d_name, ROOM_LATEST_LINK, sizeof(ROOM_LATEST_LINK) - 1) == 0
+				|| strlen(entity->d_name) >= size) {
+			continue;
+		}
 
-void engine(struct Room* roomArr, struct Queue* path, char* prefix, DIR* roomDir) {
+		if (statx(dirfd(workingDir), entity->d_name, AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC, STATX_MTIME, &attributes) != 0
+				|| !(attributes.stx_mask & STATX_MTIME)) {
+			continue;
+		}
 
-	// printf("** engine **\n");
+		/* if entity being examined is the most recent examined so far, copy its name before readdir reuses it */
 
-	/* declare room pointer and local variables */
+		if (attributes.stx_mtime.tv_sec > newestSec
+				|| (attributes.stx_mtime.tv_sec == newestSec && attributes.stx_mtime.tv_nsec > newestNsec)) {
 
-	struct Room* current;
-	
-	size_t bfrLen = 60;
-	char* bfr = (char* )malloc(bfrLen * sizeof(char));
+			newestSec = attributes.stx_mtime.tv_sec;
+			newestNsec = attributes.stx_mtime.tv_nsec;
+			strcpy(name, entity->d_name);
 
-	int gameStatus = 0;
-	int i;
-	int neighborWasSelected;
+		}
 
-	/* locate start room */
+	}
 
-	for (i = 0; i < 7; i++) {
+	closedir(workingDir);
 
-		if (strstr(roomArr[i].type, "START_ROOM")) {
+	return (name[0] != 0) ? 0 : -1;
 
-			current = &roomArr[i];
+}
 
-		}
 
-	}
+/* Store the name of the room graph to play in roomDirName: override if given, otherwise what the latest link points
+   at, otherwise the most recently modified entry. Returns 0, or -1 with a message if there is none */
 
-	/* while game has not been won */
+int targetSubDir(const char* override, char* roomDirName) {
 
-	while (!gameStatus) {
+	ssize_t len;
 
-		/* run a round and store status at end of round (> 0) = win */
+	if (override != NULL) {
 
-		gameStatus = runRound(roomArr, &current, bfr, bfrLen, path);	
+		snprintf(roomDirName, PATH_MAX, "%s", override);
+		return 0;
 
 	}
 
-	/* win when while loop exits */
+	/* buildrooms points the link at its output once it is complete, so no scan is needed */
 
-	win();
-	printPath(roomArr, path);
+	len = readlink(ROOM_LATEST_LINK, roomDirName, PATH_MAX - 1);
 
-	free(bfr);	
+	if (len > 0) {
 
-}
+		roomDirName[len] = 0;
 
+		if (access(roomDirName, F_OK) == 0) {
 
-/* Read room files from room subdirectory and store data in Room structs */
+			return 0;
 
-void readRooms(struct Room* dest, DIR* src, char* prefix) {
+		}
 
-	// printf("** readRooms **");
+	}
 
-	struct dirent* roomEntity;
-	FILE* roomFile;
-	char filename[128];
-	char str[128];
-	char substr[128] = "ROOM TYPE: ";
-	int arrIndex = 0;
-	int offset = 11;
-	int c;
+	/* no link, or a link to a graph since removed */
 
-	/* initialize rooms in room array */
+	if (getMostRecentSubDirName(roomDirName, PATH_MAX) != 0) {
 
-	int i;
-	int j;
+		fprintf(stderr, "adventure: no hindss.rooms.* room graph in . (run buildrooms first)\n");
+		return -1;
 
-	for (i = 0; i < 7; i++) {
+	}
 
+	return 0;
 
-		memset(dest[i].name, 0, sizeof(char) * 128);	
-		dest[i].num = i;
-		memset(dest[i].name, 0, sizeof(char) * 16);
-		dest[i].numNeighbors = 0;
-		
-		for (j = 0; j < 6; j++) {
+}
 
-			memset(dest[i].neighbors[j], 0, 128);
 
-		} 
+/* Game engine */
 
-	}
+void engine(struct RoomStore* store, struct PathLog* path) {
 
-	/* read each file */
+	// printf("** engine **\n");
 
-	while ((roomEntity = readdir(src)) != NULL) {
+	/* declare current room index and local variables */
 
-		/* do not examine . or .. */
+	uint32_t current;
+	
+	size_t bfrLen = 60;
+	char* bfr = (char* )malloc(bfrLen * sizeof(char));
 
-		if (strcmp(roomEntity->d_name, ".") != 0 && strcmp(roomEntity->d_name, "..") != 0) {			
+	int gameStatus = 0;
 
-			dest[arrIndex].num = arrIndex;		// set num field of Room struct
+	/* a restored game carries on from the last room of its path */
 
-			memset(filename, 0, sizeof(filename));
-			strcpy(filename, prefix);		// copy prefix to filename
-		
-			strcat(filename, roomEntity->d_name);	// concatenate roomname to filename
-		
-			roomFile = fopen(filename, "r");	// open the file
+	if (pathLogSize(path) > 0) {
 
-			c = 0;
+		current = path->last;
 
-			/* while a line can be read from file */
+	}
+	else {
 
-			while (fgets(str, 60, roomFile)) {	
+		/* locate start room */
 
-				/* if line describes name */
+		current = findRoomByType(store, START_ROOM);
 
-				if (strstr(str, "ROOM NAME")) {
+		if (current == ROOM_NONE) {
 
-					/* parse name and store in dest[arrIndex].name */
-				
-					strcpy(str, str + offset);
-	
-					strTruncLast(str);
-	
-					strcpy(dest[arrIndex].name, str);
-	
-				}
+			fprintf(stderr, "adventure: the room graph has no START_ROOM\n");
+			free(bfr);
+			return;
 
-				/* if line describes connection */
+		}
 
-				else if (strstr(str, "CONNECTION")) {			
+		/* the path starts where the player does */
 
-					/* parse and store in dest[arrIndex].connections */
+		appendPathLog(path, current);
 
-					strcpy(str, str + offset + 3);
-		
-					strTruncLast(str);
+	}
 
-					strcpy(dest[arrIndex].neighbors[c], str);
-				
-					/* increment numNeighbors */
+	clock_gettime(CLOCK_MONOTONIC, &gameStarted);
 
-					dest[arrIndex].numNeighbors++;
-		
-					/* increment connections index */
-					
-					c++; 
+	/* while game has not been won */
 
-				}
+	while (!gameStatus) {
 
-				/* if line describes room type */
+		/* a lazy store reads the current room's neighbors ahead of display() and the player's choice */
 
-				else if (strstr(str, "ROOM TYPE")) {
+		if (store->cache) {
 
-					/* parse and store in dest[arrIndex].type */
-	
-					strcpy(str, str + offset);
+			readAheadNeighbors(store->cache, current);
 
-					strTruncLast(str);
+		}
 
-					strcpy(dest[arrIndex].type, str);
+		/* run a round and store status at end of round (> 0) = win, (< 0) = no more input */
 
-				}
+		gameStatus = runRound(store, &current, bfr, bfrLen, path);	
 
-			}
+	}
 
-			fclose(roomFile);
+	/* win when while loop exits, unless input ran out first */
 
-			arrIndex++;
+	if (gameStatus > 0) {
 
-		}
+		win();
+		printPath(store, path);
 
 	}
-	
+
+	/* a game left unfinished is saved if there is somewhere to save it */
+
+	else if (checkpointPath != NULL) {
+
+		saveGame(store, current, path);
+
+	}
+
+	free(bfr);	
+
 }
 
 
 /* Prompt user with their current location and possible options, accept user input */
 
-int runRound(struct Room* roomArr, struct Room** current, char* bfr, size_t bfrLen, struct Queue* path) {
-
-	int i;
+int runRound(struct RoomStore* store, uint32_t* current, char* bfr, size_t bfrLen, struct PathLog* path) {
 
-	int neighborWasSelected;
+	int status;
 
 	/* display() */
 			
-	display(*current);
+	display(store, *current);
 
 	/* get input and validate */
 	
 	memset(bfr, 0, bfrLen * sizeof(char));
 
-	getline(&bfr, &bfrLen, stdin);
+	if (getline(&bfr, &bfrLen, stdin) == -1) {
+
+		printf("\n");
+		return -1;
+
+	}
 	
 	printf("\n");
 
@@ -441,90 +576,84 @@ int runRound(struct Room* roomArr, struct Room** current, char* bfr, size_t bfrL
 		threadTime();
 	
 	}
+
+	/* if user entered 'save' and there is a checkpoint file */
+
+	else if (checkpointPath != NULL && strcmp(bfr, "save") == 0) {
+
+		saveGame(store, *current, path);
+
+	}
 		
 	else {
 
-		neighborWasSelected = 0;				// Boolean to indicate whether a valid room selected
-	
-		for (i = 0; i < (*current)->numNeighbors; i++) {
-
-			/* if bfr matches a neighbor */
+		status = applyMove(store, current, bfr, path);
 
-			if (strcmp(bfr, (*current)->neighbors[i]) == 0) {
-				
-				neighborWasSelected++;				
+		if (status < 0) {
 	
-			}		
-
+		/* if input not valid */
+			
+			printf("HUH? I DON'T UNDERSTAND THAT ROOM. TRY AGAIN.\n\n");
+			 
 		}
 
-		/* if user entered a valid room */
+		/* if END_ROOM */
 
-		if (neighborWasSelected) {
-			
-			/* push the room to the queue */
+		return status > 0;
+		
+	}
 
-			pushQueue(path, (*current)->num);
-			
-			for (i = 0; i < 7; i++) {
+	return 0;
 
-				if (strcmp(bfr, roomArr[i].name) == 0 && neighborWasSelected) {
+}
 
-					/* update current pointer to room whose name matches bfr */
 
-					*current = &roomArr[i];
+/* Move from current to the connection called name, appending the room moved to to path. Returns 1 if it is END_ROOM,
+   0 for any other room, or -1 if name is not one of current's connections */
 
-				}
+int applyMove(struct RoomStore* store, uint32_t* current, const char* name, struct PathLog* path) {
 
-			}
+	/* look the name up once, then check that it is one of the current room's connections */
 
-		}
+	uint32_t target = findConnection(store, *current, name);
 
-		else {
-	
-		/* if input not valid */
-			
-			printf("HUH? I DON'T UNDERSTAND THAT ROOM. TRY AGAIN.\n\n");
-			 
-		}
-			
-		/* if END_ROOM */
-		
-		if (strcmp((*current)->type, "END_ROOM") == 0) {		
+	if (target == ROOM_NONE) {
 
-			/* increment finished (Boolean) */
-			 
-			return 1;
+		return -1;
 
-		}
-		
 	}
 
-	return 0;
+	/* update current room to the room whose name matches, and log it */
+
+	*current = target;
+
+	appendPathLog(path, target);
+
+	return storeType(store, target) == END_ROOM;
 
 }
 
 
 /* Print current room and connecting room to console. Prompt user for input */
 
-void display(struct Room* cur) {
+void display(struct RoomStore* store, uint32_t cur) {
 
 	// printf("** display **\n");
 
 	/* list where the player is */
 		
-	printf("CURRENT LOCATION: %s\n", cur->name);
+	printf("CURRENT LOCATION: %s\n", storeName(store, cur));
 
 	/* list possible connections that can be followed */
 	
 	printf("POSSIBLE CONNECTIONS: ");
 
-	int i;
-	for (i = 0; i < cur->numNeighbors; i++) {
+	uint32_t i;
+	for (i = 0; i < storeDegree(store, cur); i++) {
 
-		printf("%s", cur->neighbors[i]);
+		printf("%s", storeName(store, storeNeighbor(store, cur, i)));
 	
-		if (i < cur->numNeighbors - 1)	{
+		if (i + 1 < storeDegree(store, cur))	{
 			printf(", ");	
 		}
 		else {
@@ -538,145 +667,601 @@ void display(struct Room* cur) {
 }
 
 
-/* Push a node to the back of the queue */
+/* Print the rooms of the path the player has left, which is every room in it but the last */
+
+void printPath(struct RoomStore* store, struct PathLog* path) {
+
+	// printf("** print path **\n");
+
+	/* declare a cursor over the path, which reads back its trace if it has one */
+
+	struct PathLogCursor* cursor = malloc(sizeof(struct PathLogCursor));
 
-void pushQueue(struct Queue* queue, int num) {
+	uint64_t i, steps = pathLogSize(path) - 1;
+	uint32_t num;
 
-	// printf("** pushQueue **\n"); 
+	openPathLogCursor(path, cursor);
 
-	/* allocate a new node with value = number */
+	printf("YOU TOOK %llu STEPS. YOUR PATH TO VICTORY WAS:\n", (unsigned long long) steps);
+
+	for (i = 0; i < steps && nextPathRoom(cursor, &num) == 1; i++) {
 	
-	struct QueueNode* newNode = malloc(sizeof(struct QueueNode));
+		/* print room */	
+
+		printf("%s\n", storeName(store, num));
+
+	}
+
+	closePathLogCursor(cursor);
+
+	free(cursor);
+
+}
+
+
+/* Print the contents of the queue */
+
+void win() {
+
+	// printf("** win **\n");
+
+	printf("YOU HAVE FOUND THE END ROOM. CONGRATULATIONS!\n");
+
+}
+
+
+/* Open graphName as a room store, lazily through a cache of cacheRooms rooms if lazy is set. Returns 0 on success */
+
+int openGraph(char* graphName, int lazy, uint32_t cacheRooms, struct RoomStore* store) {
+
+	if (lazy) {
+
+		return openLazyRoomStore(graphName, cacheRooms, store);
+
+	}
+
+	return openRoomStore(graphName, store);
+
+}
 
-	/* new->next = NULL */
 
-	newNode->next = NULL;
+/* Print a lazy store's cache hit rate on stderr */
 
-	newNode->value = num;
+void printCacheStats(struct RoomStore* store) {
 
-	/* queue->last->next = new */
+	if (store->cache) {
+
+		fprintf(stderr, "ROOM CACHE: %llu HITS, %llu MISSES, %llu READ AHEAD, %.1f%% HIT RATE\n", store->cache->hits,
+			store->cache->misses, store->cache->readahead, 100 * roomCacheHitRate(store->cache));
+
+	}
+
+}
+
+
+/* Load the room graph's index adjacency from a packed file or a room directory, find a shortest path from START_ROOM
+   to END_ROOM and print it like printPath(), followed by the rooms expanded and the time the search took. Returns the
+   exit status */
+
+int solveMode(char* graphName, int lazy, uint32_t cacheRooms) {
+
+	struct RoomStore store;
+	struct timespec begin, end;
+	uint32_t i, pathLen;
+	uint32_t startIndex, endIndex;
+	uint32_t* path;
+	unsigned long long expanded;
+	int found;
+
+	if (openGraph(graphName, lazy, cacheRooms, &store) != 0) {
+
+		return 1;
+
+	}
+
+	startIndex = findRoomByType(&store, START_ROOM);
+	endIndex = findRoomByType(&store, END_ROOM);
+
+	if (startIndex == ROOM_NONE || endIndex == ROOM_NONE) {
+
+		fprintf(stderr, "adventure: %s has no START_ROOM or no END_ROOM\n", graphName);
+		closeRoomStore(&store);
+		return 1;
+
+	}
+
+	path = malloc(((size_t) storeNumRooms(&store) + 1) * sizeof(uint32_t));
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+
+	found = solveShortestPath(&store, startIndex, endIndex, path, &pathLen, &expanded);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (found) {
+
+		/* listed as printPath() lists a game's: START_ROOM and every room after it up to, not including, END_ROOM */
+
+		printf("YOU TOOK %u STEPS. YOUR PATH TO VICTORY WAS:\n", pathLen - 1);
+
+		for (i = 0; i + 1 < pathLen; i++) {
+
+			printf("%s\n", storeName(&store, path[i]));
+
+		}
 
-	if (queue->last != NULL) {
-		queue->last->next = newNode;
 	}
 	else {
-		queue->first = newNode;
+
+		printf("END_ROOM CANNOT BE REACHED FROM START_ROOM.\n");
+
 	}
 
-	/* queue->last = new */
+	printf("ROOMS EXPANDED: %llu\n", expanded);
+	printf("SOLVE TIME: %.6f SECONDS\n", (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9);
 
-	queue->last = newNode;
+	printCacheStats(&store);
 
-	queue->size++;
+	free(path);
+	closeRoomStore(&store);
+
+	return found ? 0 : 1;
 
 }
 
 
-/* Pop a node from the front of the queue and return the node value */
+/* Load graphName with its name table, then serve games on it at socketPath until interrupted, saving the games in
+   progress to checkpoint on request if it is given. With watch, the graph is reloaded when the latest link moves if
+   followLatest is set, or when graphName changes otherwise. Returns the exit status */
 
-int popQueue(struct Queue* queue) {
-	
-	// printf("** popQueue **\n");
+int serveMode(char* graphName, int followLatest, int watch, const char* socketPath, int numWorkers, const char* checkpoint) {
 
-	/* store value of first node */
+	struct GraphWatch graphs;
+	int result;
 
-	int result = queue->first->value;
+	/* a graph reader for each worker and one for the main thread */
 
-	/* declare garbage pointer and set */
+	if (numWorkers < 1) {
 
-	struct QueueNode* garbage;
+		numWorkers = 1;
 
-	garbage = queue->first;
+	}
+
+	if (openGraphWatch(&graphs, graphName, followLatest, numWorkers + 1) != 0) {
 
-	/* move queue first pointer */
+		return 1;
 
-	queue->first = queue->first->next;
+	}
 
-	/* deallocate garbage */
+	if (watch && startGraphWatch(&graphs) != 0) {
 
-	free(garbage);
+		closeGraphWatch(&graphs);
+		return 1;
 
-	/* return stored value from first node */	
+	}
 
-	queue->size--;
+	result = serveRooms(&graphs, socketPath, numWorkers, checkpoint);
+
+	closeGraphWatch(&graphs);
 
 	return result;
 
 }
 
 
-/* Print the contents of the pqth queue */
+/* Play a move script against the room graph without printing each move: the script or path trace at replayPath, or
+   walks random walks generated with bias and seed, written to savePath as well if it is given. Paths are logged in
+   pathEncoding. Returns the exit status */
 
-void printPath(struct Room* roomArr, struct Queue* path) {
+int replayMode(char* graphName, int lazy, uint32_t cacheRooms, const char* replayPath, uint64_t walks, double bias,
+		unsigned long long seed, const char* savePath, int pathEncoding) {
 
-	// printf("** print path **\n");
+	struct RoomStore store;
+	struct MoveScript script;
+	int result;
 
-	/* declare a node pointer */
+	if (openGraph(graphName, lazy, cacheRooms, &store) != 0) {
 
-	struct QueueNode* node;
+		return 1;
 
-	int num;
+	}
 
-	/* set pointer to first node in path */
+	/* moves are looked up by name as in the game */
 
-	node = path->first; 
+	if (!lazy) {
 
-	/* while pointer not null */
+		indexRoomNames(&store);
 
-	printf("YOU TOOK %d STEPS. YOUR PATH TO VICTORY WAS:\n", path->size);
+	}
 
-	while (node != NULL) {
-	
-		/* print room */	
+	if (replayPath != NULL && isPathTrace(replayPath)) {
+
+		result = readTraceScript(replayPath, &store, &script);
 
-		num = node->value;
+	}
+	else if (replayPath != NULL) {
+
+		result = readMoveScript(replayPath, &script);
+
+	}
+	else {
+
+		result = generateRandomWalks(&store, walks, bias, seed, &script);
+
+	}
 
-		printf("%s\n", roomArr[num].name);
+	if (result == 0 && savePath != NULL) {
 
-		node = node->next;
+		result = writeMoveScript(savePath, &script);
 
 	}
 
+	/* the cache's counts should describe the replay, not the search that generated the walks */
+
+	if (store.cache) {
+
+		store.cache->hits = 0;
+		store.cache->misses = 0;
+		store.cache->readahead = 0;
+
+	}
+
+	result = (result == 0) ? replayScript(&store, &script, pathEncoding) : 1;
+
+	printCacheStats(&store);
+
+	freeMoveScript(&script);
+	closeRoomStore(&store);
+
+	return result;
+
 }
 
 
-/* Print the contents of the queue */
+/* Play every sequence of script from START_ROOM through applyMove(), the way the engine plays typed moves, and check
+   that each one enters END_ROOM on its last move after its expected number of steps. Failures are listed on stderr,
+   up to a point, and the totals and moves per second on stdout. Paths are logged in pathEncoding, in one log cleared
+   for each sequence. Returns 0 if every sequence passed, otherwise 1 */
 
-void win() {
+int replayScript(struct RoomStore* store, const struct MoveScript* script, int pathEncoding) {
 
-	// printf("** win **\n");
+	const struct MoveSequence* sequence;
+	struct PathLog path;
+	struct timespec begin, end;
+	char label[64];
+	uint32_t start = findRoomByType(store, START_ROOM);
+	uint32_t current;
+	uint64_t i, k, steps, moves = 0, invalid = 0, failed = 0;
+	double seconds;
+	int status;
 
-	printf("YOU HAVE FOUND THE END ROOM. CONGRATULATIONS!\n");
+	if (start == ROOM_NONE) {
+
+		fprintf(stderr, "adventure: the room graph has no START_ROOM\n");
+		return 1;
+
+	}
+
+	initPathLog(&path, pathEncoding);
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+
+	for (i = 0; i < script->numSequences; i++) {
+
+		sequence = &script->sequences[i];
+
+		clearPathLog(&path);
+		appendPathLog(&path, start);
+
+		current = start;
+		status = 0;
+		steps = 0;
+
+		/* play moves until END_ROOM is entered, as the game would stop there */
+
+		for (k = 0; k < sequence->numMoves && status <= 0; k++) {
+
+			if (store->cache) {
+
+				readAheadNeighbors(store->cache, current);
+
+			}
+
+			status = applyMove(store, &current, scriptMove(script, sequence->firstMove + k), &path);
+
+			if (status < 0) { invalid++; } else { steps++; }
+
+		}
+
+		moves += k;
+
+		if (status <= 0 || k < sequence->numMoves
+				|| (sequence->expectedSteps != STEPS_UNCHECKED && steps != sequence->expectedSteps)) {
+
+			if (failed++ < 10) {
+
+				if (sequence->line) {
+					snprintf(label, sizeof(label), "sequence %llu at line %llu", (unsigned long long) i + 1,
+						(unsigned long long) sequence->line);
+				}
+				else {
+					snprintf(label, sizeof(label), "walk %llu", (unsigned long long) i + 1);
+				}
+
+				if (status <= 0) {
+					fprintf(stderr, "%s: ended in %s, not END_ROOM, after %llu steps\n", label,
+						storeName(store, current), (unsigned long long) steps);
+				}
+				else if (k < sequence->numMoves) {
+					fprintf(stderr, "%s: entered END_ROOM with %llu moves left\n", label,
+						(unsigned long long) (sequence->numMoves - k));
+				}
+				else {
+					fprintf(stderr, "%s: entered END_ROOM in %llu steps, expected %llu\n", label,
+						(unsigned long long) steps, (unsigned long long) sequence->expectedSteps);
+				}
+
+			}
+
+		}
+
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	closePathLog(&path);
+
+	seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+
+	printf("SEQUENCES: %llu PASSED, %llu FAILED\n", (unsigned long long) (script->numSequences - failed),
+		(unsigned long long) failed);
+	printf("MOVES: %llu (%llu NOT UNDERSTOOD)\n", (unsigned long long) moves, (unsigned long long) invalid);
+	printf("REPLAY TIME: %.6f SECONDS, %.0f MOVES/SEC\n", seconds, seconds > 0 ? moves / seconds : 0);
+
+	return failed ? 1 : 0;
 
 }
 
 
-/* deallocate the queue */
+/* Bidirectional breadth first search from start and end, a whole level at a time from whichever side has the smaller
+   frontier. A room is only ever reached by one side before the two meet, so one parent array serves both, and one
+   queue array holds both sides' rooms: start's side grows from the front and end's from the back. Visited rooms are
+   bitmaps, so the only memory touched per room is a bit, a parent and a queue slot. Stores start .. end in path and its
+   length in pathLen, and returns 1, or returns 0 if end cannot be reached. expanded counts rooms whose neighbors were
+   examined */
+
+int solveShortestPath(const struct RoomStore* store, uint32_t start, uint32_t end, uint32_t* path, uint32_t* pathLen,
+		unsigned long long* expanded) {
+
+	uint32_t n = storeNumRooms(store);
+	const uint32_t* neighbors;
+	uint32_t degree;
+	size_t words = n / 64 + 1;
 
-void cleanup(struct Room* roomArr, struct Queue* queue) {
+	uint64_t* visited[2];
+	uint32_t* parent = malloc((size_t) n * sizeof(uint32_t));
+	uint32_t* queue = malloc((size_t) n * sizeof(uint32_t));
 
-	// printf("** cleanup **\n");
+	/* side 0's frontier is queue[head[0] .. tail[0]), side 1's is queue[tail[1] + 1 .. head[1]] since it grows down */
 
-	struct QueueNode* garbage;
+	long head[2] = {0, (long) n - 1};
+	long tail[2] = {1, (long) n - 2};
 
-	garbage = queue->first;
+	uint32_t meetFrom = 0, meetTo = 0;
+	uint32_t u, w, len, k;
+	int side, found = 0;
+	long levelEnd, frontier[2];
 
-	while (garbage != NULL) {
+	visited[0] = calloc(words, sizeof(uint64_t));
+	visited[1] = calloc(words, sizeof(uint64_t));
 
-		queue->first = queue->first->next;
+	*expanded = 0;
 
-		free(garbage);
+	queue[0] = start;
+	queue[n - 1] = end;
+	parent[start] = start;
+	parent[end] = end;
+	visited[0][start / 64] |= 1ULL << (start % 64);
+	visited[1][end / 64] |= 1ULL << (end % 64);
 
-		garbage = queue->first;
+	if (start == end) {
+
+		found = 1;
+		meetFrom = meetTo = start;
 
 	}
 
+	while (!found) {
+
+		frontier[0] = tail[0] - head[0];
+		frontier[1] = head[1] - tail[1];
+
+		if (frontier[0] == 0 || frontier[1] == 0) { break; }
+
+		side = (frontier[1] < frontier[0]);
+
+		/* expand one whole level of this side. Every room the other side has reached is at the other side's
+		   deepest level, so the first meeting found gives a shortest path */
+
+		levelEnd = side ? tail[1] : tail[0];
+
+		while (!found && head[side] != levelEnd) {
+
+			u = queue[head[side]];
+			head[side] += side ? -1 : 1;
+			(*expanded)++;
+
+			neighbors = storeNeighbors(store, u, &degree);
+
+			for (k = 0; k < degree; k++) {
+
+				w = neighbors[k];
+
+				if (visited[!side][w / 64] & (1ULL << (w % 64))) {
+					meetFrom = side ? w : u;
+					meetTo = side ? u : w;
+					found = 1;
+					break;
+				}
+
+				if (!(visited[side][w / 64] & (1ULL << (w % 64)))) {
+					visited[side][w / 64] |= 1ULL << (w % 64);
+					parent[w] = u;
+					queue[tail[side]] = w;
+					tail[side] += side ? -1 : 1;
+				}
+
+			}
+
+		}
+
+	}
+
+	if (found) {
+
+		/* walk back from meetFrom to start, reverse, then walk on from meetTo to end */
+
+		len = 0;
+
+		for (u = meetFrom; ; u = parent[u]) {
+			path[len++] = u;
+			if (u == start) { break; }
+		}
+
+		for (k = 0; k < len / 2; k++) {
+			w = path[k];
+			path[k] = path[len - 1 - k];
+			path[len - 1 - k] = w;
+		}
+
+		if (meetTo != meetFrom) {
+			for (u = meetTo; ; u = parent[u]) {
+				path[len++] = u;
+				if (u == end) { break; }
+			}
+		}
+
+		*pathLen = len;
+
+	}
+
+	free(visited[0]);
+	free(visited[1]);
+	free(parent);
 	free(queue);
 
+	return found;
+
+}
+
+
+/* Time the game has been played, over this run and any before it was restored, in nanoseconds */
+
+uint64_t gameElapsedNs() {
+
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return elapsedBefore + (uint64_t) (now.tv_sec - gameStarted.tv_sec) * 1000000000ULL + now.tv_nsec - gameStarted.tv_nsec;
+
+}
+
+
+/* Save the game, in room current with path, to the checkpoint file and tell the player. Returns 0, or -1 with a message
+   on stderr */
+
+int saveGame(struct RoomStore* store, uint32_t current, struct PathLog* path) {
+
+	struct SnapshotWriter writer;
+	int result;
+
+	initSnapshotWriter(&writer);
+
+	result = addSessionSnapshot(&writer, current, storeNumRooms(store), storeGraphHash(store), path, gameElapsedNs());
+
+	if (result == 0) {
+
+		result = writeSnapshotFile(checkpointPath, &writer, 1);
+
+	}
+
+	freeSnapshotWriter(&writer);
+
+	printf(result == 0 ? "GAME SAVED.\n\n" : "GAME NOT SAVED.\n\n");
+
+	return result;
+
+}
+
+
+/* Resume session index of the snapshot file at snapshotPath on store: its path goes in path, a log that has not been
+   started, and its playing time in elapsedBefore. Returns 0, or -1 with a message on stderr */
+
+int restoreGame(const char* snapshotPath, uint64_t index, struct RoomStore* store, struct PathLog* path) {
+
+	struct SnapshotFile file;
+	struct SessionSnapshot session;
+	uint64_t i;
+	int status = 1;
+
+	if (readSnapshotFile(snapshotPath, &file) != 0) {
+
+		return -1;
+
+	}
+
+	/* records are variable sized, so step through those before it */
+
+	for (i = 0; i <= index && (status = nextSessionSnapshot(&file, &session)) == 1; i++);
+
+	if (status != 1) {
+
+		fprintf(stderr, status == 0 ? "%s: no session %llu\n" : "%s: session %llu is damaged\n", snapshotPath,
+			(unsigned long long) index);
+		closeSnapshotFile(&file);
+		return -1;
+
+	}
+
+	if (session.record.graphRooms != storeNumRooms(store)) {
+
+		fprintf(stderr, "%s: session %llu was played on a graph of %u rooms, not %u\n", snapshotPath,
+			(unsigned long long) index, session.record.graphRooms, storeNumRooms(store));
+		closeSnapshotFile(&file);
+		return -1;
+
+	}
+
+	if (session.record.graphHash != storeGraphHash(store)) {
+
+		fprintf(stderr, "%s: session %llu was played on a different graph\n", snapshotPath, (unsigned long long) index);
+		closeSnapshotFile(&file);
+		return -1;
+
+	}
+
+	if (restoreSessionPath(&session, store, path) != 0) {
+
+		fprintf(stderr, "%s: session %llu has a damaged path\n", snapshotPath, (unsigned long long) index);
+		closeSnapshotFile(&file);
+		return -1;
+
+	}
+
+	elapsedBefore = session.record.elapsedNs;
+
+	printf("RESUMING A SAVED GAME: %llu STEPS TAKEN, %.0f SECONDS PLAYED.\n\n",
+		(unsigned long long) pathLogSize(path) - 1, elapsedBefore / 1e9);
+
+	closeSnapshotFile(&file);
+
+	return 0;
+
 }
 
 
-/* Truncate the last character of a string */
+/* Truncate the last character of a string if it is a newline */
 
 void strTruncLast(char* input) {
 
@@ -690,84 +1275,150 @@ void strTruncLast(char* input) {
 
 	}
 
-	input[i - 1] = 0;
+	if (i > 0 && input[i - 1] == '\n') {
+
+		input[i - 1] = 0;
+
+	}
 
 }
 
 
-/* Called within the timing thread. If stopWaiting is not set, prints current time to console and dumps time to currentTime.txt */
+/* Start the timing thread, which writes each time it formats to currentTime.txt as well if timeFile is set */
 
-void* wait(void* stopWaiting) {
+void startTimeService(int timeFile) {
 
-	// printf("** wait **\n");
+	timeRequests = 0;
+	timeRequestsServed = 0;
+	writeTimeFile = timeFile;
+	stopTimeThreadWaiting = 0;
+
+	pthread_create(&timeThread, NULL, timeService, NULL);
+
+}
+
+
+/* Tell the timing thread to exit once it has served any request in progress, and join it */
+
+void stopTimeService() {
+
+	pthread_mutex_lock(&mutex_a);
+
+	stopTimeThreadWaiting = 1;
+
+	pthread_cond_signal(&timeRequested);
+
+	pthread_mutex_unlock(&mutex_a);
+
+	pthread_join(timeThread, NULL);
+
+}
+
+
+/* Body of the timing thread. Sleeps until the main thread requests the time, formats it into timeBuffer and wakes the
+   main thread, then writes it to currentTime.txt after letting go of the mutex, so the main thread never waits on the
+   file */
+
+void* timeService(void* unused) {
+
+	// printf("** timeService **\n");
+
+	(void) unused;
 
 	/* local variables */
 
 	time_t curTime;
-	struct tm* timeptr;
-	char filename[128];
-	strcpy(filename, "currentTime.txt");
+	struct tm timeParts;
 	FILE* outFile;
 	char output[128];
 
-	/* as long as stopWaiting is not set */
+	pthread_mutex_lock(&mutex_a);
+
+	while (1) {
 
-	if (!(*(int* ) stopWaiting)) {
+		/* sleep until there is a request to serve or the game is over */
 
-		pthread_mutex_lock(&mutex_a);
-		
-		/* mutex locked within timing thread */
+		while (timeRequestsServed == timeRequests && !stopTimeThreadWaiting) {
 
-		time(&curTime);
-		timeptr = localtime(&curTime);
+			pthread_cond_wait(&timeRequested, &mutex_a);
+
+		}
+
+		if (timeRequestsServed == timeRequests) {
+
+			break;
+
+		}
 
 		/* format time using strftime function */
 
-		strftime(output, sizeof(output), "%I:%M%p, %A, %B %d, %Y", timeptr);		
-			
-		outFile = fopen(filename, "w");
-		fprintf(outFile, "%s\n", output);
-		fclose(outFile);			
+		time(&curTime);
+		localtime_r(&curTime, &timeParts);
+
+		strftime(timeBuffer, sizeof(timeBuffer), "%I:%M%p, %A, %B %d, %Y", &timeParts);
+
+		timeRequestsServed = timeRequests;
+
+		pthread_cond_signal(&timeServed);
+
+		if (!writeTimeFile) {
+
+			continue;
+
+		}
 
-		/* unlocking mutex in time thread */
+		/* dump time to currentTime.txt from a copy, with the mutex unlocked */
+
+		strcpy(output, timeBuffer);
 
 		pthread_mutex_unlock(&mutex_a);
-	
+
+		outFile = fopen("currentTime.txt", "w");
+
+		if (outFile != NULL) {
+
+			fprintf(outFile, "%s\n", output);
+			fclose(outFile);
+
+		}
+
+		pthread_mutex_lock(&mutex_a);
+
 	}
 
+	pthread_mutex_unlock(&mutex_a);
+
+	return NULL;
+
 }
 
-/* Called within the main thread to free mutex so timing thread can execute code within the wait() function */
+
+/* Called within the main thread to ask the timing thread for the time, wait for it to be formatted into timeBuffer and
+   print it */
 
 void threadTime() {
 
 	// printf("** threadTime **\n");
 
-	char filename[128];
-	strcpy(filename, "currentTime.txt");
-	FILE* inFile;
 	char timeStr[128];
+	unsigned long request;
 
-	pthread_mutex_unlock(&mutex_a);
+	pthread_mutex_lock(&mutex_a);
 
-	// printf("unlocked mutex in main thread\n");
+	request = ++timeRequests;
 
-	/* join timing thread, which should be waiting to execute within wait() function */
+	pthread_cond_signal(&timeRequested);
 
-	pthread_join(timeThread, NULL);
+	while (timeRequestsServed < request) {
 
-	// printf("locking mutex in main thread\n");
- 
-	pthread_mutex_lock(&mutex_a);
+		pthread_cond_wait(&timeServed, &mutex_a);
 
-	/* relaunch timing thread */	
-
-	pthread_create(&timeThread, NULL, wait, &stopTimeThreadWaiting);
+	}
 
-	inFile = fopen(filename, "r");
+	strcpy(timeStr, timeBuffer);
 
-	fgets(timeStr, 128, inFile);
+	pthread_mutex_unlock(&mutex_a);
 
-	printf(" %s\n", timeStr);
+	printf(" %s\n\n", timeStr);
 
 }
@@ -0,0 +1,349 @@
+/***********************************************************************************************************
+ *	Title: Bot Bench
+ *	Description: Load test for the adventure server (adventure --serve). Bots connect to the server's
+ *			socket and play by reading each prompt, picking one of the possible connections at
+ *			random and typing it, one move in flight per bot. When a bot's game ends it
+ *			connects again. After the run it prints the games finished and the moves made per
+ *			second, and the mean time from sending a move to receiving the next prompt.
+ *
+ *			Usage: hindss.botbench SOCKET [--sessions S] [--seconds T] [--threads N] [--seed S]
+ *
+ *			S bots (default 1000) are split across N threads (default 2), each running an
+ *			epoll loop over its bots, for T seconds (default 5).
+ * ********************************************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+
+#define BOT_EVENTS 256
+
+static const char promptText[] = "WHERE TO? >";
+static const char connectionsText[] = "POSSIBLE CONNECTIONS: ";
+
+/* one bot: its connection and what the server has sent since the bot's last move */
+
+struct Bot {
+
+	int fd;
+	char* in;
+	size_t inLen;
+	size_t inCap;
+
+	/* when the bot's last move was sent, 0 before its first */
+
+	double sentAt;
+
+};
+
+struct BotThread {
+
+	pthread_t thread;
+	const char* socketPath;
+	int numBots;
+	double seconds;
+	unsigned long long seed;
+
+	unsigned long long moves;
+	unsigned long long games;
+	unsigned long long failures;
+	double waited;
+
+};
+
+
+/* seconds on the monotonic clock */
+
+static double now() {
+
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return t.tv_sec + t.tv_nsec / 1e9;
+
+}
+
+
+/* next number of a xorshift stream */
+
+static unsigned long long nextRandom(unsigned long long* state) {
+
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+
+	return *state;
+
+}
+
+
+/* Connect a bot to the server and add it to epoll. Returns 0, or -1 with a message on stderr */
+
+static int connectBot(struct BotThread* botThread, int epollFd, struct Bot* bot) {
+
+	struct sockaddr_un address;
+	struct epoll_event event;
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	snprintf(address.sun_path, sizeof(address.sun_path), "%s", botThread->socketPath);
+
+	bot->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	bot->inLen = 0;
+	bot->sentAt = 0;
+
+	if (bot->fd < 0 || connect(bot->fd, (struct sockaddr*) &address, sizeof(address)) != 0) {
+		perror(botThread->socketPath);
+		if (bot->fd >= 0) { close(bot->fd); }
+		return -1;
+	}
+
+	event.events = EPOLLIN;
+	event.data.ptr = bot;
+
+	return epoll_ctl(epollFd, EPOLL_CTL_ADD, bot->fd, &event);
+
+}
+
+
+/* Pick one of the connections listed before the prompt at random and send it. Returns -1 if the bot could not */
+
+static int sendMove(struct Bot* bot, unsigned long long* random) {
+
+	char* list;
+	char* end;
+	char* name;
+	char move[512];
+	size_t len;
+	int count = 1, pick;
+
+	bot->in[bot->inLen] = 0;
+
+	list = memmem(bot->in, bot->inLen, connectionsText, sizeof(connectionsText) - 1);
+	if (list == NULL) { return -1; }
+
+	list += sizeof(connectionsText) - 1;
+	end = strstr(list, ".\n");
+	if (end == NULL) { return -1; }
+
+	for (name = list; name < end; name++) {
+		if (*name == ',') { count++; }
+	}
+
+	/* skip to the picked name */
+
+	pick = nextRandom(random) % count;
+
+	for (name = list; pick > 0; name++) {
+		if (*name == ',') { pick--; name++; }
+	}
+
+	len = strcspn(name, ",.");
+	if (len + 1 >= sizeof(move)) { return -1; }
+
+	memcpy(move, name, len);
+	move[len] = '\n';
+
+	bot->inLen = 0;
+	bot->sentAt = now();
+
+	return (send(bot->fd, move, len + 1, MSG_NOSIGNAL) == (ssize_t) (len + 1)) ? 0 : -1;
+
+}
+
+
+/* one thread's bots, played until the thread's time is up */
+
+static void* runBots(void* arg) {
+
+	struct BotThread* botThread = arg;
+	struct Bot* bots = calloc(botThread->numBots, sizeof(struct Bot));
+	struct epoll_event events[BOT_EVENTS];
+	struct Bot* bot;
+	unsigned long long random = botThread->seed | 1;
+	double deadline;
+	ssize_t got;
+	int epollFd = epoll_create1(EPOLL_CLOEXEC);
+	int i, count, timeout;
+
+	for (i = 0; i < botThread->numBots; i++) {
+
+		bots[i].inCap = 4096;
+		bots[i].in = malloc(bots[i].inCap + 1);
+
+		if (connectBot(botThread, epollFd, &bots[i]) != 0) {
+			botThread->failures++;
+			botThread->numBots = i;
+			break;
+		}
+
+	}
+
+	deadline = now() + botThread->seconds;
+
+	while ((timeout = (int) ((deadline - now()) * 1000)) > 0) {
+
+		count = epoll_wait(epollFd, events, BOT_EVENTS, timeout);
+
+		for (i = 0; i < count; i++) {
+
+			bot = events[i].data.ptr;
+
+			if (bot->inLen == bot->inCap) {
+				bot->inCap *= 2;
+				bot->in = realloc(bot->in, bot->inCap + 1);
+			}
+
+			got = recv(bot->fd, bot->in + bot->inLen, bot->inCap - bot->inLen, 0);
+
+			if (got > 0) {
+
+				bot->inLen += got;
+
+				/* a whole prompt: the move has been answered */
+
+				if (bot->inLen >= sizeof(promptText) - 1
+						&& memcmp(bot->in + bot->inLen - (sizeof(promptText) - 1), promptText, sizeof(promptText) - 1) == 0) {
+
+					if (bot->sentAt > 0) { botThread->waited += now() - bot->sentAt; }
+
+					if (sendMove(bot, &random) != 0) {
+						botThread->failures++;
+						got = 0;
+					}
+					else {
+						botThread->moves++;
+					}
+
+				}
+
+			}
+
+			/* the server closes the connection once the game is won, so play another */
+
+			if (got <= 0) {
+
+				bot->in[bot->inLen] = 0;
+
+				if (got == 0 && strstr(bot->in, "CONGRATULATIONS") != NULL) {
+					botThread->games++;
+				}
+				else if (got < 0 && errno == EAGAIN) {
+					continue;
+				}
+
+				close(bot->fd);
+
+				if (connectBot(botThread, epollFd, bot) != 0) {
+					botThread->failures++;
+					bot->fd = -1;
+				}
+
+			}
+
+		}
+
+	}
+
+	for (i = 0; i < botThread->numBots; i++) {
+		if (bots[i].fd >= 0) { close(bots[i].fd); }
+		free(bots[i].in);
+	}
+
+	free(bots);
+	close(epollFd);
+
+	return NULL;
+
+}
+
+
+int main(int argc, char** argv) {
+
+	struct option longOptions[] = {
+		{"sessions", required_argument, NULL, 'n'},
+		{"seconds", required_argument, NULL, 't'},
+		{"threads", required_argument, NULL, 'j'},
+		{"seed", required_argument, NULL, 's'},
+		{NULL, 0, NULL, 0}
+	};
+
+	struct BotThread* threads;
+	unsigned long long moves = 0, games = 0, failures = 0;
+	unsigned long long seed = (unsigned long long) time(NULL);
+	double waited = 0, seconds = 5, began, elapsed;
+	int numSessions = 1000, numThreads = 2;
+	int opt, i, usage = 0;
+
+	while ((opt = getopt_long(argc, argv, "", longOptions, NULL)) != -1) {
+
+		switch (opt) {
+			case 'n': numSessions = atoi(optarg); break;
+			case 't': seconds = strtod(optarg, NULL); break;
+			case 'j': numThreads = atoi(optarg); break;
+			case 's': seed = strtoull(optarg, NULL, 0); break;
+			default: usage = 1; break;
+		}
+
+	}
+
+	if (usage || optind != argc - 1 || numSessions < 1 || numThreads < 1) {
+		fprintf(stderr, "usage: %s SOCKET [--sessions S] [--seconds T] [--threads N] [--seed S]\n", argv[0]);
+		return 1;
+	}
+
+	if (numThreads > numSessions) { numThreads = numSessions; }
+
+	threads = calloc(numThreads, sizeof(struct BotThread));
+
+	began = now();
+
+	for (i = 0; i < numThreads; i++) {
+
+		threads[i].socketPath = argv[optind];
+		threads[i].numBots = numSessions / numThreads + (i < numSessions % numThreads);
+		threads[i].seconds = seconds;
+		threads[i].seed = seed * 0x9e3779b97f4a7c15ULL + i;
+
+		pthread_create(&threads[i].thread, NULL, runBots, &threads[i]);
+
+	}
+
+	for (i = 0; i < numThreads; i++) {
+
+		pthread_join(threads[i].thread, NULL);
+
+		moves += threads[i].moves;
+		games += threads[i].games;
+		failures += threads[i].failures;
+		waited += threads[i].waited;
+
+	}
+
+	elapsed = now() - began;
+
+	printf("%d SESSIONS ON %d THREADS FOR %.2f SECONDS\n", numSessions, numThreads, elapsed);
+	printf("GAMES FINISHED: %llu (%.1f/SEC)\n", games, games / elapsed);
+	printf("MOVES: %llu (%.0f/SEC)\n", moves, moves / elapsed);
+	printf("MEAN MOVE ROUND TRIP: %.1f MICROSECONDS\n", moves ? waited / moves * 1e6 : 0);
+
+	if (failures) {
+		printf("FAILURES: %llu\n", failures);
+	}
+
+	free(threads);
+
+	return failures ? 1 : 0;
+
+}
@@ -1,628 +1,1783 @@
 /***********************************************************************************************
- *	Title: buildrooms program. 	
+ *	Title: buildrooms program.
  *	Author: Sean Hinds
  *	Date: 02/14/18
  *	Description: This C program builds a directory with process ID in the name
  *		which contains room data files for an adventure game. These rooms are connected
  *		in a graph data structure which the user navigates in the adventure game
+ *
+ *		Usage: buildrooms [--rooms N] [--min-degree a] [--max-degree b]
+ *		                  [--format text|packed|both] [--seed S] [--threads T]
+ *		                  [--topology NAME] [--degree d] [--rewire p]
+ *		                  [--placement random|far]
+ *		       buildrooms --bench
+ *
+ *		The defaults build the original 7 room game. Larger graphs get procedurally
+ *		generated names, and are stored in heap allocated arrays with CSR (compressed
+ *		sparse row) adjacency, so generation runs in near linear time and memory.
+ *
+ *		--format text (the default) writes the directory hindss.rooms.<pid>, packed
+ *		writes the single file hindss.rooms.<pid>.bin described in hindss.roomfile.h,
+ *		and both writes the two. Once written, the symlink hindss.rooms.latest is
+ *		swapped to point at the new graph (the packed file, with both), so the game
+ *		finds it without scanning the directory.
+ *
+ *		Every random number comes from a counter-based generator keyed by --seed, so a
+ *		seed always builds the same graph. Rooms are connected in shards of SHARD_ROOMS
+ *		rooms, which T threads (default one per CPU) build in parallel; shards are then
+ *		linked by random edges between them, one for every CROSS_EDGE_SHARE edges inside
+ *		each shard. Fewer links leave the shards as clusters that lengthen the distances
+ *		between them; these add about a sixteenth to the mean degree of graphs of more
+ *		than one shard. Shard boundaries and each shard's random stream do not depend on
+ *		T, so neither does the graph.
+ *
+ *		--topology picks the shape of the graph. min-degree and max-degree only apply
+ *		to random, the default; the others are built on one thread:
+ *
+ *			random		rooms get min-degree random connections, up to max-degree
+ *			grid		a square grid, each room joined to up to 4 neighbors
+ *			maze		a random spanning tree of the grid, one path between rooms
+ *			small-world	Watts-Strogatz: a ring where each room joins its d nearest
+ *					rooms (default 4), each link rewired with probability p
+ *					(default 0.1) to a random room
+ *			scale-free	Barabasi-Albert: each room joins d (default 2) rooms chosen
+ *					in proportion to their connections
+ *			chain		a single path through every room
+ *			worst		a random graph on half the rooms with a chain of the other
+ *					half hanging off it, START in the graph and END at the end of
+ *					the chain
+ *
+ *		--placement far puts START and END at the ends of a longest shortest path (exact
+ *		for small graphs, found by repeated BFS sweeps for large ones) instead of in two
+ *		random rooms.
  * ********************************************************************************************/
 
 
+#define _GNU_SOURCE
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "hindss.roomfile.h"
+
+/* output formats */
+
+#define FORMAT_TEXT 1
+#define FORMAT_PACKED 2
+#define FORMAT_BOTH (FORMAT_TEXT | FORMAT_PACKED)
+
+/* rooms per shard, and the share of a shard's edges added again as random edges to other shards */
+
+#define SHARD_ROOMS 65536
+#define CROSS_EDGE_SHARE 16
+
+#define MAX_THREADS 64
+
+/* topologies */
+
+#define TOPOLOGY_RANDOM 0
+#define TOPOLOGY_GRID 1
+#define TOPOLOGY_MAZE 2
+#define TOPOLOGY_SMALL_WORLD 3
+#define TOPOLOGY_SCALE_FREE 4
+#define TOPOLOGY_CHAIN 5
+#define TOPOLOGY_WORST 6
+#define NUM_TOPOLOGIES 7
 
-/* define the Room struct which will be used to store data to be written to files */
+const char* topologyNames[] = {"random", "grid", "maze", "small-world", "scale-free", "chain", "worst"};
 
-struct Room {
-	
-	char* name;
-	int num;
-	char* type;
-	FILE* fileptr;
-	int numConnections;
-	int connections[6];
+/* START and END placement, and the largest graph whose longest shortest path is found exactly */
+
+#define PLACE_RANDOM 0
+#define PLACE_FAR 1
+
+#define EXACT_FAR_ROOMS 2048
+#define FAR_SWEEPS 4
+
+/* random streams. Shard s draws from stream STREAM_SHARD + s */
+
+#define STREAM_NAMES 0
+#define STREAM_STATUS 1
+#define STREAM_CROSS 2
+#define STREAM_TOPOLOGY 3
+#define STREAM_SHARD 16
+
+/* a counter-based random number stream: the n-th number of a stream is a hash of the seed, the stream and n, so
+   streams are independent of each other and of the thread that draws them */
+
+struct RoomRandom {
+
+	unsigned long long key;
+	unsigned long long counter;
 
 };
 
-/* structs to be utilized in the stack data structure used in the depth first search */
+/* a set of rooms connected together: either one shard of consecutive rooms, or, for linking shards, every room. Rooms
+   are numbered across the whole graph; openPos is indexed by room number - first */
 
-struct IntStackNode {
+struct RoomShard {
 
-	int value;
-	struct IntStackNode* next;
+	int first;
+	int numRooms;
+
+	/* edges in the order they were added, which is also the order of each room's CONNECTION lines */
+
+	long numEdges;
+	long edgeCap;
+	int* edgeA;
+	int* edgeB;
+
+	/* open addressing hash set of this shard's edges, used to reject duplicate connections */
+
+	unsigned long long* edgeSet;
+	long edgeSetCap;
+	long edgeSetSize;
+
+	/* rooms with spare capacity (degree < maxDegree). openPos[i - first] is i's index in openRooms, or -1 */
+
+	int* openRooms;
+	int* openPos;
+	int numOpen;
+
+	/* components among this shard's rooms, and rooms with fewer than minDegree connections not yet given up on */
+
+	int numComponents;
+	int numUnderMin;
+
+	struct RoomRandom random;
+
+};
+
+/* the room graph. Rooms are numbered 0 .. numRooms - 1 and every per-room attribute is an array indexed by room number */
+
+struct RoomGraph {
+
+	int numRooms;
+	int minDegree;
+	int maxDegree;
+
+	unsigned long long seed;
+	int numThreads;
+
+	/* shape of the graph, its parameters, and where START and END go */
+
+	int topology;
+	int topologyDegree;
+	double rewire;
+	int placement;
+
+	/* room names, NUL terminated strings packed into one arena */
+
+	char* nameArena;
+	long* nameOffsets;
+
+	unsigned char* types;
+
+	int* degree;
+
+	/* union-find over rooms, so connectivity is known after every edge without a search. Shards touch disjoint parts */
+
+	int* ufParent;
+	unsigned char* ufRank;
+
+	/* shards, and the edges between them */
+
+	int numShards;
+	struct RoomShard* shards;
+	struct RoomShard links;
+
+	/* CSR adjacency built by finalizeGraph(): room i's neighbors are adjacency[offsets[i]] .. adjacency[offsets[i + 1] - 1] */
+
+	long numEdges;
+	long* offsets;
+	int* adjacency;
+
+};
+
+#define roomName(graph, i) ((graph)->nameArena + (graph)->nameOffsets[(i)])
+
+/* shard s holds rooms shardFirst(s) .. shardFirst(s + 1) - 1. The last shard also takes the rooms left over, so no
+   shard is smaller than SHARD_ROOMS unless the whole graph is */
+
+#define shardFirst(graph, s) ((s) >= (graph)->numShards ? (graph)->numRooms : (s) * SHARD_ROOMS)
+#define shardOf(graph, i) ((i) / SHARD_ROOMS < (graph)->numShards ? (i) / SHARD_ROOMS : (graph)->numShards - 1)
+
+/* command line options */
+
+struct BuildOptions {
+
+	int numRooms;
+	int minDegree;
+	int maxDegree;
+	int format;
+	unsigned long long seed;
+	int numThreads;
+	int topology;
+	int topologyDegree;
+	double rewire;
+	int placement;
+	int bench;
 
 };
 
-struct IntStack {
+/* shard work handed to the thread pool */
+
+struct ShardJob {
 
-	int size;
-	struct IntStackNode* top;
+	struct RoomGraph* graph;
+	void (*work)(struct RoomGraph*, int);
+	int nextShard;		// taken with __atomic_fetch_add
 
 };
 
 
 /* function signatures */
 
-void generateRoomNames(struct Room*, int);
-void openFileStreams(struct Room*, int);
-void connectRoomGraph(struct Room*, int);
-void connect(struct Room*, int, int);
-int areConnected(struct Room*, int, int);
-int minConnEach(struct Room*, int, int);
-int dfsReachesAll(struct Room*, int, int);
-void stackPush(struct IntStack*, int);
-int stackPop(struct IntStack*);
-void assignRoomStatuses(struct Room*, int);
-void deallocateRooms(struct Room*, int);
+void parseOptions(int, char**, struct BuildOptions*);
+void seedRandom(struct RoomRandom*, unsigned long long, unsigned long long);
+unsigned long long nextRandom(struct RoomRandom*);
+int randomBelow(struct RoomRandom*, int);
+double randomUnit(struct RoomRandom*);
+void initRoomGraph(struct RoomGraph*, int, int, int, unsigned long long, int);
+void initShard(struct RoomGraph*, struct RoomShard*, int, int, long, unsigned long long);
+void runShards(struct RoomGraph*, void (*)(struct RoomGraph*, int));
+void generateRoomNames(struct RoomGraph*);
+void writeShardNames(struct RoomGraph*, int);
+void connectRoomGraph(struct RoomGraph*);
+void connectShard(struct RoomGraph*, int);
+void connectRange(struct RoomGraph*, struct RoomShard*, int, int, unsigned long long);
+void linkShards(struct RoomGraph*);
+void buildTopology(struct RoomGraph*);
+void buildGrid(struct RoomGraph*, struct RoomShard*, int);
+void buildSmallWorld(struct RoomGraph*, struct RoomShard*);
+void buildScaleFree(struct RoomGraph*, struct RoomShard*);
+void buildChain(struct RoomGraph*, struct RoomShard*, int, int);
+void joinComponents(struct RoomGraph*, struct RoomShard*);
+int pickPartner(struct RoomShard*, int);
+void connect(struct RoomGraph*, struct RoomShard*, int, int);
+int areConnected(struct RoomShard*, int, int);
+void finalizeGraph(struct RoomGraph*);
+int findRoot(struct RoomGraph*, int);
+int joinPartner(struct RoomGraph*, struct RoomShard*, int);
+void assignRoomStatuses(struct RoomGraph*);
+int bfsFarthest(struct RoomGraph*, int, int*, int*, int*);
+void findFarthestPair(struct RoomGraph*, struct RoomRandom*, int*, int*);
+void writeRoomFiles(struct RoomGraph*, int);
+void freeShard(struct RoomShard*);
+void deallocateRooms(struct RoomGraph*);
+unsigned long long graphChecksum(struct RoomGraph*);
+void benchmark(int);
+void legacyConnectRoomGraph(struct RoomGraph*);
+int legacyDfsReachesAll(struct RoomGraph*, int*, int);
+
+
+int main(int argc, char** argv) {
 
+	/* local variables */
 
-int main() {
+	struct BuildOptions options;
+	struct RoomGraph graph;
 
-	/* seed random number generator */
+	/* read the command line */
 
-	srand(time(NULL));
+	parseOptions(argc, argv, &options);
 
-	/* local variables */
-	
-	int i;
-	int numRooms = 7;
+	if (options.bench) {
+		benchmark(options.numThreads);
+		return 0;
+	}
 
-	/* 7 Room array */
-	
-	struct Room rooms[numRooms];
+	initRoomGraph(&graph, options.numRooms, options.minDegree, options.maxDegree, options.seed, options.numThreads);
 
-	/* generate and set room names from a set of 10 names. Also sets room num */
+	graph.topology = options.topology;
+	graph.topologyDegree = options.topologyDegree;
+	graph.rewire = options.rewire;
+	graph.placement = options.placement;
 
-	generateRoomNames(rooms, numRooms);
+	/* generate and set room names. Also sets room num */
 
-	/* open 7 room file streams with name chosen from array */
+	generateRoomNames(&graph);
 
-	openFileStreams(rooms, numRooms);
-	
 	/* connect room graph */
-	
-	connectRoomGraph(rooms, numRooms);	
+
+	connectRoomGraph(&graph);
 
 	/* assign room statuses */
 
-	assignRoomStatuses(rooms, numRooms);
+	assignRoomStatuses(&graph);
+
+	/* write the room directory and/or packed file */
+
+	writeRoomFiles(&graph, options.format);
 
 	/* free memory */
 
-	deallocateRooms(rooms, numRooms);	
+	deallocateRooms(&graph);
 
-	/* exit status 0 */	
+	/* exit status 0 */
 
 	return 0;
 
 }
 
 
-/* this function generates 7 random room names from 10 available names and stores them as attributes of Room structs */
+/* parse command line options into options, exiting with a usage message on bad input */
+
+void parseOptions(int argc, char** argv, struct BuildOptions* options) {
+
+	struct option longOptions[] = {
+		{"rooms", required_argument, NULL, 'n'},
+		{"min-degree", required_argument, NULL, 'a'},
+		{"max-degree", required_argument, NULL, 'b'},
+		{"format", required_argument, NULL, 'f'},
+		{"seed", required_argument, NULL, 's'},
+		{"threads", required_argument, NULL, 't'},
+		{"topology", required_argument, NULL, 'T'},
+		{"degree", required_argument, NULL, 'd'},
+		{"rewire", required_argument, NULL, 'r'},
+		{"placement", required_argument, NULL, 'p'},
+		{"bench", no_argument, NULL, 'B'},
+		{NULL, 0, NULL, 0}
+	};
+
+	int opt, i;
+	int minSet = 0;
+	int maxSet = 0;
+	int degreeSet = 0;
+	int badUsage = 0;
+
+	/* defaults build the original 7 room game */
+
+	options->numRooms = 7;
+	options->minDegree = 3;
+	options->maxDegree = 6;
+	options->format = FORMAT_TEXT;
+	options->seed = (unsigned long long) time(NULL) ^ ((unsigned long long) getpid() << 32);
+	options->numThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	options->topology = TOPOLOGY_RANDOM;
+	options->topologyDegree = 0;
+	options->rewire = 0.1;
+	options->placement = PLACE_RANDOM;
+	options->bench = 0;
+
+	while ((opt = getopt_long(argc, argv, "n:a:b:f:s:t:T:d:r:p:", longOptions, NULL)) != -1) {
+
+		switch (opt) {
+			case 'n': options->numRooms = atoi(optarg); break;
+			case 'a': options->minDegree = atoi(optarg); minSet = 1; break;
+			case 'b': options->maxDegree = atoi(optarg); maxSet = 1; break;
+			case 'f':
+				if (strcmp(optarg, "text") == 0) { options->format = FORMAT_TEXT; }
+				else if (strcmp(optarg, "packed") == 0) { options->format = FORMAT_PACKED; }
+				else if (strcmp(optarg, "both") == 0) { options->format = FORMAT_BOTH; }
+				else { badUsage = 1; }
+				break;
+			case 's': options->seed = strtoull(optarg, NULL, 0); break;
+			case 't': options->numThreads = atoi(optarg); break;
+			case 'T':
+				options->topology = -1;
+				for (i = 0; i < NUM_TOPOLOGIES; i++) {
+					if (strcmp(optarg, topologyNames[i]) == 0) { options->topology = i; }
+				}
+				if (options->topology < 0) { badUsage = 1; }
+				break;
+			case 'd': options->topologyDegree = atoi(optarg); degreeSet = 1; break;
+			case 'r': options->rewire = atof(optarg); break;
+			case 'p':
+				if (strcmp(optarg, "random") == 0) { options->placement = PLACE_RANDOM; }
+				else if (strcmp(optarg, "far") == 0) { options->placement = PLACE_FAR; }
+				else { badUsage = 1; }
+				break;
+			case 'B': options->bench = 1; break;
+			default: badUsage = 1; break;
+		}
+
+	}
+
+	if (badUsage) {
+		fprintf(stderr, "usage: %s [--rooms N] [--min-degree a] [--max-degree b] [--format text|packed|both] "
+			"[--seed S] [--threads T]\n"
+			"       [--topology random|grid|maze|small-world|scale-free|chain|worst] [--degree d] [--rewire p] "
+			"[--placement random|far]\n", argv[0]);
+		exit(1);
+	}
 
-void generateRoomNames(struct Room* roomArr, int numPicks) {
+	if (options->numThreads < 1) { options->numThreads = 1; }
+	if (options->numThreads > MAX_THREADS) { options->numThreads = MAX_THREADS; }
 
-	// printf("** generateRoomNames() **\n");
+	/* a small graph cannot have rooms with more connections than there are other rooms */
 
-	/* initialize room names and local variables */
+	if (!maxSet && options->maxDegree > options->numRooms - 1) { options->maxDegree = options->numRooms - 1; }
+	if (!minSet && options->minDegree > options->maxDegree) { options->minDegree = options->maxDegree; }
 
-	int i;
-	for (i = 0; i < numPicks; i++) {
-		roomArr[i].name = (char* ) malloc(15);
-		memset(roomArr[i].name, 0, 15);
+	if (options->numRooms < 2 || options->minDegree < 1 || options->minDegree > options->maxDegree
+			|| options->maxDegree > options->numRooms - 1) {
+		fprintf(stderr, "%s: need at least 2 rooms and 1 <= min-degree <= max-degree <= rooms - 1\n", argv[0]);
+		exit(1);
+	}
+
+	/* small-world joins each room to its d nearest rooms around the ring, scale-free to d earlier rooms */
+
+	if (!degreeSet) {
+		options->topologyDegree = (options->topology == TOPOLOGY_SMALL_WORLD) ? 4 : 2;
+		if (options->topologyDegree > options->numRooms - 1) { options->topologyDegree = options->numRooms - 1; }
 	}
 
-	const int librarySize = 10;
+	if (options->topologyDegree < 1 || options->topologyDegree > 64 || options->topologyDegree > options->numRooms - 1
+			|| options->rewire < 0 || options->rewire > 1) {
+		fprintf(stderr, "%s: need 1 <= degree <= 64 and degree <= rooms - 1, and 0 <= rewire <= 1\n", argv[0]);
+		exit(1);
+	}
 
-	char* nameLibrary[librarySize];
+	/* the worst case exists to put END far away */
 
-	nameLibrary[0] = "Bridge";
-	nameLibrary[1] = "Galley";
-	nameLibrary[2] = "Barracks";
-	nameLibrary[3] = "Armory";
-	nameLibrary[4] = "Library";
-	nameLibrary[5] = "Workshop";
-	nameLibrary[6] = "Tower";
-	nameLibrary[7] = "Lookout";
-	nameLibrary[8] = "Outpost";
-	nameLibrary[9] = "Forest";
+	if (options->topology == TOPOLOGY_WORST) { options->placement = PLACE_FAR; }
 
-	int pick;
-	int picks[numPicks];
+}
 
-	int needNewPick;		// Boolean
 
-	/* generate unique random integers as indices of room names in nameLibrary */
+/* the SplitMix64 finalizer, a strong 64 bit mixing function */
 
-	int j;
-	for (i = 0; i < numPicks; i++) {	
+static unsigned long long mix64(unsigned long long z) {
 
-		do {
-	
-			needNewPick = 0;
-	
-			pick = rand() % (librarySize);
-			
-			/* ensure random number is unique */
+	z += 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
 
-			for (j = 0; j < i; j++) {
-				if (picks[j] == pick) {
-					
-					needNewPick = 1;
+}
 
-				}
-			}
-		
-		} while (needNewPick);
 
-		picks[i] = pick;
+/* start random stream number stream for a seed */
 
-	}
+void seedRandom(struct RoomRandom* random, unsigned long long seed, unsigned long long stream) {
 
-	/* store chosen room names */
+	random->key = mix64(seed ^ mix64(stream));
+	random->counter = 0;
 
-	for (i = 0; i < numPicks; i++) {
-	
-		strcpy(roomArr[i].name, nameLibrary[picks[i]]);
-		roomArr[i].num = i;
-	
-	}
+}
+
+
+/* next number of a random stream */
+
+unsigned long long nextRandom(struct RoomRandom* random) {
+
+	random->counter++;
+	return mix64(random->key + random->counter * 0x9e3779b97f4a7c15ULL);
 
 }
 
 
-/* this function opens filestream data member of each Room struct in roomArr array */
+/* random integer in [0, n), by multiplying into the high half instead of a biased and slow % */
 
-void openFileStreams(struct Room* roomArr, int numStreams) {
+int randomBelow(struct RoomRandom* random, int n) {
 
-	// printf("** openFileStreams() **\n");
+	return (int) (((unsigned __int128) nextRandom(random) * (unsigned int) n) >> 64);
 
-	/* define local variables */
+}
 
-	int strLen = 30;
-	char* filestring = malloc(sizeof(char* ) * strLen);
-	char* filepath = malloc(sizeof(char* ) * strLen);
-	memset(filepath, 0, strLen);
-	char* pid = malloc(sizeof(char* ) * strLen);
-	memset(pid, 0, strLen);
-	sprintf(pid, "%d", getpid());
 
-	/* construct file path string amd make directory */
+/* random real in [0, 1) */
 
-	sprintf(filepath, "%s", "hindss.rooms.");
-	strcat(filepath, pid);
-	mkdir(filepath, 0777);
-	strcat(filepath, "/");
+double randomUnit(struct RoomRandom* random) {
 
-	/* iterate through and open filestreams */
+	return (nextRandom(random) >> 11) * (1.0 / 9007199254740992.0);
 
-	int i;
-	for (i = 0; i < numStreams; i++) {
-		
-		memset(filestring, 0, strLen);
-		sprintf(filestring, "%s", filepath);
-		strcat(filestring, roomArr[i].name);
-				
-		roomArr[i].fileptr = fopen(filestring, "w");
-		
-	}
+}
+
+
+/* allocate the per-room arrays of the graph, and split its rooms into shards */
+
+void initRoomGraph(struct RoomGraph* graph, int numRooms, int minDegree, int maxDegree, unsigned long long seed, int numThreads) {
 
-	/* free locally allocated variables */
+	int i;
 
-	free(filestring);
-	free(filepath);
-	free(pid);
+	graph->numRooms = numRooms;
+	graph->minDegree = minDegree;
+	graph->maxDegree = maxDegree;
+	graph->seed = seed;
+	graph->numThreads = numThreads;
 
-	/* for each room of 7, write "ROOM NAME: $name" to file */	 	
+	graph->topology = TOPOLOGY_RANDOM;
+	graph->topologyDegree = 0;
+	graph->rewire = 0;
+	graph->placement = PLACE_RANDOM;
 
-	for (i = 0; i < numStreams; i++) {
+	graph->nameArena = NULL;
+	graph->nameOffsets = malloc(numRooms * sizeof(long));
+	graph->types = calloc(numRooms, sizeof(unsigned char));
+	graph->degree = calloc(numRooms, sizeof(int));
 
-		fprintf(roomArr[i].fileptr, "ROOM NAME: %s\n", roomArr[i].name);		
+	/* every room starts as its own component */
 
+	graph->ufParent = malloc(numRooms * sizeof(int));
+	graph->ufRank = calloc(numRooms, sizeof(unsigned char));
+	for (i = 0; i < numRooms; i++) {
+		graph->ufParent[i] = i;
 	}
 
+	/* shards are allocated by their own thread in connectShard() */
+
+	graph->numShards = (numRooms / SHARD_ROOMS > 0) ? numRooms / SHARD_ROOMS : 1;
+	graph->shards = calloc(graph->numShards, sizeof(struct RoomShard));
+	memset(&graph->links, 0, sizeof(graph->links));
+
+	graph->numEdges = 0;
+	graph->offsets = NULL;
+	graph->adjacency = NULL;
+
 }
 
 
-/* Connect rooms until they form a complete graph of two-way connections with no self or duplicate connections */
+/* set up a shard of numRooms rooms starting at first, with room for edgeCap edges to start with */
+
+void initShard(struct RoomGraph* graph, struct RoomShard* shard, int first, int numRooms, long edgeCap, unsigned long long stream) {
+
+	int i;
+
+	shard->first = first;
+	shard->numRooms = numRooms;
+
+	shard->numEdges = 0;
+	shard->edgeCap = edgeCap;
+	shard->edgeA = malloc(shard->edgeCap * sizeof(int));
+	shard->edgeB = malloc(shard->edgeCap * sizeof(int));
 
-void connectRoomGraph(struct Room* roomArr, int numRooms) {
-	
-	// printf("** connectFileGraph() **\n");
+	shard->edgeSetCap = 64;
+	while (shard->edgeSetCap < shard->edgeCap * 2) { shard->edgeSetCap *= 2; }
+	shard->edgeSet = calloc(shard->edgeSetCap, sizeof(unsigned long long));
+	shard->edgeSetSize = 0;
 
-	int k;
-	int o;	
-	for (k = 0; k < numRooms; k++) {
-	
-		/* set every connection to -1 */
+	/* rooms with spare capacity, in room order */
 
-		for (o = 0; o < (numRooms - 1); o++) {
-			roomArr[k].connections[o] = -1;
+	shard->openRooms = malloc(numRooms * sizeof(int));
+	shard->openPos = malloc(numRooms * sizeof(int));
+	shard->numOpen = 0;
+	shard->numUnderMin = 0;
+
+	for (i = 0; i < numRooms; i++) {
+		if (graph->degree[first + i] < graph->maxDegree) {
+			shard->openPos[i] = shard->numOpen;
+			shard->openRooms[shard->numOpen++] = first + i;
 		}
+		else {
+			shard->openPos[i] = -1;
+		}
+		if (graph->degree[first + i] < graph->minDegree) { shard->numUnderMin++; }
+	}
 
-		/* set numConnections to 0 for each room struct */
+	shard->numComponents = numRooms;
 
-		roomArr[k].numConnections = 0;
+	seedRandom(&shard->random, graph->seed, stream);
 
-	}	
-	
+}
 
-	/* while there are rooms not in the graph */
-	
-	int graphComplete = 0;
 
-	int i;
-	int j;
-	
-	while (!graphComplete) {
+/* thread pool body: run the job's work on shards until none are left */
 
-		/* choose random endpoints */
+static void* shardWorker(void* arg) {
 
-		i = rand() % (numRooms);
-		j = i;
-			
-		/* ensure uniqueness of endpoints selected */
-	
-		while (j == i) {
-			j = rand() % (numRooms);
-		}			
-		
-		/* if these rooms are not already connected */
+	struct ShardJob* job = arg;
+	int s;
 
-		if (!areConnected(roomArr, i, j)) {
+	while ((s = __atomic_fetch_add(&job->nextShard, 1, __ATOMIC_RELAXED)) < job->graph->numShards) {
+		job->work(job->graph, s);
+	}
 
-			/* add two way connection */
+	return NULL;
 
-			connect(roomArr, i, j);
-	
-			/* dfs and check that each room has at least 3 connections to check if graph complete. 
- 				THIS DEPTH FIRST SEARCH IS UNNECESSARY, as a graph of 7 rooms with a minimum of 3 outgoing connections 
-  				each will always be complete. I left it in because it would allow a programmer to increase the number of rooms
-  				in the graph beyond 7.  */
+}
 
-			if (dfsReachesAll(roomArr, numRooms, i) && minConnEach(roomArr, numRooms, 3)) {
 
-				graphComplete++;		// set graph complete
+/* run work(graph, s) for every shard s on up to numThreads threads. Each shard's work only touches that shard's rooms,
+   so the result does not depend on which thread ran it */
 
-			}
+void runShards(struct RoomGraph* graph, void (*work)(struct RoomGraph*, int)) {
 
-		}
-	
+	pthread_t threads[MAX_THREADS];
+	struct ShardJob job;
+	int i, started = 0;
+	int numThreads = graph->numThreads;
+
+	if (numThreads > graph->numShards) { numThreads = graph->numShards; }
+
+	job.graph = graph;
+	job.work = work;
+	job.nextShard = 0;
+
+	/* the calling thread is one of the workers */
+
+	for (i = 1; i < numThreads; i++) {
+		if (pthread_create(&threads[started], NULL, shardWorker, &job) == 0) { started++; }
+	}
+
+	shardWorker(&job);
+
+	for (i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
 	}
 
 }
 
 
-/* Connect rooms a and b */
+/* names in the 10 name library */
+
+static const char* nameLibrary[] = {
+	"Bridge", "Galley", "Barracks", "Armory", "Library", "Workshop", "Tower", "Lookout", "Outpost", "Forest"
+};
+
+#define LIBRARY_SIZE 10
+
 
-void connect(struct Room* roomArr, int a, int b) {
-	
-	// printf("** connect %d %d **\n", a, b);
+/* this function picks room names. A graph that fits in the 10 name library gets unique random names from it, as the
+   original game did, chosen by a partial Fisher-Yates shuffle of the library. Larger graphs get a library word followed
+   by the room number, which is unique for any count; their offsets are known up front, so shards write them in
+   parallel */
 
-	int o = 0;		// index
-	int connectionSet = 0;	// Boolean
+void generateRoomNames(struct RoomGraph* graph) {
 
-	/* add b to a's connections and increment a's numConnections */
+	int i, j, t;
+	int numPicks = graph->numRooms;
+	long used = 0;
+	long digits, nextPower;
 
-	while (!connectionSet) {
-		if (roomArr[a].connections[o] == -1) {
-			roomArr[a].connections[o] = b;
-			roomArr[a].numConnections++;
-			connectionSet++;
+	if (numPicks <= LIBRARY_SIZE) {
+
+		int picks[LIBRARY_SIZE];
+		struct RoomRandom random;
+
+		seedRandom(&random, graph->seed, STREAM_NAMES);
+
+		/* the first numPicks entries of a shuffle are a uniform random choice without repeats */
+
+		for (i = 0; i < LIBRARY_SIZE; i++) {
+			picks[i] = i;
 		}
-		else {
-			/* increment connections index to search for open slot in connections array (sentinel = -1) */
-			o++;
+
+		for (i = 0; i < numPicks; i++) {
+			j = i + randomBelow(&random, LIBRARY_SIZE - i);
+			t = picks[i];
+			picks[i] = picks[j];
+			picks[j] = t;
 		}
-	}	
 
-	/* add a to b's connections and increment b's numConnections */
+		/* store chosen room names */
+
+		graph->nameArena = malloc(LIBRARY_SIZE * 16);
+
+		for (i = 0; i < numPicks; i++) {
+
+			graph->nameOffsets[i] = used;
+			used += sprintf(graph->nameArena + used, "%s", nameLibrary[picks[i]]) + 1;
 
-	int p = 0;
-	connectionSet = 0;
-	while (!connectionSet) {
-		if (roomArr[b].connections[p] == -1) {
-			roomArr[b].connections[p] = a;
-			roomArr[b].numConnections++;
-			connectionSet++;
 		}
-		else {
-			/* increment connections index to search for open slot in connections array (sentinel = -1 ) */
-			p++;
+
+		return;
+
+	}
+
+	/* procedural names: the room number makes each one unique. Lay out the arena first */
+
+	digits = 1;
+	nextPower = 10;
+
+	for (i = 0; i < numPicks; i++) {
+
+		if (i == nextPower) {
+			digits++;
+			nextPower *= 10;
 		}
+
+		graph->nameOffsets[i] = used;
+		used += strlen(nameLibrary[i % LIBRARY_SIZE]) + digits + 1;
+
 	}
 
-	/* write connections to room filestreams for rooms a and b */
+	graph->nameArena = malloc(used);
 
-	fprintf(roomArr[a].fileptr, "CONNECTION %d: %s\n", o + 1, roomArr[b].name);
-	fprintf(roomArr[b].fileptr, "CONNECTION %d: %s\n", p + 1, roomArr[a].name);
+	runShards(graph, writeShardNames);
 
 }
 
 
-/* Boolean function to determine whether rooms a and b of roomArr are connected */
+/* write the procedural names of shard s's rooms */
 
-int areConnected(struct Room* roomArr, int a, int b) {
-
-	// printf("** areConnected() **\n");
+void writeShardNames(struct RoomGraph* graph, int s) {
 
 	int i;
-	for (i = 0; i < 6; i++) {
-		if (roomArr[a].connections[i] == b) {
-			//printf("yes connected room %d connection %d to %d\n", a, i, b);
-			
-			return 1;
-		} 
+
+	for (i = shardFirst(graph, s); i < shardFirst(graph, s + 1); i++) {
+		sprintf(roomName(graph, i), "%s%d", nameLibrary[i % LIBRARY_SIZE], i);
 	}
-	//printf("not connected\n");
-	return 0;
 
 }
 
 
-/* determine that each room has at least a certain number of connections */
+/* Connect rooms until every room has at least minDegree two-way connections, with no self or duplicate connections,
+   and every room is reachable from every other. Shards are connected on their own in parallel, then linked */
 
-int minConnEach(struct Room* roomArr, int numRooms, int min) {
+void connectRoomGraph(struct RoomGraph* graph) {
 
-	int i;
-	for (i = 0; i < numRooms; i++) {
-		if (roomArr[i].numConnections < min) {
-			return 0;
-		}
+	int i, numShort = 0;
+
+	if (graph->topology != TOPOLOGY_RANDOM) {
+		buildTopology(graph);
+		finalizeGraph(graph);
+		return;
+	}
+
+	runShards(graph, connectShard);
+
+	if (graph->numShards > 1) {
+		linkShards(graph);
+	}
+
+	/* rooms can only stay short if max-degree leaves them no partner */
+
+	for (i = 0; i < graph->numRooms; i++) {
+		if (graph->degree[i] < graph->minDegree) { numShort++; }
+	}
+
+	if (numShort > 0) {
+		fprintf(stderr, "buildrooms: %d rooms have fewer than %d connections, max-degree %d leaves no partners\n",
+			numShort, graph->minDegree, graph->maxDegree);
 	}
 
-	return 1;
+	finalizeGraph(graph);
 
 }
 
 
-/* Boolean function which performs a depth first search on the room graph to determine if it is complete */
+/* connect shard s's rooms among themselves */
 
-int dfsReachesAll(struct Room* roomGraph, int numRooms, int begin) {
+void connectShard(struct RoomGraph* graph, int s) {
 
-	// printf("** dfsReachesAll() **\n");
+	connectRange(graph, &graph->shards[s], shardFirst(graph, s), shardFirst(graph, s + 1), STREAM_SHARD + s);
 
-	int i;
-	int j;
+}
 
-	/* initialize array to store ID numbers of rooms visited */
-	
-	int* roomsVisited = (int*) malloc(numRooms * sizeof(int));
-	
-	for (i = 0; i < numRooms; i++) {
-		roomsVisited[i] = -1;
-	}
 
-	/* initialize a dynArr stack of ints */
+/* Connect rooms first .. last - 1 among themselves, recording the edges in shard: every room gets minDegree connections
+   where it can, and the rooms are made a single component. connect() keeps the count of short rooms and of components
+   up to date, so the check for a complete shard is O(1) per edge */
 
-	struct IntStack* stack = (struct IntStack*) malloc(numRooms * sizeof(struct IntStack));
-	
-	stack->size = 0;
-	stack->top = NULL;
-	
-	int examine;
-	int roomVisited;
-	int marked;
+void connectRange(struct RoomGraph* graph, struct RoomShard* shard, int first, int last, unsigned long long stream) {
 
-	/* push begin room index to the stack */
+	int i, j;
+	int numRooms = last - first;
 
-	stackPush(stack, begin);
+	int cursor = first;
+	int joinCursor = first;
+	int numShort = 0;
 
-	/* while stack not empty */
+	/* expect about minDegree / 2 edges per room to start with */
 
-	while (stack->size > 0) {
-		
-		/* pop an int from the stack to examine */
+	initShard(graph, shard, first, numRooms, (long) numRooms * graph->minDegree / 2 + 16, stream);
+
+	/* complete when no room is short and there is a single component */
+
+	while (shard->numUnderMin > numShort || shard->numComponents > 1) {
+
+		if (shard->numUnderMin > numShort && cursor < last) {
+
+			/* rooms only ever gain connections, so one pass of a cursor finds every room short of the minimum */
+
+			i = cursor;
+
+			if (graph->degree[i] >= graph->minDegree) {
+				cursor++;
+				continue;
+			}
+
+			/* choose a random partner with spare capacity */
+
+			j = pickPartner(shard, i);
+
+			if (j < 0) {
+				/* every other room is full, so this room has to stay short */
+				numShort++;
+				cursor++;
+				continue;
+			}
 
-		examine = stackPop(stack);
-		
-		/* if int not in roomsVisited */
-		
-		roomVisited = 0;
-		for (i = 0; i < numRooms; i++) {
-			if (examine == roomsVisited[i]) {
-				roomVisited++;
-			} 
 		}
-		
-		if (!roomVisited) {
-		
-			/* add ID number to roomsVisited */
-	
-			marked = 0;
-			for (i = 0; i < numRooms; i++) {
-				if (roomsVisited[i] == -1 && marked == 0) {
-					roomsVisited[i] = examine;
-					marked++;
+		else {
 
-					if (roomsVisited[numRooms - 1] != -1) {
-						return 1;
-					}
+			/* every room has its connections but the shard is in pieces: join the next room that is not in
+  				the shard's first room's component to it */
 
-				}
-			}			
-	
-			/* push neighbors to the stack */
-			
-			for (i = 0; i < (numRooms - 1); i++) {
-				roomVisited = 0;
-				if (roomGraph[examine].connections[i] != -1) {
-					
-					for (j = 0; j < numRooms; j++) {
-						
-						if (roomsVisited[j] == roomGraph[examine].connections[i]) {
-							
-							roomVisited++;
-							
-						}
-					}
-			
-					if (!roomVisited) {
-						stackPush(stack, roomGraph[examine].connections[i]);
-					}	
+			i = joinCursor;
 
-				}
+			if (findRoot(graph, i) == findRoot(graph, first)) {
+				joinCursor++;
+				continue;
 			}
-		
+
+			j = joinPartner(graph, shard, first);
+
 		}
 
+		/* add two way connection */
+
+		connect(graph, shard, i, j);
+
 	}
-	
-	int ret = 1;
-	for (i = 0; i < numRooms; i++) {
-		if (roomsVisited[i] == -1) {
-			
-			ret = 0;
-		}
-	} 
-	
-	free(roomsVisited);
-	free(stack);
 
-	return ret;
 }
 
 
-/* push a node to the stack within the depth first search */
+/* Link the connected shards into one graph: one random edge for every CROSS_EDGE_SHARE edges of each shard, between
+   rooms of different shards with spare capacity, so that paths do not all funnel through a few rooms, then joins of
+   any shard still not reachable from room 0. Edges between shards cannot duplicate an edge inside a shard, so only
+   the links set is checked */
 
-void stackPush(struct IntStack* stack, int val) {
+void linkShards(struct RoomGraph* graph) {
 
-	// printf("** stackPush() **\n");
+	int s, i, j, tries;
+	long k, crossEdges = 0;
 
-	/* allocate an intstacknode */
-	struct IntStackNode* newNode = malloc(sizeof(struct IntStackNode* ));	
+	struct RoomShard* links = &graph->links;
 
-	/* set member data */
-	newNode->value = val;
-	newNode->next = stack->top;
-	
-	/* set new node as top */
-	stack->top = newNode;
+	for (s = 0; s < graph->numShards; s++) {
+		crossEdges += graph->shards[s].numEdges / CROSS_EDGE_SHARE + 1;
+	}
 
-	/* increment stack size */
-	stack->size++;
+	initShard(graph, links, 0, graph->numRooms, crossEdges, STREAM_CROSS);
+	links->numComponents = graph->numShards;
+	links->numUnderMin = 0;
 
-}
+	for (s = 0; s < graph->numShards; s++) {
+
+		for (k = 0; k < graph->shards[s].numEdges / CROSS_EDGE_SHARE && links->numOpen > 1; k++) {
+
+			for (tries = 0; tries < 64; tries++) {
+				i = links->openRooms[randomBelow(&links->random, links->numOpen)];
+				j = links->openRooms[randomBelow(&links->random, links->numOpen)];
+				if (shardOf(graph, i) != shardOf(graph, j) && !areConnected(links, i, j)) {
+					connect(graph, links, i, j);
+					break;
+				}
+			}
 
+		}
+
+	}
 
-/* pop a node from the stack within depth first search. Returns the ID number of that node */
+	/* join each shard that room 0 cannot reach, from the shard's first room with spare capacity */
 
-int stackPop(struct IntStack* stack) {
+	for (s = 1; s < graph->numShards; s++) {
 
-	// printf("** stackPop() **\n");
+		i = shardFirst(graph, s);
 
-	/* grab top node val */
-	int result = stack->top->value;	
-	
-	/* point garbage node toward top */
-	struct IntStackNode* garbage;
-	garbage = stack->top;	
-	
-	/* set top to top->next; */	
-	stack->top = stack->top->next;
-	
-	/* deallocate garbage top node */
-	free(garbage);
+		if (findRoot(graph, i) != findRoot(graph, 0)) {
+			for (j = i; j < shardFirst(graph, s + 1) && links->openPos[j] < 0; j++) { }
+			if (j < shardFirst(graph, s + 1)) { i = j; }
+			connect(graph, links, i, joinPartner(graph, links, 0));
+		}
 
-	/* decrement stack size */
-	stack->size--;	
-	
-	/* return val from above */
-	return result;
+	}
 
 }
 
 
-/* assign START (1), MID (5), and END (1) room statuses to rooms in roomArr */ 
+/* Build one of the structured topologies. Every edge goes into the links set, which covers all rooms, except for the
+   worst case's random half, which is built like a shard. Rooms left unreachable, which only small-world rewiring can
+   cause, are then joined to room 0's component */
 
-void assignRoomStatuses(struct Room* roomArr, int numRooms) {
+void buildTopology(struct RoomGraph* graph) {
 
-	// printf("** assignRoomStatuses() **\n");
+	int n = graph->numRooms;
+	int half = n / 2;
+	struct RoomShard* links = &graph->links;
 
-	/* local variables */	
+	/* room for the most edges any topology makes */
 
-	int i;
-	int startIndex = rand() % (numRooms - 1);
-	int endIndex = startIndex;
-	int strLen = 12;
+	long edgeCap = (long) n * (graph->topologyDegree + 2) + 16;
+
+	if (graph->topology == TOPOLOGY_WORST) {
+
+		connectRange(graph, &graph->shards[0], 0, half, STREAM_SHARD);
+		initShard(graph, links, 0, n, n - half + 16, STREAM_TOPOLOGY);
+		buildChain(graph, links, half - 1, n);
 
-	char* start = "START_ROOM";
-	char* end = "END_ROOM";
-	char* mid = "MID_ROOM";	
+	}
+	else {
 
-	/* ensure uniqueness of end and start indices */
+		initShard(graph, links, 0, n, edgeCap, STREAM_TOPOLOGY);
 
-	while (endIndex == startIndex) {
-		
-		endIndex = rand() % (numRooms - 1);
+		switch (graph->topology) {
+			case TOPOLOGY_GRID: buildGrid(graph, links, 0); break;
+			case TOPOLOGY_MAZE: buildGrid(graph, links, 1); break;
+			case TOPOLOGY_SMALL_WORLD: buildSmallWorld(graph, links); break;
+			case TOPOLOGY_SCALE_FREE: buildScaleFree(graph, links); break;
+			case TOPOLOGY_CHAIN: buildChain(graph, links, 0, n); break;
+		}
 
 	}
 
-	/* mark start and end room files, as well as mid rooms */ 
+	joinComponents(graph, links);
 
-	for (i = 0; i < numRooms; i++) {
-		
-		roomArr[i].type = (char* ) malloc(15); 
-		memset(roomArr[i].type, 0, 15);
+}
 
-		if (i == startIndex) {
-			
-			strcpy(roomArr[i].type, start);
 
-		}
-		else if (i == endIndex) {
+/* Connect the rooms as a square grid, row by row, with the last row possibly short. As a maze, the grid's edges are
+   shuffled and added only where they join two components (Kruskal's algorithm), giving a random spanning tree */
+
+void buildGrid(struct RoomGraph* graph, struct RoomShard* shard, int maze) {
+
+	int n = graph->numRooms;
+	int width = 1;
+	long e, numGridEdges = 0;
+	int i, t;
+
+	while ((long) width * width < n) { width++; }
 
-			strcpy(roomArr[i].type, end);
+	int* gridA = malloc((long) n * 2 * sizeof(int));
+	int* gridB = malloc((long) n * 2 * sizeof(int));
 
+	for (i = 0; i < n; i++) {
+		if ((i + 1) % width != 0 && i + 1 < n) {
+			gridA[numGridEdges] = i;
+			gridB[numGridEdges++] = i + 1;
 		}
-		else {
-			
-			strcpy(roomArr[i].type, mid);
+		if (i + width < n) {
+			gridA[numGridEdges] = i;
+			gridB[numGridEdges++] = i + width;
+		}
+	}
 
+	if (maze) {
+		for (e = numGridEdges - 1; e > 0; e--) {
+			long k = (long) (((unsigned __int128) nextRandom(&shard->random) * (unsigned long) (e + 1)) >> 64);
+			t = gridA[e]; gridA[e] = gridA[k]; gridA[k] = t;
+			t = gridB[e]; gridB[e] = gridB[k]; gridB[k] = t;
 		}
-	
-		/* print type to filestream for each room struct. Will write to end of file */
+	}
 
-		fprintf(roomArr[i].fileptr, "ROOM TYPE: %s\n", roomArr[i].type);
-	
+	for (e = 0; e < numGridEdges; e++) {
+		if (!maze || findRoot(graph, gridA[e]) != findRoot(graph, gridB[e])) {
+			connect(graph, shard, gridA[e], gridB[e]);
+		}
 	}
 
+	free(gridA);
+	free(gridB);
+
 }
 
 
-/* free memory allocated for Room structs */
+/* Watts-Strogatz small world: a ring where each room joins the topologyDegree / 2 rooms after it, and each of those
+   links is rewired with probability rewire to a random room that is not already a neighbor */
 
-void deallocateRooms(struct Room* roomArr, int roomCount) {
+void buildSmallWorld(struct RoomGraph* graph, struct RoomShard* shard) {
 
-	// printf("** freeFileStreams() **\n");
+	int n = graph->numRooms;
+	int i, j, t, tries;
+	int reach = (graph->topologyDegree + 1) / 2;
 
-	int i;
+	for (i = 0; i < n; i++) {
+
+		for (j = 1; j <= reach; j++) {
 
-	for (i = 0; i < roomCount; i++) {
-		
-		/* close all filestreams */
+			t = (i + j) % n;
 
-		fclose(roomArr[i].fileptr);
+			if (randomUnit(&shard->random) < graph->rewire) {
+				for (tries = 0; tries < 64; tries++) {
+					t = randomBelow(&shard->random, n);
+					if (t != i && !areConnected(shard, i, t)) { break; }
+				}
+			}
+
+			if (t != i && !areConnected(shard, i, t)) {
+				connect(graph, shard, i, t);
+			}
+
+		}
 
 	}
-	
-	for (i = 0; i < roomCount; i++) {
-	
-		/* deallocate room name strings */
 
-		free(roomArr[i].name);
+}
+
 
+/* Barabasi-Albert scale free graph: the first topologyDegree + 1 rooms are all joined, then each later room joins
+   topologyDegree earlier rooms. A uniform pick from the list of every edge's endpoints picks a room in proportion to
+   its connections */
+
+void buildScaleFree(struct RoomGraph* graph, struct RoomShard* shard) {
+
+	int n = graph->numRooms;
+	int m = graph->topologyDegree;
+	int i, j, k, t, tries;
+	long numEnds = 0;
+
+	int* ends = malloc(((long) n * m * 2 + (long) m * (m + 1)) * sizeof(int));
+
+	for (i = 0; i <= m && i < n; i++) {
+		for (j = 0; j < i; j++) {
+			connect(graph, shard, i, j);
+			ends[numEnds++] = i;
+			ends[numEnds++] = j;
+		}
 	}
 
-	for (i = 0; i < roomCount; i++) {
+	for (i = m + 1; i < n; i++) {
+
+		for (k = 0; k < m; k++) {
+
+			t = -1;
+			for (tries = 0; tries < 64 && t < 0; tries++) {
+				t = ends[(long) (((unsigned __int128) nextRandom(&shard->random) * (unsigned long) numEnds) >> 64)];
+				if (t == i || areConnected(shard, i, t)) { t = -1; }
+			}
+
+			/* a room with few candidates left takes any earlier room */
+
+			while (t < 0) {
+				t = randomBelow(&shard->random, i);
+				if (areConnected(shard, i, t)) { t = -1; }
+			}
 
-		/* free type strings */
+			connect(graph, shard, i, t);
+			ends[numEnds++] = i;
+			ends[numEnds++] = t;
 
-		free(roomArr[i].type);
+		}
 
 	}
 
+	free(ends);
+
+}
+
+
+/* chain rooms first .. last - 1 together in order */
+
+void buildChain(struct RoomGraph* graph, struct RoomShard* shard, int first, int last) {
+
+	int i;
+
+	for (i = first + 1; i < last; i++) {
+		connect(graph, shard, i - 1, i);
+	}
+
+}
+
+
+/* join every room that room 0 cannot reach to room 0's component */
+
+void joinComponents(struct RoomGraph* graph, struct RoomShard* shard) {
+
+	int i;
+
+	for (i = 1; i < graph->numRooms; i++) {
+		if (findRoot(graph, i) != findRoot(graph, 0)) {
+			connect(graph, shard, i, joinPartner(graph, shard, 0));
+		}
+	}
+
+}
+
+
+/* find the root of room i's component, halving the path on the way */
+
+int findRoot(struct RoomGraph* graph, int i) {
+
+	while (graph->ufParent[i] != i) {
+		graph->ufParent[i] = graph->ufParent[graph->ufParent[i]];
+		i = graph->ufParent[i];
+	}
+
+	return i;
+
+}
+
+
+/* pick a room in room base's component for a room outside it to connect to, preferring rooms of the shard with spare
+   capacity. If base's component is entirely full, base goes over max-degree */
+
+int joinPartner(struct RoomGraph* graph, struct RoomShard* shard, int base) {
+
+	int tries, j, k;
+	int root = findRoot(graph, base);
+
+	for (tries = 0; tries < 64 && shard->numOpen > 0; tries++) {
+		j = shard->openRooms[randomBelow(&shard->random, shard->numOpen)];
+		if (findRoot(graph, j) == root) {
+			return j;
+		}
+	}
+
+	for (k = 0; k < shard->numOpen; k++) {
+		j = shard->openRooms[k];
+		if (findRoot(graph, j) == root) {
+			return j;
+		}
+	}
+
+	fprintf(stderr, "buildrooms: room %d exceeds max-degree %d to keep the graph connected\n", base, graph->maxDegree);
+
+	return base;
+
+}
+
+
+/* pick a random room of the shard with spare capacity that i may connect to. Returns -1 if there is none */
+
+int pickPartner(struct RoomShard* shard, int i) {
+
+	int tries, j, k;
+
+	/* random samples from the open set nearly always succeed */
+
+	for (tries = 0; tries < 64 && shard->numOpen > 0; tries++) {
+		j = shard->openRooms[randomBelow(&shard->random, shard->numOpen)];
+		if (j != i && !areConnected(shard, i, j)) {
+			return j;
+		}
+	}
+
+	/* the open set is small or mostly i's neighbors: scan it */
+
+	for (k = 0; k < shard->numOpen; k++) {
+		j = shard->openRooms[k];
+		if (j != i && !areConnected(shard, i, j)) {
+			return j;
+		}
+	}
+
+	return -1;
+
+}
+
+
+/* hash an edge key for the edge set */
+
+static unsigned long long hashEdge(unsigned long long key) {
+
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+	return key;
+
+}
+
+
+/* key of the undirected edge a-b. Stored keys are offset by one so that 0 marks an empty slot */
+
+static unsigned long long edgeKey(int a, int b) {
+
+	if (a > b) { int t = a; a = b; b = t; }
+	return (((unsigned long long) a << 32) | (unsigned int) b) + 1;
+
+}
+
+
+/* insert a key into the edge set without growing it */
+
+static void edgeSetInsert(unsigned long long* set, long cap, unsigned long long key) {
+
+	long slot = (long) (hashEdge(key) & (cap - 1));
+	while (set[slot] != 0) {
+		slot = (slot + 1) & (cap - 1);
+	}
+	set[slot] = key;
+
+}
+
+
+/* take room i out of the shard's open set */
+
+static void closeRoom(struct RoomShard* shard, int i) {
+
+	int pos = shard->openPos[i - shard->first];
+	int last = shard->openRooms[shard->numOpen - 1];
+
+	shard->openRooms[pos] = last;
+	shard->openPos[last - shard->first] = pos;
+	shard->openPos[i - shard->first] = -1;
+	shard->numOpen--;
+
+}
+
+
+/* Connect rooms a and b, recording the edge in shard */
+
+void connect(struct RoomGraph* graph, struct RoomShard* shard, int a, int b) {
+
+	long k;
+
+	/* grow the edge list */
+
+	if (shard->numEdges == shard->edgeCap) {
+		shard->edgeCap *= 2;
+		shard->edgeA = realloc(shard->edgeA, shard->edgeCap * sizeof(int));
+		shard->edgeB = realloc(shard->edgeB, shard->edgeCap * sizeof(int));
+	}
+
+	shard->edgeA[shard->numEdges] = a;
+	shard->edgeB[shard->numEdges] = b;
+	shard->numEdges++;
+
+	/* keep the edge set at most half full */
+
+	if ((shard->edgeSetSize + 1) * 2 > shard->edgeSetCap) {
+
+		long newCap = shard->edgeSetCap * 2;
+		unsigned long long* newSet = calloc(newCap, sizeof(unsigned long long));
+		for (k = 0; k < shard->edgeSetCap; k++) {
+			if (shard->edgeSet[k] != 0) { edgeSetInsert(newSet, newCap, shard->edgeSet[k]); }
+		}
+		free(shard->edgeSet);
+		shard->edgeSet = newSet;
+		shard->edgeSetCap = newCap;
+
+	}
+
+	edgeSetInsert(shard->edgeSet, shard->edgeSetCap, edgeKey(a, b));
+	shard->edgeSetSize++;
+
+	/* update degrees, closing rooms that are now full */
+
+	graph->degree[a]++;
+	graph->degree[b]++;
+
+	if (graph->degree[a] == graph->minDegree) { shard->numUnderMin--; }
+	if (graph->degree[b] == graph->minDegree) { shard->numUnderMin--; }
+
+	/* union by rank */
+
+	int rootA = findRoot(graph, a);
+	int rootB = findRoot(graph, b);
+
+	if (rootA != rootB) {
+		if (graph->ufRank[rootA] < graph->ufRank[rootB]) { int t = rootA; rootA = rootB; rootB = t; }
+		graph->ufParent[rootB] = rootA;
+		if (graph->ufRank[rootA] == graph->ufRank[rootB]) { graph->ufRank[rootA]++; }
+		shard->numComponents--;
+	}
+
+	if (graph->degree[a] >= graph->maxDegree && shard->openPos[a - shard->first] >= 0) { closeRoom(shard, a); }
+	if (graph->degree[b] >= graph->maxDegree && shard->openPos[b - shard->first] >= 0) { closeRoom(shard, b); }
+
+}
+
+
+/* Boolean function to determine whether rooms a and b are connected by an edge of the shard */
+
+int areConnected(struct RoomShard* shard, int a, int b) {
+
+	unsigned long long key = edgeKey(a, b);
+	long slot = (long) (hashEdge(key) & (shard->edgeSetCap - 1));
+
+	while (shard->edgeSet[slot] != 0) {
+		if (shard->edgeSet[slot] == key) {
+			return 1;
+		}
+		slot = (slot + 1) & (shard->edgeSetCap - 1);
+	}
+
+	return 0;
+
+}
+
+
+/* add a shard's edges to the CSR fill, advancing each endpoint's insertion point */
+
+static void fillEdges(struct RoomGraph* graph, struct RoomShard* shard) {
+
+	long e;
+
+	for (e = 0; e < shard->numEdges; e++) {
+		graph->adjacency[graph->offsets[shard->edgeA[e]]++] = shard->edgeB[e];
+		graph->adjacency[graph->offsets[shard->edgeB[e]]++] = shard->edgeA[e];
+	}
+
+}
+
+
+/* build CSR adjacency from the edge lists, shards first and then the links between them. Each room's neighbors keep
+   the order in which the edges were added */
+
+void finalizeGraph(struct RoomGraph* graph) {
+
+	int i, s;
+	int n = graph->numRooms;
+
+	free(graph->offsets);
+	free(graph->adjacency);
+
+	graph->numEdges = graph->links.numEdges;
+	for (s = 0; s < graph->numShards; s++) {
+		graph->numEdges += graph->shards[s].numEdges;
+	}
+
+	graph->offsets = malloc((n + 1) * sizeof(long));
+	graph->adjacency = malloc(graph->numEdges * 2 * sizeof(int));
+
+	/* prefix sums of degrees give each room's first slot */
+
+	graph->offsets[0] = 0;
+	for (i = 0; i < n; i++) {
+		graph->offsets[i + 1] = graph->offsets[i] + graph->degree[i];
+	}
+
+	/* fill, using offsets[i] as room i's insertion point, then shift the offsets back */
+
+	for (s = 0; s < graph->numShards; s++) {
+		fillEdges(graph, &graph->shards[s]);
+	}
+	fillEdges(graph, &graph->links);
+
+	for (i = n; i > 0; i--) {
+		graph->offsets[i] = graph->offsets[i - 1];
+	}
+	graph->offsets[0] = 0;
+
+}
+
+
+/* assign START (1), MID, and END (1) room statuses to rooms: two random rooms, or with PLACE_FAR two rooms as far apart
+   as can be found */
+
+void assignRoomStatuses(struct RoomGraph* graph) {
+
+	int i;
+	int startIndex, endIndex;
+	struct RoomRandom random;
+
+	seedRandom(&random, graph->seed, STREAM_STATUS);
+
+	if (graph->placement == PLACE_FAR) {
+
+		findFarthestPair(graph, &random, &startIndex, &endIndex);
+
+	}
+	else {
+
+		startIndex = randomBelow(&random, graph->numRooms);
+		endIndex = startIndex;
+
+		/* ensure uniqueness of end and start indices */
+
+		while (endIndex == startIndex) {
+
+			endIndex = randomBelow(&random, graph->numRooms);
+
+		}
+
+	}
+
+	/* mark start and end rooms, as well as mid rooms */
+
+	for (i = 0; i < graph->numRooms; i++) {
+
+		graph->types[i] = MID_ROOM;
+
+	}
+
+	graph->types[startIndex] = START_ROOM;
+	graph->types[endIndex] = END_ROOM;
+
+}
+
+
+/* breadth first search over the CSR adjacency from source, filling dist. Returns the lowest numbered room farthest from
+   source, and stores its distance in farthest */
+
+int bfsFarthest(struct RoomGraph* graph, int source, int* dist, int* queue, int* farthest) {
+
+	int head = 0, tail = 0;
+	int i, v, w;
+	long k;
+	int best = source;
+
+	for (i = 0; i < graph->numRooms; i++) { dist[i] = -1; }
+
+	dist[source] = 0;
+	queue[tail++] = source;
+
+	while (head < tail) {
+
+		v = queue[head++];
+
+		if (dist[v] > dist[best] || (dist[v] == dist[best] && v < best)) { best = v; }
+
+		for (k = graph->offsets[v]; k < graph->offsets[v + 1]; k++) {
+			w = graph->adjacency[k];
+			if (dist[w] < 0) {
+				dist[w] = dist[v] + 1;
+				queue[tail++] = w;
+			}
+		}
+
+	}
+
+	*farthest = dist[best];
+
+	return best;
+
+}
+
+
+/* Find two rooms a longest shortest path apart. Small graphs are searched from every room. Large ones use repeated
+   sweeps: from a random room find the farthest room, then the room farthest from that, and so on while the distance
+   grows, which finds the exact pair in trees such as mazes and chains and a near one otherwise */
+
+void findFarthestPair(struct RoomGraph* graph, struct RoomRandom* random, int* start, int* end) {
+
+	int i, sweep, far, distance;
+	int best = -1;
+	int from;
+
+	int* dist = malloc(graph->numRooms * sizeof(int));
+	int* queue = malloc(graph->numRooms * sizeof(int));
+
+	if (graph->numRooms <= EXACT_FAR_ROOMS) {
+
+		for (i = 0; i < graph->numRooms; i++) {
+			far = bfsFarthest(graph, i, dist, queue, &distance);
+			if (distance > best) {
+				best = distance;
+				*start = i;
+				*end = far;
+			}
+		}
+
+	}
+	else {
+
+		from = bfsFarthest(graph, randomBelow(random, graph->numRooms), dist, queue, &distance);
+
+		for (sweep = 0; sweep < FAR_SWEEPS; sweep++) {
+			far = bfsFarthest(graph, from, dist, queue, &distance);
+			if (distance <= best) { break; }
+			best = distance;
+			*start = from;
+			*end = far;
+			from = far;
+		}
+
+	}
+
+	free(dist);
+	free(queue);
+
+}
+
+
+/* write the graph as the directory hindss.rooms.<pid> in the original format, as the packed file hindss.rooms.<pid>.bin,
+   or both, then point hindss.rooms.latest at it. The format's 32 bit arrays are filled from the graph's wider ones */
+
+void writeRoomFiles(struct RoomGraph* graph, int format) {
+
+	int i;
+	char path[64];
+	struct RoomData data;
+
+	uint32_t* nameOffsets = malloc(graph->numRooms * sizeof(uint32_t));
+	uint32_t* adjOffsets = malloc((graph->numRooms + 1) * sizeof(uint32_t));
+
+	if (graph->offsets[graph->numRooms] > UINT32_MAX) {
+		fprintf(stderr, "buildrooms: too many connections for the room file format\n");
+		exit(1);
+	}
+
+	for (i = 0; i < graph->numRooms; i++) {
+		nameOffsets[i] = (uint32_t) graph->nameOffsets[i];
+		adjOffsets[i] = (uint32_t) graph->offsets[i];
+	}
+	adjOffsets[graph->numRooms] = (uint32_t) graph->offsets[graph->numRooms];
+
+	memset(&data, 0, sizeof(data));
+	data.numRooms = graph->numRooms;
+	data.numAdjacency = graph->offsets[graph->numRooms];
+	data.strings = graph->nameArena;
+	data.stringsSize = graph->nameOffsets[graph->numRooms - 1] + strlen(roomName(graph, graph->numRooms - 1)) + 1;
+	data.nameOffsets = nameOffsets;
+	data.adjOffsets = adjOffsets;
+	data.adjacency = (const uint32_t*) graph->adjacency;
+	data.types = graph->types;
+
+	/* construct names with process ID */
+
+	if (format & FORMAT_TEXT) {
+		sprintf(path, "hindss.rooms.%d", getpid());
+		if (writeRoomTextDir(path, &data, graph->numThreads) != 0) { exit(1); }
+	}
+
+	if (format & FORMAT_PACKED) {
+		sprintf(path, "hindss.rooms.%d.bin", getpid());
+		if (writePackedRooms(path, &data) != 0) {
+			perror(path);
+			exit(1);
+		}
+	}
+
+	/* the game finds the new graph through the latest link, the packed file when there is one */
+
+	if (linkLatestRooms(path) != 0) { exit(1); }
+
+	free(nameOffsets);
+	free(adjOffsets);
+
+}
+
+
+/* free a shard's arrays */
+
+void freeShard(struct RoomShard* shard) {
+
+	free(shard->edgeA);
+	free(shard->edgeB);
+	free(shard->edgeSet);
+	free(shard->openRooms);
+	free(shard->openPos);
+
+}
+
+
+/* free memory allocated for the room graph */
+
+void deallocateRooms(struct RoomGraph* graph) {
+
+	int s;
+
+	for (s = 0; s < graph->numShards; s++) {
+		freeShard(&graph->shards[s]);
+	}
+	free(graph->shards);
+	freeShard(&graph->links);
+
+	free(graph->nameArena);
+	free(graph->nameOffsets);
+	free(graph->types);
+	free(graph->degree);
+	free(graph->ufParent);
+	free(graph->ufRank);
+	free(graph->offsets);
+	free(graph->adjacency);
+
+}
+
+
+/* hash of a finished graph's adjacency, for checking that two builds made the same graph */
+
+unsigned long long graphChecksum(struct RoomGraph* graph) {
+
+	long k;
+	unsigned long long sum = mix64(graph->numRooms);
+
+	for (k = 0; k <= graph->numRooms; k++) { sum = mix64(sum ^ graph->offsets[k]); }
+	for (k = 0; k < graph->offsets[graph->numRooms]; k++) { sum = mix64(sum ^ graph->adjacency[k]); }
+
+	return sum;
+
+}
+
+
+/* Benchmark: time graph generation with union-find against the original algorithm, which ran a depth first search
+   and a minimum connection scan after every accepted edge. The original is only run while it stays affordable. Each
+   size is built with one thread and with numThreads threads from the same seed, and the two graphs compared */
+
+void benchmark(int numThreads) {
+
+	int sizes[] = {7, 50, 100, 200, 400, 800, 10000, 100000, 1000000, 10000000};
+	int numSizes = 10;
+	int i;
+	double legacySeconds, seconds, threadedSeconds;
+	unsigned long long checksum;
+	struct timespec start, end;
+	struct RoomGraph graph;
+
+	printf("%10s %14s %14s %14s %12s %6s\n", "rooms", "original (s)", "union-find (s)", "threads (s)", "edges", "same");
+
+	for (i = 0; i < numSizes; i++) {
+
+		int n = sizes[i];
+		int maxDegree = (n - 1 < 6) ? n - 1 : 6;
+
+		/* original algorithm: random pairs, full search after every edge, no degree cap */
+
+		legacySeconds = -1;
+		if (n <= 800) {
+			initRoomGraph(&graph, n, 3, n - 1, 1, 1);
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			legacyConnectRoomGraph(&graph);
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			legacySeconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+			deallocateRooms(&graph);
+		}
+
+		/* union-find generation on one thread */
+
+		initRoomGraph(&graph, n, 3, maxDegree, 1, 1);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		connectRoomGraph(&graph);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+		checksum = graphChecksum(&graph);
+		deallocateRooms(&graph);
+
+		/* and on numThreads threads */
+
+		initRoomGraph(&graph, n, 3, maxDegree, 1, numThreads);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		connectRoomGraph(&graph);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		threadedSeconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+		if (legacySeconds >= 0) {
+			printf("%10d %14.6f", n, legacySeconds);
+		}
+		else {
+			printf("%10d %14s", n, "-");
+		}
+		printf(" %14.6f %14.6f %12ld %6s\n", seconds, threadedSeconds, graph.numEdges,
+			(graphChecksum(&graph) == checksum) ? "yes" : "NO");
+		fflush(stdout);
+
+		deallocateRooms(&graph);
+
+	}
+
+}
+
+
+/* The original connectRoomGraph(), kept for the benchmark: connect random pairs, and after every new edge run a depth
+   first search and check that each room has at least 3 connections */
+
+void legacyConnectRoomGraph(struct RoomGraph* graph) {
+
+	int i, j, k;
+	int n = graph->numRooms;
+	int graphComplete = 0;
+
+	struct RoomShard* whole = &graph->shards[0];
+
+	initShard(graph, whole, 0, n, (long) n * 2 + 16, STREAM_SHARD);
+
+	/* per-room connection arrays with room for every other room, as the original struct Room had */
+
+	int* connections = malloc((long) n * (n - 1) * sizeof(int));
+	for (k = 0; k < n * (n - 1); k++) { connections[k] = -1; }
+
+	while (!graphComplete) {
+
+		i = randomBelow(&whole->random, n);
+		j = i;
+		while (j == i) {
+			j = randomBelow(&whole->random, n);
+		}
+
+		if (!areConnected(whole, i, j)) {
+
+			connections[(long) i * (n - 1) + graph->degree[i]] = j;
+			connections[(long) j * (n - 1) + graph->degree[j]] = i;
+			connect(graph, whole, i, j);
+
+			/* minConnEach() */
+
+			int minOk = 1;
+			for (k = 0; k < n; k++) {
+				if (graph->degree[k] < 3) { minOk = 0; }
+			}
+
+			if (legacyDfsReachesAll(graph, connections, i) && minOk) {
+				graphComplete++;
+			}
+
+		}
+
+	}
+
+	free(connections);
+
+}
+
+
+/* The original dfsReachesAll(): a malloc'd linked list stack, and a linear scan of the visited list for every room
+   popped and every neighbor pushed */
+
+struct IntStackNode {
+
+	int value;
+	struct IntStackNode* next;
+
+};
+
+int legacyDfsReachesAll(struct RoomGraph* graph, int* connections, int begin) {
+
+	int i, j, examine, roomVisited, marked;
+	int numRooms = graph->numRooms;
+	int* roomsVisited = malloc(numRooms * sizeof(int));
+	struct IntStackNode* top = NULL;
+	struct IntStackNode* node;
+
+	for (i = 0; i < numRooms; i++) {
+		roomsVisited[i] = -1;
+	}
+
+	node = malloc(sizeof(struct IntStackNode));
+	node->value = begin;
+	node->next = top;
+	top = node;
+
+	while (top != NULL) {
+
+		examine = top->value;
+		node = top;
+		top = top->next;
+		free(node);
+
+		roomVisited = 0;
+		for (i = 0; i < numRooms; i++) {
+			if (examine == roomsVisited[i]) { roomVisited++; }
+		}
+
+		if (!roomVisited) {
+
+			marked = 0;
+			for (i = 0; i < numRooms; i++) {
+				if (roomsVisited[i] == -1 && marked == 0) {
+					roomsVisited[i] = examine;
+					marked++;
+				}
+			}
+
+			for (i = 0; i < (numRooms - 1); i++) {
+				int neighbor = connections[(long) examine * (numRooms - 1) + i];
+				if (neighbor == -1) { continue; }
+				roomVisited = 0;
+				for (j = 0; j < numRooms; j++) {
+					if (roomsVisited[j] == neighbor) { roomVisited++; }
+				}
+				if (!roomVisited) {
+					node = malloc(sizeof(struct IntStackNode));
+					node->value = neighbor;
+					node->next = top;
+					top = node;
+				}
+			}
+
+		}
+
+	}
+
+	int ret = 1;
+	for (i = 0; i < numRooms; i++) {
+		if (roomsVisited[i] == -1) { ret = 0; }
+	}
+
+	free(roomsVisited);
+
+	return ret;
+
 }
@@ -0,0 +1,24 @@
+/***********************************************************************************************************
+ *	Title: Byte Order Mark
+ *	Description: The mark the binary formats (packed room files, path traces and session snapshots)
+ *			put in their headers' byteOrder field. Each is written in the byte order of the
+ *			machine that wrote it, so the mark reads back as written on a machine of the same
+ *			byte order and byte swapped on one of the other.
+ * ********************************************************************************************************/
+
+#include <stdint.h>
+
+#ifndef HINDSS_BYTEORDER_H
+#define HINDSS_BYTEORDER_H
+
+#define BYTE_ORDER_MARK 0x0102030405060708ULL
+
+/* Boolean: mark is BYTE_ORDER_MARK as a machine of the other byte order wrote it */
+
+static inline int otherByteOrder(uint64_t mark) {
+
+	return mark == __builtin_bswap64(BYTE_ORDER_MARK);
+
+}
+
+#endif
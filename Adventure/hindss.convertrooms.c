@@ -0,0 +1,61 @@
+/***********************************************************************************************************
+ *	Title: convertrooms program
+ *	Description: Converts a room graph between the two formats the adventure game reads.
+ *
+ *			Usage: convertrooms SOURCE DEST
+ *
+ *			If SOURCE is a room directory, DEST is written as a packed room file. If SOURCE
+ *			is a packed room file, DEST is written as a room directory in the original
+ *			one file per room format.
+ * ********************************************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "hindss.roomfile.h"
+
+
+int main(int argc, char** argv) {
+
+	struct RoomData data;
+	struct stat info;
+	int result;
+
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s SOURCE DEST\n", argv[0]);
+		return 1;
+	}
+
+	if (stat(argv[1], &info) != 0) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	/* directory to packed file */
+
+	if (S_ISDIR(info.st_mode)) {
+
+		if (readRoomTextDir(argv[1], &data, 0) != 0) { return 1; }
+
+		result = writePackedRooms(argv[2], &data);
+		if (result != 0) { perror(argv[2]); }
+
+	}
+
+	/* packed file to directory */
+
+	else {
+
+		if (openPackedRooms(argv[1], &data) != 0) { return 1; }
+
+		result = writeRoomTextDir(argv[2], &data, 0);
+
+	}
+
+	closeRoomData(&data);
+
+	return (result == 0) ? 0 : 1;
+
+}
@@ -0,0 +1,902 @@
+/***********************************************************************************************************
+ *	Title: graphstats program
+ *	Description: Reports the properties of a room graph: its connected components, degree
+ *			distribution, START_ROOM to END_ROOM distance, the distribution of distances from
+ *			START_ROOM, and its diameter.
+ *
+ *			Usage: graphstats [GRAPH] [--threads T] [--samples K] [--exact-limit N] [--seed S]
+ *
+ *			GRAPH is a room directory or packed room file, by default the one the
+ *			hindss.rooms.latest link points at. Components come from one union-find pass over
+ *			the connections. Graphs of at most N rooms (default 4096) get their exact diameter
+ *			and radius from a breadth first search out of every room, the searches spread over
+ *			T threads (default one per CPU). Larger graphs get bounds on the diameter from K
+ *			searches (default 16) that alternate between the room farthest from the last
+ *			source, a double sweep, and a random room.
+ *
+ *			Searches on large graphs are direction optimizing: a level is expanded top down
+ *			from a queue while the frontier is small, and bottom up, each unvisited room
+ *			looking for a neighbor in the frontier bitmap, once the frontier's connections
+ *			outweigh those left unexplored. Levels with enough work are split across a pool
+ *			of threads kept for the whole run; small levels are run by the main thread alone,
+ *			so long thin graphs do not pay for a barrier per level.
+ * ********************************************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "hindss.roomstore.h"
+
+#define MAX_STATS_THREADS 64
+#define DEFAULT_EXACT_LIMIT 4096
+#define DEFAULT_SAMPLES 16
+
+/* frontier connections below which a level is expanded by the main thread alone */
+
+#define PARALLEL_LEVEL_EDGES 4096
+
+/* switch to bottom up when the frontier has more than 1 / ALPHA of the unexplored connections, and back to top down
+   when the frontier has fewer than 1 / BETA of the rooms */
+
+#define BOTTOM_UP_ALPHA 14
+#define TOP_DOWN_BETA 24
+
+/* work handed out at a time: frontier rooms top down, bitmap words bottom up. Rooms found top down are queued a batch
+   at a time */
+
+#define TOP_DOWN_CHUNK 256
+#define BOTTOM_UP_CHUNK 16
+#define QUEUE_BATCH 256
+
+#define NOT_REACHED UINT32_MAX
+
+/* a breadth first search over one graph, with its thread pool, reused for every source */
+
+struct GraphBfs {
+
+	const struct RoomData* data;
+	uint32_t n;
+	size_t words;
+	int numThreads;
+
+	uint32_t* dist;
+	uint64_t* visited;
+
+	/* top down frontier and the next one */
+
+	uint32_t* queue;
+	uint64_t queueLen;
+	uint32_t* nextQueue;
+	uint64_t nextLen;
+
+	/* bottom up frontier and the next one */
+
+	uint64_t* frontier;
+	uint64_t* next;
+
+	/* the level being expanded */
+
+	uint32_t level;
+	int bottomUp;
+	uint64_t cursor;
+	uint64_t found;
+	uint64_t foundEdges;
+
+	/* rooms at each distance from the last source */
+
+	uint64_t* levelSizes;
+	uint32_t levelCap;
+
+	/* pool */
+
+	pthread_t threads[MAX_STATS_THREADS];
+	int numStarted;
+	pthread_barrier_t start;
+	pthread_barrier_t done;
+	int stop;
+
+};
+
+struct PoolJob {
+
+	struct GraphBfs* bfs;
+	int tid;
+
+};
+
+struct AllPairs {
+
+	const struct RoomData* data;
+	uint32_t nextSource;
+
+	/* over every room: the largest and smallest eccentricity within its component */
+
+	uint32_t diameter;
+	uint32_t radius;
+
+	/* ordered pairs of rooms at each distance */
+
+	unsigned long long* histogram;
+
+	pthread_mutex_t lock;
+
+};
+
+struct DiameterJob {
+
+	struct AllPairs* pairs;
+
+};
+
+
+/* seconds on the monotonic clock */
+
+static double now() {
+
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return t.tv_sec + t.tv_nsec / 1e9;
+
+}
+
+
+/* number of connections of room i */
+
+static inline uint32_t degreeOf(const struct RoomData* data, uint32_t i) {
+
+	return data->adjOffsets[i + 1] - data->adjOffsets[i];
+
+}
+
+
+/* expand part of a level top down: claim frontier rooms, mark their unvisited neighbors and queue them a batch at a
+   time */
+
+static void topDownStep(struct GraphBfs* bfs) {
+
+	const struct RoomData* data = bfs->data;
+	uint32_t batch[QUEUE_BATCH];
+	uint32_t count = 0, w;
+	uint64_t first, last, i, k, pos, found = 0, edges = 0, bit, old;
+
+	while ((first = __atomic_fetch_add(&bfs->cursor, TOP_DOWN_CHUNK, __ATOMIC_RELAXED)) < bfs->queueLen) {
+
+		last = first + TOP_DOWN_CHUNK;
+		if (last > bfs->queueLen) { last = bfs->queueLen; }
+
+		for (i = first; i < last; i++) {
+
+			for (k = data->adjOffsets[bfs->queue[i]]; k < data->adjOffsets[bfs->queue[i] + 1]; k++) {
+
+				w = data->adjacency[k];
+				bit = 1ULL << (w % 64);
+
+				/* a plain read first keeps already visited rooms off the atomic */
+
+				if (__atomic_load_n(&bfs->visited[w / 64], __ATOMIC_RELAXED) & bit) { continue; }
+
+				old = __atomic_fetch_or(&bfs->visited[w / 64], bit, __ATOMIC_RELAXED);
+				if (old & bit) { continue; }
+
+				bfs->dist[w] = bfs->level + 1;
+				edges += degreeOf(data, w);
+				found++;
+
+				batch[count++] = w;
+
+				if (count == QUEUE_BATCH) {
+					pos = __atomic_fetch_add(&bfs->nextLen, count, __ATOMIC_RELAXED);
+					memcpy(bfs->nextQueue + pos, batch, count * sizeof(uint32_t));
+					count = 0;
+				}
+
+			}
+
+		}
+
+	}
+
+	if (count > 0) {
+		pos = __atomic_fetch_add(&bfs->nextLen, count, __ATOMIC_RELAXED);
+		memcpy(bfs->nextQueue + pos, batch, count * sizeof(uint32_t));
+	}
+
+	__atomic_fetch_add(&bfs->found, found, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&bfs->foundEdges, edges, __ATOMIC_RELAXED);
+
+}
+
+
+/* expand part of a level bottom up: claim bitmap words, and give each unvisited room in them the first neighbor found
+   in the frontier as its parent. A word belongs to one thread, so no atomics are needed on it */
+
+static void bottomUpStep(struct GraphBfs* bfs) {
+
+	const struct RoomData* data = bfs->data;
+	uint64_t first, last, word, unvisited, nextWord, found = 0, edges = 0, k;
+	uint32_t v, u;
+
+	while ((first = __atomic_fetch_add(&bfs->cursor, BOTTOM_UP_CHUNK, __ATOMIC_RELAXED)) < bfs->words) {
+
+		last = first + BOTTOM_UP_CHUNK;
+		if (last > bfs->words) { last = bfs->words; }
+
+		for (word = first; word < last; word++) {
+
+			unvisited = ~bfs->visited[word];
+			nextWord = 0;
+
+			/* the last word's bits past the last room */
+
+			if (word == bfs->words - 1 && bfs->n % 64) { unvisited &= (1ULL << (bfs->n % 64)) - 1; }
+
+			while (unvisited) {
+
+				v = word * 64 + __builtin_ctzll(unvisited);
+				unvisited &= unvisited - 1;
+
+				for (k = data->adjOffsets[v]; k < data->adjOffsets[v + 1]; k++) {
+
+					u = data->adjacency[k];
+
+					if (bfs->frontier[u / 64] & (1ULL << (u % 64))) {
+						nextWord |= 1ULL << (v % 64);
+						bfs->dist[v] = bfs->level + 1;
+						edges += degreeOf(data, v);
+						found++;
+						break;
+					}
+
+				}
+
+			}
+
+			bfs->next[word] = nextWord;
+			bfs->visited[word] |= nextWord;
+
+		}
+
+	}
+
+	__atomic_fetch_add(&bfs->found, found, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&bfs->foundEdges, edges, __ATOMIC_RELAXED);
+
+}
+
+
+/* a pool thread: expand each level it is started on until told to stop */
+
+static void* bfsPoolThread(void* arg) {
+
+	struct PoolJob* job = arg;
+	struct GraphBfs* bfs = job->bfs;
+
+	while (1) {
+
+		pthread_barrier_wait(&bfs->start);
+
+		if (bfs->stop) { break; }
+
+		if (bfs->bottomUp) { bottomUpStep(bfs); } else { topDownStep(bfs); }
+
+		pthread_barrier_wait(&bfs->done);
+
+	}
+
+	free(job);
+
+	return NULL;
+
+}
+
+
+/* Set up a search over data with numThreads threads, the calling thread being one of them */
+
+static void initGraphBfs(struct GraphBfs* bfs, const struct RoomData* data, int numThreads) {
+
+	struct PoolJob* job;
+	int i;
+
+	memset(bfs, 0, sizeof(*bfs));
+
+	bfs->data = data;
+	bfs->n = data->numRooms;
+	bfs->words = ((size_t) data->numRooms + 63) / 64;
+	bfs->numThreads = numThreads;
+
+	bfs->dist = malloc((size_t) bfs->n * sizeof(uint32_t));
+	bfs->queue = malloc((size_t) bfs->n * sizeof(uint32_t));
+	bfs->nextQueue = malloc((size_t) bfs->n * sizeof(uint32_t));
+	bfs->visited = malloc(bfs->words * sizeof(uint64_t));
+	bfs->frontier = malloc(bfs->words * sizeof(uint64_t));
+	bfs->next = malloc(bfs->words * sizeof(uint64_t));
+
+	bfs->levelCap = 64;
+	bfs->levelSizes = malloc(bfs->levelCap * sizeof(uint64_t));
+
+	pthread_barrier_init(&bfs->start, NULL, numThreads);
+	pthread_barrier_init(&bfs->done, NULL, numThreads);
+
+	for (i = 1; i < numThreads; i++) {
+
+		job = malloc(sizeof(struct PoolJob));
+		job->bfs = bfs;
+		job->tid = i;
+
+		pthread_create(&bfs->threads[i], NULL, bfsPoolThread, job);
+
+	}
+
+}
+
+
+/* stop the pool and release a search */
+
+static void closeGraphBfs(struct GraphBfs* bfs) {
+
+	int i;
+
+	bfs->stop = 1;
+
+	if (bfs->numThreads > 1) {
+		pthread_barrier_wait(&bfs->start);
+	}
+
+	for (i = 1; i < bfs->numThreads; i++) {
+		pthread_join(bfs->threads[i], NULL);
+	}
+
+	pthread_barrier_destroy(&bfs->start);
+	pthread_barrier_destroy(&bfs->done);
+
+	free(bfs->dist);
+	free(bfs->queue);
+	free(bfs->nextQueue);
+	free(bfs->visited);
+	free(bfs->frontier);
+	free(bfs->next);
+	free(bfs->levelSizes);
+
+}
+
+
+/* Search from source, filling dist and levelSizes. Returns the source's eccentricity, and stores the rooms reached in
+   reached and the connections examined in edges */
+
+static uint32_t runGraphBfs(struct GraphBfs* bfs, uint32_t source, uint64_t* reached, uint64_t* edges) {
+
+	const struct RoomData* data = bfs->data;
+	uint64_t explored, frontierEdges, word, bits, i;
+	uint32_t* swapQueue;
+	uint64_t* swapBits;
+
+	memset(bfs->dist, 0xff, (size_t) bfs->n * sizeof(uint32_t));
+	memset(bfs->visited, 0, bfs->words * sizeof(uint64_t));
+
+	bfs->dist[source] = 0;
+	bfs->visited[source / 64] |= 1ULL << (source % 64);
+	bfs->queue[0] = source;
+	bfs->queueLen = 1;
+	bfs->level = 0;
+	bfs->bottomUp = 0;
+	bfs->levelSizes[0] = 1;
+
+	*reached = 1;
+	frontierEdges = degreeOf(data, source);
+	explored = frontierEdges;
+
+	while (1) {
+
+		bfs->cursor = 0;
+		bfs->nextLen = 0;
+		bfs->found = 0;
+		bfs->foundEdges = 0;
+
+		/* big levels go to the pool, small ones are expanded here */
+
+		if (bfs->numThreads > 1 && (bfs->bottomUp || frontierEdges >= PARALLEL_LEVEL_EDGES)) {
+
+			pthread_barrier_wait(&bfs->start);
+			if (bfs->bottomUp) { bottomUpStep(bfs); } else { topDownStep(bfs); }
+			pthread_barrier_wait(&bfs->done);
+
+		}
+		else if (bfs->bottomUp) {
+
+			bottomUpStep(bfs);
+
+		}
+		else {
+
+			topDownStep(bfs);
+
+		}
+
+		if (bfs->found == 0) { break; }
+
+		bfs->level++;
+		*reached += bfs->found;
+		explored += bfs->foundEdges;
+		frontierEdges = bfs->foundEdges;
+
+		if (bfs->level == bfs->levelCap) {
+			bfs->levelCap *= 2;
+			bfs->levelSizes = realloc(bfs->levelSizes, bfs->levelCap * sizeof(uint64_t));
+		}
+
+		bfs->levelSizes[bfs->level] = bfs->found;
+
+		/* pick the direction of the next level, converting the frontier if it changes */
+
+		if (!bfs->bottomUp && frontierEdges > (data->numAdjacency - explored) / BOTTOM_UP_ALPHA) {
+
+			memset(bfs->frontier, 0, bfs->words * sizeof(uint64_t));
+
+			for (i = 0; i < bfs->nextLen; i++) {
+				bfs->frontier[bfs->nextQueue[i] / 64] |= 1ULL << (bfs->nextQueue[i] % 64);
+			}
+
+			bfs->bottomUp = 1;
+
+		}
+		else if (!bfs->bottomUp) {
+
+			swapQueue = bfs->queue;
+			bfs->queue = bfs->nextQueue;
+			bfs->nextQueue = swapQueue;
+			bfs->queueLen = bfs->nextLen;
+
+		}
+		else if (bfs->found < bfs->n / TOP_DOWN_BETA) {
+
+			bfs->queueLen = 0;
+
+			for (word = 0; word < bfs->words; word++) {
+				for (bits = bfs->next[word]; bits; bits &= bits - 1) {
+					bfs->queue[bfs->queueLen++] = word * 64 + __builtin_ctzll(bits);
+				}
+			}
+
+			bfs->bottomUp = 0;
+
+		}
+		else {
+
+			swapBits = bfs->frontier;
+			bfs->frontier = bfs->next;
+			bfs->next = swapBits;
+
+		}
+
+	}
+
+	*edges = explored;
+
+	return bfs->level;
+
+}
+
+
+/* union-find root of room i, halving the path on the way */
+
+static uint32_t findRoot(uint32_t* parent, uint32_t i) {
+
+	while (parent[i] != i) {
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+
+	return i;
+
+}
+
+
+/* Print the number of components and the size of the largest. Returns the number of components */
+
+static uint32_t reportComponents(const struct RoomData* data) {
+
+	uint32_t* parent = malloc((size_t) data->numRooms * sizeof(uint32_t));
+	uint32_t* size = calloc(data->numRooms, sizeof(uint32_t));
+	uint32_t i, a, b, components = 0, largest = 0;
+	uint64_t k;
+
+	for (i = 0; i < data->numRooms; i++) {
+		parent[i] = i;
+	}
+
+	for (i = 0; i < data->numRooms; i++) {
+
+		for (k = data->adjOffsets[i]; k < data->adjOffsets[i + 1]; k++) {
+
+			a = findRoot(parent, i);
+			b = findRoot(parent, data->adjacency[k]);
+
+			if (a != b) { parent[a < b ? b : a] = a < b ? a : b; }
+
+		}
+
+	}
+
+	for (i = 0; i < data->numRooms; i++) {
+
+		a = findRoot(parent, i);
+		if (size[a]++ == 0) { components++; }
+		if (size[a] > largest) { largest = size[a]; }
+
+	}
+
+	printf("COMPONENTS: %u, LARGEST %u ROOMS\n", components, largest);
+
+	free(parent);
+	free(size);
+
+	return components;
+
+}
+
+
+/* Print the smallest, largest and mean degree, and how many rooms have each degree, or each power of two range of
+   degrees when there are too many to list */
+
+static void reportDegrees(const struct RoomData* data) {
+
+	unsigned long long buckets[34] = {0};
+	unsigned long long* exact;
+	uint32_t i, d, minDegree = UINT32_MAX, maxDegree = 0;
+	int b;
+
+	for (i = 0; i < data->numRooms; i++) {
+		d = degreeOf(data, i);
+		if (d < minDegree) { minDegree = d; }
+		if (d > maxDegree) { maxDegree = d; }
+	}
+
+	printf("DEGREE: MIN %u, MAX %u, MEAN %.2f\n", minDegree, maxDegree,
+		data->numRooms ? (double) data->numAdjacency / data->numRooms : 0);
+
+	if (maxDegree <= 32) {
+
+		exact = calloc(maxDegree + 1, sizeof(unsigned long long));
+
+		for (i = 0; i < data->numRooms; i++) {
+			exact[degreeOf(data, i)]++;
+		}
+
+		for (d = 0; d <= maxDegree; d++) {
+			if (exact[d]) { printf("\t%u: %llu\n", d, exact[d]); }
+		}
+
+		free(exact);
+		return;
+
+	}
+
+	/* bucket 0 holds degree 0, bucket b degrees 2^(b-1) .. 2^b - 1 */
+
+	for (i = 0; i < data->numRooms; i++) {
+		d = degreeOf(data, i);
+		buckets[d ? 32 - __builtin_clz(d) : 0]++;
+	}
+
+	for (b = 0; b < 34; b++) {
+
+		if (!buckets[b]) { continue; }
+
+		if (b == 0) { printf("\t0: %llu\n", buckets[b]); }
+		else { printf("\t%u-%u: %llu\n", 1U << (b - 1), (uint32_t) ((1ULL << b) - 1), buckets[b]); }
+
+	}
+
+}
+
+
+/* Print counts by distance, grouping distances into at most 32 equal ranges */
+
+static void printDistanceHistogram(const unsigned long long* counts, uint32_t maxDistance) {
+
+	uint32_t width = maxDistance / 32 + 1;
+	uint32_t first, d;
+	unsigned long long sum;
+
+	for (first = 0; first <= maxDistance; first += width) {
+
+		sum = 0;
+
+		for (d = first; d < first + width && d <= maxDistance; d++) {
+			sum += counts[d];
+		}
+
+		if (width == 1) { printf("\t%u: %llu\n", first, sum); }
+		else { printf("\t%u-%u: %llu\n", first, (first + width - 1 < maxDistance) ? first + width - 1 : maxDistance, sum); }
+
+	}
+
+}
+
+
+/* an all pairs worker: a plain breadth first search from every source it claims */
+
+static void* diameterThread(void* arg) {
+
+	struct AllPairs* pairs = ((struct DiameterJob*) arg)->pairs;
+	const struct RoomData* data = pairs->data;
+	uint32_t n = data->numRooms;
+	uint32_t* dist = malloc((size_t) n * sizeof(uint32_t));
+	uint32_t* queue = malloc((size_t) n * sizeof(uint32_t));
+	unsigned long long* histogram = calloc(n, sizeof(unsigned long long));
+	uint32_t source, u, w, head, tail, diameter = 0, radius = UINT32_MAX, d;
+	uint64_t k;
+
+	while ((source = __atomic_fetch_add(&pairs->nextSource, 1, __ATOMIC_RELAXED)) < n) {
+
+		memset(dist, 0xff, (size_t) n * sizeof(uint32_t));
+
+		dist[source] = 0;
+		queue[0] = source;
+
+		for (head = 0, tail = 1; head < tail; head++) {
+
+			u = queue[head];
+			histogram[dist[u]]++;
+
+			for (k = data->adjOffsets[u]; k < data->adjOffsets[u + 1]; k++) {
+				w = data->adjacency[k];
+				if (dist[w] == NOT_REACHED) {
+					dist[w] = dist[u] + 1;
+					queue[tail++] = w;
+				}
+			}
+
+		}
+
+		/* the last room queued is the farthest */
+
+		d = dist[queue[tail - 1]];
+		if (d > diameter) { diameter = d; }
+		if (d < radius) { radius = d; }
+
+	}
+
+	pthread_mutex_lock(&pairs->lock);
+
+	if (diameter > pairs->diameter) { pairs->diameter = diameter; }
+	if (radius < pairs->radius) { pairs->radius = radius; }
+
+	for (d = 0; d < n; d++) {
+		pairs->histogram[d] += histogram[d];
+	}
+
+	pthread_mutex_unlock(&pairs->lock);
+
+	free(dist);
+	free(queue);
+	free(histogram);
+
+	return NULL;
+
+}
+
+
+/* Print the exact diameter and radius, and the distances between all ordered pairs of rooms that are connected */
+
+static void reportExactDiameter(const struct RoomData* data, int numThreads) {
+
+	struct AllPairs pairs;
+	struct DiameterJob job;
+	pthread_t threads[MAX_STATS_THREADS];
+	double began = now();
+	int i;
+
+	pairs.data = data;
+	pairs.nextSource = 0;
+	pairs.diameter = 0;
+	pairs.radius = UINT32_MAX;
+	pairs.histogram = calloc(data->numRooms, sizeof(unsigned long long));
+	pthread_mutex_init(&pairs.lock, NULL);
+
+	job.pairs = &pairs;
+
+	for (i = 1; i < numThreads; i++) {
+		pthread_create(&threads[i], NULL, diameterThread, &job);
+	}
+
+	diameterThread(&job);
+
+	for (i = 1; i < numThreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	printf("DIAMETER: %u (EXACT, %u SEARCHES IN %.3f SECONDS)\n", pairs.diameter, data->numRooms, now() - began);
+	printf("RADIUS: %u\n", pairs.radius);
+	printf("DISTANCES BETWEEN ALL ORDERED PAIRS:\n");
+
+	printDistanceHistogram(pairs.histogram, pairs.diameter);
+
+	pthread_mutex_destroy(&pairs.lock);
+	free(pairs.histogram);
+
+}
+
+
+/* the room farthest from the last source, the lowest numbered among the farthest */
+
+static uint32_t farthestRoom(const struct GraphBfs* bfs, uint32_t eccentricity) {
+
+	uint32_t i;
+
+	for (i = 0; i < bfs->n; i++) {
+		if (bfs->dist[i] == eccentricity) { return i; }
+	}
+
+	return 0;
+
+}
+
+
+/* Print bounds on the diameter from samples searches. Every search's eccentricity is a lower bound, and in a connected
+   graph twice any eccentricity is an upper bound */
+
+static void reportDiameterBounds(struct GraphBfs* bfs, uint32_t components, uint32_t first, int samples,
+		unsigned long long seed) {
+
+	uint32_t source = first, eccentricity, lower = 0, upper = UINT32_MAX;
+	uint64_t reached, edges, random = seed | 1;
+	double began = now();
+	int s;
+
+	for (s = 0; s < samples; s++) {
+
+		eccentricity = runGraphBfs(bfs, source, &reached, &edges);
+
+		if (eccentricity > lower) { lower = eccentricity; }
+		if (2ULL * eccentricity < upper) { upper = 2 * eccentricity; }
+
+		/* odd samples sweep on from the farthest room, even ones start somewhere new */
+
+		if (s % 2 == 0) {
+			source = farthestRoom(bfs, eccentricity);
+		}
+		else {
+			random ^= random << 13;
+			random ^= random >> 7;
+			random ^= random << 17;
+			source = random % bfs->n;
+		}
+
+	}
+
+	if (components == 1) {
+		printf("DIAMETER: %u TO %u (ESTIMATED, %d SEARCHES IN %.3f SECONDS)\n", lower, upper, samples, now() - began);
+	}
+	else {
+		printf("DIAMETER: AT LEAST %u (ESTIMATED, %d SEARCHES IN %.3f SECONDS)\n", lower, samples, now() - began);
+	}
+
+}
+
+
+int main(int argc, char** argv) {
+
+	struct option longOptions[] = {
+		{"threads", required_argument, NULL, 't'},
+		{"samples", required_argument, NULL, 'k'},
+		{"exact-limit", required_argument, NULL, 'x'},
+		{"seed", required_argument, NULL, 's'},
+		{NULL, 0, NULL, 0}
+	};
+
+	struct RoomStore store;
+	struct GraphBfs bfs;
+	const char* graphPath = ROOM_LATEST_LINK;
+	unsigned long long seed = (unsigned long long) time(NULL);
+	unsigned long long* counts;
+	uint32_t start, end, components, eccentricity, d;
+	uint64_t reached, edges;
+	int numThreads = 0, samples = DEFAULT_SAMPLES, exactLimit = DEFAULT_EXACT_LIMIT;
+	int opt, usage = 0;
+	double began, elapsed;
+
+	while ((opt = getopt_long(argc, argv, "", longOptions, NULL)) != -1) {
+
+		switch (opt) {
+			case 't': numThreads = atoi(optarg); break;
+			case 'k': samples = atoi(optarg); break;
+			case 'x': exactLimit = atoi(optarg); break;
+			case 's': seed = strtoull(optarg, NULL, 0); break;
+			default: usage = 1; break;
+		}
+
+	}
+
+	if (optind < argc) { graphPath = argv[optind++]; }
+
+	if (usage || optind != argc || samples < 1) {
+		fprintf(stderr, "usage: %s [GRAPH] [--threads T] [--samples K] [--exact-limit N] [--seed S]\n", argv[0]);
+		return 1;
+	}
+
+	if (numThreads <= 0) { numThreads = (int) sysconf(_SC_NPROCESSORS_ONLN); }
+	if (numThreads > MAX_STATS_THREADS) { numThreads = MAX_STATS_THREADS; }
+	if (numThreads < 1) { numThreads = 1; }
+
+	if (openRoomStore(graphPath, &store) != 0) {
+		return 1;
+	}
+
+	if (storeNumRooms(&store) == 0) {
+		fprintf(stderr, "%s: no rooms\n", graphPath);
+		closeRoomStore(&store);
+		return 1;
+	}
+
+	printf("ROOMS: %u, CONNECTIONS: %llu\n", storeNumRooms(&store), (unsigned long long) store.data.numAdjacency);
+
+	components = reportComponents(&store.data);
+
+	reportDegrees(&store.data);
+
+	/* distances from START_ROOM, with one of the direction optimizing searches */
+
+	start = findRoomByType(&store, START_ROOM);
+	end = findRoomByType(&store, END_ROOM);
+
+	initGraphBfs(&bfs, &store.data, numThreads);
+
+	if (start != ROOM_NONE) {
+
+		began = now();
+		eccentricity = runGraphBfs(&bfs, start, &reached, &edges);
+		elapsed = now() - began;
+
+		if (end == ROOM_NONE) {
+			printf("START_ROOM TO END_ROOM: NO END_ROOM\n");
+		}
+		else if (bfs.dist[end] == NOT_REACHED) {
+			printf("START_ROOM TO END_ROOM: NOT CONNECTED\n");
+		}
+		else {
+			printf("START_ROOM TO END_ROOM: %u STEPS\n", bfs.dist[end]);
+		}
+
+		printf("SEARCH FROM START_ROOM: %llu ROOMS, %u LEVELS, %.3f SECONDS, %.1f M CONNECTIONS/SEC ON %d THREADS\n",
+			(unsigned long long) reached, eccentricity + 1, elapsed, elapsed > 0 ? edges / elapsed / 1e6 : 0, numThreads);
+		printf("DISTANCES FROM START_ROOM:\n");
+
+		counts = malloc(((size_t) eccentricity + 1) * sizeof(unsigned long long));
+
+		for (d = 0; d <= eccentricity; d++) {
+			counts[d] = bfs.levelSizes[d];
+		}
+
+		printDistanceHistogram(counts, eccentricity);
+
+		free(counts);
+
+	}
+	else {
+
+		printf("START_ROOM TO END_ROOM: NO START_ROOM\n");
+
+	}
+
+	if (storeNumRooms(&store) <= (uint32_t) exactLimit) {
+		reportExactDiameter(&store.data, numThreads);
+	}
+	else {
+		reportDiameterBounds(&bfs, components, start != ROOM_NONE ? start : 0, samples, seed);
+	}
+
+	closeGraphBfs(&bfs);
+	closeRoomStore(&store);
+
+	return 0;
+
+}
@@ -0,0 +1,463 @@
+/***********************************************************************************************************
+ *	Title: Graph Watch
+ *	Description: Snapshots, readers and the watch thread (see hindss.graphwatch.h). The watch thread
+ *			is the only one that loads, publishes or frees a snapshot, so the current pointer
+ *			and the retired list need no lock: readers only ever load the pointer and move
+ *			snapshot counts and their own generation.
+ *
+ *			A reader going online stores the generation it sees before it can load the
+ *			current pointer, and the swap stores the pointer before the generation, so a
+ *			reader whose stored generation is at least the swap's cannot load the old pointer.
+ * ********************************************************************************************************/
+
+#define _GNU_SOURCE
+
+#include "hindss.graphwatch.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#define WATCH_EVENT_BUFFER 4096
+
+
+/* milliseconds on the monotonic clock */
+
+static long long nowMs() {
+
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return t.tv_sec * 1000LL + t.tv_nsec / 1000000;
+
+}
+
+
+/* Load the graph at name with its name table as a snapshot held once. Returns NULL with a message on stderr if it
+   cannot be loaded or has no START_ROOM */
+
+static struct GraphSnapshot* loadSnapshot(const char* name) {
+
+	struct GraphSnapshot* snap = calloc(1, sizeof(struct GraphSnapshot));
+
+	if (openRoomStore(name, &snap->store) != 0) {
+		free(snap);
+		return NULL;
+	}
+
+	snap->start = findRoomByType(&snap->store, START_ROOM);
+	if (snap->start == ROOM_NONE) {
+		fprintf(stderr, "adventure: %s has no START_ROOM\n", name);
+		closeRoomStore(&snap->store);
+		free(snap);
+		return NULL;
+	}
+
+	indexRoomNames(&snap->store);
+
+	snap->name = strdup(name);
+	snap->refs = 1;
+
+	return snap;
+
+}
+
+
+/* release a snapshot's graph */
+
+static void freeSnapshot(struct GraphSnapshot* snap) {
+
+	closeRoomStore(&snap->store);
+	free(snap->name);
+	free(snap);
+
+}
+
+
+/* Load graphName as the first snapshot of a watch with numReaders readers, all offline. followLatest marks graphName as
+   where the latest link pointed, so that watching follows the link rather than graphName. Returns 0, or -1 with a
+   message on stderr */
+
+int openGraphWatch(struct GraphWatch* watch, const char* graphName, int followLatest, int numReaders) {
+
+	int i;
+
+	memset(watch, 0, sizeof(*watch));
+
+	watch->inotifyFd = -1;
+	watch->stopFd = -1;
+
+	watch->current = loadSnapshot(graphName);
+
+	if (watch->current == NULL) { return -1; }
+
+	watch->generation = 1;
+	watch->current->generation = 1;
+
+	watch->followLatest = followLatest;
+	watch->graphPath = strdup(graphName);
+
+	watch->numReaders = numReaders;
+	watch->readers = aligned_alloc(64, numReaders * sizeof(struct GraphReader));
+
+	for (i = 0; i < numReaders; i++) {
+		watch->readers[i].seen = GRAPH_READER_OFFLINE;
+	}
+
+	return 0;
+
+}
+
+
+/* Reader i is about to take snapshots */
+
+void graphReaderOnline(struct GraphWatch* watch, int i) {
+
+	__atomic_store_n(&watch->readers[i].seen, __atomic_load_n(&watch->generation, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+
+}
+
+
+/* Reader i holds no pointer to a snapshot other than through the snapshots it has taken */
+
+void graphReaderOffline(struct GraphWatch* watch, int i) {
+
+	__atomic_store_n(&watch->readers[i].seen, GRAPH_READER_OFFLINE, __ATOMIC_SEQ_CST);
+
+}
+
+
+/* Take the current snapshot for as long as a game lasts. Only an online reader may call this */
+
+struct GraphSnapshot* acquireGraph(struct GraphWatch* watch) {
+
+	struct GraphSnapshot* snap = __atomic_load_n(&watch->current, __ATOMIC_SEQ_CST);
+
+	__atomic_add_fetch(&snap->refs, 1, __ATOMIC_RELAXED);
+
+	return snap;
+
+}
+
+
+/* Give back a snapshot taken with acquireGraph(). A retired snapshot is freed later by the watch thread */
+
+void releaseGraph(struct GraphSnapshot* snap) {
+
+	__atomic_sub_fetch(&snap->refs, 1, __ATOMIC_RELEASE);
+
+}
+
+
+/* Boolean: no reader can still load retired snapshot snap, and no game holds it */
+
+static int snapshotDone(const struct GraphWatch* watch, const struct GraphSnapshot* snap) {
+
+	uint64_t seen;
+	int i;
+
+	for (i = 0; i < watch->numReaders; i++) {
+
+		seen = __atomic_load_n(&watch->readers[i].seen, __ATOMIC_SEQ_CST);
+
+		if (seen != GRAPH_READER_OFFLINE && seen < snap->retiredBy) { return 0; }
+
+	}
+
+	return __atomic_load_n(&snap->refs, __ATOMIC_ACQUIRE) == 0;
+
+}
+
+
+/* free the retired snapshots that are done */
+
+static void freeRetired(struct GraphWatch* watch) {
+
+	struct GraphSnapshot** link = &watch->retired;
+	struct GraphSnapshot* snap;
+
+	while ((snap = *link) != NULL) {
+
+		if (snapshotDone(watch, snap)) {
+			*link = snap->nextRetired;
+			freeSnapshot(snap);
+		}
+		else {
+			link = &snap->nextRetired;
+		}
+
+	}
+
+}
+
+
+/* Load the source's graph and make it current, retiring the old snapshot. A graph that fails to load leaves the
+   current one in place. A latest link that still points at the current graph is not reloaded */
+
+static void reloadGraph(struct GraphWatch* watch) {
+
+	struct GraphSnapshot* old = watch->current;
+	struct GraphSnapshot* snap;
+	char name[PATH_MAX];
+	ssize_t len;
+
+	if (watch->followLatest) {
+
+		len = readlink(ROOM_LATEST_LINK, name, sizeof(name) - 1);
+
+		if (len <= 0) {
+			perror(ROOM_LATEST_LINK);
+			watch->failures++;
+			return;
+		}
+
+		name[len] = 0;
+
+		if (strcmp(name, old->name) == 0) { return; }
+
+	}
+	else {
+
+		snprintf(name, sizeof(name), "%s", watch->graphPath);
+
+	}
+
+	snap = loadSnapshot(name);
+
+	if (snap == NULL) {
+		fprintf(stderr, "adventure: keeping generation %llu\n", (unsigned long long) old->generation);
+		watch->failures++;
+		return;
+	}
+
+	snap->generation = old->generation + 1;
+
+	/* pointer first, then generation: see the top of this file */
+
+	__atomic_store_n(&watch->current, snap, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&watch->generation, snap->generation, __ATOMIC_SEQ_CST);
+
+	old->retiredBy = snap->generation;
+	old->nextRetired = watch->retired;
+	watch->retired = old;
+
+	releaseGraph(old);
+
+	watch->reloads++;
+
+	fprintf(stderr, "adventure: generation %llu: %u rooms from %s\n", (unsigned long long) snap->generation,
+		storeNumRooms(&snap->store), snap->name);
+
+}
+
+
+/* Boolean: an inotify event is about the graph's source */
+
+static int watchedEvent(const struct GraphWatch* watch, const struct inotify_event* event) {
+
+	if (event->mask & IN_Q_OVERFLOW) { return 1; }
+
+	return watch->watchName == NULL || (event->len > 0 && strcmp(event->name, watch->watchName) == 0);
+
+}
+
+
+/* the watch thread: wait for the source to change and settle, reload it, and free retired snapshots */
+
+static void* watchThread(void* arg) {
+
+	struct GraphWatch* watch = arg;
+	struct pollfd fds[2];
+	char buffer[WATCH_EVENT_BUFFER] __attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event* event;
+	long long lastEvent = 0, waited;
+	ssize_t got, pos;
+	int pending = 0, timeout;
+
+	fds[0].fd = watch->inotifyFd;
+	fds[0].events = POLLIN;
+	fds[1].fd = watch->stopFd;
+	fds[1].events = POLLIN;
+
+	while (1) {
+
+		timeout = -1;
+
+		if (pending) {
+			waited = nowMs() - lastEvent;
+			timeout = (waited < GRAPH_WATCH_SETTLE_MS) ? (int) (GRAPH_WATCH_SETTLE_MS - waited) : 0;
+		}
+		else if (watch->retired != NULL) {
+			timeout = GRAPH_WATCH_RETIRE_MS;
+		}
+
+		if (poll(fds, 2, timeout) < 0 && errno != EINTR) {
+			perror("poll");
+			break;
+		}
+
+		if (fds[1].revents & POLLIN) { break; }
+
+		/* every event restarts the wait for the source to settle */
+
+		while ((got = read(watch->inotifyFd, buffer, sizeof(buffer))) > 0) {
+
+			for (pos = 0; pos < got; pos += sizeof(struct inotify_event) + event->len) {
+
+				event = (const struct inotify_event*) (buffer + pos);
+
+				if (watchedEvent(watch, event)) {
+					pending = 1;
+					lastEvent = nowMs();
+				}
+
+			}
+
+		}
+
+		if (pending && nowMs() - lastEvent >= GRAPH_WATCH_SETTLE_MS) {
+			pending = 0;
+			reloadGraph(watch);
+		}
+
+		freeRetired(watch);
+
+	}
+
+	return NULL;
+
+}
+
+
+/* Watch the graph's source with inotify and reload it on a thread of the watch's own, which takes no signals. Returns
+   0, or -1 with a message on stderr */
+
+int startGraphWatch(struct GraphWatch* watch) {
+
+	struct stat info;
+	sigset_t all, previous;
+	char* slash;
+	uint32_t mask;
+
+	if (watch->followLatest) {
+
+		/* buildrooms renames a new link over the latest link once its output is complete */
+
+		watch->watchDir = strdup(".");
+		watch->watchName = strdup(ROOM_LATEST_LINK);
+		mask = IN_MOVED_TO | IN_CREATE;
+
+	}
+	else if (stat(watch->graphPath, &info) == 0 && S_ISDIR(info.st_mode)) {
+
+		/* room files are written one at a time, so any change inside the directory counts */
+
+		watch->watchDir = strdup(watch->graphPath);
+		watch->watchName = NULL;
+		mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE;
+
+	}
+	else {
+
+		/* a packed file is renamed into place whole, or rewritten by a program that does not */
+
+		watch->watchDir = strdup(watch->graphPath);
+		slash = strrchr(watch->watchDir, '/');
+
+		if (slash == NULL) {
+			free(watch->watchDir);
+			watch->watchDir = strdup(".");
+			watch->watchName = strdup(watch->graphPath);
+		}
+		else {
+			watch->watchName = strdup(slash + 1);
+			slash[slash == watch->watchDir ? 1 : 0] = 0;
+		}
+
+		mask = IN_CLOSE_WRITE | IN_MOVED_TO;
+
+	}
+
+	watch->inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if (watch->inotifyFd < 0 || inotify_add_watch(watch->inotifyFd, watch->watchDir, mask) < 0) {
+		perror(watch->watchDir);
+		return -1;
+	}
+
+	watch->stopFd = eventfd(0, EFD_CLOEXEC);
+
+	if (watch->stopFd < 0) {
+		perror("eventfd");
+		return -1;
+	}
+
+	/* the thread inherits a mask that blocks everything, leaving signals to the threads that wait for them */
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &previous);
+
+	if (pthread_create(&watch->thread, NULL, watchThread, watch) != 0) {
+		pthread_sigmask(SIG_SETMASK, &previous, NULL);
+		fprintf(stderr, "adventure: cannot start the graph watch\n");
+		return -1;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+	watch->watching = 1;
+
+	return 0;
+
+}
+
+
+/* Stop watching and free every snapshot. All games must have released theirs */
+
+void closeGraphWatch(struct GraphWatch* watch) {
+
+	struct GraphSnapshot* snap;
+	uint64_t one = 1;
+
+	if (watch->watching) {
+
+		if (write(watch->stopFd, &one, sizeof(one)) != sizeof(one)) {
+			perror("eventfd");
+		}
+
+		pthread_join(watch->thread, NULL);
+
+		fprintf(stderr, "adventure: %llu GRAPH RELOADS, %llu FAILED\n", watch->reloads, watch->failures);
+
+	}
+
+	if (watch->inotifyFd >= 0) { close(watch->inotifyFd); }
+	if (watch->stopFd >= 0) { close(watch->stopFd); }
+
+	while ((snap = watch->retired) != NULL) {
+		watch->retired = snap->nextRetired;
+		freeSnapshot(snap);
+	}
+
+	if (watch->current != NULL) {
+		freeSnapshot(watch->current);
+	}
+
+	free(watch->readers);
+	free(watch->graphPath);
+	free(watch->watchDir);
+	free(watch->watchName);
+
+	memset(watch, 0, sizeof(*watch));
+
+}
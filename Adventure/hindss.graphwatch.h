@@ -0,0 +1,101 @@
+/***********************************************************************************************************
+ *	Title: Graph Watch
+ *	Description: A room graph that can be replaced while games are being played on it. The graph in
+ *			use is a snapshot: a loaded room store with a name table and a count of the games
+ *			holding it. A game takes the current snapshot when it starts and keeps it until
+ *			it ends, so it is never moved to another graph mid-game.
+ *
+ *			Watching subscribes with inotify to the graph's source: the hindss.rooms.latest
+ *			link when following buildrooms' newest output, or else the packed room file or
+ *			room directory that was named. Once the source has been quiet for a moment, a
+ *			thread of the watch's own loads the new graph and swaps it in with one atomic
+ *			store; loading and freeing never happen on the threads that play.
+ *
+ *			Retiring the old snapshot is RCU style. Each playing thread is a reader that goes
+ *			offline while it waits for events and online while it handles them, and may only
+ *			take the current snapshot while online. A retired snapshot is freed once every
+ *			reader has been offline or seen the swap since it was retired, so none can still
+ *			be about to take it, and no game holds it.
+ * ********************************************************************************************************/
+
+#include <pthread.h>
+#include "hindss.roomstore.h"
+
+#ifndef HINDSS_GRAPHWATCH_H
+#define HINDSS_GRAPHWATCH_H
+
+/* how long the source must be quiet before it is loaded, and how often retired snapshots are checked */
+
+#define GRAPH_WATCH_SETTLE_MS 200
+#define GRAPH_WATCH_RETIRE_MS 100
+
+struct GraphSnapshot {
+
+	struct RoomStore store;
+	char* name;
+	uint64_t generation;
+
+	/* the START_ROOM every game on the graph begins in, found once when the graph is loaded */
+
+	uint32_t start;
+
+	/* games holding the snapshot, plus one while it is current */
+
+	int refs;
+
+	/* the watch's list of retired snapshots, and the generation that replaced this one */
+
+	struct GraphSnapshot* nextRetired;
+	uint64_t retiredBy;
+
+};
+
+/* the last generation a reader saw while online, or GRAPH_READER_OFFLINE. Padded to its own cache line */
+
+#define GRAPH_READER_OFFLINE UINT64_MAX
+
+struct GraphReader {
+
+	uint64_t seen;
+	char pad[56];
+
+};
+
+struct GraphWatch {
+
+	struct GraphSnapshot* current;
+	uint64_t generation;
+
+	struct GraphReader* readers;
+	int numReaders;
+
+	/* the graph's source: the latest link, or a fixed path, and the directory entry inotify reports it by */
+
+	int followLatest;
+	char* graphPath;
+	char* watchDir;
+	char* watchName;
+
+	int inotifyFd;
+	int stopFd;
+	int watching;
+	pthread_t thread;
+
+	/* owned by the watch thread */
+
+	struct GraphSnapshot* retired;
+
+	unsigned long long reloads;
+	unsigned long long failures;
+
+};
+
+int openGraphWatch(struct GraphWatch* , const char* , int, int);
+int startGraphWatch(struct GraphWatch* );
+void closeGraphWatch(struct GraphWatch* );
+void graphReaderOnline(struct GraphWatch* , int);
+void graphReaderOffline(struct GraphWatch* , int);
+struct GraphSnapshot* acquireGraph(struct GraphWatch* );
+void releaseGraph(struct GraphSnapshot* );
+
+#endif
@@ -0,0 +1,373 @@
+/***********************************************************************************************************
+ *	Title: Room Directory Load Benchmark
+ *	Description: Times reading room directories of increasing size with the original serial reader
+ *			and with readRoomTextDir() on increasing numbers of threads, and checks that every
+ *			reader produced the same graph. The directories are written under . as
+ *			hindss.loadbench.<pid>.<files> and removed afterwards. Files are read from the
+ *			page cache, since each directory has just been written.
+ *
+ *			Usage: loadbench [max files]
+ * ********************************************************************************************************/
+
+#define _GNU_SOURCE
+
+#include "hindss.roomfile.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#define MAX_THREAD_COUNTS 5
+
+
+/* growable byte buffer used while reading the text form */
+
+struct ByteBuffer {
+
+	char* bytes;
+	uint64_t size;
+	uint64_t cap;
+
+};
+
+static uint64_t appendBytes(struct ByteBuffer* buffer, const char* bytes, uint64_t len) {
+
+	uint64_t at = buffer->size;
+
+	if (buffer->size + len > buffer->cap) {
+		buffer->cap = (buffer->cap == 0) ? 4096 : buffer->cap;
+		while (buffer->size + len > buffer->cap) { buffer->cap *= 2; }
+		buffer->bytes = realloc(buffer->bytes, buffer->cap);
+	}
+
+	memcpy(buffer->bytes + at, bytes, len);
+	buffer->size += len;
+
+	return at;
+
+}
+
+
+/* room order used to look rooms up by name */
+
+static const struct ByteBuffer* sortNames;
+static const uint32_t* sortOffsets;
+
+static int compareRoomNames(const void* a, const void* b) {
+
+	return strcmp(sortNames->bytes + sortOffsets[*(const uint32_t*) a], sortNames->bytes + sortOffsets[*(const uint32_t*) b]);
+
+}
+
+
+/* The original serial reader: readdir, then fopen, fgets and strstr per file, with connections resolved by a binary
+   search over the rooms sorted by name. Returns 0 on success */
+
+static int legacyReadRoomTextDir(const char* dirPath, struct RoomData* data) {
+
+	DIR* dir;
+	struct dirent* entry;
+	FILE* roomFile;
+	char line[256];
+	char* path = malloc(strlen(dirPath) + 256 + 2);
+	char* value;
+	int failed = 0;
+	uint64_t i, k;
+
+	struct ByteBuffer names = {NULL, 0, 0};
+	struct ByteBuffer neighborNames = {NULL, 0, 0};
+	struct ByteBuffer nameOffsets = {NULL, 0, 0};
+	struct ByteBuffer neighborOffsets = {NULL, 0, 0};
+	struct ByteBuffer adjOffsets = {NULL, 0, 0};
+	struct ByteBuffer types = {NULL, 0, 0};
+
+	uint32_t numRooms = 0;
+	uint32_t offset;
+	uint8_t type;
+
+	memset(data, 0, sizeof(*data));
+
+	dir = opendir(dirPath);
+	if (dir == NULL) {
+		perror(dirPath);
+		free(path);
+		return -1;
+	}
+
+	offset = 0;
+	appendBytes(&adjOffsets, (char*) &offset, sizeof(offset));
+
+	while ((entry = readdir(dir)) != NULL && !failed) {
+
+		if (entry->d_name[0] == '.') { continue; }
+
+		sprintf(path, "%s/%s", dirPath, entry->d_name);
+		roomFile = fopen(path, "r");
+		if (roomFile == NULL) {
+			perror(path);
+			failed = 1;
+			break;
+		}
+
+		type = MID_ROOM;
+		offset = UINT32_MAX;
+
+		/* lines are "ROOM NAME: x", "CONNECTION n: x" and "ROOM TYPE: x" */
+
+		while (fgets(line, sizeof(line), roomFile) != NULL) {
+
+			line[strcspn(line, "\n")] = 0;
+			value = strstr(line, ": ");
+			if (value == NULL) { continue; }
+			value += 2;
+
+			if (strncmp(line, "ROOM NAME", 9) == 0) {
+				offset = (uint32_t) appendBytes(&names, value, strlen(value) + 1);
+			}
+			else if (strncmp(line, "CONNECTION", 10) == 0) {
+				uint32_t at = (uint32_t) appendBytes(&neighborNames, value, strlen(value) + 1);
+				appendBytes(&neighborOffsets, (char*) &at, sizeof(at));
+			}
+			else if (strncmp(line, "ROOM TYPE", 9) == 0) {
+				if (strcmp(value, "START_ROOM") == 0) { type = START_ROOM; }
+				else if (strcmp(value, "END_ROOM") == 0) { type = END_ROOM; }
+			}
+
+		}
+
+		fclose(roomFile);
+
+		/* a file without a ROOM NAME line is named after the file */
+
+		if (offset == UINT32_MAX) {
+			offset = (uint32_t) appendBytes(&names, entry->d_name, strlen(entry->d_name) + 1);
+		}
+
+		appendBytes(&nameOffsets, (char*) &offset, sizeof(offset));
+		appendBytes(&types, (char*) &type, sizeof(type));
+
+		uint32_t end = (uint32_t) (neighborOffsets.size / sizeof(uint32_t));
+		appendBytes(&adjOffsets, (char*) &end, sizeof(end));
+
+		numRooms++;
+
+	}
+
+	closedir(dir);
+	free(path);
+
+	data->numRooms = numRooms;
+	data->numAdjacency = neighborOffsets.size / sizeof(uint32_t);
+	data->strings = names.bytes;
+	data->stringsSize = names.size;
+	data->nameOffsets = (uint32_t*) nameOffsets.bytes;
+	data->adjOffsets = (uint32_t*) adjOffsets.bytes;
+	data->types = (uint8_t*) types.bytes;
+	data->ownsArrays = 1;
+
+	/* resolve neighbor names with a binary search over the rooms sorted by name */
+
+	uint32_t* byName = malloc((numRooms + 1) * sizeof(uint32_t));
+	uint32_t* adjacency = malloc((data->numAdjacency + 1) * sizeof(uint32_t));
+	const uint32_t* neighborAt = (const uint32_t*) neighborOffsets.bytes;
+
+	for (i = 0; i < numRooms; i++) { byName[i] = (uint32_t) i; }
+
+	sortNames = &names;
+	sortOffsets = data->nameOffsets;
+	qsort(byName, numRooms, sizeof(uint32_t), compareRoomNames);
+
+	for (k = 0; k < data->numAdjacency && !failed; k++) {
+
+		const char* want = neighborNames.bytes + neighborAt[k];
+		long low = 0, high = (long) numRooms - 1, found = -1;
+
+		while (low <= high && found < 0) {
+			long mid = (low + high) / 2;
+			int cmp = strcmp(want, names.bytes + data->nameOffsets[byName[mid]]);
+			if (cmp == 0) { found = byName[mid]; }
+			else if (cmp < 0) { high = mid - 1; }
+			else { low = mid + 1; }
+		}
+
+		if (found < 0) {
+			fprintf(stderr, "%s: connection to unknown room %s\n", dirPath, want);
+			failed = 1;
+		}
+		adjacency[k] = (uint32_t) found;
+
+	}
+
+	data->adjacency = adjacency;
+
+	free(byName);
+	free(neighborNames.bytes);
+	free(neighborOffsets.bytes);
+
+	if (failed || numRooms == 0) {
+		if (numRooms == 0) { fprintf(stderr, "%s: no rooms\n", dirPath); }
+		closeRoomData(data);
+		return -1;
+	}
+
+	return 0;
+
+}
+
+
+/* Build a graph of n rooms called Room0 .. Room<n-1> in a ring, each also joined to the room n / 7 + 1 further on */
+
+static void syntheticRooms(uint32_t n, struct RoomData* data) {
+
+	uint32_t i;
+	uint32_t chord = n / 7 + 1;
+	uint32_t stringsSize = 0;
+	char* strings = malloc((size_t) n * 16);
+	uint32_t* nameOffsets = malloc(n * sizeof(uint32_t));
+	uint32_t* adjOffsets = malloc((n + 1) * sizeof(uint32_t));
+	uint32_t* adjacency = malloc((size_t) n * 4 * sizeof(uint32_t));
+	uint8_t* types = calloc(n, 1);
+
+	for (i = 0; i < n; i++) {
+
+		nameOffsets[i] = stringsSize;
+		stringsSize += sprintf(strings + stringsSize, "Room%u", i) + 1;
+
+		adjOffsets[i] = i * 4;
+		adjacency[i * 4] = (i + 1) % n;
+		adjacency[i * 4 + 1] = (i + n - 1) % n;
+		adjacency[i * 4 + 2] = (i + chord) % n;
+		adjacency[i * 4 + 3] = (i + n - chord) % n;
+
+	}
+
+	adjOffsets[n] = n * 4;
+	types[0] = START_ROOM;
+	types[n / 2] = END_ROOM;
+
+	memset(data, 0, sizeof(*data));
+	data->numRooms = n;
+	data->numAdjacency = (uint64_t) n * 4;
+	data->strings = strings;
+	data->stringsSize = stringsSize;
+	data->nameOffsets = nameOffsets;
+	data->adjOffsets = adjOffsets;
+	data->adjacency = adjacency;
+	data->types = types;
+	data->ownsArrays = 1;
+
+}
+
+
+/* Boolean: a and b hold the same rooms with the same types and connections, whatever order they were read in */
+
+static int sameGraph(const struct RoomData* a, const struct RoomData* b) {
+
+	uint32_t i, j, k, n = a->numRooms;
+	uint32_t* bIndex;
+	uint32_t* aToB;
+	int same = (a->numRooms == b->numRooms && a->numAdjacency == b->numAdjacency);
+
+	if (!same) { return 0; }
+
+	/* synthetic names are Room<i>, so a name gives its original index */
+
+	bIndex = malloc(n * sizeof(uint32_t));
+	aToB = malloc(n * sizeof(uint32_t));
+
+	for (i = 0; i < n; i++) { bIndex[strtoul(roomDataName(b, i) + 4, NULL, 10) % n] = i; }
+	for (i = 0; i < n; i++) { aToB[i] = bIndex[strtoul(roomDataName(a, i) + 4, NULL, 10) % n]; }
+
+	for (i = 0; i < n && same; i++) {
+
+		j = aToB[i];
+
+		if (strcmp(roomDataName(a, i), roomDataName(b, j)) != 0 || a->types[i] != b->types[j]
+				|| a->adjOffsets[i + 1] - a->adjOffsets[i] != b->adjOffsets[j + 1] - b->adjOffsets[j]) {
+			same = 0;
+		}
+
+		for (k = 0; same && k < a->adjOffsets[i + 1] - a->adjOffsets[i]; k++) {
+			if (aToB[a->adjacency[a->adjOffsets[i] + k]] != b->adjacency[b->adjOffsets[j] + k]) { same = 0; }
+		}
+
+	}
+
+	free(bIndex);
+	free(aToB);
+
+	return same;
+
+}
+
+
+/* seconds since start */
+
+static double secondsSince(const struct timespec* start) {
+
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+
+}
+
+
+int main(int argc, char** argv) {
+
+	uint32_t sizes[] = {1000, 10000, 100000, 1000000};
+	int numSizes = 4;
+	int threadCounts[MAX_THREAD_COUNTS] = {1, 2, 4, 8, 16};
+	uint32_t maxFiles = (argc > 1) ? (uint32_t) strtoul(argv[1], NULL, 10) : 100000;
+	char dirPath[64];
+	char command[128];
+	struct RoomData source, legacy, loaded;
+	struct timespec start;
+	int i, t, same;
+
+	printf("%10s %14s", "files", "original (s)");
+	for (t = 0; t < MAX_THREAD_COUNTS; t++) { printf(" %9d thr", threadCounts[t]); }
+	printf(" %6s\n", "same");
+
+	for (i = 0; i < numSizes && sizes[i] <= maxFiles; i++) {
+
+		syntheticRooms(sizes[i], &source);
+
+		sprintf(dirPath, "hindss.loadbench.%d.%u", (int) getpid(), sizes[i]);
+		if (writeRoomTextDir(dirPath, &source, 0) != 0) { return 1; }
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (legacyReadRoomTextDir(dirPath, &legacy) != 0) { return 1; }
+		printf("%10u %14.6f", sizes[i], secondsSince(&start));
+
+		same = sameGraph(&source, &legacy);
+
+		for (t = 0; t < MAX_THREAD_COUNTS; t++) {
+
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			if (readRoomTextDir(dirPath, &loaded, threadCounts[t]) != 0) { return 1; }
+			printf(" %13.6f", secondsSince(&start));
+			fflush(stdout);
+
+			same = same && sameGraph(&source, &loaded);
+			closeRoomData(&loaded);
+
+		}
+
+		printf(" %6s\n", same ? "yes" : "NO");
+
+		closeRoomData(&legacy);
+		closeRoomData(&source);
+
+		sprintf(command, "rm -rf %s", dirPath);
+		if (system(command) != 0) { fprintf(stderr, "could not remove %s\n", dirPath); }
+
+	}
+
+	return 0;
+
+}
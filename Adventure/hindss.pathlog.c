@@ -0,0 +1,434 @@
+/***********************************************************************************************************
+ *	Title: Path Log
+ *	Description: Appending to, tracing and reading back path logs (see hindss.pathlog.h). Every room
+ *			is encoded whole into the buffer, so a trace chunk never splits a room and a
+ *			cursor only has to carry a partial room across its own reads of the file. A trace
+ *			that cannot be written ends the program, as a trace with rooms missing from the
+ *			middle would be worse than none.
+ * ********************************************************************************************************/
+
+#define _GNU_SOURCE
+
+#include "hindss.pathlog.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* longest varint of a 33 bit zigzag difference */
+
+#define VARINT_MAX 5
+
+
+/* Start an empty log holding rooms in the given encoding, without a trace */
+
+void initPathLog(struct PathLog* log, int encoding) {
+
+	memset(log, 0, sizeof(*log));
+
+	log->encoding = encoding;
+	log->traceFd = -1;
+
+}
+
+
+/* write len bytes to the trace or end the program */
+
+static void writeTrace(struct PathLog* log, const void* data, size_t len, off_t offset) {
+
+	ssize_t written;
+	size_t done = 0;
+
+	while (done < len) {
+
+		written = pwrite(log->traceFd, (const char*) data + done, len - done, offset + done);
+
+		if (written <= 0) {
+			perror(log->tracePath);
+			exit(1);
+		}
+
+		done += written;
+
+	}
+
+}
+
+
+/* Stream the log to a new trace file at path from now on, opened for reading too so cursors can read it back. Rooms
+   already in the log go to the trace first. Returns 0, or -1 with a message on stderr */
+
+int tracePathLog(struct PathLog* log, const char* path) {
+
+	struct PathTraceHeader header;
+
+	log->traceFd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+	if (log->traceFd < 0) {
+		perror(path);
+		return -1;
+	}
+
+	log->tracePath = strdup(path);
+	log->traceBytes = 0;
+
+	/* from here on the buffer is written out a chunk at a time instead of growing */
+
+	if (log->cap < PATH_TRACE_CHUNK) {
+		log->cap = PATH_TRACE_CHUNK;
+		log->bytes = realloc(log->bytes, log->cap);
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PATH_TRACE_MAGIC, sizeof(header.magic));
+	header.version = PATH_TRACE_VERSION;
+	header.encoding = log->encoding;
+	header.byteOrder = BYTE_ORDER_MARK;
+
+	writeTrace(log, &header, sizeof(header), 0);
+
+	return 0;
+
+}
+
+
+/* write the buffered rooms to the trace and empty the buffer */
+
+static void flushPathLog(struct PathLog* log) {
+
+	writeTrace(log, log->bytes, log->len, sizeof(struct PathTraceHeader) + log->traceBytes);
+
+	log->traceBytes += log->len;
+	log->len = 0;
+
+}
+
+
+/* Append room to the log */
+
+void appendPathLog(struct PathLog* log, uint32_t room) {
+
+	uint64_t zigzag;
+	int64_t delta;
+	uint8_t* out;
+
+	if (log->len + VARINT_MAX > log->cap) {
+
+		if (log->traceFd >= 0 && log->len > 0) {
+			flushPathLog(log);
+		}
+		else {
+			log->cap = log->cap ? log->cap * 2 : 64;
+			log->bytes = realloc(log->bytes, log->cap);
+		}
+
+	}
+
+	out = log->bytes + log->len;
+
+	if (log->encoding == PATH_LOG_PLAIN) {
+
+		memcpy(out, &room, sizeof(room));
+		log->len += sizeof(room);
+
+	}
+	else {
+
+		delta = (int64_t) room - (int64_t) log->last;
+		zigzag = ((uint64_t) delta << 1) ^ (uint64_t) (delta >> 63);
+
+		while (zigzag >= 0x80) {
+			*out++ = (uint8_t) zigzag | 0x80;
+			zigzag >>= 7;
+		}
+
+		*out++ = (uint8_t) zigzag;
+		log->len = out - log->bytes;
+
+	}
+
+	log->last = room;
+	log->numRooms++;
+
+}
+
+
+/* Empty a log that is not tracing, keeping its buffer */
+
+void clearPathLog(struct PathLog* log) {
+
+	log->len = 0;
+	log->numRooms = 0;
+	log->last = 0;
+
+}
+
+
+/* Copy the log's encoded rooms, those traced and then those buffered, to out, which must hold pathLogEncodedSize()
+   bytes. Returns 0, or -1 with a message on stderr if the trace cannot be read back */
+
+int copyPathLogBytes(const struct PathLog* log, uint8_t* out) {
+
+	ssize_t got;
+	uint64_t done = 0;
+
+	while (done < log->traceBytes) {
+
+		got = pread(log->traceFd, out + done, log->traceBytes - done, sizeof(struct PathTraceHeader) + done);
+
+		if (got <= 0) {
+			perror(log->tracePath);
+			return -1;
+		}
+
+		done += got;
+
+	}
+
+	memcpy(out + log->traceBytes, log->bytes, log->len);
+
+	return 0;
+
+}
+
+
+/* Replace the rooms of a log that is not tracing with numRooms rooms already encoded in its encoding as len bytes, the
+   last of them last */
+
+void loadPathLog(struct PathLog* log, const uint8_t* bytes, size_t len, uint64_t numRooms, uint32_t last) {
+
+	if (len + VARINT_MAX > log->cap) {
+		log->cap = len + VARINT_MAX > 64 ? len + VARINT_MAX : 64;
+		log->bytes = realloc(log->bytes, log->cap);
+	}
+
+	memcpy(log->bytes, bytes, len);
+
+	log->len = len;
+	log->numRooms = numRooms;
+	log->last = last;
+
+}
+
+
+/* Finish the trace, if there is one, and release the log. Returns 0, or -1 with a message on stderr if the trace could
+   not be completed */
+
+int closePathLog(struct PathLog* log) {
+
+	struct PathTraceHeader header;
+	int result = 0;
+
+	if (log->traceFd >= 0) {
+
+		flushPathLog(log);
+
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, PATH_TRACE_MAGIC, sizeof(header.magic));
+		header.version = PATH_TRACE_VERSION;
+		header.encoding = log->encoding;
+		header.byteOrder = BYTE_ORDER_MARK;
+		header.numRooms = log->numRooms;
+
+		writeTrace(log, &header, sizeof(header), 0);
+
+		if (close(log->traceFd) != 0) {
+			perror(log->tracePath);
+			result = -1;
+		}
+
+	}
+
+	free(log->bytes);
+	free(log->tracePath);
+
+	initPathLog(log, log->encoding);
+
+	return result;
+
+}
+
+
+/* Read a log's rooms from the start: what it has traced, then its buffer */
+
+void openPathLogCursor(const struct PathLog* log, struct PathLogCursor* cursor) {
+
+	cursor->encoding = log->encoding;
+	cursor->last = 0;
+
+	cursor->fd = log->traceFd;
+	cursor->ownsFd = 0;
+	cursor->fileOffset = sizeof(struct PathTraceHeader);
+	cursor->fileLeft = (log->traceFd >= 0) ? log->traceBytes : 0;
+
+	cursor->tail = log->bytes;
+	cursor->tailLen = log->len;
+
+	cursor->pos = 0;
+	cursor->len = 0;
+	cursor->inTail = 0;
+
+}
+
+
+/* Read the trace file at path, storing the room count its header gives in numRooms (0 if it was never closed).
+   Returns 0, or -1 with a message on stderr */
+
+int openPathTrace(const char* path, struct PathLogCursor* cursor, uint64_t* numRooms) {
+
+	struct PathTraceHeader header;
+	off_t size;
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+
+	size = lseek(fd, 0, SEEK_END);
+
+	if (size < (off_t) sizeof(header) || pread(fd, &header, sizeof(header), 0) != (ssize_t) sizeof(header)
+			|| memcmp(header.magic, PATH_TRACE_MAGIC, sizeof(header.magic)) != 0) {
+		fprintf(stderr, "%s: not a path trace\n", path);
+		close(fd);
+		return -1;
+	}
+
+	if (header.byteOrder != BYTE_ORDER_MARK || header.version != PATH_TRACE_VERSION
+			|| header.encoding > PATH_LOG_COMPACT) {
+		fprintf(stderr, otherByteOrder(header.byteOrder)
+				? "%s: path trace is of the other byte order\n" : "%s: not a path trace\n", path);
+		close(fd);
+		return -1;
+	}
+
+	cursor->encoding = header.encoding;
+	cursor->last = 0;
+
+	cursor->fd = fd;
+	cursor->ownsFd = 1;
+	cursor->fileOffset = sizeof(header);
+	cursor->fileLeft = size - sizeof(header);
+
+	cursor->tail = NULL;
+	cursor->tailLen = 0;
+
+	cursor->pos = 0;
+	cursor->len = 0;
+	cursor->inTail = 0;
+
+	*numRooms = header.numRooms;
+
+	return 0;
+
+}
+
+
+/* Returns 1 if the file at path starts like a path trace */
+
+int isPathTrace(const char* path) {
+
+	char magic[sizeof(((struct PathTraceHeader*) 0)->magic)];
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	int result;
+
+	if (fd < 0) { return 0; }
+
+	result = (read(fd, magic, sizeof(magic)) == (ssize_t) sizeof(magic) && memcmp(magic, PATH_TRACE_MAGIC, sizeof(magic)) == 0);
+
+	close(fd);
+
+	return result;
+
+}
+
+
+/* Store the next room in room. Returns 1, or 0 at the end of the log, or -1 if a trace is cut off or unreadable */
+
+int nextPathRoom(struct PathLogCursor* cursor, uint32_t* room) {
+
+	const uint8_t* data;
+	uint64_t zigzag = 0;
+	ssize_t got;
+	size_t avail, want, i;
+	int shift = 0;
+
+	/* keep at least a whole room in the buffer while the file lasts */
+
+	if (!cursor->inTail && cursor->len - cursor->pos < VARINT_MAX && cursor->fileLeft > 0) {
+
+		memmove(cursor->buf, cursor->buf + cursor->pos, cursor->len - cursor->pos);
+		cursor->len -= cursor->pos;
+		cursor->pos = 0;
+
+		want = sizeof(cursor->buf) - cursor->len;
+		if (want > cursor->fileLeft) { want = cursor->fileLeft; }
+
+		got = pread(cursor->fd, cursor->buf + cursor->len, want, cursor->fileOffset);
+		if (got <= 0) { return -1; }
+
+		cursor->len += got;
+		cursor->fileOffset += got;
+		cursor->fileLeft -= got;
+
+	}
+
+	if (!cursor->inTail && cursor->pos == cursor->len && cursor->fileLeft == 0) {
+		cursor->inTail = 1;
+		cursor->pos = 0;
+	}
+
+	data = cursor->inTail ? cursor->tail : cursor->buf;
+	avail = (cursor->inTail ? cursor->tailLen : cursor->len) - cursor->pos;
+
+	if (avail == 0) { return 0; }
+
+	data += cursor->pos;
+
+	if (cursor->encoding == PATH_LOG_PLAIN) {
+
+		if (avail < sizeof(*room)) { return -1; }
+
+		memcpy(room, data, sizeof(*room));
+		cursor->pos += sizeof(*room);
+
+		return 1;
+
+	}
+
+	for (i = 0; ; i++) {
+
+		if (i == avail || i == VARINT_MAX) { return -1; }
+
+		zigzag |= (uint64_t) (data[i] & 0x7f) << shift;
+		shift += 7;
+
+		if (!(data[i] & 0x80)) { break; }
+
+	}
+
+	cursor->pos += i + 1;
+	cursor->last = (uint32_t) ((int64_t) cursor->last + (int64_t) ((zigzag >> 1) ^ -(zigzag & 1)));
+
+	*room = cursor->last;
+
+	return 1;
+
+}
+
+
+/* release a cursor, closing a trace file it opened */
+
+void closePathLogCursor(struct PathLogCursor* cursor) {
+
+	if (cursor->ownsFd) {
+		close(cursor->fd);
+	}
+
+	cursor->fd = -1;
+	cursor->ownsFd = 0;
+
+}
@@ -0,0 +1,109 @@
+/***********************************************************************************************************
+ *	Title: Path Log
+ *	Description: The rooms a player has stood in, in order, as one growable buffer rather than a node
+ *			per step. A plain log holds 32 bit room indices; a compact log holds each room as
+ *			the zigzag varint of its difference from the room before, which on long walks
+ *			through nearby rooms takes one or two bytes a step.
+ *
+ *			A log can also stream to a binary trace file, so that a long run need not be
+ *			kept in memory: the buffer is written out whenever it fills and only the part
+ *			not yet written is held. A trace is a struct PathTraceHeader followed by the log's
+ *			bytes, and can be read back with a cursor after the run, or by another program.
+ * ********************************************************************************************************/
+
+#include "hindss.byteorder.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef HINDSS_PATHLOG_H
+#define HINDSS_PATHLOG_H
+
+#define PATH_LOG_PLAIN 0
+#define PATH_LOG_COMPACT 1
+
+#define PATH_TRACE_MAGIC "HSTRACE1"
+#define PATH_TRACE_VERSION 1
+
+/* buffered bytes a tracing log writes at a time */
+
+#define PATH_TRACE_CHUNK 65536
+
+/* fields, and the 32 bit rooms of a plain log, are in the byte order of the machine that wrote the trace, which
+   byteOrder records. numRooms is written when the trace is closed, and is 0 in a trace that was not */
+
+struct PathTraceHeader {
+
+	char magic[8];
+	uint32_t version;
+	uint32_t encoding;
+	uint64_t byteOrder;
+	uint64_t numRooms;
+
+};
+
+struct PathLog {
+
+	int encoding;
+	uint64_t numRooms;
+
+	/* encoded rooms not yet written to the trace, which is all of them without one */
+
+	uint8_t* bytes;
+	size_t len;
+	size_t cap;
+
+	/* the last room appended, which the next compact room is relative to */
+
+	uint32_t last;
+
+	/* trace file, -1 if there is none, and the bytes written to it after the header */
+
+	int traceFd;
+	char* tracePath;
+	uint64_t traceBytes;
+
+};
+
+/* reads a log's rooms in order, from its trace and then its buffer, or from a trace file on its own */
+
+struct PathLogCursor {
+
+	int encoding;
+	uint32_t last;
+
+	int fd;
+	int ownsFd;
+	uint64_t fileOffset;
+	uint64_t fileLeft;
+
+	const uint8_t* tail;
+	size_t tailLen;
+
+	uint8_t buf[PATH_TRACE_CHUNK];
+	size_t pos;
+	size_t len;
+	int inTail;
+
+};
+
+#define pathLogSize(log) ((log)->numRooms)
+
+/* bytes the log's rooms take encoded, traced or not */
+
+#define pathLogEncodedSize(log) ((log)->traceBytes + (log)->len)
+
+void initPathLog(struct PathLog* , int);
+int tracePathLog(struct PathLog* , const char* );
+void appendPathLog(struct PathLog* , uint32_t);
+void clearPathLog(struct PathLog* );
+int copyPathLogBytes(const struct PathLog* , uint8_t* );
+void loadPathLog(struct PathLog* , const uint8_t* , size_t, uint64_t, uint32_t);
+int closePathLog(struct PathLog* );
+void openPathLogCursor(const struct PathLog* , struct PathLogCursor* );
+int openPathTrace(const char* , struct PathLogCursor* , uint64_t* );
+int isPathTrace(const char* );
+int nextPathRoom(struct PathLogCursor* , uint32_t* );
+void closePathLogCursor(struct PathLogCursor* );
+
+#endif
@@ -0,0 +1,363 @@
+/***********************************************************************************************************
+ *	Title: Move Scripts
+ *	Description: Reading, generating and writing move scripts (see hindss.replay.h). A script is held
+ *			as one buffer of names and an array of offsets into it, so replaying it touches
+ *			no allocator.
+ * ********************************************************************************************************/
+
+#include "hindss.replay.h"
+#include "hindss.pathlog.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+
+/* start an empty script */
+
+static void initMoveScript(struct MoveScript* script) {
+
+	memset(script, 0, sizeof(*script));
+
+}
+
+
+/* append a move named name, len bytes long, to the script's last sequence */
+
+static void addMove(struct MoveScript* script, const char* name, size_t len) {
+
+	if (script->textSize + len + 1 > script->textCap) {
+		script->textCap = (script->textCap ? script->textCap * 2 : 4096) + len + 1;
+		script->text = realloc(script->text, script->textCap);
+	}
+
+	if (script->numMoves == script->movesCap) {
+		script->movesCap = script->movesCap ? script->movesCap * 2 : 1024;
+		script->moves = realloc(script->moves, script->movesCap * sizeof(uint64_t));
+	}
+
+	memcpy(script->text + script->textSize, name, len);
+	script->text[script->textSize + len] = 0;
+
+	script->moves[script->numMoves++] = script->textSize;
+	script->textSize += len + 1;
+
+	script->sequences[script->numSequences - 1].numMoves++;
+
+}
+
+
+/* start a new sequence with the next move */
+
+static void addSequence(struct MoveScript* script, uint64_t line) {
+
+	struct MoveSequence* sequence;
+
+	if (script->numSequences == script->sequencesCap) {
+		script->sequencesCap = script->sequencesCap ? script->sequencesCap * 2 : 64;
+		script->sequences = realloc(script->sequences, script->sequencesCap * sizeof(struct MoveSequence));
+	}
+
+	sequence = &script->sequences[script->numSequences++];
+
+	sequence->firstMove = script->numMoves;
+	sequence->numMoves = 0;
+	sequence->expectedSteps = STEPS_UNCHECKED;
+	sequence->line = line;
+
+}
+
+
+/* Read the script at path. Returns 0, or -1 with a message on stderr */
+
+int readMoveScript(const char* path, struct MoveScript* script) {
+
+	FILE* inFile = fopen(path, "r");
+
+	char* line = NULL;
+	size_t lineCap = 0;
+	ssize_t len;
+	uint64_t lineNum = 0;
+	char* end;
+	int open = 0;
+
+	initMoveScript(script);
+
+	if (inFile == NULL) {
+		perror(path);
+		return -1;
+	}
+
+	while ((len = getline(&line, &lineCap, inFile)) != -1) {
+
+		lineNum++;
+
+		/* trim newlines */
+
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) { line[--len] = 0; }
+
+		if (line[0] == '#') { continue; }
+
+		/* a blank line ends a sequence without a step count */
+
+		if (len == 0) {
+			open = 0;
+			continue;
+		}
+
+		if (line[0] == '=') {
+
+			if (!open) {
+				addSequence(script, lineNum);
+			}
+
+			script->sequences[script->numSequences - 1].expectedSteps = strtoull(line + 1, &end, 10);
+
+			if (end == line + 1 || *end != 0) {
+				fprintf(stderr, "%s:%llu: bad step count \"%s\"\n", path, (unsigned long long) lineNum, line);
+				free(line);
+				fclose(inFile);
+				freeMoveScript(script);
+				return -1;
+			}
+
+			open = 0;
+			continue;
+
+		}
+
+		if (!open) {
+			addSequence(script, lineNum);
+			open = 1;
+		}
+
+		addMove(script, line, len);
+
+	}
+
+	free(line);
+	fclose(inFile);
+
+	return 0;
+
+}
+
+
+/* Read the path trace at path as a script of one sequence, typing the name of each room after the first, which takes
+   as many steps as there are moves. Returns 0, or -1 with a message on stderr */
+
+int readTraceScript(const char* path, const struct RoomStore* store, struct MoveScript* script) {
+
+	struct PathLogCursor* cursor = malloc(sizeof(struct PathLogCursor));
+	const char* name;
+	uint64_t numRooms, count = 0;
+	uint32_t room;
+	int result;
+
+	initMoveScript(script);
+
+	if (openPathTrace(path, cursor, &numRooms) != 0) {
+		free(cursor);
+		return -1;
+	}
+
+	addSequence(script, 0);
+
+	while ((result = nextPathRoom(cursor, &room)) == 1) {
+
+		if (room >= storeNumRooms(store)) {
+			result = -1;
+			break;
+		}
+
+		if (count++ > 0) {
+			name = storeName(store, room);
+			addMove(script, name, strlen(name));
+		}
+
+	}
+
+	closePathLogCursor(cursor);
+	free(cursor);
+
+	/* a trace that was closed says how many rooms it holds */
+
+	if (result != 0 || count == 0 || (numRooms != 0 && numRooms != count)) {
+		fprintf(stderr, "%s: path trace is damaged or does not fit the room graph\n", path);
+		freeMoveScript(script);
+		return -1;
+	}
+
+	script->sequences[0].expectedSteps = count - 1;
+
+	return 0;
+
+}
+
+
+/* the n-th number of a seed's random stream */
+
+static unsigned long long walkRandom(unsigned long long seed, unsigned long long n) {
+
+	unsigned long long x = seed + n * 0x9e3779b97f4a7c15ULL;
+
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+
+	return x ^ (x >> 31);
+
+}
+
+
+/* Add count random walks from START_ROOM to END_ROOM to script. Each step goes to a neighbor one room nearer END_ROOM
+   with probability bias and to any neighbor otherwise, so every walk ends, and its length is recorded as its step
+   count. Distances come from one breadth first search out of END_ROOM. Returns 0, or -1 with a message on stderr if
+   END_ROOM cannot be reached */
+
+int generateRandomWalks(const struct RoomStore* store, uint64_t count, double bias, unsigned long long seed,
+		struct MoveScript* script) {
+
+	uint32_t n = storeNumRooms(store);
+	uint32_t start = findRoomByType(store, START_ROOM);
+	uint32_t end = findRoomByType(store, END_ROOM);
+	uint32_t* dist;
+	uint32_t* queue;
+	const uint32_t* neighbors;
+	const char* name;
+	uint32_t degree, u, next, k, nearer;
+	uint64_t head, tail, walk, steps;
+	unsigned long long draw = 0;
+	uint64_t threshold = (bias >= 1) ? UINT64_MAX : (bias <= 0) ? 0 : (uint64_t) (bias * 18446744073709551616.0);
+
+	initMoveScript(script);
+
+	if (start == ROOM_NONE || end == ROOM_NONE) {
+		fprintf(stderr, "adventure: the room graph has no START_ROOM or no END_ROOM\n");
+		return -1;
+	}
+
+	/* distance of every room from END_ROOM */
+
+	dist = malloc((size_t) n * sizeof(uint32_t));
+	queue = malloc((size_t) n * sizeof(uint32_t));
+
+	memset(dist, 0xff, (size_t) n * sizeof(uint32_t));
+
+	dist[end] = 0;
+	queue[0] = end;
+
+	for (head = 0, tail = 1; head < tail; head++) {
+
+		u = queue[head];
+		neighbors = storeNeighbors(store, u, &degree);
+
+		for (k = 0; k < degree; k++) {
+			if (dist[neighbors[k]] == UINT32_MAX) {
+				dist[neighbors[k]] = dist[u] + 1;
+				queue[tail++] = neighbors[k];
+			}
+		}
+
+	}
+
+	free(queue);
+
+	if (dist[start] == UINT32_MAX) {
+		fprintf(stderr, "adventure: END_ROOM cannot be reached from START_ROOM\n");
+		free(dist);
+		return -1;
+	}
+
+	for (walk = 0; walk < count; walk++) {
+
+		addSequence(script, 0);
+
+		for (u = start, steps = 0; u != end; u = next, steps++) {
+
+			neighbors = storeNeighbors(store, u, &degree);
+
+			if (walkRandom(seed, draw++) < threshold) {
+
+				/* a uniformly chosen neighbor nearer END_ROOM, of which there is at least one */
+
+				for (k = 0, nearer = 0, next = u; k < degree; k++) {
+					if (dist[neighbors[k]] + 1 == dist[u]) {
+						nearer++;
+						if (walkRandom(seed, draw++) % nearer == 0) { next = neighbors[k]; }
+					}
+				}
+
+			}
+			else {
+
+				next = neighbors[walkRandom(seed, draw++) % degree];
+
+			}
+
+			name = storeName(store, next);
+			addMove(script, name, strlen(name));
+
+		}
+
+		script->sequences[script->numSequences - 1].expectedSteps = steps;
+
+	}
+
+	free(dist);
+
+	return 0;
+
+}
+
+
+/* Write script to path in the format readMoveScript() reads. Returns 0, or -1 with a message on stderr */
+
+int writeMoveScript(const char* path, const struct MoveScript* script) {
+
+	FILE* outFile = fopen(path, "w");
+	const struct MoveSequence* sequence;
+	uint64_t i, k;
+
+	if (outFile == NULL) {
+		perror(path);
+		return -1;
+	}
+
+	for (i = 0; i < script->numSequences; i++) {
+
+		sequence = &script->sequences[i];
+
+		for (k = 0; k < sequence->numMoves; k++) {
+			fprintf(outFile, "%s\n", scriptMove(script, sequence->firstMove + k));
+		}
+
+		if (sequence->expectedSteps != STEPS_UNCHECKED) {
+			fprintf(outFile, "= %llu\n", (unsigned long long) sequence->expectedSteps);
+		}
+		else {
+			fprintf(outFile, "\n");
+		}
+
+	}
+
+	if (fclose(outFile) != 0) {
+		perror(path);
+		return -1;
+	}
+
+	return 0;
+
+}
+
+
+/* release a script */
+
+void freeMoveScript(struct MoveScript* script) {
+
+	free(script->text);
+	free(script->moves);
+	free(script->sequences);
+
+	initMoveScript(script);
+
+}
@@ -0,0 +1,63 @@
+/***********************************************************************************************************
+ *	Title: Move Scripts
+ *	Description: Sequences of moves for playing the adventure engine without a player. A script is a
+ *			text file with one typed room name per line. A sequence of moves ends at a line
+ *			"= STEPS", giving the number of moves that should succeed before END_ROOM is
+ *			entered, or at a blank line or the end of the file, which leave the count
+ *			unchecked. Lines starting with # are comments.
+ *
+ *			A path trace (see hindss.pathlog.h) is read as a script of one sequence that
+ *			enters each room of the trace after the first.
+ *
+ *			Scripts can also be generated as random walks from START_ROOM to END_ROOM, which
+ *			are written with their step counts so they can be replayed later.
+ * ********************************************************************************************************/
+
+#include "hindss.roomstore.h"
+
+#ifndef HINDSS_REPLAY_H
+#define HINDSS_REPLAY_H
+
+#define STEPS_UNCHECKED UINT64_MAX
+
+/* one sequence: moves firstMove .. firstMove + numMoves of its script, played from START_ROOM */
+
+struct MoveSequence {
+
+	uint64_t firstMove;
+	uint64_t numMoves;
+	uint64_t expectedSteps;
+
+	/* line of the script the sequence starts on, 0 for generated sequences */
+
+	uint64_t line;
+
+};
+
+struct MoveScript {
+
+	/* typed names back to back, each NUL terminated, and the offset of each move's name */
+
+	char* text;
+	uint64_t textSize;
+	uint64_t textCap;
+
+	uint64_t* moves;
+	uint64_t numMoves;
+	uint64_t movesCap;
+
+	struct MoveSequence* sequences;
+	uint64_t numSequences;
+	uint64_t sequencesCap;
+
+};
+
+#define scriptMove(script, i) ((script)->text + (script)->moves[i])
+
+int readMoveScript(const char* , struct MoveScript* );
+int readTraceScript(const char* , const struct RoomStore* , struct MoveScript* );
+int generateRandomWalks(const struct RoomStore* , uint64_t, double, unsigned long long, struct MoveScript* );
+int writeMoveScript(const char* , const struct MoveScript* );
+void freeMoveScript(struct MoveScript* );
+
+#endif
@@ -0,0 +1,378 @@
+/***********************************************************************************************************
+ *	Title: Room Cache
+ *	Description: A bounded least recently used cache of rooms read on demand from a packed room
+ *			file. A miss costs a handful of small preads: the room's two adjOffsets entries,
+ *			its name offset, its type, its neighbor list and its name. Every value read is
+ *			checked against the header, and a bad room or failed read ends the program, since
+ *			the game cannot go on without the room it asked for.
+ * ********************************************************************************************************/
+
+#define _GNU_SOURCE
+
+#include "hindss.roomcache.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define NO_SLOT UINT32_MAX
+#define NAME_CHUNK 64
+
+
+/* Open the packed room file at path for lazy reading with room for capacity decoded rooms (at least 2). Returns 0 on
+   success, -1 with a message on stderr on failure */
+
+int openRoomCache(const char* path, uint32_t capacity, struct RoomCache* cache) {
+
+	struct stat info;
+	uint32_t buckets = 16;
+	uint32_t i;
+
+	memset(cache, 0, sizeof(*cache));
+
+	cache->fd = open(path, O_RDONLY);
+	if (cache->fd < 0) {
+		perror(path);
+		return -1;
+	}
+
+	if (fstat(cache->fd, &info) != 0
+			|| pread(cache->fd, &cache->header, sizeof(cache->header), 0) != (ssize_t) sizeof(cache->header)
+			|| !roomFileHeaderValid(&cache->header, info.st_size)) {
+		fprintf(stderr, roomFileByteSwapped(&cache->header) ? "%s: packed room file is of the other byte order\n"
+				: "%s: bad packed room file header\n", path);
+		close(cache->fd);
+		return -1;
+	}
+
+	/* rooms are read in no particular order */
+
+	posix_fadvise(cache->fd, 0, 0, POSIX_FADV_RANDOM);
+
+	if (capacity < 2) { capacity = 2; }
+	while (buckets < capacity * 2) { buckets *= 2; }
+
+	cache->path = strdup(path);
+	cache->capacity = capacity;
+	cache->slots = calloc(capacity, sizeof(struct CachedRoom));
+	cache->buckets = malloc(buckets * sizeof(uint32_t));
+	cache->bucketMask = buckets - 1;
+	cache->head = NO_SLOT;
+	cache->tail = NO_SLOT;
+
+	for (i = 0; i < buckets; i++) {
+		cache->buckets[i] = NO_SLOT;
+	}
+
+	return 0;
+
+}
+
+
+/* pread exactly len bytes at offset or end the program */
+
+static void readExactly(struct RoomCache* cache, void* buf, size_t len, uint64_t offset) {
+
+	ssize_t got;
+	size_t done = 0;
+
+	while (done < len) {
+
+		got = pread(cache->fd, (char*) buf + done, len - done, offset + done);
+
+		if (got <= 0) {
+			fprintf(stderr, "%s: cannot read room data\n", cache->path);
+			exit(1);
+		}
+
+		done += got;
+
+	}
+
+}
+
+
+/* report a room that does not fit the header and end the program */
+
+static void badRoom(struct RoomCache* cache, uint32_t index) {
+
+	fprintf(stderr, "%s: corrupt packed room file at room %u\n", cache->path, index);
+	exit(1);
+
+}
+
+
+/* unlink slot s from the recently used list */
+
+static void unlinkSlot(struct RoomCache* cache, uint32_t s) {
+
+	struct CachedRoom* room = &cache->slots[s];
+
+	if (room->prev != NO_SLOT) { cache->slots[room->prev].next = room->next; } else { cache->head = room->next; }
+	if (room->next != NO_SLOT) { cache->slots[room->next].prev = room->prev; } else { cache->tail = room->prev; }
+
+}
+
+
+/* put slot s at the most recently used end of the list */
+
+static void pushFront(struct RoomCache* cache, uint32_t s) {
+
+	struct CachedRoom* room = &cache->slots[s];
+
+	room->prev = NO_SLOT;
+	room->next = cache->head;
+
+	if (cache->head != NO_SLOT) { cache->slots[cache->head].prev = s; } else { cache->tail = s; }
+
+	cache->head = s;
+
+}
+
+
+/* slot holding room index, or NO_SLOT */
+
+static uint32_t findSlot(struct RoomCache* cache, uint32_t index) {
+
+	uint32_t s = cache->buckets[index & cache->bucketMask];
+
+	while (s != NO_SLOT && cache->slots[s].index != index) {
+		s = cache->slots[s].hashNext;
+	}
+
+	return s;
+
+}
+
+
+/* take slot s out of its hash chain */
+
+static void unhashSlot(struct RoomCache* cache, uint32_t s) {
+
+	uint32_t* link = &cache->buckets[cache->slots[s].index & cache->bucketMask];
+
+	while (*link != s) {
+		link = &cache->slots[*link].hashNext;
+	}
+
+	*link = cache->slots[s].hashNext;
+
+}
+
+
+/* read room index from the file into slot s */
+
+static void decodeRoom(struct RoomCache* cache, uint32_t s, uint32_t index) {
+
+	struct CachedRoom* room = &cache->slots[s];
+	const struct RoomFileHeader* header = &cache->header;
+	uint32_t adjRange[2];
+	uint32_t nameOffset;
+	uint32_t i, len, chunk;
+
+	readExactly(cache, adjRange, sizeof(adjRange), header->adjOffsetsOffset + (uint64_t) index * sizeof(uint32_t));
+	readExactly(cache, &nameOffset, sizeof(nameOffset), header->nameOffsetsOffset + (uint64_t) index * sizeof(uint32_t));
+	readExactly(cache, &room->type, 1, header->typesOffset + index);
+
+	if (adjRange[0] > adjRange[1] || adjRange[1] > header->numAdjacency || nameOffset >= header->stringsSize
+			|| room->type > END_ROOM) {
+		badRoom(cache, index);
+	}
+
+	/* neighbor list */
+
+	room->index = index;
+	room->degree = adjRange[1] - adjRange[0];
+
+	if (room->degree > room->neighborCap) {
+		room->neighborCap = room->degree;
+		room->neighbors = realloc(room->neighbors, room->neighborCap * sizeof(uint32_t));
+	}
+
+	readExactly(cache, room->neighbors, room->degree * sizeof(uint32_t),
+		header->adjacencyOffset + (uint64_t) adjRange[0] * sizeof(uint32_t));
+
+	for (i = 0; i < room->degree; i++) {
+		if (room->neighbors[i] >= header->numRooms) { badRoom(cache, index); }
+	}
+
+	/* name, read a chunk at a time up to its NUL. The strings section ends in a NUL, checked here as it is reached */
+
+	len = 0;
+
+	while (1) {
+
+		chunk = NAME_CHUNK;
+		if (chunk > header->stringsSize - nameOffset - len) { chunk = header->stringsSize - nameOffset - len; }
+
+		if (len + chunk + 1 > room->nameCap) {
+			room->nameCap = len + chunk + 1;
+			room->name = realloc(room->name, room->nameCap);
+		}
+
+		readExactly(cache, room->name + len, chunk, header->stringsOffset + nameOffset + len);
+		room->name[len + chunk] = 0;
+
+		if (memchr(room->name + len, 0, chunk) != NULL) { break; }
+
+		len += chunk;
+
+		if (nameOffset + len >= header->stringsSize) { badRoom(cache, index); }
+
+	}
+
+}
+
+
+/* Return room index, reading it into the least recently used slot if it is not cached. The room is valid until more
+   rooms than the cache holds are fetched after it */
+
+static struct CachedRoom* loadRoom(struct RoomCache* cache, uint32_t index, int ahead) {
+
+	uint32_t s;
+	uint32_t* bucket;
+
+	if (index >= cache->header.numRooms) { badRoom(cache, index); }
+
+	s = findSlot(cache, index);
+
+	if (s != NO_SLOT) {
+
+		if (!ahead) { cache->hits++; }
+
+		if (cache->head != s) {
+			unlinkSlot(cache, s);
+			pushFront(cache, s);
+		}
+
+		return &cache->slots[s];
+
+	}
+
+	if (ahead) { cache->readahead++; } else { cache->misses++; }
+
+	/* a free slot, or the least recently used one */
+
+	if (cache->used < cache->capacity) {
+		s = cache->used++;
+	}
+	else {
+		s = cache->tail;
+		unlinkSlot(cache, s);
+		unhashSlot(cache, s);
+	}
+
+	decodeRoom(cache, s, index);
+
+	bucket = &cache->buckets[index & cache->bucketMask];
+	cache->slots[s].hashNext = *bucket;
+	*bucket = s;
+
+	pushFront(cache, s);
+
+	return &cache->slots[s];
+
+}
+
+
+/* return room index, from the cache when it is there */
+
+struct CachedRoom* fetchRoom(struct RoomCache* cache, uint32_t index) {
+
+	return loadRoom(cache, index, 0);
+
+}
+
+
+/* Read every neighbor of room index into the cache, so that listing them and moving to one of them are hits. The
+   room itself is fetched again last so that it stays the most recently used */
+
+void readAheadNeighbors(struct RoomCache* cache, uint32_t index) {
+
+	struct CachedRoom* room = loadRoom(cache, index, 1);
+	uint32_t degree = room->degree;
+	uint32_t k;
+
+	uint32_t* neighbors = malloc(degree * sizeof(uint32_t) + 1);
+	memcpy(neighbors, room->neighbors, degree * sizeof(uint32_t));
+
+	for (k = 0; k < degree; k++) {
+		loadRoom(cache, neighbors[k], 1);
+	}
+
+	loadRoom(cache, index, 1);
+
+	free(neighbors);
+
+}
+
+
+/* pread exactly len bytes at offset in the file, bypassing the slots, or end the program. For reading whole sections
+   in large pieces */
+
+void readRoomFileBytes(struct RoomCache* cache, void* buf, size_t len, uint64_t offset) {
+
+	readExactly(cache, buf, len, offset);
+
+}
+
+
+/* Return the first room of the given type, or UINT32_MAX, streaming the types section through a small buffer */
+
+uint32_t scanRoomTypes(struct RoomCache* cache, int type) {
+
+	uint8_t buf[65536];
+	uint32_t first, count, i;
+
+	for (first = 0; first < cache->header.numRooms; first += count) {
+
+		count = cache->header.numRooms - first;
+		if (count > sizeof(buf)) { count = sizeof(buf); }
+
+		readExactly(cache, buf, count, cache->header.typesOffset + first);
+
+		for (i = 0; i < count; i++) {
+			if (buf[i] == type) { return first + i; }
+		}
+
+	}
+
+	return UINT32_MAX;
+
+}
+
+
+/* fraction of fetches found in the cache */
+
+double roomCacheHitRate(const struct RoomCache* cache) {
+
+	unsigned long long total = cache->hits + cache->misses;
+
+	return total ? (double) cache->hits / total : 0;
+
+}
+
+
+/* release a room cache */
+
+void closeRoomCache(struct RoomCache* cache) {
+
+	uint32_t s;
+
+	for (s = 0; s < cache->used; s++) {
+		free(cache->slots[s].neighbors);
+		free(cache->slots[s].name);
+	}
+
+	free(cache->slots);
+	free(cache->buckets);
+	free(cache->path);
+
+	close(cache->fd);
+
+	memset(cache, 0, sizeof(*cache));
+
+}
@@ -0,0 +1,73 @@
+/***********************************************************************************************************
+ *	Title: Room Cache
+ *	Description: Lazy access to a packed room file. Nothing is loaded up front: a room is read with
+ *			pread the first time it is asked for, using the file's own nameOffsets and
+ *			adjOffsets sections as the per-room offset index, and kept in a fixed number of
+ *			slots with least recently used eviction. Memory depends on the number of slots,
+ *			not on the size of the graph.
+ * ********************************************************************************************************/
+
+#include "hindss.roomfile.h"
+
+#ifndef HINDSS_ROOMCACHE_H
+#define HINDSS_ROOMCACHE_H
+
+#define ROOM_CACHE_DEFAULT_ROOMS 4096
+
+/* a decoded room. Its buffers stay with the slot and are reused by the next room decoded into it */
+
+struct CachedRoom {
+
+	uint32_t index;
+	uint8_t type;
+	uint32_t degree;
+	uint32_t* neighbors;
+	uint32_t neighborCap;
+	char* name;
+	uint32_t nameCap;
+
+	/* least recently used list and hash chain, as slot numbers */
+
+	uint32_t prev;
+	uint32_t next;
+	uint32_t hashNext;
+
+};
+
+struct RoomCache {
+
+	int fd;
+	char* path;
+	struct RoomFileHeader header;
+
+	uint32_t capacity;
+	uint32_t used;
+	struct CachedRoom* slots;
+
+	/* room index to slot, chained through hashNext */
+
+	uint32_t* buckets;
+	uint32_t bucketMask;
+
+	/* most and least recently used slots */
+
+	uint32_t head;
+	uint32_t tail;
+
+	/* requests found in the cache and requests that had to read the file, plus rooms read ahead */
+
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long readahead;
+
+};
+
+int openRoomCache(const char* , uint32_t, struct RoomCache* );
+struct CachedRoom* fetchRoom(struct RoomCache* , uint32_t);
+void readAheadNeighbors(struct RoomCache* , uint32_t);
+void readRoomFileBytes(struct RoomCache* , void* , size_t, uint64_t);
+uint32_t scanRoomTypes(struct RoomCache* , int);
+double roomCacheHitRate(const struct RoomCache* );
+void closeRoomCache(struct RoomCache* );
+
+#endif
@@ -0,0 +1,298 @@
+/***********************************************************************************************************
+ *	Title: Room File Formats
+ *	Description: Readers and writers for room graphs. The text directory form is the original one
+ *			file per room layout. The packed form holds the same graph in one file whose
+ *			sections are used in place after mmap, so loading it costs a few page faults
+ *			instead of a fopen and a parse per room. The text reader and writer are in
+ *			hindss.roomreader.c and hindss.roomwriter.c.
+ * ********************************************************************************************************/
+
+#define _GNU_SOURCE
+
+#include "hindss.roomfile.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+const char* roomTypeNames[] = {"MID_ROOM", "START_ROOM", "END_ROOM"};
+
+#define ALIGN8(x) (((x) + 7) & ~(uint64_t) 7)
+
+
+/* Boolean: path is a regular file that starts with the packed magic */
+
+int isPackedRoomFile(const char* path) {
+
+	char magic[8];
+	struct stat info;
+	int fd;
+	ssize_t got;
+
+	if (stat(path, &info) != 0 || !S_ISREG(info.st_mode)) { return 0; }
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) { return 0; }
+	got = read(fd, magic, sizeof(magic));
+	close(fd);
+
+	return (got == sizeof(magic) && memcmp(magic, ROOM_FILE_MAGIC, sizeof(magic)) == 0);
+
+}
+
+
+/* write len bytes of buf and then zeros up to the next 8 byte boundary. Returns 0 on success */
+
+static int writeSection(FILE* out, const void* buf, uint64_t len) {
+
+	static const char zeros[8] = {0};
+
+	if (len > 0 && fwrite(buf, 1, len, out) != len) { return -1; }
+	if (ALIGN8(len) != len && fwrite(zeros, 1, ALIGN8(len) - len, out) != ALIGN8(len) - len) { return -1; }
+
+	return 0;
+
+}
+
+
+/* Write a room graph as one packed file. It is written under a hidden temporary name beside path and renamed over
+   path once complete, so a program that has the old file mapped keeps it whole, and a watcher sees the new file appear
+   in one step. Returns 0 on success, -1 with errno set on failure */
+
+int writePackedRooms(const char* path, const struct RoomData* data) {
+
+	struct RoomFileHeader header;
+	char tempPath[PATH_MAX];
+	const char* base = strrchr(path, '/');
+	FILE* out;
+	int failed, savedErrno;
+	uint64_t n = data->numRooms;
+
+	base = base ? base + 1 : path;
+
+	if (snprintf(tempPath, sizeof(tempPath), "%.*s.%s.%d", (int) (base - path), path, base, (int) getpid())
+			>= (int) sizeof(tempPath)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	/* section offsets, each aligned so that the mapped arrays can be used directly */
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, ROOM_FILE_MAGIC, sizeof(header.magic));
+	header.version = ROOM_FILE_VERSION;
+	header.byteOrder = BYTE_ORDER_MARK;
+	header.numRooms = data->numRooms;
+	header.numAdjacency = data->numAdjacency;
+
+	header.stringsOffset = ALIGN8(sizeof(header));
+	header.stringsSize = data->stringsSize;
+	header.nameOffsetsOffset = header.stringsOffset + ALIGN8(data->stringsSize);
+	header.adjOffsetsOffset = header.nameOffsetsOffset + ALIGN8(n * sizeof(uint32_t));
+	header.adjacencyOffset = header.adjOffsetsOffset + ALIGN8((n + 1) * sizeof(uint32_t));
+	header.typesOffset = header.adjacencyOffset + ALIGN8(data->numAdjacency * sizeof(uint32_t));
+	header.fileSize = header.typesOffset + ALIGN8(n);
+
+	out = fopen(tempPath, "w");
+	if (out == NULL) { return -1; }
+
+	failed = writeSection(out, &header, sizeof(header))
+		|| writeSection(out, data->strings, data->stringsSize)
+		|| writeSection(out, data->nameOffsets, n * sizeof(uint32_t))
+		|| writeSection(out, data->adjOffsets, (n + 1) * sizeof(uint32_t))
+		|| writeSection(out, data->adjacency, data->numAdjacency * sizeof(uint32_t))
+		|| writeSection(out, data->types, n);
+
+	if (fclose(out) != 0) { failed = 1; }
+
+	if (!failed && rename(tempPath, path) != 0) { failed = 1; }
+
+	if (failed) {
+		savedErrno = errno;
+		unlink(tempPath);
+		errno = savedErrno;
+		return -1;
+	}
+
+	return 0;
+
+}
+
+
+/* Boolean: the section [offset, offset + len) lies inside a file of size bytes */
+
+static int sectionFits(uint64_t offset, uint64_t len, uint64_t size) {
+
+	return (offset % 4 == 0 && offset <= size && len <= size - offset);
+
+}
+
+
+/* Boolean: header is a packed room header of this version and byte order whose sections all fit in a file of fileSize
+   bytes */
+
+int roomFileHeaderValid(const struct RoomFileHeader* header, uint64_t fileSize) {
+
+	uint64_t n = header->numRooms;
+
+	return (memcmp(header->magic, ROOM_FILE_MAGIC, sizeof(header->magic)) == 0 && header->version == ROOM_FILE_VERSION
+			&& header->byteOrder == BYTE_ORDER_MARK && header->fileSize == fileSize
+			&& sectionFits(header->stringsOffset, header->stringsSize, header->fileSize)
+			&& sectionFits(header->nameOffsetsOffset, n * sizeof(uint32_t), header->fileSize)
+			&& sectionFits(header->adjOffsetsOffset, (n + 1) * sizeof(uint32_t), header->fileSize)
+			&& sectionFits(header->adjacencyOffset, header->numAdjacency * sizeof(uint32_t), header->fileSize)
+			&& sectionFits(header->typesOffset, n, header->fileSize)
+			&& header->stringsSize != 0);
+
+}
+
+
+/* Boolean: header was written on a machine of the other byte order */
+
+int roomFileByteSwapped(const struct RoomFileHeader* header) {
+
+	return memcmp(header->magic, ROOM_FILE_MAGIC, sizeof(header->magic)) == 0
+			&& otherByteOrder(header->byteOrder);
+
+}
+
+
+/* map a packed room file and point data's arrays into the mapping. The header and every index in the file are checked,
+   so a truncated or corrupt file is rejected here rather than read out of bounds later. Returns 0 on success, -1 with
+   a message on stderr on failure */
+
+int openPackedRooms(const char* path, struct RoomData* data) {
+
+	int fd;
+	uint64_t i, n;
+	struct stat info;
+	const struct RoomFileHeader* header;
+	char* map;
+
+	memset(data, 0, sizeof(*data));
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+
+	if (fstat(fd, &info) != 0 || (uint64_t) info.st_size < sizeof(struct RoomFileHeader)) {
+		fprintf(stderr, "%s: not a packed room file\n", path);
+		close(fd);
+		return -1;
+	}
+
+	map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror(path);
+		return -1;
+	}
+
+	/* the whole file is read once for the checks below and again by the game */
+
+	madvise(map, info.st_size, MADV_WILLNEED);
+
+	data->map = map;
+	data->mapSize = info.st_size;
+
+	header = (const struct RoomFileHeader*) map;
+	n = header->numRooms;
+
+	if (roomFileByteSwapped(header)) {
+		fprintf(stderr, "%s: packed room file is of the other byte order\n", path);
+		closeRoomData(data);
+		return -1;
+	}
+
+	if (!roomFileHeaderValid(header, info.st_size) || map[header->stringsOffset + header->stringsSize - 1] != 0) {
+		fprintf(stderr, "%s: bad packed room file header\n", path);
+		closeRoomData(data);
+		return -1;
+	}
+
+	data->numRooms = header->numRooms;
+	data->numAdjacency = header->numAdjacency;
+	data->strings = map + header->stringsOffset;
+	data->stringsSize = header->stringsSize;
+	data->nameOffsets = (const uint32_t*) (map + header->nameOffsetsOffset);
+	data->adjOffsets = (const uint32_t*) (map + header->adjOffsetsOffset);
+	data->adjacency = (const uint32_t*) (map + header->adjacencyOffset);
+	data->types = (const uint8_t*) (map + header->typesOffset);
+
+	/* every name, neighbor list and neighbor must be in range */
+
+	int valid = (data->adjOffsets[0] == 0 && data->adjOffsets[n] == data->numAdjacency);
+
+	for (i = 0; i < n && valid; i++) {
+		if (data->nameOffsets[i] >= data->stringsSize || data->adjOffsets[i] > data->adjOffsets[i + 1]
+				|| data->types[i] > END_ROOM) {
+			valid = 0;
+		}
+	}
+
+	for (i = 0; i < data->numAdjacency && valid; i++) {
+		if (data->adjacency[i] >= n) { valid = 0; }
+	}
+
+	if (!valid) {
+		fprintf(stderr, "%s: corrupt packed room file\n", path);
+		closeRoomData(data);
+		return -1;
+	}
+
+	return 0;
+
+}
+
+
+/* release a room graph returned by openPackedRooms() or readRoomTextDir() */
+
+void closeRoomData(struct RoomData* data) {
+
+	if (data->map != NULL) {
+		munmap(data->map, data->mapSize);
+	}
+
+	if (data->ownsArrays) {
+		free((void*) data->strings);
+		free((void*) data->nameOffsets);
+		free((void*) data->adjOffsets);
+		free((void*) data->adjacency);
+		free((void*) data->types);
+	}
+
+	memset(data, 0, sizeof(*data));
+
+}
+
+
+/* Point the ROOM_LATEST_LINK symlink in the working directory at target, a name in the same directory. The new link
+   is made under a temporary name and renamed over the old one, so a reader sees either link whole. Returns 0 on
+   success, -1 with a message on stderr on failure */
+
+int linkLatestRooms(const char* target) {
+
+	char tempName[64];
+
+	snprintf(tempName, sizeof(tempName), "%s.%d", ROOM_LATEST_LINK, (int) getpid());
+
+	unlink(tempName);
+
+	if (symlink(target, tempName) != 0 || rename(tempName, ROOM_LATEST_LINK) != 0) {
+		perror(ROOM_LATEST_LINK);
+		unlink(tempName);
+		return -1;
+	}
+
+	return 0;
+
+}
@@ -0,0 +1,95 @@
+/***********************************************************************************************************
+ *	Title: Room File Formats
+ *	Description: Declarations shared by buildrooms, adventure and convertrooms for the two on-disk
+ *			forms of a room graph: the original directory of one text file per room, and a
+ *			single packed binary file which is loaded with mmap.
+ *
+ *			Packed layout, every section 8 byte aligned. Integers are in the byte order of the
+ *			machine that wrote the file, so that the arrays can be used straight from the
+ *			mapping; the header's byteOrder mark (see hindss.byteorder.h) records it, and a
+ *			file from a machine of the other byte order is rejected:
+ *
+ *				header		struct RoomFileHeader
+ *				strings		room names, NUL terminated, back to back
+ *				nameOffsets	uint32[numRooms], offset of each name in strings
+ *				adjOffsets	uint32[numRooms + 1], CSR offsets into adjacency
+ *				adjacency	uint32[numAdjacency], neighbor room indices
+ *				types		uint8[numRooms], MID_ROOM, START_ROOM or END_ROOM
+ * ********************************************************************************************************/
+
+#include "hindss.byteorder.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef HINDSS_ROOMFILE_H
+#define HINDSS_ROOMFILE_H
+
+/* room types */
+
+#define MID_ROOM 0
+#define START_ROOM 1
+#define END_ROOM 2
+
+extern const char* roomTypeNames[];
+
+#define ROOM_FILE_MAGIC "HROOMS\r\n"
+#define ROOM_FILE_VERSION 1
+
+/* symlink in the working directory to the room graph buildrooms wrote last */
+
+#define ROOM_LATEST_LINK "hindss.rooms.latest"
+
+struct RoomFileHeader {
+
+	char magic[8];
+	uint32_t version;
+	uint32_t numRooms;
+	uint64_t byteOrder;
+	uint64_t numAdjacency;
+	uint64_t stringsOffset;
+	uint64_t stringsSize;
+	uint64_t nameOffsetsOffset;
+	uint64_t adjOffsetsOffset;
+	uint64_t adjacencyOffset;
+	uint64_t typesOffset;
+	uint64_t fileSize;
+
+};
+
+/* a room graph in memory, in the same layout as the packed file. When loaded from a packed file every pointer
+   points into the mapping, otherwise the arrays are malloc'd */
+
+struct RoomData {
+
+	uint32_t numRooms;
+	uint64_t numAdjacency;
+
+	const char* strings;
+	uint64_t stringsSize;
+	const uint32_t* nameOffsets;
+	const uint32_t* adjOffsets;
+	const uint32_t* adjacency;
+	const uint8_t* types;
+
+	/* ownership */
+
+	void* map;
+	size_t mapSize;
+	int ownsArrays;
+
+};
+
+#define roomDataName(data, i) ((data)->strings + (data)->nameOffsets[(i)])
+
+int isPackedRoomFile(const char* );
+int roomFileHeaderValid(const struct RoomFileHeader* , uint64_t);
+int roomFileByteSwapped(const struct RoomFileHeader* );
+int writePackedRooms(const char* , const struct RoomData* );
+int openPackedRooms(const char* , struct RoomData* );
+int readRoomTextDir(const char* , struct RoomData* , int);
+int writeRoomTextDir(const char* , const struct RoomData* , int);
+void closeRoomData(struct RoomData* );
+int linkLatestRooms(const char* );
+
+#endif
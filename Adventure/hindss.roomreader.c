@@ -0,0 +1,548 @@
+/***********************************************************************************************************
+ *	Title: Room Directory Reader
+ *	Description: Reads a directory of one text file per room, in the original format, into a room
+ *			graph. The directory is listed once with getdents64. A pool of worker threads
+ *			then takes batches of files in turn, reads each file whole and parses its lines
+ *			by hand into buffers of the worker's own, recording where each room's name and
+ *			connection names landed. Once every file is parsed the rooms are laid out in
+ *			listing order, their names copied into one string arena, and the connection
+ *			names resolved to room indices through a hash table of the room names, again
+ *			by batches across the workers.
+ * ********************************************************************************************************/
+
+#define _GNU_SOURCE
+
+#include "hindss.roomstore.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#define READ_BATCH 64
+#define MAX_READER_THREADS 16
+#define DIRENT_BUFFER 65536
+#define NO_ROOM UINT32_MAX
+
+
+/* growable byte buffer */
+
+struct ByteBuffer {
+
+	char* bytes;
+	uint64_t size;
+	uint64_t cap;
+
+};
+
+static uint64_t appendBytes(struct ByteBuffer* buffer, const void* bytes, uint64_t len) {
+
+	uint64_t at = buffer->size;
+
+	if (buffer->size + len > buffer->cap) {
+		buffer->cap = (buffer->cap == 0) ? 4096 : buffer->cap;
+		while (buffer->size + len > buffer->cap) { buffer->cap *= 2; }
+		buffer->bytes = realloc(buffer->bytes, buffer->cap);
+	}
+
+	memcpy(buffer->bytes + at, bytes, len);
+	buffer->size += len;
+
+	return at;
+
+}
+
+
+/* where one file's room landed in its worker's buffers */
+
+struct RoomRecord {
+
+	uint32_t worker;
+	uint32_t nameAt;
+	uint32_t nameLen;
+	uint32_t firstNeighbor;
+	uint32_t numNeighbors;
+	uint8_t type;
+
+};
+
+/* one worker's buffers: room names and connection names back to back, and where each connection name starts */
+
+struct ReaderWorker {
+
+	struct ByteBuffer names;
+	struct ByteBuffer neighborNames;
+	struct ByteBuffer neighborAt;
+	struct ByteBuffer file;
+
+};
+
+/* state shared by the workers */
+
+struct RoomReader {
+
+	const char* dirPath;
+	int dirFd;
+
+	/* file names from the listing */
+
+	struct ByteBuffer fileNames;
+	struct ByteBuffer fileNameAt;
+	uint32_t numFiles;
+
+	struct RoomRecord* records;
+	struct ReaderWorker* workers;
+
+	/* the graph being built, and the name table used to resolve connections */
+
+	char* strings;
+	uint32_t* nameOffsets;
+	uint32_t* adjOffsets;
+	uint32_t* adjacency;
+	uint8_t* types;
+
+	uint32_t* nameSlots;
+	uint64_t nameMask;
+
+	/* batches handed out, per phase */
+
+	uint32_t numBatches;
+	uint32_t nextBatch;
+	int phase;
+
+	pthread_mutex_t errorLock;
+	int failed;
+
+};
+
+/* a worker thread's argument */
+
+struct ReaderJob {
+
+	struct RoomReader* reader;
+	uint32_t worker;
+
+};
+
+#define PHASE_PARSE 0
+#define PHASE_RESOLVE 1
+
+#define fileNameOf(reader, f) ((reader)->fileNames.bytes + ((const uint32_t*) (reader)->fileNameAt.bytes)[(f)])
+
+
+/* list the directory with getdents64 into reader's file names, skipping dot files. Returns 0 on success */
+
+static int listRoomFiles(struct RoomReader* reader) {
+
+	char* buf = malloc(DIRENT_BUFFER);
+	long got, pos;
+	uint32_t at;
+
+	struct linux_dirent64 {
+		uint64_t d_ino;
+		int64_t d_off;
+		unsigned short d_reclen;
+		unsigned char d_type;
+		char d_name[];
+	}* entry;
+
+	while ((got = syscall(SYS_getdents64, reader->dirFd, buf, DIRENT_BUFFER)) > 0) {
+
+		for (pos = 0; pos < got; pos += entry->d_reclen) {
+
+			entry = (struct linux_dirent64*) (buf + pos);
+
+			if (entry->d_name[0] == '.') { continue; }
+
+			at = (uint32_t) appendBytes(&reader->fileNames, entry->d_name, strlen(entry->d_name) + 1);
+			appendBytes(&reader->fileNameAt, &at, sizeof(at));
+			reader->numFiles++;
+
+		}
+
+	}
+
+	free(buf);
+
+	if (got < 0) {
+		perror(reader->dirPath);
+		return -1;
+	}
+
+	return 0;
+
+}
+
+
+/* report a failure in room file name once and stop the other workers */
+
+static void readerFailed(struct RoomReader* reader, const char* name, const char* message, const char* detail) {
+
+	pthread_mutex_lock(&reader->errorLock);
+
+	if (!reader->failed) {
+		fprintf(stderr, "%s/%s: %s%s\n", reader->dirPath, name, message, detail);
+		__atomic_store_n(&reader->failed, 1, __ATOMIC_RELAXED);
+	}
+
+	pthread_mutex_unlock(&reader->errorLock);
+
+}
+
+
+/* Boolean: the line at line, len bytes long, starts with prefix */
+
+static int startsWith(const char* line, size_t len, const char* prefix, size_t prefixLen) {
+
+	return len >= prefixLen && memcmp(line, prefix, prefixLen) == 0;
+
+}
+
+
+/* Read file f whole into the worker's file buffer and parse it into the worker's buffers and f's record. Lines are
+   "ROOM NAME: x", "CONNECTION n: x" and "ROOM TYPE: x"; a file without a ROOM NAME line is named after the file */
+
+static int parseRoomFile(struct RoomReader* reader, struct ReaderWorker* worker, uint32_t workerIndex, uint32_t f) {
+
+	struct RoomRecord* record = &reader->records[f];
+	const char* fileName = fileNameOf(reader, f);
+	char *line, *end, *lineEnd, *value;
+	size_t len, valueLen;
+	ssize_t got;
+	uint32_t at;
+	int fd;
+
+	fd = openat(reader->dirFd, fileName, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		readerFailed(reader, fileName, "cannot open room file", "");
+		return -1;
+	}
+
+	worker->file.size = 0;
+
+	do {
+		if (worker->file.cap - worker->file.size < 4096) {
+			worker->file.cap = (worker->file.cap == 0) ? 8192 : worker->file.cap * 2;
+			worker->file.bytes = realloc(worker->file.bytes, worker->file.cap);
+		}
+		got = read(fd, worker->file.bytes + worker->file.size, worker->file.cap - worker->file.size);
+		if (got > 0) { worker->file.size += got; }
+	} while (got > 0);
+
+	close(fd);
+
+	if (got < 0) {
+		readerFailed(reader, fileName, "cannot read room file", "");
+		return -1;
+	}
+
+	record->worker = workerIndex;
+	record->nameAt = NO_ROOM;
+	record->firstNeighbor = (uint32_t) (worker->neighborAt.size / sizeof(uint32_t));
+	record->numNeighbors = 0;
+	record->type = MID_ROOM;
+
+	line = worker->file.bytes;
+	end = worker->file.bytes + worker->file.size;
+
+	for (; line < end; line = lineEnd + 1) {
+
+		lineEnd = memchr(line, '\n', end - line);
+		if (lineEnd == NULL) { lineEnd = end; }
+		len = lineEnd - line;
+
+		value = memchr(line, ':', len);
+		if (value == NULL || value + 1 >= lineEnd || value[1] != ' ') { continue; }
+		value += 2;
+		valueLen = lineEnd - value;
+
+		if (startsWith(line, len, "ROOM NAME", 9)) {
+			record->nameAt = (uint32_t) appendBytes(&worker->names, value, valueLen);
+			appendBytes(&worker->names, "", 1);
+			record->nameLen = (uint32_t) valueLen;
+		}
+		else if (startsWith(line, len, "CONNECTION", 10)) {
+			at = (uint32_t) appendBytes(&worker->neighborNames, value, valueLen);
+			appendBytes(&worker->neighborNames, "", 1);
+			appendBytes(&worker->neighborAt, &at, sizeof(at));
+			record->numNeighbors++;
+		}
+		else if (startsWith(line, len, "ROOM TYPE", 9)) {
+			if (valueLen == 10 && memcmp(value, "START_ROOM", 10) == 0) { record->type = START_ROOM; }
+			else if (valueLen == 8 && memcmp(value, "END_ROOM", 8) == 0) { record->type = END_ROOM; }
+		}
+
+	}
+
+	if (record->nameAt == NO_ROOM) {
+		record->nameLen = (uint32_t) strlen(fileName);
+		record->nameAt = (uint32_t) appendBytes(&worker->names, fileName, record->nameLen + 1);
+	}
+
+	return 0;
+
+}
+
+
+/* index of the room called name, or NO_ROOM */
+
+static uint32_t lookupRoom(const struct RoomReader* reader, const char* name) {
+
+	uint64_t slot = hashName(name) & reader->nameMask;
+
+	while (reader->nameSlots[slot] != NO_ROOM) {
+		if (strcmp(reader->strings + reader->nameOffsets[reader->nameSlots[slot]], name) == 0) {
+			return reader->nameSlots[slot];
+		}
+		slot = (slot + 1) & reader->nameMask;
+	}
+
+	return NO_ROOM;
+
+}
+
+
+/* resolve file f's connection names into the adjacency array */
+
+static int resolveRoom(struct RoomReader* reader, uint32_t f) {
+
+	const struct RoomRecord* record = &reader->records[f];
+	const struct ReaderWorker* worker = &reader->workers[record->worker];
+	const uint32_t* neighborAt = (const uint32_t*) worker->neighborAt.bytes;
+	const char* want;
+	uint32_t k, room;
+
+	for (k = 0; k < record->numNeighbors; k++) {
+
+		want = worker->neighborNames.bytes + neighborAt[record->firstNeighbor + k];
+		room = lookupRoom(reader, want);
+
+		if (room == NO_ROOM) {
+			readerFailed(reader, fileNameOf(reader, f), "connection to unknown room ", want);
+			return -1;
+		}
+
+		reader->adjacency[reader->adjOffsets[f] + k] = room;
+
+	}
+
+	return 0;
+
+}
+
+
+/* worker: take batches of files until none are left, parsing them or resolving their connections by phase */
+
+static void* roomReaderThread(void* arg) {
+
+	struct ReaderJob* job = arg;
+	struct RoomReader* reader = job->reader;
+	struct ReaderWorker* worker = &reader->workers[job->worker];
+	uint32_t batch, first, last, f;
+
+	while (!__atomic_load_n(&reader->failed, __ATOMIC_RELAXED)) {
+
+		batch = __atomic_fetch_add(&reader->nextBatch, 1, __ATOMIC_RELAXED);
+		if (batch >= reader->numBatches) { break; }
+
+		first = batch * READ_BATCH;
+		last = first + READ_BATCH;
+		if (last > reader->numFiles) { last = reader->numFiles; }
+
+		for (f = first; f < last && !__atomic_load_n(&reader->failed, __ATOMIC_RELAXED); f++) {
+			if (reader->phase == PHASE_PARSE) {
+				parseRoomFile(reader, worker, job->worker, f);
+			}
+			else {
+				resolveRoom(reader, f);
+			}
+		}
+
+	}
+
+	return NULL;
+
+}
+
+
+/* run the current phase on numThreads workers, the calling thread being worker 0 */
+
+static void runReaderPhase(struct RoomReader* reader, int phase, int numThreads) {
+
+	pthread_t threads[MAX_READER_THREADS];
+	struct ReaderJob jobs[MAX_READER_THREADS];
+	int i, started = 0;
+
+	reader->phase = phase;
+	reader->nextBatch = 0;
+
+	for (i = 0; i < numThreads; i++) {
+		jobs[i].reader = reader;
+		jobs[i].worker = (uint32_t) i;
+	}
+
+	for (i = 1; i < numThreads; i++) {
+		if (pthread_create(&threads[started], NULL, roomReaderThread, &jobs[i]) == 0) { started++; }
+	}
+
+	roomReaderThread(&jobs[0]);
+
+	for (i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+}
+
+
+/* Lay the parsed rooms out in listing order: name offsets and CSR offsets by prefix sum, names copied into one arena,
+   then the name table built over them */
+
+static void mergeRooms(struct RoomReader* reader, uint64_t* stringsSize, uint64_t* numAdjacency) {
+
+	uint64_t nameTotal = 0, neighborTotal = 0, size = 16, slot;
+	uint32_t f;
+	const struct RoomRecord* record;
+
+	reader->nameOffsets = malloc(((size_t) reader->numFiles + 1) * sizeof(uint32_t));
+	reader->adjOffsets = malloc(((size_t) reader->numFiles + 1) * sizeof(uint32_t));
+	reader->types = malloc((size_t) reader->numFiles + 1);
+
+	for (f = 0; f < reader->numFiles; f++) {
+		reader->nameOffsets[f] = (uint32_t) nameTotal;
+		reader->adjOffsets[f] = (uint32_t) neighborTotal;
+		reader->types[f] = reader->records[f].type;
+		nameTotal += reader->records[f].nameLen + 1;
+		neighborTotal += reader->records[f].numNeighbors;
+	}
+
+	reader->adjOffsets[reader->numFiles] = (uint32_t) neighborTotal;
+
+	reader->strings = malloc(nameTotal + 1);
+	reader->adjacency = malloc((neighborTotal + 1) * sizeof(uint32_t));
+
+	for (f = 0; f < reader->numFiles; f++) {
+		record = &reader->records[f];
+		memcpy(reader->strings + reader->nameOffsets[f], reader->workers[record->worker].names.bytes + record->nameAt,
+			record->nameLen + 1);
+	}
+
+	/* a repeated name keeps its first room */
+
+	while (size < (uint64_t) reader->numFiles * 2) { size *= 2; }
+
+	reader->nameSlots = malloc(size * sizeof(uint32_t));
+	reader->nameMask = size - 1;
+	memset(reader->nameSlots, 0xff, size * sizeof(uint32_t));
+
+	for (f = 0; f < reader->numFiles; f++) {
+
+		slot = hashName(reader->strings + reader->nameOffsets[f]) & reader->nameMask;
+
+		while (reader->nameSlots[slot] != NO_ROOM
+				&& strcmp(reader->strings + reader->nameOffsets[reader->nameSlots[slot]], reader->strings + reader->nameOffsets[f]) != 0) {
+			slot = (slot + 1) & reader->nameMask;
+		}
+
+		if (reader->nameSlots[slot] == NO_ROOM) { reader->nameSlots[slot] = f; }
+
+	}
+
+	*stringsSize = nameTotal;
+	*numAdjacency = neighborTotal;
+
+}
+
+
+/* Read the original one file per room directory into data with numThreads workers (0 for one per CPU). Returns 0 on
+   success, -1 with a message on stderr on failure */
+
+int readRoomTextDir(const char* dirPath, struct RoomData* data, int numThreads) {
+
+	struct RoomReader reader;
+	uint64_t stringsSize = 0, numAdjacency = 0;
+	int i;
+
+	memset(data, 0, sizeof(*data));
+	memset(&reader, 0, sizeof(reader));
+
+	reader.dirPath = dirPath;
+	reader.dirFd = open(dirPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (reader.dirFd < 0) {
+		perror(dirPath);
+		return -1;
+	}
+
+	if (listRoomFiles(&reader) != 0) {
+		close(reader.dirFd);
+		free(reader.fileNames.bytes);
+		free(reader.fileNameAt.bytes);
+		return -1;
+	}
+
+	if (reader.numFiles == 0) {
+		fprintf(stderr, "%s: no rooms\n", dirPath);
+		close(reader.dirFd);
+		free(reader.fileNames.bytes);
+		free(reader.fileNameAt.bytes);
+		return -1;
+	}
+
+	pthread_mutex_init(&reader.errorLock, NULL);
+
+	/* no more threads than CPUs or batches */
+
+	reader.numBatches = (reader.numFiles + READ_BATCH - 1) / READ_BATCH;
+
+	if (numThreads <= 0) { numThreads = (int) sysconf(_SC_NPROCESSORS_ONLN); }
+	if (numThreads > MAX_READER_THREADS) { numThreads = MAX_READER_THREADS; }
+	if ((uint32_t) numThreads > reader.numBatches) { numThreads = (int) reader.numBatches; }
+	if (numThreads < 1) { numThreads = 1; }
+
+	reader.records = malloc(reader.numFiles * sizeof(struct RoomRecord));
+	reader.workers = calloc(numThreads, sizeof(struct ReaderWorker));
+
+	/* parse every file, lay the rooms out, then resolve connections */
+
+	runReaderPhase(&reader, PHASE_PARSE, numThreads);
+
+	if (!reader.failed) {
+		mergeRooms(&reader, &stringsSize, &numAdjacency);
+		runReaderPhase(&reader, PHASE_RESOLVE, numThreads);
+	}
+
+	for (i = 0; i < numThreads; i++) {
+		free(reader.workers[i].names.bytes);
+		free(reader.workers[i].neighborNames.bytes);
+		free(reader.workers[i].neighborAt.bytes);
+		free(reader.workers[i].file.bytes);
+	}
+
+	free(reader.workers);
+	free(reader.records);
+	free(reader.nameSlots);
+	free(reader.fileNames.bytes);
+	free(reader.fileNameAt.bytes);
+	pthread_mutex_destroy(&reader.errorLock);
+	close(reader.dirFd);
+
+	data->numRooms = reader.numFiles;
+	data->numAdjacency = numAdjacency;
+	data->strings = reader.strings;
+	data->stringsSize = stringsSize;
+	data->nameOffsets = reader.nameOffsets;
+	data->adjOffsets = reader.adjOffsets;
+	data->adjacency = reader.adjacency;
+	data->types = reader.types;
+	data->ownsArrays = 1;
+
+	if (reader.failed) {
+		closeRoomData(data);
+		return -1;
+	}
+
+	return 0;
+
+}
@@ -0,0 +1,343 @@
+/***********************************************************************************************************
+ *	Title: Room Store
+ *	Description: Loading a room graph into the engine's room store, and finding rooms by name with
+ *			an FNV-1a hash table of room indices. The table holds no names of its own: it
+ *			compares against the string arena, so it costs 4 bytes a slot. A lazy store has
+ *			no table, since building one would read every room.
+ * ********************************************************************************************************/
+
+#include "hindss.roomstore.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* bytes read at a time when hashing a lazily read file */
+
+#define HASH_CHUNK (1 << 20)
+
+
+/* fold len bytes into an FNV-1a hash */
+
+static uint64_t hashBytes(uint64_t hash, const void* bytes, size_t len) {
+
+	const unsigned char* p = bytes;
+
+	while (len-- > 0) {
+
+		hash ^= *p++;
+		hash *= 1099511628211ULL;
+
+	}
+
+	return hash;
+
+}
+
+
+/* FNV-1a hash of a loaded graph: the room count, every name with its NUL in room order, then the types, adjOffsets
+   and adjacency sections as they are */
+
+static uint64_t hashRoomData(const struct RoomData* data) {
+
+	uint64_t hash = 14695981039346656037ULL;
+	uint32_t i;
+	const char* name;
+
+	hash = hashBytes(hash, &data->numRooms, sizeof(data->numRooms));
+
+	for (i = 0; i < data->numRooms; i++) {
+		name = roomDataName(data, i);
+		hash = hashBytes(hash, name, strlen(name) + 1);
+	}
+
+	hash = hashBytes(hash, data->types, data->numRooms);
+	hash = hashBytes(hash, data->adjOffsets, ((uint64_t) data->numRooms + 1) * sizeof(uint32_t));
+	hash = hashBytes(hash, data->adjacency, data->numAdjacency * sizeof(uint32_t));
+
+	return hash;
+
+}
+
+
+/* fold len bytes of the file at offset into hash, read HASH_CHUNK bytes at a time into buf */
+
+static uint64_t hashFileSection(struct RoomCache* cache, uint64_t hash, uint64_t offset, uint64_t len, char* buf) {
+
+	uint64_t chunk;
+
+	for (; len > 0; offset += chunk, len -= chunk) {
+
+		chunk = len < HASH_CHUNK ? len : HASH_CHUNK;
+		readRoomFileBytes(cache, buf, chunk, offset);
+		hash = hashBytes(hash, buf, chunk);
+
+	}
+
+	return hash;
+
+}
+
+
+/* hashRoomData() of a packed file read lazily, computed from the file's sections with large preads rather than room by
+   room through the cache. Names are found through a window on the strings section that moves as their offsets do, so
+   names stored in room order are read once, front to back */
+
+static uint64_t hashRoomFile(struct RoomCache* cache) {
+
+	const struct RoomFileHeader* header = &cache->header;
+	uint64_t hash = 14695981039346656037ULL;
+	uint64_t winStart = 0, winLen = 0, p, len;
+	uint32_t* offsets = malloc(HASH_CHUNK);
+	uint32_t first, count, i, numRooms = header->numRooms;
+	char* window = malloc(HASH_CHUNK);
+	char* nul;
+
+	hash = hashBytes(hash, &numRooms, sizeof(numRooms));
+
+	for (first = 0; first < numRooms; first += count) {
+
+		count = numRooms - first;
+		if (count > HASH_CHUNK / sizeof(uint32_t)) { count = HASH_CHUNK / sizeof(uint32_t); }
+
+		readRoomFileBytes(cache, offsets, count * sizeof(uint32_t),
+			header->nameOffsetsOffset + (uint64_t) first * sizeof(uint32_t));
+
+		/* a name longer than what is left of the window is hashed a window at a time */
+
+		for (i = 0; i < count; i++) {
+
+			p = offsets[i];
+
+			do {
+
+				if (p < winStart || p >= winStart + winLen) {
+
+					if (p >= header->stringsSize) {
+						fprintf(stderr, "%s: corrupt packed room file at room %u\n", cache->path, first + i);
+						exit(1);
+					}
+
+					winStart = p;
+					winLen = header->stringsSize - p < HASH_CHUNK ? header->stringsSize - p : HASH_CHUNK;
+					readRoomFileBytes(cache, window, winLen, header->stringsOffset + winStart);
+
+				}
+
+				nul = memchr(window + (p - winStart), 0, winStart + winLen - p);
+				len = nul ? (uint64_t) (nul - window) + 1 - (p - winStart) : winStart + winLen - p;
+				hash = hashBytes(hash, window + (p - winStart), len);
+				p += len;
+
+			} while (nul == NULL);
+
+		}
+
+	}
+
+	hash = hashFileSection(cache, hash, header->typesOffset, numRooms, window);
+	hash = hashFileSection(cache, hash, header->adjOffsetsOffset, ((uint64_t) numRooms + 1) * sizeof(uint32_t), window);
+	hash = hashFileSection(cache, hash, header->adjacencyOffset, header->numAdjacency * sizeof(uint32_t), window);
+
+	free(offsets);
+	free(window);
+
+	return hash;
+
+}
+
+
+/* Load the packed room file or room directory at path into store, without a name table. Returns 0 on success */
+
+int openRoomStore(const char* path, struct RoomStore* store) {
+
+	int result;
+
+	store->nameSlots = NULL;
+	store->nameMask = 0;
+	store->cache = NULL;
+
+	if (isPackedRoomFile(path)) {
+		result = openPackedRooms(path, &store->data);
+	}
+	else {
+		result = readRoomTextDir(path, &store->data, 0);
+	}
+
+	store->graphHashed = 0;
+
+	return result;
+
+}
+
+
+/* Open the packed room file at path as a lazy store caching up to capacity rooms. Returns 0 on success */
+
+int openLazyRoomStore(const char* path, uint32_t capacity, struct RoomStore* store) {
+
+	memset(store, 0, sizeof(*store));
+
+	if (!isPackedRoomFile(path)) {
+		fprintf(stderr, "%s: only a packed room file can be read lazily\n", path);
+		return -1;
+	}
+
+	store->cache = malloc(sizeof(struct RoomCache));
+
+	if (openRoomCache(path, capacity, store->cache) != 0) {
+		free(store->cache);
+		store->cache = NULL;
+		return -1;
+	}
+
+	store->data.numRooms = store->cache->header.numRooms;
+
+	return 0;
+
+}
+
+
+/* Return the store's graph hash, hashing the graph the first time. Threads sharing a store may each hash it if they
+   ask at once, but they all get the same hash */
+
+uint64_t storeGraphHash(struct RoomStore* store) {
+
+	uint64_t hash;
+
+	if (__atomic_load_n(&store->graphHashed, __ATOMIC_ACQUIRE)) {
+		return store->graphHash;
+	}
+
+	hash = store->cache ? hashRoomFile(store->cache) : hashRoomData(&store->data);
+
+	__atomic_store_n(&store->graphHash, hash, __ATOMIC_RELAXED);
+	__atomic_store_n(&store->graphHashed, 1, __ATOMIC_RELEASE);
+
+	return hash;
+
+}
+
+
+/* Build the name table, with at least half again as many slots as rooms. A repeated name keeps its first room */
+
+void indexRoomNames(struct RoomStore* store) {
+
+	uint64_t size = 16;
+	uint64_t slot;
+	uint32_t i;
+	const char* name;
+
+	while (size < (uint64_t) storeNumRooms(store) + storeNumRooms(store) / 2) { size *= 2; }
+
+	free(store->nameSlots);
+
+	store->nameSlots = malloc(size * sizeof(uint32_t));
+	store->nameMask = size - 1;
+
+	memset(store->nameSlots, 0xff, size * sizeof(uint32_t));
+
+	for (i = 0; i < storeNumRooms(store); i++) {
+
+		name = storeName(store, i);
+		slot = hashName(name) & store->nameMask;
+
+		while (store->nameSlots[slot] != ROOM_NONE && strcmp(storeName(store, store->nameSlots[slot]), name) != 0) {
+			slot = (slot + 1) & store->nameMask;
+		}
+
+		if (store->nameSlots[slot] == ROOM_NONE) {
+			store->nameSlots[slot] = i;
+		}
+
+	}
+
+}
+
+
+/* Return the index of the room called name, or ROOM_NONE. Needs indexRoomNames() */
+
+uint32_t findRoomByName(const struct RoomStore* store, const char* name) {
+
+	uint64_t slot = hashName(name) & store->nameMask;
+
+	while (store->nameSlots[slot] != ROOM_NONE) {
+
+		if (strcmp(storeName(store, store->nameSlots[slot]), name) == 0) {
+			return store->nameSlots[slot];
+		}
+
+		slot = (slot + 1) & store->nameMask;
+
+	}
+
+	return ROOM_NONE;
+
+}
+
+
+/* Return the index of the first room of the given type, or ROOM_NONE */
+
+uint32_t findRoomByType(const struct RoomStore* store, int type) {
+
+	uint32_t i;
+
+	if (store->cache) {
+		return scanRoomTypes(store->cache, type);
+	}
+
+	for (i = 0; i < storeNumRooms(store); i++) {
+
+		if (storeType(store, i) == type) {
+			return i;
+		}
+
+	}
+
+	return ROOM_NONE;
+
+}
+
+
+/* Return the room called name if it is one of room's connections, or ROOM_NONE. With a name table this is one lookup
+   and a check of room's neighbor list, otherwise the neighbors' names are compared */
+
+uint32_t findConnection(const struct RoomStore* store, uint32_t room, const char* name) {
+
+	uint32_t k, target = ROOM_NONE;
+	uint32_t degree = storeDegree(store, room);
+
+	if (store->nameSlots != NULL) {
+		target = findRoomByName(store, name);
+		if (target == ROOM_NONE) { return ROOM_NONE; }
+	}
+
+	for (k = 0; k < degree; k++) {
+
+		if (target != ROOM_NONE ? storeNeighbor(store, room, k) == target
+				: strcmp(storeName(store, storeNeighbor(store, room, k)), name) == 0) {
+			return storeNeighbor(store, room, k);
+		}
+
+	}
+
+	return ROOM_NONE;
+
+}
+
+
+/* release a room store */
+
+void closeRoomStore(struct RoomStore* store) {
+
+	free(store->nameSlots);
+	store->nameSlots = NULL;
+
+	if (store->cache) {
+		closeRoomCache(store->cache);
+		free(store->cache);
+		store->cache = NULL;
+	}
+
+	closeRoomData(&store->data);
+
+}
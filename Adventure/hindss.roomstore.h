@@ -0,0 +1,114 @@
+/***********************************************************************************************************
+ *	Title: Room Store
+ *	Description: The adventure engine's in-memory room graph. Rooms are held as arrays rather than
+ *			one struct per room: names back to back in one string arena, a 1 byte type per
+ *			room, and connections as 32 bit room indices in CSR form (see hindss.roomfile.h).
+ *			A packed room file is used in place from its mapping; a room directory is read
+ *			into malloc'd arrays of the same layout. An optional hash table of room indices
+ *			finds a room by name.
+ *
+ *			A lazy store loads nothing: every access goes through a room cache (see
+ *			hindss.roomcache.h) that reads rooms from a packed file as they are asked for.
+ * ********************************************************************************************************/
+
+#include "hindss.roomfile.h"
+#include "hindss.roomcache.h"
+
+#ifndef HINDSS_ROOMSTORE_H
+#define HINDSS_ROOMSTORE_H
+
+#define ROOM_NONE UINT32_MAX
+
+struct RoomStore {
+
+	struct RoomData data;
+
+	/* open addressing table from name to room index, ROOM_NONE in empty slots. NULL until indexRoomNames() */
+
+	uint32_t* nameSlots;
+	uint64_t nameMask;
+
+	/* lazy stores read rooms through this cache, and data holds only numRooms */
+
+	struct RoomCache* cache;
+
+	/* hash of the whole graph, saved with the games played on it. Two graphs hash alike only if they have the same
+	   rooms with the same names joined the same way. It reads the whole graph, so storeGraphHash() takes it the first
+	   time a game is saved or restored, and sets graphHashed */
+
+	uint64_t graphHash;
+	int graphHashed;
+
+};
+
+/* FNV-1a hash of a room name, for the store's name table and the room directory reader's */
+
+static inline uint64_t hashName(const char* name) {
+
+	uint64_t hash = 14695981039346656037ULL;
+
+	while (*name) {
+
+		hash ^= (unsigned char) *name++;
+		hash *= 1099511628211ULL;
+
+	}
+
+	return hash;
+
+}
+
+/* room accessors. A name or neighbor list from a lazy store is valid until the cache has fetched as many other rooms
+   as it holds */
+
+#define storeNumRooms(store) ((store)->data.numRooms)
+
+static inline const char* storeName(const struct RoomStore* store, uint32_t i) {
+
+	return store->cache ? fetchRoom(store->cache, i)->name : roomDataName(&store->data, i);
+
+}
+
+static inline int storeType(const struct RoomStore* store, uint32_t i) {
+
+	return store->cache ? fetchRoom(store->cache, i)->type : store->data.types[i];
+
+}
+
+static inline uint32_t storeDegree(const struct RoomStore* store, uint32_t i) {
+
+	return store->cache ? fetchRoom(store->cache, i)->degree : store->data.adjOffsets[i + 1] - store->data.adjOffsets[i];
+
+}
+
+static inline uint32_t storeNeighbor(const struct RoomStore* store, uint32_t i, uint32_t k) {
+
+	return store->cache ? fetchRoom(store->cache, i)->neighbors[k] : store->data.adjacency[store->data.adjOffsets[i] + k];
+
+}
+
+static inline const uint32_t* storeNeighbors(const struct RoomStore* store, uint32_t i, uint32_t* degree) {
+
+	struct CachedRoom* room;
+
+	if (store->cache) {
+		room = fetchRoom(store->cache, i);
+		*degree = room->degree;
+		return room->neighbors;
+	}
+
+	*degree = store->data.adjOffsets[i + 1] - store->data.adjOffsets[i];
+	return store->data.adjacency + store->data.adjOffsets[i];
+
+}
+
+int openRoomStore(const char* , struct RoomStore* );
+int openLazyRoomStore(const char* , uint32_t, struct RoomStore* );
+uint64_t storeGraphHash(struct RoomStore* );
+void indexRoomNames(struct RoomStore* );
+uint32_t findRoomByName(const struct RoomStore* , const char* );
+uint32_t findRoomByType(const struct RoomStore* , int);
+uint32_t findConnection(const struct RoomStore* , uint32_t, const char* );
+void closeRoomStore(struct RoomStore* );
+
+#endif
@@ -0,0 +1,506 @@
+/***********************************************************************************************************
+ *	Title: Room Directory Writer
+ *	Description: Writes a finished room graph as a directory of one text file per room, in the
+ *			original format. Rooms are split into batches of up to ROOM_BATCH; a pool of
+ *			worker threads takes batches in turn, renders each batch's files into one
+ *			memory buffer, opens the batch's files, writes them and closes them again. A
+ *			batch is never more files than each worker's share of the open file limit, so
+ *			the number of open files stays bounded however many rooms there are.
+ *
+ *			Writes go through an io_uring per worker when the kernel provides one, so a
+ *			whole batch is submitted in one system call. Otherwise each file gets a plain
+ *			pwrite().
+ * ********************************************************************************************************/
+
+#define _GNU_SOURCE
+
+#include "hindss.roomfile.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/syscall.h>
+
+#ifdef __NR_io_uring_setup
+#include <linux/io_uring.h>
+#endif
+
+#define ROOM_BATCH 64
+#define MAX_WRITER_THREADS 16
+
+
+/* an io_uring with its rings mapped. fd is -1 if there is none */
+
+struct WriteRing {
+
+	int fd;
+
+#ifdef __NR_io_uring_setup
+
+	unsigned* sqTail;
+	unsigned* sqMask;
+	unsigned* sqArray;
+	struct io_uring_sqe* sqes;
+
+	unsigned* cqHead;
+	unsigned* cqTail;
+	unsigned* cqMask;
+	struct io_uring_cqe* cqes;
+
+	void* sqRing;
+	size_t sqRingSize;
+	void* cqRing;
+	size_t cqRingSize;
+	size_t sqesSize;
+
+#endif
+
+};
+
+/* state shared by the writer threads */
+
+struct RoomWriter {
+
+	const struct RoomData* data;
+	int dirFd;
+	const char* dirPath;
+
+	uint32_t batchSize;
+	uint32_t numBatches;
+	uint32_t nextBatch;		// taken with __atomic_fetch_add
+
+	pthread_mutex_t errorLock;
+	int failed;
+
+};
+
+
+#ifdef __NR_io_uring_setup
+
+/* set up an io_uring with room for one batch. On any failure the ring is left zeroed with fd -1 */
+
+static void openWriteRing(struct WriteRing* ring) {
+
+	struct io_uring_params params;
+
+	memset(ring, 0, sizeof(*ring));
+	memset(&params, 0, sizeof(params));
+	ring->fd = (int) syscall(__NR_io_uring_setup, ROOM_BATCH, &params);
+	if (ring->fd < 0) {
+		ring->fd = -1;
+		return;
+	}
+
+	ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+	ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+
+	if (ring->sqRing == MAP_FAILED || ring->cqRing == MAP_FAILED || ring->sqes == MAP_FAILED) {
+		if (ring->sqRing != MAP_FAILED) { munmap(ring->sqRing, ring->sqRingSize); }
+		if (ring->cqRing != MAP_FAILED) { munmap(ring->cqRing, ring->cqRingSize); }
+		if (ring->sqes != MAP_FAILED) { munmap(ring->sqes, ring->sqesSize); }
+		close(ring->fd);
+		ring->fd = -1;
+		return;
+	}
+
+	ring->sqTail = (unsigned*) ((char*) ring->sqRing + params.sq_off.tail);
+	ring->sqMask = (unsigned*) ((char*) ring->sqRing + params.sq_off.ring_mask);
+	ring->sqArray = (unsigned*) ((char*) ring->sqRing + params.sq_off.array);
+
+	ring->cqHead = (unsigned*) ((char*) ring->cqRing + params.cq_off.head);
+	ring->cqTail = (unsigned*) ((char*) ring->cqRing + params.cq_off.tail);
+	ring->cqMask = (unsigned*) ((char*) ring->cqRing + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe*) ((char*) ring->cqRing + params.cq_off.cqes);
+
+}
+
+
+/* unmap and close an io_uring */
+
+static void closeWriteRing(struct WriteRing* ring) {
+
+	if (ring->fd < 0) { return; }
+
+	munmap(ring->sqRing, ring->sqRingSize);
+	munmap(ring->cqRing, ring->cqRingSize);
+	munmap(ring->sqes, ring->sqesSize);
+	close(ring->fd);
+	ring->fd = -1;
+
+}
+
+
+/* write count buffers to count files with one submission. written[i] gets each write's result, a byte count or
+   -errno, or 0 for a write the kernel would not take, which is left to pwrite(). Untaken writes stay queued in the
+   ring, so it is closed then. Returns -1 if waiting for completions failed, in which case written[] is not to be
+   trusted */
+
+static int ringWrite(struct WriteRing* ring, int count, const int* fds, char* const* bufs, const size_t* lens, ssize_t* written) {
+
+	int i, reaped, submitted, got;
+	unsigned tail = *ring->sqTail;
+	unsigned head;
+
+	for (i = 0; i < count; i++) {
+
+		unsigned slot = tail & *ring->sqMask;
+		struct io_uring_sqe* sqe = &ring->sqes[slot];
+
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_WRITE;
+		sqe->fd = fds[i];
+		sqe->addr = (unsigned long) bufs[i];
+		sqe->len = (unsigned) lens[i];
+		sqe->off = 0;
+		sqe->user_data = (unsigned long) i;
+
+		ring->sqArray[slot] = slot;
+		written[i] = 0;
+		tail++;
+
+	}
+
+	__atomic_store_n(ring->sqTail, tail, __ATOMIC_RELEASE);
+
+	/* the kernel may take fewer entries than it is offered, so offer the rest until it takes none */
+
+	submitted = 0;
+	while (submitted < count) {
+
+		got = (int) syscall(__NR_io_uring_enter, ring->fd, count - submitted, 0, 0, NULL, 0);
+		if (got < 0 && errno == EINTR) { continue; }
+		if (got <= 0) { break; }
+		submitted += got;
+
+	}
+
+	/* reap the completion of every write that was submitted, waiting again if the kernel returned early */
+
+	reaped = 0;
+	while (reaped < submitted) {
+
+		head = *ring->cqHead;
+		while (head != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) {
+			struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cqMask];
+			written[cqe->user_data] = cqe->res;
+			head++;
+			reaped++;
+		}
+		__atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+
+		if (reaped < submitted && syscall(__NR_io_uring_enter, ring->fd, 0, submitted - reaped, IORING_ENTER_GETEVENTS, NULL,
+				0) < 0 && errno != EINTR) {
+			closeWriteRing(ring);
+			return -1;
+		}
+
+	}
+
+	if (submitted < count) { closeWriteRing(ring); }
+
+	return 0;
+
+}
+
+#else
+
+static void openWriteRing(struct WriteRing* ring) { ring->fd = -1; }
+static void closeWriteRing(struct WriteRing* ring) { (void) ring; }
+
+static int ringWrite(struct WriteRing* ring, int count, const int* fds, char* const* bufs, const size_t* lens, ssize_t* written) {
+	return -1;
+}
+
+#endif
+
+
+/* write the rest of a file's len bytes with pwrite(), starting from byte done. Ring writes leave the file offset alone,
+   so positioned writes are used here too. Returns 0 on success */
+
+static int writeRest(int fd, const char* buf, size_t len, size_t done) {
+
+	ssize_t got;
+
+	while (done < len) {
+		got = pwrite(fd, buf + done, len - done, (off_t) done);
+		if (got < 0 && errno == EINTR) { continue; }
+		if (got <= 0) { return -1; }
+		done += got;
+	}
+
+	return 0;
+
+}
+
+
+/* append the decimal form of value at out, returning the new end */
+
+static char* appendNumber(char* out, uint32_t value) {
+
+	char digits[10];
+	int n = 0;
+
+	do {
+		digits[n++] = '0' + value % 10;
+		value /= 10;
+	} while (value > 0);
+
+	while (n > 0) { *out++ = digits[--n]; }
+
+	return out;
+
+}
+
+
+/* append a string at out, returning the new end */
+
+static char* appendString(char* out, const char* str) {
+
+	size_t len = strlen(str);
+	memcpy(out, str, len);
+	return out + len;
+
+}
+
+
+/* bytes needed for room i's file */
+
+static size_t roomFileSize(const struct RoomData* data, uint32_t i) {
+
+	uint32_t k;
+	size_t size = strlen("ROOM NAME: \n") + strlen(roomDataName(data, i))
+		+ strlen("ROOM TYPE: \n") + strlen(roomTypeNames[data->types[i]]);
+
+	for (k = data->adjOffsets[i]; k < data->adjOffsets[i + 1]; k++) {
+		size += strlen("CONNECTION 4294967295: \n") + strlen(roomDataName(data, data->adjacency[k]));
+	}
+
+	return size;
+
+}
+
+
+/* render room i's file at out, exactly as the original fprintf() calls did, returning the new end */
+
+static char* renderRoomFile(const struct RoomData* data, uint32_t i, char* out) {
+
+	uint32_t k;
+
+	out = appendString(out, "ROOM NAME: ");
+	out = appendString(out, roomDataName(data, i));
+	*out++ = '\n';
+
+	for (k = data->adjOffsets[i]; k < data->adjOffsets[i + 1]; k++) {
+		out = appendString(out, "CONNECTION ");
+		out = appendNumber(out, k - data->adjOffsets[i] + 1);
+		out = appendString(out, ": ");
+		out = appendString(out, roomDataName(data, data->adjacency[k]));
+		*out++ = '\n';
+	}
+
+	out = appendString(out, "ROOM TYPE: ");
+	out = appendString(out, roomTypeNames[data->types[i]]);
+	*out++ = '\n';
+
+	return out;
+
+}
+
+
+/* report a failure once, and tell the other workers to stop */
+
+static void writerFailed(struct RoomWriter* writer, const char* name) {
+
+	int savedErrno = errno;
+
+	pthread_mutex_lock(&writer->errorLock);
+	if (!writer->failed) {
+		fprintf(stderr, "%s/%s: %s\n", writer->dirPath, name, strerror(savedErrno));
+	}
+	__atomic_store_n(&writer->failed, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&writer->errorLock);
+
+}
+
+
+/* worker thread: take batches until there are none left, render them, and write them out */
+
+static void* roomWriterThread(void* arg) {
+
+	struct RoomWriter* writer = arg;
+	const struct RoomData* data = writer->data;
+	struct WriteRing ring;
+
+	int fds[ROOM_BATCH];
+	char* bufs[ROOM_BATCH];
+	size_t lens[ROOM_BATCH];
+	ssize_t written[ROOM_BATCH];
+
+	char* render = NULL;
+	size_t renderCap = 0;
+
+	uint32_t batch, first, last, i;
+	int count, k;
+
+	openWriteRing(&ring);
+
+	while (!__atomic_load_n(&writer->failed, __ATOMIC_RELAXED)) {
+
+		batch = __atomic_fetch_add(&writer->nextBatch, 1, __ATOMIC_RELAXED);
+		if (batch >= writer->numBatches) { break; }
+
+		first = batch * writer->batchSize;
+		last = first + writer->batchSize;
+		if (last > data->numRooms) { last = data->numRooms; }
+		count = (int) (last - first);
+
+		/* render the whole batch into one buffer */
+
+		size_t need = 0;
+		for (i = first; i < last; i++) { need += roomFileSize(data, i); }
+		if (need > renderCap) {
+			renderCap = need * 2;
+			render = realloc(render, renderCap);
+		}
+
+		char* out = render;
+		for (i = first; i < last; i++) {
+			bufs[i - first] = out;
+			out = renderRoomFile(data, i, out);
+			lens[i - first] = out - bufs[i - first];
+		}
+
+		/* open the batch's files */
+
+		for (k = 0; k < count; k++) {
+			fds[k] = openat(writer->dirFd, roomDataName(data, first + k), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+			if (fds[k] < 0) {
+				writerFailed(writer, roomDataName(data, first + k));
+				break;
+			}
+		}
+
+		/* write them all, through the ring when there is one */
+
+		if (k == count) {
+
+			if (ring.fd < 0 || ringWrite(&ring, count, fds, bufs, lens, written) != 0) {
+				for (k = 0; k < count; k++) { written[k] = 0; }
+			}
+
+			/* finish short writes, and redo writes the ring could not do, with pwrite() */
+
+			for (k = 0; k < count; k++) {
+
+				if (written[k] == -EINVAL || written[k] == -EOPNOTSUPP) {
+					closeWriteRing(&ring);
+					written[k] = 0;
+				}
+
+				if (written[k] < 0) {
+					errno = (int) -written[k];
+					writerFailed(writer, roomDataName(data, first + k));
+				}
+				else if (writeRest(fds[k], bufs[k], lens[k], (size_t) written[k]) != 0) {
+					writerFailed(writer, roomDataName(data, first + k));
+				}
+
+			}
+
+		}
+
+		/* close every file that was opened */
+
+		while (k > 0) {
+			k--;
+			if (fds[k] >= 0 && close(fds[k]) != 0) { writerFailed(writer, roomDataName(data, first + k)); }
+		}
+
+	}
+
+	closeWriteRing(&ring);
+	free(render);
+
+	return NULL;
+
+}
+
+
+/* write a room graph as a directory of one text file per room, in the original format, using numThreads writer threads
+   (0 for one per CPU). Returns 0 on success, -1 with a message on stderr on failure */
+
+int writeRoomTextDir(const char* dirPath, const struct RoomData* data, int numThreads) {
+
+	struct RoomWriter writer;
+	pthread_t threads[MAX_WRITER_THREADS];
+	struct rlimit fileLimit;
+	long spareFds;
+	int i, started;
+
+	if (mkdir(dirPath, 0777) != 0 && errno != EEXIST) {
+		perror(dirPath);
+		return -1;
+	}
+
+	writer.dirFd = open(dirPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (writer.dirFd < 0) {
+		perror(dirPath);
+		return -1;
+	}
+
+	writer.data = data;
+	writer.dirPath = dirPath;
+	writer.nextBatch = 0;
+	writer.failed = 0;
+	pthread_mutex_init(&writer.errorLock, NULL);
+
+	/* no more threads than CPUs */
+
+	if (numThreads <= 0) { numThreads = (int) sysconf(_SC_NPROCESSORS_ONLN); }
+	if (numThreads > MAX_WRITER_THREADS) { numThreads = MAX_WRITER_THREADS; }
+	if (numThreads < 1) { numThreads = 1; }
+
+	/* split the open file limit between the workers, keeping some descriptors back for the rings and the caller */
+
+	writer.batchSize = ROOM_BATCH;
+	if (getrlimit(RLIMIT_NOFILE, &fileLimit) == 0 && fileLimit.rlim_cur != RLIM_INFINITY) {
+		spareFds = ((long) fileLimit.rlim_cur - 32) / numThreads - 1;
+		if (spareFds < (long) writer.batchSize) { writer.batchSize = (spareFds < 1) ? 1 : (uint32_t) spareFds; }
+	}
+
+	writer.numBatches = (uint32_t) (((uint64_t) data->numRooms + writer.batchSize - 1) / writer.batchSize);
+	if ((uint32_t) numThreads > writer.numBatches) { numThreads = (int) writer.numBatches; }
+	if (numThreads < 1) { numThreads = 1; }
+
+	/* the calling thread is one of the workers */
+
+	started = 0;
+	for (i = 1; i < numThreads; i++) {
+		if (pthread_create(&threads[started], NULL, roomWriterThread, &writer) == 0) { started++; }
+	}
+
+	roomWriterThread(&writer);
+
+	for (i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	pthread_mutex_destroy(&writer.errorLock);
+	close(writer.dirFd);
+
+	return writer.failed ? -1 : 0;
+
+}
@@ -0,0 +1,787 @@
+/***********************************************************************************************************
+ *	Title: Adventure Server
+ *	Description: The server's accept and epoll loops (see hindss.server.h). Every worker watches the
+ *			listening socket with EPOLLEXCLUSIVE, so a new connection wakes one worker, which
+ *			owns the session from then on. Sessions are level triggered and answer one line at
+ *			a time: while a reply is still being sent the session waits for EPOLLOUT instead
+ *			of reading, so a client that does not read cannot make the server buffer without
+ *			limit. SIGINT or SIGTERM stops the workers through an eventfd.
+ *
+ *			A checkpoint asks every worker, through an eventfd of its own, to encode its games
+ *			into its own buffer between events; the main thread waits for them all and writes
+ *			the buffers as one snapshot file, gathered with writev().
+ *
+ *			The descriptor limit is raised as far as it goes. A worker that runs out anyway
+ *			stops watching the listening socket, which would otherwise stay readable and wake
+ *			it forever, until one of its sessions closes or a second has passed.
+ * ********************************************************************************************************/
+
+#define _GNU_SOURCE
+
+#include "hindss.server.h"
+#include "hindss.pathlog.h"
+#include "hindss.snapshot.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+
+#define SESSION_LINE_MAX 256
+#define SERVER_EVENTS 256
+
+/* milliseconds a worker out of descriptors waits before trying to accept again, if none of its sessions closes */
+
+#define ACCEPT_RETRY_MS 1000
+
+/* one game. in holds typed input up to the next newline, out the reply not yet sent */
+
+struct ServerSession {
+
+	int fd;
+	uint32_t events;
+	uint32_t current;
+
+	/* the graph the game started on, kept until it ends */
+
+	struct GraphSnapshot* graph;
+
+	/* when the game started, on the monotonic clock */
+
+	uint64_t startedNs;
+
+	/* rooms the player has stood in, varint encoded */
+
+	struct PathLog path;
+
+	uint16_t inLen;
+	uint8_t discarding;
+	uint8_t finished;
+	char in[SESSION_LINE_MAX];
+
+	char* out;
+	size_t outLen;
+	size_t outSent;
+	size_t outCap;
+
+	/* the worker's list of open sessions */
+
+	struct ServerSession* prev;
+	struct ServerSession* next;
+
+};
+
+struct ServerWorker {
+
+	pthread_t thread;
+	int epollFd;
+	int listenFd;
+	int stopFd;
+	int checkpointFd;
+
+	/* where sessions take their graph, and this worker's reader there */
+
+	struct GraphWatch* watch;
+	int reader;
+
+	struct ServerSession* sessions;
+
+	/* set while the listening socket is out of the epoll set for want of descriptors */
+
+	int acceptPaused;
+
+	/* for reading back a finished session's path */
+
+	struct PathLogCursor cursor;
+
+	/* the worker's games as of the last checkpoint */
+
+	struct SnapshotWriter snapshot;
+
+	unsigned long long accepted;
+	unsigned long long finished;
+	unsigned long long moves;
+
+};
+
+/* epoll tags for the descriptors that are not sessions */
+
+static char listenTag;
+static char stopTag;
+static char checkpointTag;
+
+/* workers still encoding their games for a checkpoint */
+
+static pthread_mutex_t checkpointLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t checkpointDone = PTHREAD_COND_INITIALIZER;
+static int checkpointsPending;
+
+/* set once running out of descriptors has been reported */
+
+static int reportedNoFds;
+
+
+/* nanoseconds on the monotonic clock */
+
+static uint64_t monotonicNs() {
+
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+
+}
+
+
+/* append len bytes of text to a session's pending reply */
+
+static void sendText(struct ServerSession* session, const char* text, size_t len) {
+
+	if (session->outLen + len > session->outCap) {
+		session->outCap = (session->outCap ? session->outCap * 2 : 512) + len;
+		session->out = realloc(session->out, session->outCap);
+	}
+
+	memcpy(session->out + session->outLen, text, len);
+	session->outLen += len;
+
+}
+
+
+/* append a NUL terminated string to a session's pending reply */
+
+static void sendString(struct ServerSession* session, const char* text) {
+
+	sendText(session, text, strlen(text));
+
+}
+
+
+/* the engine's display(): where the player is, where they can go, and the prompt */
+
+static void sendRoom(struct ServerSession* session, const struct RoomStore* store) {
+
+	uint32_t i, degree;
+	const uint32_t* neighbors = storeNeighbors(store, session->current, &degree);
+
+	sendString(session, "CURRENT LOCATION: ");
+	sendString(session, storeName(store, session->current));
+	sendString(session, "\nPOSSIBLE CONNECTIONS: ");
+
+	for (i = 0; i < degree; i++) {
+		sendString(session, storeName(store, neighbors[i]));
+		sendString(session, (i + 1 < degree) ? ", " : ".\n");
+	}
+
+	sendString(session, "WHERE TO? >");
+
+}
+
+
+/* the engine's win() and printPath() */
+
+static void sendWin(struct ServerWorker* worker, struct ServerSession* session) {
+
+	char line[64];
+	uint64_t i, steps = pathLogSize(&session->path) - 1;
+	uint32_t room;
+
+	snprintf(line, sizeof(line), "YOU TOOK %llu STEPS. YOUR PATH TO VICTORY WAS:\n", (unsigned long long) steps);
+
+	sendString(session, "YOU HAVE FOUND THE END ROOM. CONGRATULATIONS!\n");
+	sendString(session, line);
+
+	openPathLogCursor(&session->path, &worker->cursor);
+
+	for (i = 0; i < steps && nextPathRoom(&worker->cursor, &room) == 1; i++) {
+		sendString(session, storeName(&session->graph->store, room));
+		sendString(session, "\n");
+	}
+
+	closePathLogCursor(&worker->cursor);
+
+}
+
+
+/* answer one typed line the way runRound() would. A NULL line was too long to be a room */
+
+static void playLine(struct ServerWorker* worker, struct ServerSession* session, const char* line) {
+
+	const struct RoomStore* store = &session->graph->store;
+	char timeStr[128];
+	struct tm timeParts;
+	time_t curTime;
+	uint32_t target;
+
+	sendString(session, "\n");
+
+	if (line != NULL && strcmp(line, "time") == 0) {
+
+		time(&curTime);
+		localtime_r(&curTime, &timeParts);
+		strftime(timeStr, sizeof(timeStr), "%I:%M%p, %A, %B %d, %Y", &timeParts);
+
+		sendString(session, " ");
+		sendString(session, timeStr);
+		sendString(session, "\n\n");
+		sendRoom(session, store);
+		return;
+
+	}
+
+	target = (line != NULL) ? findConnection(store, session->current, line) : ROOM_NONE;
+
+	if (target == ROOM_NONE) {
+
+		sendString(session, "HUH? I DON'T UNDERSTAND THAT ROOM. TRY AGAIN.\n\n");
+		sendRoom(session, store);
+		return;
+
+	}
+
+	session->current = target;
+	appendPathLog(&session->path, target);
+
+	worker->moves++;
+
+	if (storeType(store, target) == END_ROOM) {
+
+		sendWin(worker, session);
+		session->finished = 1;
+		worker->finished++;
+
+	}
+	else {
+
+		sendRoom(session, store);
+
+	}
+
+}
+
+
+/* Send as much of the pending reply as the socket takes. Returns -1 if the connection is gone */
+
+static int flushSession(struct ServerSession* session) {
+
+	ssize_t sent;
+
+	while (session->outSent < session->outLen) {
+
+		sent = send(session->fd, session->out + session->outSent, session->outLen - session->outSent, MSG_NOSIGNAL);
+
+		if (sent < 0) {
+			if (errno == EINTR) { continue; }
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+		}
+
+		session->outSent += sent;
+
+	}
+
+	session->outLen = 0;
+	session->outSent = 0;
+
+	return 0;
+
+}
+
+
+/* Answer buffered lines one at a time for as long as each reply goes straight out. A line too long for the buffer is
+   thrown away and answered as an unknown room. Returns -1 if the connection is gone */
+
+static int serviceSession(struct ServerWorker* worker, struct ServerSession* session) {
+
+	char* newline;
+	size_t used;
+
+	while (session->outLen == 0 && !session->finished) {
+
+		newline = memchr(session->in, '\n', session->inLen);
+
+		if (newline == NULL) {
+
+			if (session->inLen == SESSION_LINE_MAX) {
+				session->inLen = 0;
+				session->discarding = 1;
+			}
+
+			break;
+
+		}
+
+		*newline = 0;
+		used = newline - session->in + 1;
+
+		if (newline > session->in && newline[-1] == '\r') { newline[-1] = 0; }
+
+		playLine(worker, session, session->discarding ? NULL : session->in);
+
+		session->discarding = 0;
+		session->inLen -= used;
+		memmove(session->in, session->in + used, session->inLen);
+
+		if (flushSession(session) != 0) { return -1; }
+
+	}
+
+	return 0;
+
+}
+
+
+/* stop watching the listening socket, or watch it again */
+
+static void pauseAccepting(struct ServerWorker* worker) {
+
+	if (epoll_ctl(worker->epollFd, EPOLL_CTL_DEL, worker->listenFd, NULL) == 0) {
+		worker->acceptPaused = 1;
+	}
+
+}
+
+static void resumeAccepting(struct ServerWorker* worker) {
+
+	struct epoll_event event;
+
+	event.events = EPOLLIN | EPOLLEXCLUSIVE;
+	event.data.ptr = &listenTag;
+
+	if (epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, worker->listenFd, &event) == 0) {
+		worker->acceptPaused = 0;
+	}
+
+}
+
+
+/* close a session and take it out of the worker's list. Its descriptor is free for a connection again */
+
+static void closeSession(struct ServerWorker* worker, struct ServerSession* session) {
+
+	if (session->prev) { session->prev->next = session->next; } else { worker->sessions = session->next; }
+	if (session->next) { session->next->prev = session->prev; }
+
+	close(session->fd);
+
+	releaseGraph(session->graph);
+	closePathLog(&session->path);
+	free(session->out);
+	free(session);
+
+	if (worker->acceptPaused) { resumeAccepting(worker); }
+
+}
+
+
+/* Watch for input while there is nothing left to send, and for room to send otherwise. Returns -1 if epoll fails */
+
+static int watchSession(struct ServerWorker* worker, struct ServerSession* session) {
+
+	struct epoll_event event;
+	uint32_t events = (session->outLen > 0) ? EPOLLOUT : EPOLLIN;
+
+	if (events == session->events) { return 0; }
+
+	event.events = events;
+	event.data.ptr = session;
+	session->events = events;
+
+	return epoll_ctl(worker->epollFd, EPOLL_CTL_MOD, session->fd, &event);
+
+}
+
+
+/* accept every waiting connection and greet each with the start room. Out of descriptors, the worker stops accepting
+   for now */
+
+static void acceptSessions(struct ServerWorker* worker) {
+
+	struct ServerSession* session;
+	struct epoll_event event;
+	int fd;
+
+	while (1) {
+
+		fd = accept4(worker->listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+		if (fd < 0) {
+
+			if (errno == EINTR || errno == ECONNABORTED) { continue; }
+
+			if (errno == EMFILE || errno == ENFILE) {
+
+				if (!__atomic_exchange_n(&reportedNoFds, 1, __ATOMIC_RELAXED)) {
+					fprintf(stderr, "adventure: out of file descriptors, waiting for sessions to end before accepting "
+						"more\n");
+				}
+
+				pauseAccepting(worker);
+
+			}
+
+			break;
+
+		}
+
+		session = calloc(1, sizeof(struct ServerSession));
+
+		session->fd = fd;
+		session->startedNs = monotonicNs();
+		session->graph = acquireGraph(worker->watch);
+		session->current = session->graph->start;
+		session->events = EPOLLIN;
+
+		initPathLog(&session->path, PATH_LOG_COMPACT);
+		appendPathLog(&session->path, session->current);
+
+		event.events = EPOLLIN;
+		event.data.ptr = session;
+
+		if (epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+			close(fd);
+			releaseGraph(session->graph);
+			closePathLog(&session->path);
+			free(session);
+			continue;
+		}
+
+		session->next = worker->sessions;
+		if (worker->sessions) { worker->sessions->prev = session; }
+		worker->sessions = session;
+
+		worker->accepted++;
+
+		sendRoom(session, &session->graph->store);
+
+		if (flushSession(session) != 0 || watchSession(worker, session) != 0) {
+			closeSession(worker, session);
+		}
+
+	}
+
+}
+
+
+/* read what a session's client has sent, answer it, and close the session when it is over */
+
+static void sessionEvent(struct ServerWorker* worker, struct ServerSession* session, uint32_t events) {
+
+	ssize_t got;
+
+	if (events & (EPOLLERR | EPOLLHUP)) {
+		closeSession(worker, session);
+		return;
+	}
+
+	if ((events & EPOLLOUT) && flushSession(session) != 0) {
+		closeSession(worker, session);
+		return;
+	}
+
+	if ((events & EPOLLIN) && session->inLen < SESSION_LINE_MAX) {
+
+		got = recv(session->fd, session->in + session->inLen, SESSION_LINE_MAX - session->inLen, 0);
+
+		if (got == 0 || (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+			closeSession(worker, session);
+			return;
+		}
+
+		if (got > 0) { session->inLen += got; }
+
+	}
+
+	if (serviceSession(worker, session) != 0 || (session->finished && session->outLen == 0)
+			|| watchSession(worker, session) != 0) {
+		closeSession(worker, session);
+	}
+
+}
+
+
+/* encode every game of a worker that has not ended into its snapshot buffer, and tell the main thread */
+
+static void snapshotSessions(struct ServerWorker* worker) {
+
+	struct ServerSession* session;
+	uint64_t now = monotonicNs(), count;
+
+	if (read(worker->checkpointFd, &count, sizeof(count)) != sizeof(count)) {
+		perror("eventfd");
+	}
+
+	clearSnapshotWriter(&worker->snapshot);
+
+	for (session = worker->sessions; session != NULL; session = session->next) {
+
+		if (!session->finished) {
+			addSessionSnapshot(&worker->snapshot, session->current, storeNumRooms(&session->graph->store),
+				storeGraphHash(&session->graph->store), &session->path, now - session->startedNs);
+		}
+
+	}
+
+	pthread_mutex_lock(&checkpointLock);
+
+	if (--checkpointsPending == 0) {
+		pthread_cond_signal(&checkpointDone);
+	}
+
+	pthread_mutex_unlock(&checkpointLock);
+
+}
+
+
+/* a worker's epoll loop, until the stop eventfd is signalled. The worker is a graph reader that is offline while it
+   waits */
+
+static void* serverWorker(void* arg) {
+
+	struct ServerWorker* worker = arg;
+	struct epoll_event events[SERVER_EVENTS];
+	int i, count, running = 1;
+
+	while (running) {
+
+		graphReaderOffline(worker->watch, worker->reader);
+
+		count = epoll_wait(worker->epollFd, events, SERVER_EVENTS, worker->acceptPaused ? ACCEPT_RETRY_MS : -1);
+
+		graphReaderOnline(worker->watch, worker->reader);
+
+		/* descriptors may have been freed elsewhere */
+
+		if (count == 0 && worker->acceptPaused) { resumeAccepting(worker); }
+
+		if (count < 0) {
+			if (errno == EINTR) { continue; }
+			perror("epoll_wait");
+			break;
+		}
+
+		for (i = 0; i < count; i++) {
+
+			if (events[i].data.ptr == &stopTag) {
+				running = 0;
+			}
+			else if (events[i].data.ptr == &listenTag) {
+				acceptSessions(worker);
+			}
+			else if (events[i].data.ptr == &checkpointTag) {
+				snapshotSessions(worker);
+			}
+			else {
+				sessionEvent(worker, events[i].data.ptr, events[i].events);
+			}
+
+		}
+
+	}
+
+	graphReaderOffline(worker->watch, worker->reader);
+
+	while (worker->sessions) {
+		closeSession(worker, worker->sessions);
+	}
+
+	return NULL;
+
+}
+
+
+/* Save every game in progress to a snapshot file at path: each worker encodes its own, and the main thread writes them
+   all at once */
+
+static void checkpointSessions(struct ServerWorker* workers, int numWorkers, const char* path) {
+
+	struct SnapshotWriter* writers = malloc(numWorkers * sizeof(struct SnapshotWriter));
+	unsigned long long sessions = 0, bytes = 0;
+	uint64_t one = 1, began = monotonicNs();
+	int i;
+
+	pthread_mutex_lock(&checkpointLock);
+	checkpointsPending = numWorkers;
+	pthread_mutex_unlock(&checkpointLock);
+
+	for (i = 0; i < numWorkers; i++) {
+		if (write(workers[i].checkpointFd, &one, sizeof(one)) != sizeof(one)) {
+			perror("eventfd");
+		}
+	}
+
+	pthread_mutex_lock(&checkpointLock);
+
+	while (checkpointsPending > 0) {
+		pthread_cond_wait(&checkpointDone, &checkpointLock);
+	}
+
+	pthread_mutex_unlock(&checkpointLock);
+
+	for (i = 0; i < numWorkers; i++) {
+		writers[i] = workers[i].snapshot;
+		sessions += writers[i].numSessions;
+		bytes += writers[i].len;
+	}
+
+	if (writeSnapshotFile(path, writers, numWorkers) == 0) {
+		fprintf(stderr, "adventure: CHECKPOINTED %llu SESSIONS, %llu BYTES, TO %s IN %.3f SECONDS\n", sessions, bytes,
+			path, (monotonicNs() - began) / 1e9);
+	}
+
+	free(writers);
+
+}
+
+
+/* Serve games on the graphs of watch at the Unix socket socketPath with numWorkers threads until SIGINT or SIGTERM.
+   Each worker is one of the readers of watch, and the calling thread is the last, so there are at most one fewer
+   workers than readers. If checkpoint is given, the games in progress are saved to it on SIGUSR1 and at shutdown.
+   Each game is played on the graph that was current when it started. Returns the exit status */
+
+int serveRooms(struct GraphWatch* watch, const char* socketPath, int numWorkers, const char* checkpoint) {
+
+	struct sockaddr_un address;
+	struct ServerWorker* workers;
+	struct epoll_event event;
+	struct GraphSnapshot* graph;
+	sigset_t signals;
+	struct rlimit limit;
+	unsigned long long accepted = 0, finished = 0, moves = 0;
+	uint64_t one = 1;
+	int listenFd, stopFd, signal, i;
+
+	if (strlen(socketPath) >= sizeof(address.sun_path)) {
+		fprintf(stderr, "%s: socket path too long\n", socketPath);
+		return 1;
+	}
+
+	if (numWorkers < 1) { numWorkers = 1; }
+	if (numWorkers > watch->numReaders - 1) { numWorkers = watch->numReaders - 1; }
+
+	/* a descriptor a session: take all the kernel allows */
+
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socketPath);
+
+	listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+	unlink(socketPath);
+
+	if (listenFd < 0 || bind(listenFd, (struct sockaddr*) &address, sizeof(address)) != 0
+			|| listen(listenFd, SOMAXCONN) != 0) {
+		perror(socketPath);
+		if (listenFd >= 0) { close(listenFd); }
+		return 1;
+	}
+
+	/* the workers leave SIGINT, SIGTERM and SIGUSR1 to the main thread's sigwait() */
+
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	sigaddset(&signals, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+	stopFd = eventfd(0, EFD_CLOEXEC);
+
+	workers = calloc(numWorkers, sizeof(struct ServerWorker));
+
+	for (i = 0; i < numWorkers; i++) {
+
+		workers[i].watch = watch;
+		workers[i].reader = i;
+		workers[i].listenFd = listenFd;
+		workers[i].stopFd = stopFd;
+		workers[i].checkpointFd = eventfd(0, EFD_CLOEXEC);
+		workers[i].epollFd = epoll_create1(EPOLL_CLOEXEC);
+
+		initSnapshotWriter(&workers[i].snapshot);
+
+		event.events = EPOLLIN | EPOLLEXCLUSIVE;
+		event.data.ptr = &listenTag;
+		epoll_ctl(workers[i].epollFd, EPOLL_CTL_ADD, listenFd, &event);
+
+		event.events = EPOLLIN;
+		event.data.ptr = &stopTag;
+		epoll_ctl(workers[i].epollFd, EPOLL_CTL_ADD, stopFd, &event);
+
+		event.events = EPOLLIN;
+		event.data.ptr = &checkpointTag;
+		epoll_ctl(workers[i].epollFd, EPOLL_CTL_ADD, workers[i].checkpointFd, &event);
+
+		pthread_create(&workers[i].thread, NULL, serverWorker, &workers[i]);
+
+	}
+
+	graphReaderOnline(watch, watch->numReaders - 1);
+	graph = acquireGraph(watch);
+	graphReaderOffline(watch, watch->numReaders - 1);
+
+	fprintf(stderr, "adventure: serving %u rooms on %s with %d workers\n", storeNumRooms(&graph->store), socketPath,
+		numWorkers);
+
+	releaseGraph(graph);
+
+	/* SIGUSR1 checkpoints and carries on; the others stop the server, after a last checkpoint */
+
+	while (sigwait(&signals, &signal) == 0 && signal == SIGUSR1) {
+
+		if (checkpoint != NULL) {
+			checkpointSessions(workers, numWorkers, checkpoint);
+		}
+		else {
+			fprintf(stderr, "adventure: no checkpoint file to save games to\n");
+		}
+
+	}
+
+	if (checkpoint != NULL) {
+		checkpointSessions(workers, numWorkers, checkpoint);
+	}
+
+	/* the eventfd stays readable, so every worker sees it */
+
+	if (write(stopFd, &one, sizeof(one)) != sizeof(one)) {
+		perror("eventfd");
+	}
+
+	for (i = 0; i < numWorkers; i++) {
+
+		pthread_join(workers[i].thread, NULL);
+		close(workers[i].epollFd);
+		close(workers[i].checkpointFd);
+		freeSnapshotWriter(&workers[i].snapshot);
+
+		accepted += workers[i].accepted;
+		finished += workers[i].finished;
+		moves += workers[i].moves;
+
+	}
+
+	fprintf(stderr, "adventure: %llu SESSIONS, %llu FINISHED, %llu MOVES\n", accepted, finished, moves);
+
+	close(stopFd);
+	close(listenFd);
+	unlink(socketPath);
+
+	free(workers);
+
+	return 0;
+
+}
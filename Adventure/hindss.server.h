@@ -0,0 +1,24 @@
+/***********************************************************************************************************
+ *	Title: Adventure Server
+ *	Description: Many games at once over a local Unix socket, all played on room stores that are
+ *			loaded once and only ever read. Each connection is a game: the server sends the
+ *			same text the engine prints, reads one typed room name per line, and closes the
+ *			connection once the player has entered END_ROOM and been shown the path.
+ *
+ *			A few worker threads each run an epoll loop over the sessions they accepted, so a
+ *			session is only ever touched by one thread and needs no lock. A session is its
+ *			socket, the graph snapshot it started on (see hindss.graphwatch.h), the room it is
+ *			in, a compact log of its path (see hindss.pathlog.h) and its line buffers. A graph
+ *			swapped in while the server runs is played by the sessions that start after it.
+ * ********************************************************************************************************/
+
+#include "hindss.graphwatch.h"
+
+#ifndef HINDSS_SERVER_H
+#define HINDSS_SERVER_H
+
+#define SERVER_DEFAULT_WORKERS 4
+
+int serveRooms(struct GraphWatch* , const char* , int, const char* );
+
+#endif
@@ -0,0 +1,407 @@
+/***********************************************************************************************************
+ *	Title: Session Snapshots
+ *	Description: Writing and reading snapshot files (see hindss.snapshot.h). Every record and path is
+ *			padded to 8 bytes, so each writer's buffer is whole words and the checksum can be
+ *			run across several writers' buffers as if they were one.
+ * ********************************************************************************************************/
+
+#define _GNU_SOURCE
+
+#include "hindss.snapshot.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#define ALIGN8(x) (((x) + 7) & ~(uint64_t) 7)
+
+#define CHECKSUM_SEED 14695981039104346037ULL
+#define CHECKSUM_PRIME 1099511628211ULL
+
+/* most buffers one writev() takes */
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+
+/* Fold len bytes, a multiple of 8, into hash a word at a time, FNV style with the high half folded back down */
+
+static uint64_t checksumWords(uint64_t hash, const uint8_t* bytes, size_t len) {
+
+	uint64_t word;
+	size_t i;
+
+	for (i = 0; i < len; i += 8) {
+
+		memcpy(&word, bytes + i, sizeof(word));
+
+		hash = (hash ^ word) * CHECKSUM_PRIME;
+		hash ^= hash >> 32;
+
+	}
+
+	return hash;
+
+}
+
+
+/* Start a writer with no sessions */
+
+void initSnapshotWriter(struct SnapshotWriter* writer) {
+
+	memset(writer, 0, sizeof(*writer));
+
+}
+
+
+/* Add a session in room current of a graph of graphRooms rooms hashing to graphHash, with its path and the time it has
+   been played for. Returns 0, or -1 with a message on stderr if the path's trace cannot be read back */
+
+int addSessionSnapshot(struct SnapshotWriter* writer, uint32_t current, uint32_t graphRooms, uint64_t graphHash,
+		const struct PathLog* path, uint64_t elapsedNs) {
+
+	struct SessionRecord record;
+	size_t pathBytes = pathLogEncodedSize(path);
+	size_t need = sizeof(record) + ALIGN8(pathBytes);
+
+	if (writer->len + need > writer->cap) {
+		writer->cap = (writer->cap ? writer->cap * 2 : 4096) + need;
+		writer->bytes = realloc(writer->bytes, writer->cap);
+	}
+
+	memset(&record, 0, sizeof(record));
+	record.current = current;
+	record.graphRooms = graphRooms;
+	record.encoding = path->encoding;
+	record.last = path->last;
+	record.elapsedNs = elapsedNs;
+	record.pathRooms = pathLogSize(path);
+	record.pathBytes = pathBytes;
+	record.graphHash = graphHash;
+
+	if (copyPathLogBytes(path, writer->bytes + writer->len + sizeof(record)) != 0) {
+		return -1;
+	}
+
+	memcpy(writer->bytes + writer->len, &record, sizeof(record));
+	memset(writer->bytes + writer->len + sizeof(record) + pathBytes, 0, ALIGN8(pathBytes) - pathBytes);
+
+	writer->len += need;
+	writer->numSessions++;
+
+	return 0;
+
+}
+
+
+/* Empty a writer, keeping its buffer */
+
+void clearSnapshotWriter(struct SnapshotWriter* writer) {
+
+	writer->len = 0;
+	writer->numSessions = 0;
+
+}
+
+
+/* release a writer */
+
+void freeSnapshotWriter(struct SnapshotWriter* writer) {
+
+	free(writer->bytes);
+	initSnapshotWriter(writer);
+
+}
+
+
+/* Write iov in full with as few writev() calls as it takes, at most IOV_MAX buffers to a call, advancing iov past what
+   is written. Returns 0, or -1 with errno set */
+
+static int writeAll(int fd, struct iovec* iov, int count) {
+
+	ssize_t written;
+
+	while (count > 0) {
+
+		written = writev(fd, iov, count < IOV_MAX ? count : IOV_MAX);
+
+		if (written < 0) {
+			if (errno == EINTR) { continue; }
+			return -1;
+		}
+
+		while (count > 0 && (size_t) written >= iov->iov_len) {
+			written -= iov->iov_len;
+			iov++;
+			count--;
+		}
+
+		if (count > 0) {
+			iov->iov_base = (char*) iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+
+	}
+
+	return 0;
+
+}
+
+
+/* Write the sessions of numWriters writers, in order, as one snapshot file at path, replacing any snapshot there only
+   once the new one is complete and on disk. Returns 0, or -1 with a message on stderr */
+
+int writeSnapshotFile(const char* path, struct SnapshotWriter* writers, int numWriters) {
+
+	struct SnapshotHeader header;
+	struct iovec* iov;
+	char tempPath[PATH_MAX];
+	const char* base = strrchr(path, '/');
+	uint64_t sessions = 0;
+	int fd, i, failed;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version = SNAPSHOT_VERSION;
+	header.byteOrder = BYTE_ORDER_MARK;
+	header.checksum = CHECKSUM_SEED;
+
+	iov = malloc((numWriters + 1) * sizeof(struct iovec));
+	iov[0].iov_base = &header;
+	iov[0].iov_len = sizeof(header);
+
+	for (i = 0; i < numWriters; i++) {
+
+		sessions += writers[i].numSessions;
+		header.payloadSize += writers[i].len;
+		header.checksum = checksumWords(header.checksum, writers[i].bytes, writers[i].len);
+
+		iov[i + 1].iov_base = writers[i].bytes;
+		iov[i + 1].iov_len = writers[i].len;
+
+	}
+
+	if (sessions > UINT32_MAX) {
+		fprintf(stderr, "%s: too many sessions for one snapshot\n", path);
+		free(iov);
+		return -1;
+	}
+
+	header.numSessions = (uint32_t) sessions;
+
+	/* a hidden name beside path, as for packed room files */
+
+	base = base ? base + 1 : path;
+
+	if (snprintf(tempPath, sizeof(tempPath), "%.*s.%s.%d", (int) (base - path), path, base, (int) getpid())
+			>= (int) sizeof(tempPath)) {
+		fprintf(stderr, "%s: path too long\n", path);
+		free(iov);
+		return -1;
+	}
+
+	fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+	if (fd < 0) {
+		perror(tempPath);
+		free(iov);
+		return -1;
+	}
+
+	failed = writeAll(fd, iov, numWriters + 1) != 0 || fsync(fd) != 0;
+	free(iov);
+
+	if (close(fd) != 0) { failed = 1; }
+
+	if (failed || rename(tempPath, path) != 0) {
+		perror(path);
+		unlink(tempPath);
+		return -1;
+	}
+
+	return 0;
+
+}
+
+
+/* Read the snapshot file at path into memory and check its header and checksum. Returns 0, or -1 with a message on
+   stderr */
+
+int readSnapshotFile(const char* path, struct SnapshotFile* file) {
+
+	struct SnapshotHeader header;
+	struct stat info;
+	ssize_t got;
+	size_t done = 0;
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	memset(file, 0, sizeof(*file));
+
+	if (fd < 0 || fstat(fd, &info) != 0) {
+		perror(path);
+		if (fd >= 0) { close(fd); }
+		return -1;
+	}
+
+	file->size = info.st_size;
+	file->bytes = malloc(file->size ? file->size : 1);
+
+	while (done < file->size) {
+
+		got = read(fd, file->bytes + done, file->size - done);
+
+		if (got < 0 && errno == EINTR) { continue; }
+
+		if (got <= 0) {
+			if (got < 0) { perror(path); } else { fprintf(stderr, "%s: file shrank while being read\n", path); }
+			close(fd);
+			closeSnapshotFile(file);
+			return -1;
+		}
+
+		done += got;
+
+	}
+
+	close(fd);
+
+	if (file->size < sizeof(header)) {
+		fprintf(stderr, "%s: not a session snapshot\n", path);
+		closeSnapshotFile(file);
+		return -1;
+	}
+
+	memcpy(&header, file->bytes, sizeof(header));
+
+	if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) == 0 && otherByteOrder(header.byteOrder)) {
+		fprintf(stderr, "%s: session snapshot is of the other byte order\n", path);
+		closeSnapshotFile(file);
+		return -1;
+	}
+
+	if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 || header.version != SNAPSHOT_VERSION
+			|| header.byteOrder != BYTE_ORDER_MARK) {
+		fprintf(stderr, "%s: not a session snapshot of this version\n", path);
+		closeSnapshotFile(file);
+		return -1;
+	}
+
+	if (header.payloadSize != file->size - sizeof(header) || header.payloadSize % 8 != 0
+			|| checksumWords(CHECKSUM_SEED, file->bytes + sizeof(header), header.payloadSize) != header.checksum) {
+		fprintf(stderr, "%s: snapshot is damaged (size or checksum mismatch)\n", path);
+		closeSnapshotFile(file);
+		return -1;
+	}
+
+	file->numSessions = header.numSessions;
+	file->sessionsRead = 0;
+	file->pos = sizeof(header);
+
+	return 0;
+
+}
+
+
+/* Store the next session in session. Returns 1, or 0 after the last session, or -1 if a record does not fit */
+
+int nextSessionSnapshot(struct SnapshotFile* file, struct SessionSnapshot* session) {
+
+	uint64_t left;
+
+	if (file->sessionsRead == file->numSessions) { return 0; }
+
+	left = file->size - file->pos;
+
+	if (left < sizeof(session->record)) { return -1; }
+
+	memcpy(&session->record, file->bytes + file->pos, sizeof(session->record));
+
+	if (session->record.pathBytes > left - sizeof(session->record)
+			|| ALIGN8(session->record.pathBytes) > left - sizeof(session->record)) {
+		return -1;
+	}
+
+	session->path = file->bytes + file->pos + sizeof(session->record);
+
+	file->pos += sizeof(session->record) + ALIGN8(session->record.pathBytes);
+	file->sessionsRead++;
+
+	return 1;
+
+}
+
+
+/* Boolean: to is one of from's connections */
+
+static int connected(const struct RoomStore* store, uint32_t from, uint32_t to) {
+
+	uint32_t k, degree;
+	const uint32_t* neighbors = storeNeighbors(store, from, &degree);
+
+	for (k = 0; k < degree; k++) {
+		if (neighbors[k] == to) { return 1; }
+	}
+
+	return 0;
+
+}
+
+
+/* Load a session's path into path, a log that has not been initialized, after checking that it decodes to the rooms
+   the record gives, each connected to the one before in store, ending in the current room. Returns 0, or -1 if it does
+   not */
+
+int restoreSessionPath(const struct SessionSnapshot* session, const struct RoomStore* store, struct PathLog* path) {
+
+	const struct SessionRecord* record = &session->record;
+	struct PathLogCursor* cursor;
+	uint64_t rooms = 0;
+	uint32_t room = 0, previous = 0;
+	int status;
+
+	if (record->encoding > PATH_LOG_COMPACT || record->pathRooms == 0 || record->current != record->last
+			|| record->graphRooms != storeNumRooms(store) || record->current >= record->graphRooms) {
+		return -1;
+	}
+
+	initPathLog(path, record->encoding);
+	loadPathLog(path, session->path, record->pathBytes, record->pathRooms, record->last);
+
+	cursor = malloc(sizeof(struct PathLogCursor));
+	openPathLogCursor(path, cursor);
+
+	while ((status = nextPathRoom(cursor, &room)) == 1 && room < record->graphRooms
+			&& (rooms == 0 || connected(store, previous, room))) {
+		previous = room;
+		rooms++;
+	}
+
+	closePathLogCursor(cursor);
+	free(cursor);
+
+	if (status != 0 || rooms != record->pathRooms || room != record->last) {
+		closePathLog(path);
+		return -1;
+	}
+
+	return 0;
+
+}
+
+
+/* release a snapshot file read into memory */
+
+void closeSnapshotFile(struct SnapshotFile* file) {
+
+	free(file->bytes);
+	file->bytes = NULL;
+	file->size = 0;
+
+}
@@ -0,0 +1,106 @@
+/***********************************************************************************************************
+ *	Title: Session Snapshots
+ *	Description: Games in progress saved to a binary file and resumed from it. A snapshot file holds
+ *			any number of sessions, so a server can save thousands of them in one write: a
+ *			struct SnapshotHeader, then for each session a struct SessionRecord followed by
+ *			its path log's encoded bytes (see hindss.pathlog.h), padded to 8 bytes.
+ *
+ *			The header's checksum covers everything after it, hashed a 64 bit word at a time,
+ *			and a file is written under a hidden temporary name, synced and renamed into
+ *			place, so a reader sees a whole snapshot or the one before it. Reading one back
+ *			is a single read and a pass over the bytes; a session's path is copied into its
+ *			log as it was encoded, then decoded once to check it is a walk through the graph.
+ * ********************************************************************************************************/
+
+#include "hindss.byteorder.h"
+#include "hindss.pathlog.h"
+#include "hindss.roomstore.h"
+
+#ifndef HINDSS_SNAPSHOT_H
+#define HINDSS_SNAPSHOT_H
+
+#define SNAPSHOT_MAGIC "HSSNAPS1"
+#define SNAPSHOT_VERSION 1
+
+/* header and record fields, and the 32 bit rooms of a plain path, are in the byte order of the machine that wrote the
+   snapshot, which byteOrder records */
+
+struct SnapshotHeader {
+
+	char magic[8];
+	uint32_t version;
+	uint32_t numSessions;
+	uint64_t byteOrder;
+	uint64_t payloadSize;
+	uint64_t checksum;
+
+};
+
+struct SessionRecord {
+
+	/* the room the player is in, which is also the last room of the path */
+
+	uint32_t current;
+
+	/* rooms in the graph the session was played on */
+
+	uint32_t graphRooms;
+
+	/* the path log's encoding and the last room appended to it */
+
+	uint32_t encoding;
+	uint32_t last;
+
+	uint64_t elapsedNs;
+	uint64_t pathRooms;
+	uint64_t pathBytes;
+
+	/* the graphHash of that graph's room store */
+
+	uint64_t graphHash;
+
+};
+
+/* sessions encoded back to back, ready to be written */
+
+struct SnapshotWriter {
+
+	uint8_t* bytes;
+	size_t len;
+	size_t cap;
+	uint32_t numSessions;
+
+};
+
+/* a snapshot file read into memory, and the next session to be read from it */
+
+struct SnapshotFile {
+
+	uint8_t* bytes;
+	size_t size;
+	uint32_t numSessions;
+	uint32_t sessionsRead;
+	size_t pos;
+
+};
+
+/* one session read back. path points into the snapshot file's bytes */
+
+struct SessionSnapshot {
+
+	struct SessionRecord record;
+	const uint8_t* path;
+
+};
+
+void initSnapshotWriter(struct SnapshotWriter* );
+int addSessionSnapshot(struct SnapshotWriter* , uint32_t, uint32_t, uint64_t, const struct PathLog* , uint64_t);
+void clearSnapshotWriter(struct SnapshotWriter* );
+void freeSnapshotWriter(struct SnapshotWriter* );
+int writeSnapshotFile(const char* , struct SnapshotWriter* , int);
+int readSnapshotFile(const char* , struct SnapshotFile* );
+int nextSessionSnapshot(struct SnapshotFile* , struct SessionSnapshot* );
+int restoreSessionPath(const struct SessionSnapshot* , const struct RoomStore* , struct PathLog* );
+void closeSnapshotFile(struct SnapshotFile* );
+
+#endif
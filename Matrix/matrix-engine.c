@@ -0,0 +1,621 @@
+/***********************************************************************************************************
+ *	Title: Matrix Engine
+ *	Description: The matrix script's operations compiled: dims, transpose, mean, add and multiply,
+ *			reading and writing the same tab separated integers and failing with the same
+ *			messages. The script runs this program in its place when it finds it beside
+ *			itself. To call, type ./matrix-engine [function] [arg1]...[argn].
+ *
+ *			As in the script, a row is a line, the last one whether or not a newline ends it,
+ *			the columns are the words of the first row, and arithmetic is bash's:
+ *			64 bit integers that wrap on overflow. The mean of a column rounds half away from
+ *			zero, (sum + (rows/2)*((sum>0)*2-1))/rows. Operations exit 0, or 1 with a message
+ *			on stderr. Rows that are not all as long as the first, and entries that are not
+ *			integers, are errors here rather than garbage out.
+ *
+ *			multiply is blocked and threaded (see matrix-gemm.h). MATRIX_THREADS sets how many
+ *			threads it uses, one per processor by default, and MATRIX_KERNEL picks its kernel
+ *			(scalar, avx2 or avx512) over the fastest the processor runs.
+ * ********************************************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "matrix-gemm.h"
+
+#define READ_CHUNK 65536
+#define OUTPUT_BUFFER 65536
+
+/* a matrix of rows x cols entries, row by row */
+
+struct Matrix {
+
+	uint64_t rows;
+	uint64_t cols;
+	int64_t* values;
+
+};
+
+/* the text of an input, and where each word of it is */
+
+struct MatrixText {
+
+	char* text;
+	size_t len;
+
+	uint64_t rows;
+	uint64_t cols;
+
+	/* start and length of every word, row by row */
+
+	size_t* wordStart;
+	uint32_t* wordLen;
+	uint64_t numWords;
+
+};
+
+/* stdout, buffered here so that printing a large matrix is not a call per entry */
+
+static char output[OUTPUT_BUFFER];
+static size_t outputLen;
+
+
+/* write out what is buffered */
+
+static void flushOutput() {
+
+	if (outputLen > 0 && fwrite(output, 1, outputLen, stdout) != outputLen) {
+		perror("matrix-engine");
+		exit(1);
+	}
+
+	outputLen = 0;
+
+}
+
+
+/* buffer len bytes of text for stdout */
+
+static void putText(const char* text, size_t len) {
+
+	if (outputLen + len > OUTPUT_BUFFER) {
+		flushOutput();
+	}
+
+	if (len > OUTPUT_BUFFER) {
+		if (fwrite(text, 1, len, stdout) != len) { perror("matrix-engine"); exit(1); }
+		return;
+	}
+
+	memcpy(output + outputLen, text, len);
+	outputLen += len;
+
+}
+
+
+/* buffer one character for stdout */
+
+static void putChar(char c) {
+
+	if (outputLen == OUTPUT_BUFFER) {
+		flushOutput();
+	}
+
+	output[outputLen++] = c;
+
+}
+
+
+/* buffer an integer in decimal for stdout */
+
+static void putInteger(int64_t value) {
+
+	char digits[24];
+	uint64_t magnitude = (value < 0) ? 0 - (uint64_t) value : (uint64_t) value;
+	int n = 0;
+
+	do {
+		digits[n++] = '0' + magnitude % 10;
+		magnitude /= 10;
+	} while (magnitude > 0);
+
+	if (value < 0) { putChar('-'); }
+
+	while (n > 0) {
+		putChar(digits[--n]);
+	}
+
+}
+
+
+/* print one row of values, tab separated, and a newline */
+
+static void putRow(const int64_t* values, uint64_t count) {
+
+	uint64_t j;
+
+	for (j = 0; j < count; j++) {
+		if (j > 0) { putChar('\t'); }
+		putInteger(values[j]);
+	}
+
+	putChar('\n');
+
+}
+
+
+/* Read all of the file at path, or stdin if path is NULL, into text. Returns 0, or -1 if it cannot be read */
+
+static int readInput(const char* path, struct MatrixText* input) {
+
+	FILE* in = (path != NULL) ? fopen(path, "r") : stdin;
+	size_t cap = READ_CHUNK, got;
+
+	memset(input, 0, sizeof(*input));
+
+	if (in == NULL) { return -1; }
+
+	input->text = malloc(cap);
+
+	while ((got = fread(input->text + input->len, 1, cap - input->len, in)) > 0) {
+
+		input->len += got;
+
+		if (input->len == cap) {
+			cap *= 2;
+			input->text = realloc(input->text, cap);
+		}
+
+	}
+
+	if (ferror(in)) {
+		if (path != NULL) { fclose(in); }
+		free(input->text);
+		input->text = NULL;
+		return -1;
+	}
+
+	if (path != NULL) { fclose(in); }
+
+	return 0;
+
+}
+
+
+/* Boolean: c separates words */
+
+static inline int isSpace(char c) {
+
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+
+}
+
+
+/* Find the rows of an input and the words of each. With whole set, every row must have as many words as the first,
+   which gives the columns; otherwise only the rows and the first row's words are counted, which is all dims needs.
+   Returns 0, or -1 with a message on stderr for rows of different lengths */
+
+static int splitInput(struct MatrixText* input, int whole) {
+
+	size_t pos = 0, end, start, cap = 0;
+	uint64_t words;
+
+	while ((end = pos) < input->len) {
+
+		/* a row runs to its newline, or for the last row possibly to the end of the input */
+
+		while (end < input->len && input->text[end] != '\n') { end++; }
+
+		words = 0;
+
+		while (pos < end) {
+
+			while (pos < end && isSpace(input->text[pos])) { pos++; }
+			if (pos == end) { break; }
+
+			start = pos;
+			while (pos < end && !isSpace(input->text[pos])) { pos++; }
+
+			if (whole) {
+
+				if (input->numWords == cap) {
+					cap = cap ? cap * 2 : 1024;
+					input->wordStart = realloc(input->wordStart, cap * sizeof(size_t));
+					input->wordLen = realloc(input->wordLen, cap * sizeof(uint32_t));
+				}
+
+				input->wordStart[input->numWords] = start;
+				input->wordLen[input->numWords] = pos - start;
+				input->numWords++;
+
+			}
+
+			words++;
+
+		}
+
+		if (input->rows == 0) {
+			input->cols = words;
+		}
+		else if (whole && words != input->cols) {
+			fprintf(stderr, "matrix rows are not all the same length\n");
+			return -1;
+		}
+
+		input->rows++;
+		pos = end + 1;
+
+		if (!whole && input->rows == 1) {
+
+			/* the rest only needs counting */
+
+			for (; pos < input->len; pos++) {
+				if (input->text[pos] == '\n' || pos == input->len - 1) { input->rows++; }
+			}
+
+		}
+
+	}
+
+	return 0;
+
+}
+
+
+/* release an input */
+
+static void freeInput(struct MatrixText* input) {
+
+	free(input->text);
+	free(input->wordStart);
+	free(input->wordLen);
+
+	memset(input, 0, sizeof(*input));
+
+}
+
+
+/* Parse a word as bash would an integer, wrapping past 64 bits. Returns 0, or -1 if it is not an integer */
+
+static int parseInteger(const char* word, uint32_t len, int64_t* value) {
+
+	uint64_t magnitude = 0;
+	uint32_t i = 0;
+	int negative = 0;
+
+	if (len > 0 && (word[0] == '-' || word[0] == '+')) {
+		negative = (word[0] == '-');
+		i = 1;
+	}
+
+	if (i == len) { return -1; }
+
+	for (; i < len; i++) {
+
+		if (word[i] < '0' || word[i] > '9') { return -1; }
+
+		magnitude = magnitude * 10 + (word[i] - '0');
+
+	}
+
+	*value = (int64_t) (negative ? 0 - magnitude : magnitude);
+
+	return 0;
+
+}
+
+
+/* Read the matrix at path, or on stdin if path is NULL, into m. unreadable is the message if the file cannot be read.
+   Returns 0, or -1 with a message on stderr */
+
+static int loadMatrix(const char* path, const char* unreadable, struct Matrix* m) {
+
+	struct MatrixText input;
+	uint64_t i;
+
+	if ((path != NULL && access(path, R_OK) != 0) || readInput(path, &input) != 0) {
+		fprintf(stderr, "%s\n", unreadable);
+		return -1;
+	}
+
+	if (splitInput(&input, 1) != 0) {
+		freeInput(&input);
+		return -1;
+	}
+
+	m->rows = input.rows;
+	m->cols = input.cols;
+	m->values = malloc((input.numWords ? input.numWords : 1) * sizeof(int64_t));
+
+	for (i = 0; i < input.numWords; i++) {
+
+		if (parseInteger(input.text + input.wordStart[i], input.wordLen[i], &m->values[i]) != 0) {
+			fprintf(stderr, "matrix entries must be integers\n");
+			free(m->values);
+			freeInput(&input);
+			return -1;
+		}
+
+	}
+
+	freeInput(&input);
+
+	return 0;
+
+}
+
+
+/* dims: the rows and the columns of one matrix */
+
+static int dims(int argc, char** argv) {
+
+	struct MatrixText input;
+
+	if (argc > 1) {
+		fprintf(stderr, "too many args to matrix dims\n");
+		return 1;
+	}
+
+	if ((argc == 1 && access(argv[0], R_OK) != 0) || readInput(argc == 1 ? argv[0] : NULL, &input) != 0) {
+		fprintf(stderr, "cannot get dims of unreadable file\n");
+		return 1;
+	}
+
+	splitInput(&input, 0);
+
+	printf("%llu %llu\n", (unsigned long long) input.rows, (unsigned long long) input.cols);
+
+	freeInput(&input);
+
+	return 0;
+
+}
+
+
+/* transpose: one matrix flipped about its diagonal. Entries are copied as they were written */
+
+static int transpose(int argc, char** argv) {
+
+	struct MatrixText input;
+	uint64_t i, j, w;
+
+	if (argc > 1) {
+		fprintf(stderr, "too many args\n");
+		return 1;
+	}
+
+	if ((argc == 1 && access(argv[0], R_OK) != 0) || readInput(argc == 1 ? argv[0] : NULL, &input) != 0) {
+		fprintf(stderr, "cannot transpose unreadable file\n");
+		return 1;
+	}
+
+	if (splitInput(&input, 1) != 0) {
+		freeInput(&input);
+		return 1;
+	}
+
+	for (j = 0; j < input.cols; j++) {
+
+		for (i = 0; i < input.rows; i++) {
+
+			w = i * input.cols + j;
+
+			if (i > 0) { putChar('\t'); }
+			putText(input.text + input.wordStart[w], input.wordLen[w]);
+
+		}
+
+		putChar('\n');
+
+	}
+
+	flushOutput();
+	freeInput(&input);
+
+	return 0;
+
+}
+
+
+/* mean: the mean of each column of one matrix, rounded half away from zero */
+
+static int mean(int argc, char** argv) {
+
+	struct Matrix m;
+	uint64_t* sums;
+	uint64_t i, j;
+	int64_t sum, rows, half;
+
+	if (argc > 1) {
+		fprintf(stderr, "too many args\n");
+		return 1;
+	}
+
+	if (loadMatrix(argc == 1 ? argv[0] : NULL, "cannot find mean of unreadable file", &m) != 0) {
+		return 1;
+	}
+
+	if (m.rows < 1) {
+		fprintf(stderr, "cannot find mean vector of a matrix with 0 rows\n");
+		free(m.values);
+		return 1;
+	}
+
+	/* sums wrap as bash's do */
+
+	sums = calloc(m.cols ? m.cols : 1, sizeof(uint64_t));
+
+	for (i = 0; i < m.rows; i++) {
+		for (j = 0; j < m.cols; j++) {
+			sums[j] += (uint64_t) m.values[i * m.cols + j];
+		}
+	}
+
+	rows = (int64_t) m.rows;
+	half = rows / 2;
+
+	for (j = 0; j < m.cols; j++) {
+
+		sum = (int64_t) sums[j];
+
+		if (j > 0) { putChar('\t'); }
+		putInteger((int64_t) ((uint64_t) sum + (uint64_t) half * (uint64_t) ((sum > 0) * 2 - 1)) / rows);
+
+	}
+
+	putChar('\n');
+
+	flushOutput();
+	free(sums);
+	free(m.values);
+
+	return 0;
+
+}
+
+
+/* add: the sum of two matrices of the same dimensions. As in the script, a second matrix not named is read on stdin */
+
+static int add(int argc, char** argv) {
+
+	struct Matrix a, b;
+	uint64_t i, j;
+	int64_t* row;
+
+	if (argc > 2) {
+		fprintf(stderr, "too many args\n");
+		return 1;
+	}
+
+	if (argc < 1) {
+		fprintf(stderr, "no args to matrix add\n");
+		return 1;
+	}
+
+	if (access(argv[0], R_OK) != 0 || (argc == 2 && access(argv[1], R_OK) != 0)) {
+		fprintf(stderr, "cannot add unreadable file\n");
+		return 1;
+	}
+
+	if (loadMatrix(argv[0], "cannot add unreadable file", &a) != 0) {
+		return 1;
+	}
+
+	if (loadMatrix(argc == 2 ? argv[1] : NULL, "cannot add unreadable file", &b) != 0) {
+		free(a.values);
+		return 1;
+	}
+
+	if (a.rows != b.rows || a.cols != b.cols) {
+		fprintf(stderr, "This is an error\n");
+		free(a.values);
+		free(b.values);
+		return 1;
+	}
+
+	for (i = 0; i < a.rows; i++) {
+
+		row = a.values + i * a.cols;
+
+		for (j = 0; j < a.cols; j++) {
+			row[j] = (int64_t) ((uint64_t) row[j] + (uint64_t) b.values[i * a.cols + j]);
+		}
+
+		putRow(row, a.cols);
+
+	}
+
+	flushOutput();
+	free(a.values);
+	free(b.values);
+
+	return 0;
+
+}
+
+
+/* multiply: the product of two matrices, the first with as many columns as the second has rows */
+
+static int multiply(int argc, char** argv) {
+
+	struct Matrix a, b;
+	const struct GemmKernel* kernel = NULL;
+	const char* setting;
+	int numThreads = defaultGemmThreads();
+	int64_t* product;
+	uint64_t i;
+
+	if (argc > 2) {
+		fprintf(stderr, "too many args\n");
+		return 1;
+	}
+
+	if (argc < 2) {
+		fprintf(stderr, "too few args\n");
+		return 1;
+	}
+
+	if (access(argv[0], R_OK) != 0 || access(argv[1], R_OK) != 0) {
+		fprintf(stderr, "cannot multiply unreadable file\n");
+		return 1;
+	}
+
+	if (loadMatrix(argv[0], "cannot multiply unreadable file", &a) != 0) {
+		return 1;
+	}
+
+	if (loadMatrix(argv[1], "cannot multiply unreadable file", &b) != 0) {
+		free(a.values);
+		return 1;
+	}
+
+	if (a.cols != b.rows) {
+		fprintf(stderr, "undefined matrix multiplication\n");
+		free(a.values);
+		free(b.values);
+		return 1;
+	}
+
+	/* an unknown or unsupported kernel falls back to the best one */
+
+	if ((setting = getenv("MATRIX_THREADS")) != NULL && atoi(setting) > 0) { numThreads = atoi(setting); }
+	if ((setting = getenv("MATRIX_KERNEL")) != NULL) { kernel = findGemmKernel(setting); }
+
+	product = malloc((a.rows * b.cols + 1) * sizeof(int64_t));
+
+	multiplyMatrices(a.values, b.values, product, a.rows, a.cols, b.cols, numThreads, kernel);
+
+	for (i = 0; i < a.rows; i++) {
+		putRow(product + i * b.cols, b.cols);
+	}
+
+	flushOutput();
+	free(product);
+	free(a.values);
+	free(b.values);
+
+	return 0;
+
+}
+
+
+int main(int argc, char** argv) {
+
+	if (argc >= 2) {
+
+		if (strcmp(argv[1], "dims") == 0) { return dims(argc - 2, argv + 2); }
+		if (strcmp(argv[1], "transpose") == 0) { return transpose(argc - 2, argv + 2); }
+		if (strcmp(argv[1], "mean") == 0) { return mean(argc - 2, argv + 2); }
+		if (strcmp(argv[1], "add") == 0) { return add(argc - 2, argv + 2); }
+		if (strcmp(argv[1], "multiply") == 0) { return multiply(argc - 2, argv + 2); }
+
+	}
+
+	fprintf(stderr, "usage: %s dims|transpose|mean|add|multiply [FILE]...\n", argv[0]);
+
+	return 1;
+
+}
@@ -0,0 +1,633 @@
+/***********************************************************************************************************
+ *	Title: Matrix Multiply
+ *	Description: Blocked, threaded multiply (see matrix-gemm.h). The product is built a block of b at
+ *			a time, GEMM_BLOCK_DEPTH rows by GEMM_BLOCK_COLS columns: the threads pack the
+ *			block's column panels together, then claim rows of a a block at a time, pack
+ *			them, and run the kernel over every tile of those rows against every panel.
+ *
+ *			When every entry of both matrices fits in 32 bits each product fits in 64, and
+ *			the SIMD kernels use a single 32 x 32 -> 64 bit multiply. Otherwise AVX-512
+ *			multiplies 64 bit lanes directly and AVX2 builds the low 64 bits of a product
+ *			from three 32 bit multiplies.
+ * ********************************************************************************************************/
+
+#define _GNU_SOURCE
+
+#include "matrix-gemm.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <immintrin.h>
+
+/* the block of b packed at a time. GEMM_BLOCK_DEPTH terms of a kernel's panel of b stay in the L1 cache while it runs
+   down the rows of a */
+
+#define GEMM_BLOCK_DEPTH 256
+#define GEMM_BLOCK_COLS 2048
+
+/* rows of a a thread claims and packs at a time, fewer when there are not enough to go around */
+
+#define GEMM_BLOCK_ROWS 96
+
+/* a product with fewer terms than this is not worth starting threads for */
+
+#define GEMM_THREAD_TERMS (1 << 20)
+
+/* entries in the largest kernel's tile */
+
+#define GEMM_MAX_TILE 128
+
+/* one multiply, with its thread pool */
+
+struct Gemm {
+
+	const uint64_t* a;
+	const uint64_t* b;
+	uint64_t* c;
+	uint64_t m;
+	uint64_t k;
+	uint64_t n;
+
+	const struct GemmKernel* kernel;
+	int narrow;
+	int numThreads;
+	uint64_t blockRows;
+
+	/* the block of b being multiplied, from row pc and column jc, and its panels packed */
+
+	uint64_t pc;
+	uint64_t kc;
+	uint64_t jc;
+	uint64_t nc;
+	uint64_t* packedB;
+	uint64_t panelCursor;
+
+	/* rows of a claimed so far, and each thread's packed rows */
+
+	uint64_t rowCursor;
+	uint64_t* packedA[MAX_GEMM_THREADS];
+
+	/* pool */
+
+	pthread_t threads[MAX_GEMM_THREADS];
+	pthread_barrier_t start;
+	pthread_barrier_t packed;
+	pthread_barrier_t done;
+	int stop;
+
+};
+
+struct GemmJob {
+
+	struct Gemm* gemm;
+	int tid;
+
+};
+
+
+/* the plain C kernel: a 2 x 4 tile, small enough to stay in general purpose registers */
+
+static void scalarTile(uint64_t kc, const uint64_t* a, const uint64_t* b, uint64_t* c, uint64_t ldc, int narrow) {
+
+	uint64_t sum[2][4];
+	uint64_t kk;
+	int r, j;
+
+	(void) narrow;
+
+	memset(sum, 0, sizeof(sum));
+
+	for (kk = 0; kk < kc; kk++) {
+
+		#pragma GCC unroll 2
+		for (r = 0; r < 2; r++) {
+			#pragma GCC unroll 4
+			for (j = 0; j < 4; j++) {
+				sum[r][j] += a[kk * 2 + r] * b[kk * 4 + j];
+			}
+		}
+
+	}
+
+	for (r = 0; r < 2; r++) {
+		for (j = 0; j < 4; j++) {
+			c[r * ldc + j] += sum[r][j];
+		}
+	}
+
+}
+
+
+/* low 64 bits of the products of 64 bit lanes, given their high halves shifted down: lo*lo + ((hi*lo + lo*hi) << 32) */
+
+__attribute__((target("avx2")))
+static inline __m256i multiplyLanes(__m256i x, __m256i xHigh, __m256i y, __m256i yHigh) {
+
+	__m256i cross = _mm256_add_epi64(_mm256_mul_epu32(xHigh, y), _mm256_mul_epu32(x, yHigh));
+
+	return _mm256_add_epi64(_mm256_mul_epu32(x, y), _mm256_slli_epi64(cross, 32));
+
+}
+
+
+/* the AVX2 kernel: a 4 x 8 tile, two registers a row */
+
+__attribute__((target("avx2")))
+static void avx2Tile(uint64_t kc, const uint64_t* a, const uint64_t* b, uint64_t* c, uint64_t ldc, int narrow) {
+
+	__m256i sum[4][2];
+	__m256i b0, b1, b0High, b1High, x, xHigh;
+	uint64_t kk;
+	int r;
+
+	for (r = 0; r < 4; r++) {
+		sum[r][0] = _mm256_setzero_si256();
+		sum[r][1] = _mm256_setzero_si256();
+	}
+
+	if (narrow) {
+
+		for (kk = 0; kk < kc; kk++) {
+
+			b0 = _mm256_loadu_si256((const __m256i*) (b + kk * 8));
+			b1 = _mm256_loadu_si256((const __m256i*) (b + kk * 8 + 4));
+
+			#pragma GCC unroll 4
+			for (r = 0; r < 4; r++) {
+				x = _mm256_set1_epi64x((long long) a[kk * 4 + r]);
+				sum[r][0] = _mm256_add_epi64(sum[r][0], _mm256_mul_epi32(x, b0));
+				sum[r][1] = _mm256_add_epi64(sum[r][1], _mm256_mul_epi32(x, b1));
+			}
+
+		}
+
+	}
+	else {
+
+		for (kk = 0; kk < kc; kk++) {
+
+			b0 = _mm256_loadu_si256((const __m256i*) (b + kk * 8));
+			b1 = _mm256_loadu_si256((const __m256i*) (b + kk * 8 + 4));
+			b0High = _mm256_srli_epi64(b0, 32);
+			b1High = _mm256_srli_epi64(b1, 32);
+
+			#pragma GCC unroll 4
+			for (r = 0; r < 4; r++) {
+				x = _mm256_set1_epi64x((long long) a[kk * 4 + r]);
+				xHigh = _mm256_set1_epi64x((long long) (a[kk * 4 + r] >> 32));
+				sum[r][0] = _mm256_add_epi64(sum[r][0], multiplyLanes(x, xHigh, b0, b0High));
+				sum[r][1] = _mm256_add_epi64(sum[r][1], multiplyLanes(x, xHigh, b1, b1High));
+			}
+
+		}
+
+	}
+
+	for (r = 0; r < 4; r++) {
+		_mm256_storeu_si256((__m256i*) (c + r * ldc),
+				_mm256_add_epi64(_mm256_loadu_si256((const __m256i*) (c + r * ldc)), sum[r][0]));
+		_mm256_storeu_si256((__m256i*) (c + r * ldc + 4),
+				_mm256_add_epi64(_mm256_loadu_si256((const __m256i*) (c + r * ldc + 4)), sum[r][1]));
+	}
+
+}
+
+
+/* the AVX-512 kernel: an 8 x 16 tile, two registers a row */
+
+__attribute__((target("avx512f,avx512dq")))
+static void avx512Tile(uint64_t kc, const uint64_t* a, const uint64_t* b, uint64_t* c, uint64_t ldc, int narrow) {
+
+	__m512i sum[8][2];
+	__m512i b0, b1, x;
+	uint64_t kk;
+	int r;
+
+	for (r = 0; r < 8; r++) {
+		sum[r][0] = _mm512_setzero_si512();
+		sum[r][1] = _mm512_setzero_si512();
+	}
+
+	if (narrow) {
+
+		for (kk = 0; kk < kc; kk++) {
+
+			b0 = _mm512_loadu_si512(b + kk * 16);
+			b1 = _mm512_loadu_si512(b + kk * 16 + 8);
+
+			#pragma GCC unroll 8
+			for (r = 0; r < 8; r++) {
+				x = _mm512_set1_epi64((long long) a[kk * 8 + r]);
+				sum[r][0] = _mm512_add_epi64(sum[r][0], _mm512_mul_epi32(x, b0));
+				sum[r][1] = _mm512_add_epi64(sum[r][1], _mm512_mul_epi32(x, b1));
+			}
+
+		}
+
+	}
+	else {
+
+		for (kk = 0; kk < kc; kk++) {
+
+			b0 = _mm512_loadu_si512(b + kk * 16);
+			b1 = _mm512_loadu_si512(b + kk * 16 + 8);
+
+			#pragma GCC unroll 8
+			for (r = 0; r < 8; r++) {
+				x = _mm512_set1_epi64((long long) a[kk * 8 + r]);
+				sum[r][0] = _mm512_add_epi64(sum[r][0], _mm512_mullo_epi64(x, b0));
+				sum[r][1] = _mm512_add_epi64(sum[r][1], _mm512_mullo_epi64(x, b1));
+			}
+
+		}
+
+	}
+
+	for (r = 0; r < 8; r++) {
+		_mm512_storeu_si512(c + r * ldc, _mm512_add_epi64(_mm512_loadu_si512(c + r * ldc), sum[r][0]));
+		_mm512_storeu_si512(c + r * ldc + 8, _mm512_add_epi64(_mm512_loadu_si512(c + r * ldc + 8), sum[r][1]));
+	}
+
+}
+
+
+/* Boolean: the processor runs each kernel */
+
+static int scalarSupported() {
+
+	return 1;
+
+}
+
+static int avx2Supported() {
+
+	__builtin_cpu_init();
+
+	return __builtin_cpu_supports("avx2");
+
+}
+
+static int avx512Supported() {
+
+	__builtin_cpu_init();
+
+	return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq");
+
+}
+
+
+/* every kernel, slowest first */
+
+static const struct GemmKernel kernels[] = {
+
+	{ "scalar", 2, 4, scalarTile, scalarSupported },
+	{ "avx2", 4, 8, avx2Tile, avx2Supported },
+	{ "avx512", 8, 16, avx512Tile, avx512Supported }
+
+};
+
+#define NUM_KERNELS ((int) (sizeof(kernels) / sizeof(kernels[0])))
+
+
+/* the i'th kernel, supported or not, or NULL past the last */
+
+const struct GemmKernel* gemmKernelAt(int i) {
+
+	return i >= 0 && i < NUM_KERNELS ? &kernels[i] : NULL;
+
+}
+
+
+/* the fastest kernel this processor runs */
+
+const struct GemmKernel* bestGemmKernel() {
+
+	int i;
+
+	for (i = NUM_KERNELS - 1; i > 0; i--) {
+		if (kernels[i].supported()) { return &kernels[i]; }
+	}
+
+	return &kernels[0];
+
+}
+
+
+/* the kernel called name, or NULL if there is none or this processor cannot run it */
+
+const struct GemmKernel* findGemmKernel(const char* name) {
+
+	int i;
+
+	for (i = 0; i < NUM_KERNELS; i++) {
+		if (strcmp(kernels[i].name, name) == 0) { return kernels[i].supported() ? &kernels[i] : NULL; }
+	}
+
+	return NULL;
+
+}
+
+
+/* one thread per processor online, up to MAX_GEMM_THREADS */
+
+int defaultGemmThreads() {
+
+	long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (online < 1) { return 1; }
+	if (online > MAX_GEMM_THREADS) { return MAX_GEMM_THREADS; }
+
+	return (int) online;
+
+}
+
+
+/* Boolean: every one of count values fits in 32 bits, signed */
+
+static int fitsIn32(const uint64_t* values, uint64_t count) {
+
+	uint64_t i;
+
+	for (i = 0; i < count; i++) {
+		if (values[i] + 0x80000000ULL > 0xffffffffULL) { return 0; }
+	}
+
+	return 1;
+
+}
+
+
+/* pack the block of b's panels a thread claims, each kernel->cols columns wide, term by term, with zeros past the last
+   column */
+
+static void packPanels(struct Gemm* gemm) {
+
+	uint64_t cols = gemm->kernel->cols;
+	uint64_t numPanels = (gemm->nc + cols - 1) / cols;
+	uint64_t p, kk, width;
+	uint64_t* dest;
+	const uint64_t* src;
+
+	while ((p = __atomic_fetch_add(&gemm->panelCursor, 1, __ATOMIC_RELAXED)) < numPanels) {
+
+		width = gemm->nc - p * cols < cols ? gemm->nc - p * cols : cols;
+		dest = gemm->packedB + p * gemm->kc * cols;
+		src = gemm->b + gemm->pc * gemm->n + gemm->jc + p * cols;
+
+		for (kk = 0; kk < gemm->kc; kk++) {
+
+			memcpy(dest + kk * cols, src + kk * gemm->n, width * sizeof(uint64_t));
+			memset(dest + kk * cols + width, 0, (cols - width) * sizeof(uint64_t));
+
+		}
+
+	}
+
+}
+
+
+/* pack rows ic to ic + mc of a's block into dest, kernel->rows rows at a time, term by term, with zeros past the last
+   row */
+
+static void packRows(const struct Gemm* gemm, uint64_t* dest, uint64_t ic, uint64_t mc) {
+
+	uint64_t rows = gemm->kernel->rows;
+	uint64_t ir, kk, r;
+	const uint64_t* src;
+
+	for (ir = 0; ir < mc; ir += rows) {
+
+		for (r = 0; r < rows; r++) {
+
+			if (ir + r < mc) {
+
+				src = gemm->a + (ic + ir + r) * gemm->k + gemm->pc;
+
+				for (kk = 0; kk < gemm->kc; kk++) {
+					dest[kk * rows + r] = src[kk];
+				}
+
+			}
+			else {
+
+				for (kk = 0; kk < gemm->kc; kk++) {
+					dest[kk * rows + r] = 0;
+				}
+
+			}
+
+		}
+
+		dest += gemm->kc * rows;
+
+	}
+
+}
+
+
+/* multiply the rows of a that a thread claims by the packed block of b. A tile that runs past the edge of c is built
+   in edge and added in by hand */
+
+static void multiplyRows(struct Gemm* gemm, int tid) {
+
+	const struct GemmKernel* kernel = gemm->kernel;
+	uint64_t rows = kernel->rows, cols = kernel->cols;
+	uint64_t edge[GEMM_MAX_TILE];
+	uint64_t ic, mc, ir, jr, r, j, height, width;
+	uint64_t* tile;
+
+	while ((ic = __atomic_fetch_add(&gemm->rowCursor, gemm->blockRows, __ATOMIC_RELAXED)) < gemm->m) {
+
+		mc = gemm->m - ic < gemm->blockRows ? gemm->m - ic : gemm->blockRows;
+
+		packRows(gemm, gemm->packedA[tid], ic, mc);
+
+		/* each panel of b stays in cache while every tile of these rows is run against it */
+
+		for (jr = 0; jr < gemm->nc; jr += cols) {
+
+			width = gemm->nc - jr < cols ? gemm->nc - jr : cols;
+
+			for (ir = 0; ir < mc; ir += rows) {
+
+				height = mc - ir < rows ? mc - ir : rows;
+				tile = gemm->c + (ic + ir) * gemm->n + gemm->jc + jr;
+
+				if (height == rows && width == cols) {
+
+					kernel->tile(gemm->kc, gemm->packedA[tid] + ir * gemm->kc, gemm->packedB + jr * gemm->kc, tile,
+							gemm->n, gemm->narrow);
+
+				}
+				else {
+
+					memset(edge, 0, sizeof(edge));
+
+					kernel->tile(gemm->kc, gemm->packedA[tid] + ir * gemm->kc, gemm->packedB + jr * gemm->kc, edge,
+							cols, gemm->narrow);
+
+					for (r = 0; r < height; r++) {
+						for (j = 0; j < width; j++) {
+							tile[r * gemm->n + j] += edge[r * cols + j];
+						}
+					}
+
+				}
+
+			}
+
+		}
+
+	}
+
+}
+
+
+/* a thread's part of one block: pack panels of b until all are packed, then multiply rows of a until all are done */
+
+static void multiplyBlock(struct Gemm* gemm, int tid) {
+
+	packPanels(gemm);
+
+	pthread_barrier_wait(&gemm->packed);
+
+	multiplyRows(gemm, tid);
+
+}
+
+
+/* a pool thread: multiply each block it is started on until told to stop */
+
+static void* gemmPoolThread(void* arg) {
+
+	struct GemmJob* job = arg;
+	struct Gemm* gemm = job->gemm;
+
+	while (1) {
+
+		pthread_barrier_wait(&gemm->start);
+
+		if (gemm->stop) { break; }
+
+		multiplyBlock(gemm, job->tid);
+
+		pthread_barrier_wait(&gemm->done);
+
+	}
+
+	free(job);
+
+	return NULL;
+
+}
+
+
+/* Store in c, m x n, the product of a, m x k, and b, k x n, all row by row, using up to numThreads threads and
+   kernel, or the best kernel if kernel is NULL */
+
+void multiplyMatrices(const int64_t* a, const int64_t* b, int64_t* c, uint64_t m, uint64_t k, uint64_t n,
+		int numThreads, const struct GemmKernel* kernel) {
+
+	struct Gemm gemm;
+	struct GemmJob* job;
+	uint64_t rowBlocks;
+	int i;
+
+	memset(c, 0, m * n * sizeof(int64_t));
+
+	if (m == 0 || n == 0 || k == 0) { return; }
+
+	memset(&gemm, 0, sizeof(gemm));
+
+	gemm.a = (const uint64_t*) a;
+	gemm.b = (const uint64_t*) b;
+	gemm.c = (uint64_t*) c;
+	gemm.m = m;
+	gemm.k = k;
+	gemm.n = n;
+	gemm.kernel = kernel ? kernel : bestGemmKernel();
+	gemm.narrow = fitsIn32(gemm.a, m * k) && fitsIn32(gemm.b, k * n);
+
+	/* a thread for every block of rows, with at least two blocks a thread where there are rows enough */
+
+	if (numThreads < 1 || (double) m * k * n < GEMM_THREAD_TERMS) { numThreads = 1; }
+	if (numThreads > MAX_GEMM_THREADS) { numThreads = MAX_GEMM_THREADS; }
+
+	gemm.blockRows = GEMM_BLOCK_ROWS;
+
+	if (m < GEMM_BLOCK_ROWS * 2 * (uint64_t) numThreads) {
+		gemm.blockRows = (m + 2 * numThreads - 1) / (2 * numThreads);
+		gemm.blockRows = (gemm.blockRows + gemm.kernel->rows - 1) / gemm.kernel->rows * gemm.kernel->rows;
+	}
+
+	rowBlocks = (m + gemm.blockRows - 1) / gemm.blockRows;
+
+	if ((uint64_t) numThreads > rowBlocks) { numThreads = (int) rowBlocks; }
+
+	gemm.numThreads = numThreads;
+
+	gemm.packedB = malloc((GEMM_BLOCK_COLS + GEMM_MAX_TILE) * GEMM_BLOCK_DEPTH * sizeof(uint64_t));
+
+	for (i = 0; i < numThreads; i++) {
+		gemm.packedA[i] = malloc((gemm.blockRows + GEMM_MAX_TILE) * GEMM_BLOCK_DEPTH * sizeof(uint64_t));
+	}
+
+	pthread_barrier_init(&gemm.start, NULL, numThreads);
+	pthread_barrier_init(&gemm.packed, NULL, numThreads);
+	pthread_barrier_init(&gemm.done, NULL, numThreads);
+
+	for (i = 1; i < numThreads; i++) {
+
+		job = malloc(sizeof(struct GemmJob));
+		job->gemm = &gemm;
+		job->tid = i;
+
+		pthread_create(&gemm.threads[i], NULL, gemmPoolThread, job);
+
+	}
+
+	/* every block of b in turn, each block's terms added into c */
+
+	for (gemm.jc = 0; gemm.jc < n; gemm.jc += GEMM_BLOCK_COLS) {
+
+		gemm.nc = n - gemm.jc < GEMM_BLOCK_COLS ? n - gemm.jc : GEMM_BLOCK_COLS;
+
+		for (gemm.pc = 0; gemm.pc < k; gemm.pc += GEMM_BLOCK_DEPTH) {
+
+			gemm.kc = k - gemm.pc < GEMM_BLOCK_DEPTH ? k - gemm.pc : GEMM_BLOCK_DEPTH;
+			gemm.panelCursor = 0;
+			gemm.rowCursor = 0;
+
+			if (numThreads > 1) { pthread_barrier_wait(&gemm.start); }
+
+			multiplyBlock(&gemm, 0);
+
+			if (numThreads > 1) { pthread_barrier_wait(&gemm.done); }
+
+		}
+
+	}
+
+	/* stop the pool */
+
+	gemm.stop = 1;
+
+	if (numThreads > 1) { pthread_barrier_wait(&gemm.start); }
+
+	for (i = 1; i < numThreads; i++) {
+		pthread_join(gemm.threads[i], NULL);
+	}
+
+	pthread_barrier_destroy(&gemm.start);
+	pthread_barrier_destroy(&gemm.packed);
+	pthread_barrier_destroy(&gemm.done);
+
+	for (i = 0; i < numThreads; i++) {
+		free(gemm.packedA[i]);
+	}
+
+	free(gemm.packedB);
+
+}
@@ -0,0 +1,45 @@
+/***********************************************************************************************************
+ *	Title: Matrix Multiply
+ *	Description: The product of two integer matrices for matrix-engine's multiply, blocked for the
+ *			cache and split across threads. b is packed a block at a time into panels a few
+ *			columns wide, and each thread packs the rows of a it claims the same way, so a
+ *			small kernel can run down both in order keeping a tile of the product in
+ *			registers. Kernels are plain C, AVX2 and AVX-512, chosen when the program runs
+ *			from what the processor supports.
+ *
+ *			Products and sums wrap at 64 bits as bash's do. Sums that wrap come out the
+ *			same whatever order they are added in, so the result is exactly that of the
+ *			plain three loops.
+ * ********************************************************************************************************/
+
+#include <stdint.h>
+
+#ifndef MATRIX_GEMM_H
+#define MATRIX_GEMM_H
+
+/* most threads one multiply will use */
+
+#define MAX_GEMM_THREADS 64
+
+/* a kernel: the tile of the product it keeps in registers, rows x cols, and the function that adds one tile's terms
+   from a packed panel of a and one of b to the tile of c at c, rows ldc apart. With narrow set every entry fits in
+   32 bits */
+
+struct GemmKernel {
+
+	const char* name;
+	int rows;
+	int cols;
+	void (*tile)(uint64_t, const uint64_t* , const uint64_t* , uint64_t* , uint64_t, int);
+	int (*supported)();
+
+};
+
+const struct GemmKernel* bestGemmKernel();
+const struct GemmKernel* findGemmKernel(const char* );
+const struct GemmKernel* gemmKernelAt(int);
+int defaultGemmThreads();
+void multiplyMatrices(const int64_t* , const int64_t* , int64_t* , uint64_t, uint64_t, uint64_t, int,
+		const struct GemmKernel* );
+
+#endif
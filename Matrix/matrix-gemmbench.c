@@ -0,0 +1,252 @@
+/***********************************************************************************************************
+ *	Title: Matrix Multiply Benchmark
+ *	Description: Times matrix-engine's multiply (see matrix-gemm.h) on random square matrices held in
+ *			memory, so that reading and printing text is left out. For each size every kernel
+ *			the processor runs is timed, best of a few runs, and its rate given in billions
+ *			of integer operations a second, counting a multiply and an add for each of the
+ *			n^3 terms as a GFLOP/s figure would. Each product is checked against the plain
+ *			three loops, in full up to --check-limit and at sampled entries above it, and the
+ *			plain loops are timed too where they are run in full.
+ *
+ *			To call, type ./matrix-gemmbench [--threads T] [--kernel K] [--repeat R] [--wide]
+ *			[--check-limit N] [SIZE]... Entries are between -99 and 99, or any 64 bit value
+ *			with --wide, which takes the kernels' full 64 bit multiply.
+ * ********************************************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include "matrix-gemm.h"
+
+#define DEFAULT_REPEAT 3
+#define DEFAULT_CHECK_LIMIT 1024
+#define CHECK_SAMPLES 4096
+
+static const uint64_t defaultSizes[] = { 256, 512, 1024, 2048 };
+
+
+/* seconds on the monotonic clock */
+
+static double now() {
+
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return t.tv_sec + t.tv_nsec / 1e9;
+
+}
+
+
+/* next value of a xorshift generator */
+
+static uint64_t nextRandom(uint64_t* state) {
+
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+
+	return *state;
+
+}
+
+
+/* fill count entries with random values, between -99 and 99 unless wide */
+
+static void randomEntries(int64_t* values, uint64_t count, uint64_t seed, int wide) {
+
+	uint64_t state = seed * 0x9e3779b97f4a7c15ULL + 1, i;
+
+	for (i = 0; i < count; i++) {
+		values[i] = wide ? (int64_t) nextRandom(&state) : (int64_t) (nextRandom(&state) % 199) - 99;
+	}
+
+}
+
+
+/* the plain three loops, one row of c at a time, wrapping as the engine does */
+
+static void naiveMultiply(const int64_t* a, const int64_t* b, int64_t* c, uint64_t n) {
+
+	uint64_t i, j, k;
+	uint64_t* row;
+
+	for (i = 0; i < n; i++) {
+
+		row = (uint64_t*) c + i * n;
+		memset(row, 0, n * sizeof(uint64_t));
+
+		for (k = 0; k < n; k++) {
+			for (j = 0; j < n; j++) {
+				row[j] += (uint64_t) a[i * n + k] * (uint64_t) b[k * n + j];
+			}
+		}
+
+	}
+
+}
+
+
+/* Boolean: sampled entries of c are those of the plain product */
+
+static int sampledEntriesMatch(const int64_t* a, const int64_t* b, const int64_t* c, uint64_t n) {
+
+	uint64_t state = 12345, s, i, j, k, sum;
+
+	for (s = 0; s < CHECK_SAMPLES; s++) {
+
+		i = nextRandom(&state) % n;
+		j = nextRandom(&state) % n;
+		sum = 0;
+
+		for (k = 0; k < n; k++) {
+			sum += (uint64_t) a[i * n + k] * (uint64_t) b[k * n + j];
+		}
+
+		if ((int64_t) sum != c[i * n + j]) { return 0; }
+
+	}
+
+	return 1;
+
+}
+
+
+/* print one line of results */
+
+static void printResult(uint64_t n, const char* kernel, int numThreads, double seconds, const char* check) {
+
+	printf("%6llu  %-8s %7d %10.3f %10.2f   %s\n", (unsigned long long) n, kernel, numThreads, seconds,
+			2.0 * n * n * n / seconds / 1e9, check);
+
+}
+
+
+/* time every kernel, or only the one given, on n x n matrices */
+
+static void benchSize(uint64_t n, int numThreads, const struct GemmKernel* only, int repeat, int wide,
+		uint64_t checkLimit) {
+
+	const struct GemmKernel* kernel;
+	int64_t* a = malloc(n * n * sizeof(int64_t));
+	int64_t* b = malloc(n * n * sizeof(int64_t));
+	int64_t* c = malloc(n * n * sizeof(int64_t));
+	int64_t* expected = NULL;
+	double start, best, seconds;
+	int i, run, same;
+
+	randomEntries(a, n * n, 1, wide);
+	randomEntries(b, n * n, 2, wide);
+
+	if (n <= checkLimit) {
+
+		expected = malloc(n * n * sizeof(int64_t));
+
+		start = now();
+		naiveMultiply(a, b, expected, n);
+		printResult(n, "naive", 1, now() - start, "-");
+
+	}
+
+	for (i = 0; (kernel = gemmKernelAt(i)) != NULL; i++) {
+
+		if ((only && kernel != only) || !kernel->supported()) { continue; }
+
+		best = 0;
+
+		for (run = 0; run < repeat; run++) {
+
+			start = now();
+			multiplyMatrices(a, b, c, n, n, n, numThreads, kernel);
+			seconds = now() - start;
+
+			if (run == 0 || seconds < best) { best = seconds; }
+
+		}
+
+		if (expected) {
+			same = memcmp(c, expected, n * n * sizeof(int64_t)) == 0;
+		}
+		else {
+			same = sampledEntriesMatch(a, b, c, n);
+		}
+
+		printResult(n, kernel->name, numThreads, best,
+				same ? (expected ? "identical" : "samples identical") : "MISMATCH");
+
+	}
+
+	free(a);
+	free(b);
+	free(c);
+	free(expected);
+
+}
+
+
+int main(int argc, char** argv) {
+
+	static struct option longOptions[] = {
+		{ "threads", required_argument, NULL, 't' },
+		{ "kernel", required_argument, NULL, 'k' },
+		{ "repeat", required_argument, NULL, 'r' },
+		{ "wide", no_argument, NULL, 'w' },
+		{ "check-limit", required_argument, NULL, 'c' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	const struct GemmKernel* only = NULL;
+	int numThreads = defaultGemmThreads(), repeat = DEFAULT_REPEAT, wide = 0, opt, i;
+	uint64_t checkLimit = DEFAULT_CHECK_LIMIT;
+
+	while ((opt = getopt_long(argc, argv, "", longOptions, NULL)) != -1) {
+
+		switch (opt) {
+
+			case 't': numThreads = atoi(optarg); break;
+			case 'r': repeat = atoi(optarg); break;
+			case 'w': wide = 1; break;
+			case 'c': checkLimit = strtoull(optarg, NULL, 10); break;
+
+			case 'k':
+				only = findGemmKernel(optarg);
+				if (only == NULL) {
+					fprintf(stderr, "%s: no kernel %s on this processor\n", argv[0], optarg);
+					return 1;
+				}
+				break;
+
+			default:
+				fprintf(stderr, "usage: %s [--threads T] [--kernel K] [--repeat R] [--wide] [--check-limit N] "
+						"[SIZE]...\n", argv[0]);
+				return 1;
+
+		}
+
+	}
+
+	if (numThreads < 1) { numThreads = 1; }
+	if (numThreads > MAX_GEMM_THREADS) { numThreads = MAX_GEMM_THREADS; }
+	if (repeat < 1) { repeat = 1; }
+
+	printf("%6s  %-8s %7s %10s %10s   %s\n", "size", "kernel", "threads", "seconds", "GOP/s", "check");
+
+	if (optind == argc) {
+
+		for (i = 0; i < (int) (sizeof(defaultSizes) / sizeof(defaultSizes[0])); i++) {
+			benchSize(defaultSizes[i], numThreads, only, repeat, wide, checkLimit);
+		}
+
+	}
+
+	for (i = optind; i < argc; i++) {
+		benchSize(strtoull(argv[i], NULL, 10), numThreads, only, repeat, wide, checkLimit);
+	}
+
+	return 0;
+
+}
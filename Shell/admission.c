@@ -0,0 +1,193 @@
+/****************************************************************************************************
+ *	Title: Background Admission Control
+ *	Description: Limits how many background jobs smallsh runs at once and how fast they are spawned,
+ *			using a concurrency cap and a token bucket. A background command that cannot be
+ *			admitted is copied into a FIFO queue and launched later, as children exit or as
+ *			tokens refill.
+ * *************************************************************************************************/
+
+
+#include "admission.h"
+
+
+/* no limits, empty queue */
+
+void initAdmission(struct AdmissionControl* ac) {
+
+	memset(ac, 0, sizeof(struct AdmissionControl));
+	ac->nextId = 1;
+	clock_gettime(CLOCK_MONOTONIC, &ac->lastRefill);
+
+}
+
+
+/* set the maximum number of concurrent background jobs. 0 removes the limit */
+
+void setBackgroundLimit(struct AdmissionControl* ac, int max) {
+
+	ac->maxBackground = (max > 0) ? max : 0;
+
+}
+
+
+/* set the spawn rate in jobs per second and the burst size. A rate of 0 removes the limit */
+
+void setSpawnRate(struct AdmissionControl* ac, double rate, double burst) {
+
+	ac->rate = (rate > 0) ? rate : 0;
+	ac->burst = (burst >= 1) ? burst : 1;
+	ac->tokens = ac->burst;			// start with a full bucket
+	clock_gettime(CLOCK_MONOTONIC, &ac->lastRefill);
+
+}
+
+
+/* seconds elapsed since a monotonic timestamp */
+
+double secondsSince(struct timespec* then) {
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double) (now.tv_sec - then->tv_sec) + (double) (now.tv_nsec - then->tv_nsec) / 1e9;
+
+}
+
+
+/* add the tokens earned since the last refill, up to the bucket size */
+
+static void refill(struct AdmissionControl* ac) {
+
+	if (ac->rate <= 0) { return; }
+
+	ac->tokens += secondsSince(&ac->lastRefill) * ac->rate;
+	if (ac->tokens > ac->burst) { ac->tokens = ac->burst; }
+	clock_gettime(CLOCK_MONOTONIC, &ac->lastRefill);
+
+}
+
+
+/* Boolean: may a background job be launched now, given the number already running */
+
+int mayLaunch(struct AdmissionControl* ac, int runningBG) {
+
+	refill(ac);
+
+	if (ac->maxBackground > 0 && runningBG >= ac->maxBackground) { return 0; }
+	if (ac->rate > 0 && ac->tokens < 1) { return 0; }
+
+	return 1;
+
+}
+
+
+/* seconds until the next launch could be admitted. -1 means wait for a child to exit */
+
+double nextLaunchDelay(struct AdmissionControl* ac, int runningBG) {
+
+	refill(ac);
+
+	if (ac->maxBackground > 0 && runningBG >= ac->maxBackground) { return -1; }
+	if (ac->rate > 0 && ac->tokens < 1) { return (1 - ac->tokens) / ac->rate; }
+
+	return 0;
+
+}
+
+
+/* spend a token for a launched job */
+
+void recordLaunch(struct AdmissionControl* ac) {
+
+	if (ac->rate > 0) { ac->tokens -= 1; }
+	ac->launched++;
+
+}
+
+
+/* copy args into a new queue entry at the back of the queue */
+
+struct PendingCommand* enqueueCommand(struct AdmissionControl* ac, char** args) {
+
+	int i, argc = 0;
+	while (args[argc] != NULL) { argc++; }
+
+	struct PendingCommand* cmd = malloc(sizeof(struct PendingCommand));
+	cmd->args = malloc((argc + 1) * sizeof(char* ));
+	for (i = 0; i < argc; i++) {
+		cmd->args[i] = strdup(args[i]);
+	}
+	cmd->args[argc] = NULL;
+
+	cmd->id = ac->nextId++;
+	cmd->next = NULL;
+	clock_gettime(CLOCK_MONOTONIC, &cmd->queuedAt);
+
+	if (ac->last != NULL) {
+		ac->last->next = cmd;
+	}
+	else {
+		ac->first = cmd;
+	}
+	ac->last = cmd;
+
+	ac->size++;
+	ac->queuedTotal++;
+
+	return cmd;
+
+}
+
+
+/* remove the command at the front of the queue and record how long it waited. Caller frees it */
+
+struct PendingCommand* dequeueCommand(struct AdmissionControl* ac) {
+
+	struct PendingCommand* cmd = ac->first;
+	if (cmd == NULL) { return NULL; }
+
+	ac->first = cmd->next;
+	if (ac->first == NULL) { ac->last = NULL; }
+	ac->size--;
+
+	double waited = secondsSince(&cmd->queuedAt);
+	ac->totalWait += waited;
+	if (waited > ac->maxWait) { ac->maxWait = waited; }
+
+	if (ac->size == 0) { ac->nextId = 1; }
+
+	return cmd;
+
+}
+
+
+/* free a dequeued command and its copied args */
+
+void freePendingCommand(struct PendingCommand* cmd) {
+
+	int i;
+	for (i = 0; cmd->args[i] != NULL; i++) {
+		free(cmd->args[i]);
+	}
+	free(cmd->args);
+	free(cmd);
+
+}
+
+
+/* print the commands waiting to be launched */
+
+void printQueue(struct AdmissionControl* ac) {
+
+	int i;
+	struct PendingCommand* cmd;
+
+	for (cmd = ac->first; cmd != NULL; cmd = cmd->next) {
+		printf("[q%d] waiting %.2fs ", cmd->id, secondsSince(&cmd->queuedAt));
+		for (i = 0; cmd->args[i] != NULL; i++) {
+			printf(" %s", cmd->args[i]);
+		}
+		printf(" &\n");
+	}
+	fflush(stdout);
+
+}
@@ -0,0 +1,68 @@
+/***********************************************************************************************
+ *	Title: Background Admission Control Declarations
+ * 	Description: Function signatures and struct definitions for the admission control used by
+ * 			smallsh to cap the number of concurrent background jobs and the rate at
+ * 			which they are spawned. Commands over the limit wait in a FIFO queue.
+ * ********************************************************************************************/
+
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+struct PendingCommand {
+
+	int id;
+	char** args;			// deep copy of the argument vector, NULL terminated
+	struct timespec queuedAt;
+	struct PendingCommand* next;
+
+};
+
+struct AdmissionControl {
+
+	/* limits, 0 means unlimited */
+
+	int maxBackground;
+	double rate;			// tokens added per second
+	double burst;			// bucket capacity
+
+	/* token bucket state */
+
+	double tokens;
+	struct timespec lastRefill;
+
+	/* FIFO of commands waiting for a slot */
+
+	int size;
+	int nextId;
+	struct PendingCommand* first;
+	struct PendingCommand* last;
+
+	/* statistics */
+
+	long launched;
+	long queuedTotal;
+	double totalWait;
+	double maxWait;
+
+};
+
+void initAdmission(struct AdmissionControl* );
+void setBackgroundLimit(struct AdmissionControl* , int);
+void setSpawnRate(struct AdmissionControl* , double, double);
+int mayLaunch(struct AdmissionControl* , int);
+double nextLaunchDelay(struct AdmissionControl* , int);
+void recordLaunch(struct AdmissionControl* );
+struct PendingCommand* enqueueCommand(struct AdmissionControl* , char** );
+struct PendingCommand* dequeueCommand(struct AdmissionControl* );
+void freePendingCommand(struct PendingCommand* );
+void printQueue(struct AdmissionControl* );
+double secondsSince(struct timespec* );
+
+#endif
@@ -13,18 +13,36 @@
 
 
 /* function names and pointers for builtin commands */
-int numBuiltins = 3;
-char* builtinNames[] = {"exit", "cd", "status"};
-int (*builtinFuncs[])(char** ) = {&shExit, &shCd, &shStatus};
+int numBuiltins = 12;
+char* builtinNames[] = {"exit", "cd", "status", "jobs", "fg", "bg", "kill", "fgonly", "limit", "rate", "queue", "stats"};
+int (*builtinFuncs[])(char** ) = {&shExit, &shCd, &shStatus, &shJobs, &shFg, &shBg, &shKill, &shFgOnly,
+					&shLimit, &shRate, &shQueue, &shStats};
 
-/* global variables to track exit status of last command and currently running subprocesses */
+/* builtins that read and write data, run in a child of their own like any other command */
+int numIOBuiltins = 2;
+char* ioBuiltinNames[] = {"cat", "tee"};
+int (*ioBuiltinFuncs[])(char** ) = {&catFiles, &teeFiles};
+
+/* global variables to track exit status of last command and the table of running or stopped jobs */
 int lastCommandStatus, lastCommandSignal;
-struct Stack* processStack;
+struct JobTable jobTable;
+
+/* concurrency cap, spawn rate and FIFO queue for background commands */
+struct AdmissionControl admission;
 
 /* set foreground only mode and track whether last command was background */
 int allowBG = 1;
 int lastCommandIsBG;
 
+/* command lines read from fd 0 but not yet used, kept here rather than in stdin so waitForInput() can tell whether a
+   line is waiting without polling */
+struct InputBuffer inputBfr = {.start = 0, .end = 0};
+
+/* process group of the shell, whether it owns a terminal, and the process group currently in the foreground */
+pid_t shellPgid;
+int shellIsInteractive;
+volatile pid_t foregroundPgid = 0;
+
 /* declare sigaction structs */
 struct sigaction SIGINT_action = {0};
 struct sigaction SIGTSTP_action = {0};
@@ -35,19 +53,31 @@ struct sigaction SIGCHLD_action = {0};
 
 void commandLoop() {
 
+	/* if running on a terminal, wait until the shell is in the foreground before taking it over */
+
+	shellIsInteractive = isatty(STDIN_FILENO);
+
+	if (shellIsInteractive) {
+		while (tcgetpgrp(STDIN_FILENO) != (shellPgid = getpgrp())) {
+			kill(-shellPgid, SIGTTIN);
+		}
+	}
+
 	/* set signal handlers for parent process */
 
-        SIGINT_action.sa_handler = SIG_IGN;	// ignore SIGINT by default in partent
+        SIGINT_action.sa_handler = SIG_IGN;	// ignore SIGINT by default in partent, ^C goes to the foreground job
         sigfillset(&SIGINT_action.sa_mask);            
         SIGINT_action.sa_flags = SA_RESTART;
 
         sigaction(SIGINT, &SIGINT_action, NULL);
 
-        SIGTSTP_action.sa_handler = toggleBG;	// SIGTSTP reprogrammed to toggle foreground only mode
+        SIGTSTP_action.sa_handler = SIG_IGN;	// ^Z stops the foreground job, never the shell
         sigfillset(&SIGTSTP_action.sa_mask);
         SIGTSTP_action.sa_flags = SA_RESTART;
 
         sigaction(SIGTSTP, &SIGTSTP_action, NULL);
+	sigaction(SIGTTIN, &SIGTSTP_action, NULL);
+	sigaction(SIGTTOU, &SIGTSTP_action, NULL);	// shell must be able to call tcsetpgrp() from the background
 
         SIGCHLD_action.sa_handler = checkOnChildren;
         sigfillset(&SIGCHLD_action.sa_mask);
@@ -55,14 +85,27 @@ void commandLoop() {
 
         sigaction(SIGCHLD, &SIGCHLD_action, NULL);
 
+	/* put the shell in its own process group and grab control of the terminal */
+
+	if (shellIsInteractive) {
+		shellPgid = getpid();
+		if (setpgid(shellPgid, shellPgid) < 0) { shellPgid = getpgrp(); }	// already a session leader
+		tcsetpgrp(STDIN_FILENO, shellPgid);
+	}
+
 	/* variables for grabbing user input */
 
 	int argc, stat, i;	
 	char** args;
+	char** expanded;
+	struct StringList globStrings;
 	char* input;
 
-	/* allocate memory for the process stack */
-	int init = initStack(&processStack);
+	/* clear the job table and admission queue */
+	initJobs(&jobTable);
+	initAdmission(&admission);
+	initStringList(&globStrings);
+	initCopyStats();
 
 	/* continuously prompt user */
 
@@ -73,20 +116,31 @@ void commandLoop() {
 		/* grab user input, count arguments, and execute those arguments */
 
 		args = getArgs(input);	
+
+		/* end of input: launch whatever is still queued, then leave */
+
+		if (args == NULL) {
+			finishQueue();
+			break;
+		}
+
+		/* pathname expansion of *, ?, [...] and ** patterns */
+
+		expanded = expandArgs(args, &globStrings);
+		free(args);
+		args = expanded;
+
 		argc = countArgs(args);
 		stat = execArgs(argc, args);
 		
-		/* free allocated args array */
+		/* free allocated args array and expanded paths */
 			
 		if (args != NULL) {free(args);}
+		freeStringList(&globStrings);
 		if (input != NULL) {/*printf("input not null\n"); free(input);*/} // troublemaker?
 
 	} while (stat);	
 
-	/* dump the stack, free memory allocated to the stack structure */
-
-	dumpStack(processStack);
-
 }
 
 
@@ -97,22 +151,20 @@ char** getArgs(char* input) {
 	/* get a line of input from user */
 
 	size_t bfrsize = 0;
-	size_t chars;
+	ssize_t chars;
+
+	/* keep launching queued background commands until a line is ready */
+
+	waitForInput();
 
-	chars = getline(&input, &bfrsize, stdin);
+	input = NULL;
+	chars = readLine(&input, &bfrsize);
+
+	if (chars < 0) { free(input); return NULL; }
 
 	/* expand $$ into PID anywhere it is encountered */
 
-	char* toSearch = malloc(sizeof(input));		// remaining buffer to search
-	char* ptr = input;
-	while (ptr = strstr(ptr, "$$")) {
-		memset(toSearch, 0, sizeof(toSearch));
-		strcpy(toSearch, ptr + (2 * sizeof(char)));
-		/* sprintf the PID and toSearch to input wherever ptr is pointing */
-		sprintf(ptr, "%d%s", getpid(), toSearch);
-		ptr += (2 * sizeof(char));
-	}
-	free(toSearch);
+	input = expandPid(input, &bfrsize);
 
 	char** args = malloc(bfrsize * sizeof(char* ));
 	const char* delims = " \n\t\a\r";		// strtok will parse by these delimeters
@@ -149,6 +201,78 @@ char** getArgs(char* input) {
 }
 
 
+/* expandPid returns line with every $$ replaced by the shell's PID, in a new buffer sized to fit, and frees line. cap
+   is set to the new buffer's size */
+
+char* expandPid(char* line, size_t* cap) {
+
+	char pid[24];
+	int pidLen = snprintf(pid, sizeof(pid), "%d", getpid());
+	size_t count = 0;
+	char *from, *to, *expanded, *found;
+
+	for (from = line; (found = strstr(from, "$$")) != NULL; from = found + 2) { count++; }
+	if (count == 0) { return line; }
+
+	*cap = strlen(line) + count * pidLen + 1;
+	expanded = malloc(*cap);
+
+	for (from = line, to = expanded; (found = strstr(from, "$$")) != NULL; from = found + 2) {
+		memcpy(to, from, found - from);
+		to += found - from;
+		memcpy(to, pid, pidLen);
+		to += pidLen;
+	}
+	strcpy(to, from);
+
+	free(line);
+	return expanded;
+
+}
+
+
+/* readLine reads one line from fd 0, with its newline if it has one, into *line, growing it as getline() does. Reads a
+   buffer at a time rather than a byte at a time, keeping the rest for the next line. Returns the line's length, or -1
+   at end of input */
+
+ssize_t readLine(char** line, size_t* cap) {
+
+	size_t len = 0, take;
+	ssize_t n;
+	char* newline;
+
+	for (;;) {
+
+		/* refill the buffer once it is used up */
+
+		if (inputBfr.start == inputBfr.end) {
+			n = read(STDIN_FILENO, inputBfr.bytes, INPUT_BFR_SIZE);
+			if (n < 0 && errno == EINTR) { continue; }
+			if (n <= 0) { return (len > 0) ? (ssize_t) len : -1; }
+			inputBfr.start = 0;
+			inputBfr.end = n;
+		}
+
+		newline = memchr(inputBfr.bytes + inputBfr.start, '\n', inputBfr.end - inputBfr.start);
+		take = newline ? (size_t) (newline - inputBfr.bytes) + 1 - inputBfr.start : inputBfr.end - inputBfr.start;
+
+		if (len + take + 1 > *cap) {
+			*cap = (len + take + 1) * 2;
+			*line = realloc(*line, *cap);
+		}
+
+		memcpy(*line + len, inputBfr.bytes + inputBfr.start, take);
+		len += take;
+		(*line)[len] = '\0';
+		inputBfr.start += take;
+
+		if (newline) { return len; }
+
+	}
+
+}
+
+
 /* countArgs() counts the number of arguments user entered */
 
 int countArgs(char** args) {
@@ -196,24 +320,66 @@ int execArgs(int argc, char** args) {
 
 	}
 
+	/* background commands must pass admission control, otherwise they wait in the queue */
+
+	if (lastCommandIsBG) {
+
+		sigset_t childMask, prevMask;
+		sigemptyset(&childMask);
+		sigaddset(&childMask, SIGCHLD);
+		sigprocmask(SIG_BLOCK, &childMask, &prevMask);
+
+		if (admission.size > 0 || !mayLaunch(&admission, countBackgroundJobs(&jobTable))) {
+			struct PendingCommand* cmd = enqueueCommand(&admission, args);
+			printf("background command queued as q%d\n", cmd->id); fflush(stdout);
+			sigprocmask(SIG_SETMASK, &prevMask, NULL);
+			return 1;
+		}
+
+		recordLaunch(&admission);
+		sigprocmask(SIG_SETMASK, &prevMask, NULL);
+
+	}
+
+	return launchCommand(args, lastCommandIsBG);
+
+}
+
+
+/* findIOBuiltin returns the function of the cat or tee builtin named name, or NULL if it names neither */
+
+int (*findIOBuiltin(char* name))(char** ) {
+
+	for (int i = 0; i < numIOBuiltins; i++) {
+		if (strcmp(name, ioBuiltinNames[i]) == 0) { return ioBuiltinFuncs[i]; }
+	}
+	return NULL;
+
+}
+
+
+/* launchCommand opens the files of any IO redirection and forks a child to run args through execvp(), or to run the
+   cat or tee builtin if args names one. Only the child redirects its stdin and stdout, so the shell's own stay as they
+   were, for queued commands launched while a foreground job runs as much as for the shell's messages. A builtin is
+   a job like any other: ^C and ^Z reach it, and the shell reaps and launches background jobs while it runs */
+
+int launchCommand(char** args, int isBG) {
+
 	/* if none of the above returns caught, fork the new child process from parent */
 
-	int stat = -5, dontFork = 0;
-	pid_t newPid, wPid;
+	int dontFork = 0;
+	pid_t newPid;
 
 	/* check for IO redirection */
 
-	int stdIn = dup(0);
-	int stdOut = dup(1);
-	int devNull = open("/dev/null", 0);
+	int devNull = open("/dev/null", O_RDWR | O_CLOEXEC);
 	
-	int newIn;
-	int newOut;
+	int newIn = -1;
+	int newOut = -1;
 	int redirectInput;
 	int redirectOutput;
 
-	char* redirectInputPath;
-	char* redirectOutputPath;
+	int (*ioBuiltin)(char** ) = findIOBuiltin(args[0]);
 
 	struct redirect* ioIsRedirected;
 	ioIsRedirected = checkIORedirection(args);
@@ -226,28 +392,38 @@ int execArgs(int argc, char** args) {
 	if (redirectInput) {
 		newIn = open(ioIsRedirected[0].path, O_RDONLY | O_CREAT, 0644);
 		if (newIn < 0) { printf("cannot open %s for input\n", ioIsRedirected[0].path); 
-			fflush(stdout); dontFork++; lastCommandStatus = 1; lastCommandSignal = -5; return 1; }
+			fflush(stdout); dontFork++; lastCommandStatus = 1; lastCommandSignal = -5; }
 	}
-	if (redirectOutput) {
-		newOut = open(ioIsRedirected[1].path, O_APPEND | O_TRUNC | O_WRONLY | O_CREAT, 0644);
+	if (redirectOutput && !dontFork) {
+		/* not appending for a builtin, since splice(2) and copy_file_range(2) refuse such outputs */
+		newOut = open(ioIsRedirected[1].path, (ioBuiltin ? 0 : O_APPEND) | O_TRUNC | O_WRONLY | O_CREAT, 0644);
 		if (newOut < 0) { printf("cannot open %s for output\n: ", ioIsRedirected[1].path);
-			fflush(stdout); dontFork++; lastCommandStatus = 1; lastCommandSignal = -5; return 1; }
+			fflush(stdout); dontFork++; lastCommandStatus = 1; lastCommandSignal = -5; }
 	}
 	
+	/* a child that could not be tracked in the job table would never be reaped, so refuse to start one. Slots are
+	   only freed behind our back, never taken */
+
+	if (!dontFork && jobTableFull(&jobTable)) {
+		printf("job table full, cannot run %s\n", args[0]); fflush(stdout);
+		dontFork++; lastCommandStatus = 1; lastCommandSignal = -5;
+	}
+
 	/* verify that program should fork a new process. Fork */
 
+	struct Job* job;
+	sigset_t childMask, prevMask;
+
 	newPid = 0;
 	if (!dontFork) {
-		newPid = fork();	
-	
-		/* IO redirection happens here */
-	
-		if (redirectInput) { int redirectInputCommand = dup2(newIn, 0); }
 
-		if (redirectOutput) { int redirectOutputCommand = dup2(newOut, 1); }
+		/* hold SIGCHLD until the child is in the job table, so checkOnChildren() cannot miss it */
+
+		sigemptyset(&childMask);
+		sigaddset(&childMask, SIGCHLD);
+		sigprocmask(SIG_BLOCK, &childMask, &prevMask);
 
-		for (int i = 0; i < 2; i++) { free(ioIsRedirected[i].path); }
-		free(ioIsRedirected);
+		newPid = fork();	
 
 		/* call execvp() in child process using a switch */
 
@@ -257,20 +433,36 @@ int execArgs(int argc, char** args) {
 			
 				/* fork successful, execute this  within child process */
 
-			        /* if child is foreground, overwrite SIGINT_action. Child will respond to SIGINT */
+				/* every job gets its own process group. A foreground job also takes the terminal,
+  					so ^C and ^Z from the keyboard are delivered to it rather than to the shell */
+
+				setpgid(0, 0);
+
+				if (!isBG && shellIsInteractive) {
+					tcsetpgrp(STDIN_FILENO, getpid());
+				}
+
+				/* restore default dispositions, ignored signals would otherwise stay ignored across execvp() */
 
-				if (!lastCommandIsBG) {
-					SIGTSTP_action.sa_handler = SIG_IGN;
-					sigaction(SIGTSTP, &SIGTSTP_action, NULL);
+				resetChildSignals();
+				sigprocmask(SIG_SETMASK, &prevMask, NULL);
 
-			       		SIGINT_action.sa_handler = toggleBG;
-        				sigaction(SIGINT, &SIGINT_action, NULL);
-				} else {
+				/* announce a background command on the shell's stdout, before redirecting its own */
+
+				if (isBG) { printf("background pid is %d\n: ", getpid()); fflush(stdout); }
+
+				/* IO redirection happens here */
+
+				if (redirectInput) { dup2(newIn, 0); close(newIn); }
+				if (redirectOutput) { dup2(newOut, 1); close(newOut); }
+
+				if (isBG) {
 					/* background command, if not specified redirect IO to/from /dev/null */
-					printf("background pid is %d\n: ", getpid()); fflush(stdout); 
 					if (!redirectInput) { dup2(devNull, 0); }
 					if (!redirectOutput) { dup2(devNull, 1); } 
 				}
+
+				if (ioBuiltin != NULL) { exit(ioBuiltin(args)); }
         		
 				if (execvp(args[0], args) == -1) {
 					/* execvp should not return from child process */
@@ -284,48 +476,40 @@ int execArgs(int argc, char** args) {
 				/* fork unsuccessful, throw error (parent process) */
 			
 				perror("fork unsuccessful");
+				sigprocmask(SIG_SETMASK, &prevMask, NULL);
 				break;		
 
 			default:
 	
 				/* execute this clause within parent process */
 
-				//printf("I am the parent %d\n", getpid()); fflush(stdout);
+				/* set the child's process group from the parent as well, whichever runs first wins the race */
 
-				/* push child pid to the process stack */
-	
-				pushStack(processStack, newPid);
-				//printf("stack right now\n"); fflush(stdout); printStack(processStack);
-		
-				if (!lastCommandIsBG) {
-					do {
-						wPid = waitpid(newPid, &stat, 0);
-						//printf("wifsignaled is %d\n", WIFSIGNALED(stat));
-						//printf("wifexited is %d\n", WIFEXITED(stat));
-					} while (!WIFEXITED(stat) && !WIFSIGNALED(stat)); // macros
-
-					if (WIFSIGNALED(stat) && (WTERMSIG(stat) == 2)) 
-						{ lastCommandSignal = 2; lastCommandStatus = -5; shStatus(NULL); }
-		
-					else if (WIFEXITED(stat)) {lastCommandStatus = WEXITSTATUS(stat); lastCommandSignal = -5;}
-					else if (WIFSIGNALED(stat)) {lastCommandSignal = WTERMSIG(stat); lastCommandStatus = -5;}
-					/* child has exited, delete from process stack */
+				setpgid(newPid, newPid);
 
-					deleteFromStack(processStack, newPid);			
-					//printStack(processStack);
+				/* add the child to the job table */
 
+				job = addJob(&jobTable, newPid, args, isBG);
+		
+				if (!isBG) {
+					waitForeground(job, newPid, 0);
 				} 					
+
+				sigprocmask(SIG_SETMASK, &prevMask, NULL);
 				break;
 
 		}
 	}
 
-	/* check for io redirection and restore IO */
-	
-	if (redirectInput) { dup2(stdIn, 0); close(newIn); }
-	if (redirectOutput) { dup2(stdOut, 1); close(newOut); }
+	/* the child has its own copies of the redirection files */
+
+	if (newIn >= 0) { close(newIn); }
+	if (newOut >= 0) { close(newOut); }
 	close(devNull);
 
+	for (int i = 0; i < 2; i++) { free(ioIsRedirected[i].path); }
+	free(ioIsRedirected);
+
 	return 1;
 
 }
@@ -338,21 +522,13 @@ int execArgs(int argc, char** args) {
 
 int shExit(char** args) {
 	
-	//printf("shexit\n");
-
-	/* check for background processes */
-
-	//printf("checking on the children\n");
-
-	int killPid;
-	struct StackNode* ptr = processStack->top;
-	while (ptr != NULL) {
-		
-		killPid = ptr->val;
-		ptr = ptr->next;
-		//printf("I have no code of ethics. I just love killin'!\n"); fflush(stdout);
-		kill(killPid, SIGKILL);		
+	/* kill the process group of every job, running or stopped */
 
+	int i;
+	for (i = 0; i < MAX_JOBS; i++) {
+		if (jobTable.jobs[i].state != JOB_FREE) {
+			kill(-jobTable.jobs[i].pgid, SIGKILL);
+		}
 	}
 
 	exit(0);
@@ -425,7 +601,7 @@ struct redirect* checkIORedirection(char** args) {
 			/* overwrite redirection operator in args array */
 
 			while (args[k] != NULL) {
-				strcpy(args[j], args[k]);
+				args[j] = args[k];
 				j++;
 				k++;
 			}
@@ -441,7 +617,7 @@ struct redirect* checkIORedirection(char** args) {
 			j = i;
 			k = i + 2;
 			while (args[k] != NULL) {
-				strcpy(args[j], args[k]);
+				args[j] = args[k];
 				j++;
 				k++;
 			}
@@ -458,41 +634,461 @@ struct redirect* checkIORedirection(char** args) {
 }
 
 
-/* checkOnChildren() will be called by the shell process through a sigaction which handles SIGCHLD */
+/* checkOnChildren() will be called by the shell process through a sigaction which handles SIGCHLD. Reaps
+   finished jobs and records jobs stopped or continued by a signal. The foreground job is left to waitForeground() */
 
 void checkOnChildren() {
 
-	/* check for background processes */
+	int i, wPid, stat = -5;
+	struct Job* job;
 
-	//printf("checking on the children\n");
+	for (i = 0; i < MAX_JOBS; i++) {
 
-	int wPid, stat = -5;
-	struct StackNode* ptr = processStack->top;
-	while (ptr != NULL) {
-		//printf("checking a background (?) process\n"); fflush(stdout);
-		wPid = waitpid(ptr->val, &stat, WNOHANG);
-		ptr = ptr->next;
-		if (wPid > 0 && WIFEXITED(stat)) {
+		job = &jobTable.jobs[i];
+		if (job->state == JOB_FREE || job->pgid == foregroundPgid) { continue; }
+
+		wPid = waitpid(job->pgid, &stat, WNOHANG | WUNTRACED | WCONTINUED);
+		if (wPid <= 0) { continue; }
+
+		if (WIFEXITED(stat)) {
 			/* informative message */
 			printf("background pid %d is done: exit value %d\n: ", wPid, WEXITSTATUS(stat)); fflush(stdout);
-			/* child has exited, delete from process stack */	
-			deleteFromStack(processStack, wPid);						
+			removeJob(&jobTable, job);
+		}
+		else if (WIFSIGNALED(stat)) {
+			printf("background pid %d is done: terminated by signal %d\n: ", wPid, WTERMSIG(stat)); fflush(stdout);
+			removeJob(&jobTable, job);
+		}
+		else if (WIFSTOPPED(stat)) {
+			job->state = JOB_STOPPED;
+			printf("\n"); printJob(job); printf(": "); fflush(stdout);
+		}
+		else if (WIFCONTINUED(stat)) {
+			job->state = JOB_RUNNING;
 		}
+
 	}
-	
 
 }
 
 
-/* toggle normal and foreground-only modes, will be called by a sigaction which handles SIGTSTP */
+/* waitForeground() gives the terminal to a job and waits until it exits or is stopped. Called with SIGCHLD blocked.
+   If cont is set the job is sent SIGCONT after it owns the terminal, as fg does for a stopped job */
+
+void waitForeground(struct Job* job, pid_t pgid, int cont) {
+
+	int stat = -5;
+	pid_t wPid;
+
+	foregroundPgid = pgid;
+
+	if (shellIsInteractive) { tcsetpgrp(STDIN_FILENO, pgid); }
+	if (cont) { kill(-pgid, SIGCONT); }
+
+	/* while background commands are queued, keep launching them as slots free up */
+
+	sigset_t unblocked;
+	sigprocmask(SIG_SETMASK, NULL, &unblocked);
+	sigdelset(&unblocked, SIGCHLD);
+
+	do {
+		if (admission.first != NULL) {
+			wPid = waitpid(pgid, &stat, WUNTRACED | WNOHANG);
+			if (wPid == 0) { waitForSlot(&unblocked, 0); drainQueue(); }
+		}
+		else {
+			wPid = waitpid(pgid, &stat, WUNTRACED);
+		}
+	} while ((wPid == -1 && errno == EINTR) || wPid == 0);
+
+	/* take the terminal back */
+
+	if (shellIsInteractive) { tcsetpgrp(STDIN_FILENO, shellPgid); }
+	foregroundPgid = 0;
+
+	if (wPid == -1) { removeJob(&jobTable, job); return; }
+
+	if (WIFSTOPPED(stat)) {
+		/* ^Z: keep the job in the table so it can be resumed with fg or bg */
+		if (job != NULL) {
+			job->state = JOB_STOPPED;
+			job->isBG = 0;
+			printf("\n"); printJob(job);
+		}
+		lastCommandSignal = WSTOPSIG(stat); lastCommandStatus = -5;
+		return;
+	}
+
+	if (WIFSIGNALED(stat) && (WTERMSIG(stat) == 2)) 
+		{ lastCommandSignal = 2; lastCommandStatus = -5; shStatus(NULL); }
+
+	else if (WIFEXITED(stat)) {lastCommandStatus = WEXITSTATUS(stat); lastCommandSignal = -5;}
+	else if (WIFSIGNALED(stat)) {lastCommandSignal = WTERMSIG(stat); lastCommandStatus = -5;}
+
+	/* child has exited, delete from job table */
+
+	removeJob(&jobTable, job);
+
+}
+
+
+/* restore default signal dispositions in a child before execvp() */
+
+void resetChildSignals() {
+
+	struct sigaction defaultAction = {0};
+	defaultAction.sa_handler = SIG_DFL;
+	sigemptyset(&defaultAction.sa_mask);
+
+	sigaction(SIGINT, &defaultAction, NULL);
+	sigaction(SIGTSTP, &defaultAction, NULL);
+	sigaction(SIGTTIN, &defaultAction, NULL);
+	sigaction(SIGTTOU, &defaultAction, NULL);
+	sigaction(SIGCHLD, &defaultAction, NULL);
+
+}
+
+
+/* shJobs lists running and stopped jobs */
+
+int shJobs(char** args) {
+
+	sigset_t childMask, prevMask;
+	sigemptyset(&childMask);
+	sigaddset(&childMask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &childMask, &prevMask);
+
+	printJobs(&jobTable);
+
+	sigprocmask(SIG_SETMASK, &prevMask, NULL);
+	return 1;
+
+}
+
+
+/* shFg resumes a job in the foreground: fg [%n] */
+
+int shFg(char** args) {
+
+	sigset_t childMask, prevMask;
+	sigemptyset(&childMask);
+	sigaddset(&childMask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &childMask, &prevMask);
+
+	struct Job* job = findJobBySpec(&jobTable, args[1]);
+
+	if (job == NULL) {
+		printf("fg: no such job\n"); fflush(stdout);
+	}
+	else {
+		printf("%s\n", job->command); fflush(stdout);
+		job->isBG = 0;
+		job->state = JOB_RUNNING;
+		waitForeground(job, job->pgid, 1);
+	}
+
+	sigprocmask(SIG_SETMASK, &prevMask, NULL);
+	return 1;
+
+}
+
+
+/* shBg resumes a stopped job in the background: bg [%n] */
+
+int shBg(char** args) {
+
+	sigset_t childMask, prevMask;
+	sigemptyset(&childMask);
+	sigaddset(&childMask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &childMask, &prevMask);
+
+	struct Job* job = findJobBySpec(&jobTable, args[1]);
+
+	if (job == NULL) {
+		printf("bg: no such job\n"); fflush(stdout);
+	}
+	else {
+		job->isBG = 1;
+		job->state = JOB_RUNNING;
+		kill(-job->pgid, SIGCONT);
+		printJob(job);
+	}
+
+	sigprocmask(SIG_SETMASK, &prevMask, NULL);
+	return 1;
+
+}
+
+
+/* shKill sends a signal to a job or a pid: kill [-signal] %n|pid ... Defaults to SIGTERM */
+
+int shKill(char** args) {
+
+	int i = 1, sig = SIGTERM;
+	long pid;
+	char* end;
+	struct Job* job;
+
+	if (args[1] != NULL && args[1][0] == '-') {
+		sig = parseSignal(args[1] + 1);
+		if (sig < 0) { printf("kill: unknown signal %s\n", args[1]); fflush(stdout); return 1; }
+		i++;
+	}
+
+	if (args[i] == NULL) { printf("usage: kill [-signal] %%job | pid\n"); fflush(stdout); return 1; }
+
+	for (; args[i] != NULL; i++) {
+
+		if (args[i][0] == '%') {
+			job = findJobBySpec(&jobTable, args[i]);
+			if (job == NULL) { printf("kill: %s: no such job\n", args[i]); fflush(stdout); continue; }
+
+			/* signal the whole process group. A stopped job must be continued to act on the signal */
+
+			if (kill(-job->pgid, sig) < 0) { perror("kill"); }
+			if (job->state == JOB_STOPPED && sig != SIGSTOP && sig != SIGTSTP) { kill(-job->pgid, SIGCONT); }
+		}
+		else {
+
+			/* only a positive pid names one process. Anything else would signal a group, the shell's own for 0 */
+
+			errno = 0;
+			pid = strtol(args[i], &end, 10);
+			if (end == args[i] || *end != '\0' || errno != 0 || pid <= 0 || pid != (pid_t) pid) {
+				printf("kill: %s: arguments must be process or job IDs\n", args[i]); fflush(stdout);
+				continue;
+			}
+			if (kill((pid_t) pid, sig) < 0) { perror("kill"); }
+
+		}
+
+	}
+
+	return 1;
+
+}
+
+
+/* parse a signal given as a number or a name, with or without the SIG prefix. Returns -1 if unknown */
+
+int parseSignal(char* name) {
+
+	int i;
+	const char* names[] = {"HUP", "INT", "QUIT", "KILL", "USR1", "USR2", "TERM", "CONT", "STOP", "TSTP"};
+	const int numbers[] = {SIGHUP, SIGINT, SIGQUIT, SIGKILL, SIGUSR1, SIGUSR2, SIGTERM, SIGCONT, SIGSTOP, SIGTSTP};
+
+	if (name[0] >= '0' && name[0] <= '9') { return atoi(name); }
+	if (strncmp(name, "SIG", 3) == 0) { name += 3; }
+
+	for (i = 0; i < 10; i++) {
+		if (strcmp(name, names[i]) == 0) { return numbers[i]; }
+	}
+
+	return -1;
+
+}
+
+
+/* shLimit shows or sets the maximum number of concurrent background jobs: limit [n], 0 for unlimited */
+
+int shLimit(char** args) {
+
+	if (args[1] != NULL) {
+		setBackgroundLimit(&admission, atoi(args[1]));
+	}
+
+	if (admission.maxBackground > 0) { printf("background limit %d\n", admission.maxBackground); }
+	else { printf("background limit unlimited\n"); }
+	fflush(stdout);
+
+	return 1;
+
+}
+
+
+/* shRate shows or sets the background spawn rate: rate [jobs per second [burst]], 0 for unlimited */
+
+int shRate(char** args) {
+
+	if (args[1] != NULL) {
+		setSpawnRate(&admission, atof(args[1]), (args[2] != NULL) ? atof(args[2]) : 1);
+	}
+
+	if (admission.rate > 0) { printf("spawn rate %.2f/s burst %.0f\n", admission.rate, admission.burst); }
+	else { printf("spawn rate unlimited\n"); }
+	fflush(stdout);
+
+	return 1;
+
+}
+
+
+/* shQueue lists background commands waiting for admission */
+
+int shQueue(char** args) {
+
+	printQueue(&admission);
+	return 1;
+
+}
+
+
+/* shStats prints background admission statistics */
+
+int shStats(char** args) {
+
+	long dequeued = admission.queuedTotal - admission.size;
+
+	printf("background launched: %ld\n", admission.launched);
+	printf("background running: %d\n", countBackgroundJobs(&jobTable));
+	printf("queued: %ld total, %d pending\n", admission.queuedTotal, admission.size);
+	printf("queue wait: mean %.3fs, max %.3fs, total %.3fs\n",
+		(dequeued > 0) ? admission.totalWait / dequeued : 0.0, admission.maxWait, admission.totalWait);
+	double copySeconds = copyStats->nanoseconds / 1e9;
+	printf("cat/tee: %lld bytes in %.3fs, %.1f MB/s, %lld bytes zero-copy\n", copyStats->bytes, copySeconds,
+		(copySeconds > 0) ? copyStats->bytes / copySeconds / 1e6 : 0.0, copyStats->zeroCopyBytes);
+	printf("glob directory cache: %ld hits, %ld misses, %ld invalidated\n",
+		dirCacheStats.hits, dirCacheStats.misses, dirCacheStats.invalidations);
+	fflush(stdout);
+
+	return 1;
+
+}
+
+
+/* drainQueue launches queued background commands, oldest first, for as long as admission control allows */
+
+void drainQueue() {
+
+	struct PendingCommand* cmd;
+	char** argv;
+	int argc;
+	sigset_t childMask, prevMask;
+	sigemptyset(&childMask);
+	sigaddset(&childMask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &childMask, &prevMask);
+
+	while (admission.first != NULL && mayLaunch(&admission, countBackgroundJobs(&jobTable))) {
+		cmd = dequeueCommand(&admission);
+		recordLaunch(&admission);
+
+		/* launch from a copy of the array, since redirection takes its operators and paths out of the array it is
+		   given, and cmd->args must still hold every string to free them */
+
+		argc = countArgs(cmd->args);
+		argv = malloc((argc + 2) * sizeof(char* ));
+		memcpy(argv, cmd->args, (argc + 1) * sizeof(char* ));
+		argv[argc + 1] = NULL;
+
+		launchCommand(argv, 1);
+
+		free(argv);
+		freePendingCommand(cmd);
+	}
+
+	sigprocmask(SIG_SETMASK, &prevMask, NULL);
+
+}
+
+
+/* sleep until a child exits, the token bucket refills, or (if watchInput) stdin becomes readable. SIGCHLD is
+   blocked on entry and only let through atomically inside ppoll(), so an exit cannot slip in unnoticed.
+   Returns 1 if input is ready */
+
+int waitForSlot(sigset_t* unblocked, int watchInput) {
+
+	struct pollfd fds;
+	struct timespec timeout;
+	double delay = nextLaunchDelay(&admission, countBackgroundJobs(&jobTable));
+
+	fds.fd = STDIN_FILENO;
+	fds.events = POLLIN;
+	fds.revents = 0;
+
+	timeout.tv_sec = (time_t) delay;
+	timeout.tv_nsec = (long) ((delay - (double) timeout.tv_sec) * 1e9);
+
+	return ppoll(&fds, watchInput ? 1 : 0, (delay < 0) ? NULL : &timeout, unblocked) > 0;
+
+}
+
+
+/* waitForInput() is called before reading a command line. While commands are queued it keeps launching them as
+   slots free up, and returns as soon as a line can be read */
+
+void waitForInput() {
+
+	sigset_t childMask, prevMask;
+	sigemptyset(&childMask);
+	sigaddset(&childMask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &childMask, &prevMask);
+
+	drainQueue();
+
+	/* a line already in the buffer is ready without polling fd 0 */
+
+	while (admission.first != NULL && inputBfr.start == inputBfr.end) {
+		if (waitForSlot(&prevMask, 1)) { break; }
+		drainQueue();
+	}
+
+	sigprocmask(SIG_SETMASK, &prevMask, NULL);
+
+}
+
+
+/* finishQueue() is called at end of input and launches every queued command before the shell exits. Stopped jobs
+   keep their slots until something continues them, so when only stopped jobs hold the slots the queued commands are
+   reported and dropped rather than waited for */
+
+void finishQueue() {
+
+	struct PendingCommand* cmd;
+	sigset_t childMask, prevMask;
+	sigemptyset(&childMask);
+	sigaddset(&childMask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &childMask, &prevMask);
+
+	drainQueue();
+
+	while (admission.first != NULL) {
+
+		if (nextLaunchDelay(&admission, countBackgroundJobs(&jobTable)) < 0 && countRunningBackgroundJobs(&jobTable) == 0) {
+			printf("background jobs are stopped, not launching:\n");
+			printQueue(&admission);
+			while ((cmd = dequeueCommand(&admission)) != NULL) { freePendingCommand(cmd); }
+			break;
+		}
+
+		waitForSlot(&prevMask, 0);
+		drainQueue();
+
+	}
+
+	sigprocmask(SIG_SETMASK, &prevMask, NULL);
+
+}
+
+
+/* shFgOnly toggles foreground-only mode, in which & is ignored. Previously bound to ^Z */
+
+int shFgOnly(char** args) {
+
+	toggleBG();
+	return 1;
+
+}
+
+
+/* toggle normal and foreground-only modes */
 
 void toggleBG() {
 
 	if (allowBG) {
-		printf("Entering foreground-only mode (& is now ignored)\n: "); fflush(stdout);
+		printf("Entering foreground-only mode (& is now ignored)\n"); fflush(stdout);
 		allowBG = 0;
 	} else {
-		printf("Exiting foreground-only mode\n: "); fflush(stdout);
+		printf("Exiting foreground-only mode\n"); fflush(stdout);
 		allowBG = 1; 
 	}
 
@@ -16,11 +16,26 @@
 #include <unistd.h>
 #include <sys/wait.h>
 #include <fcntl.h>
-#include "stack.h"
+#include <errno.h>
+#include <poll.h>
+#include "jobs.h"
+#include "admission.h"
+#include "globExpand.h"
+#include "copyBuiltins.h"
 
 #ifndef COMMAND_LOOP_H
 #define COMMAND_LOOP_H
 
+#define INPUT_BFR_SIZE 4096
+
+struct InputBuffer {
+
+	char bytes[INPUT_BFR_SIZE];
+	size_t start;		// next unread byte
+	size_t end;		// end of the bytes read
+
+};
+
 struct redirect {
 
         int status;
@@ -31,16 +46,35 @@ struct redirect {
 
 void commandLoop();
 char** getArgs(char* );
+ssize_t readLine(char** , size_t* );
+char* expandPid(char* , size_t* );
 int execArgs(int, char** );
+int launchCommand(char** , int);
+int (*findIOBuiltin(char* ))(char** );
 int countArgs(char** );
 
 int shExit(char** );
 int shCd(char** );
 int shStatus(char** );
+int shJobs(char** );
+int shFg(char** );
+int shBg(char** );
+int shKill(char** );
+int shFgOnly(char** );
+int shLimit(char** );
+int shRate(char** );
+int shQueue(char** );
+int shStats(char** );
 
 struct redirect* checkIORedirection(char** );
 void checkOnChildren();
-void termForeground();
+void waitForeground(struct Job* , pid_t, int);
+void resetChildSignals();
+int parseSignal(char* );
 void toggleBG();
+void drainQueue();
+int waitForSlot(sigset_t* , int);
+void waitForInput();
+void finishQueue();
 
 #endif
@@ -0,0 +1,406 @@
+/****************************************************************************************************
+ *	Title: Copy Builtins
+ *	Description: Builtin cat and tee for smallsh. Data is moved inside the kernel wherever the file
+ *			descriptors allow: copy_file_range or sendfile from regular files, splice to and from
+ *			pipes, and tee(2) to duplicate a pipe for every tee output. When a descriptor does
+ *			not support any of these (a terminal, for example) the copy falls back to large
+ *			buffered reads and writes.
+ * *************************************************************************************************/
+
+
+#include "copyBuiltins.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+
+struct CopyStats* copyStats;
+
+static char* copyBfr = NULL;
+
+
+/* map the stats where the children running cat and tee can add to them. Called once, before any is forked */
+
+void initCopyStats() {
+
+	copyStats = mmap(NULL, sizeof(struct CopyStats), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (copyStats == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+
+}
+
+
+/* Boolean: does errno mean this kind of copy is not supported between these descriptors, so another method should
+   be tried, rather than a real IO error */
+
+static int unsupported(int err) {
+
+	return err == EINVAL || err == ENOSYS || err == EXDEV || err == EOPNOTSUPP || err == EBADF || err == ESPIPE;
+
+}
+
+
+/* Boolean: was fd opened for append. splice(2) refuses such outputs with EINVAL */
+
+static int isAppending(int fd) {
+
+	int flags = fcntl(fd, F_GETFL);
+	return flags >= 0 && (flags & O_APPEND);
+
+}
+
+
+/* write all of bfr, retrying short writes. Returns 0 or -1 */
+
+static int writeAll(int fd, const char* bfr, size_t len) {
+
+	ssize_t n;
+	while (len > 0) {
+		n = write(fd, bfr, len);
+		if (n < 0) {
+			if (errno == EINTR) { continue; }
+			return -1;
+		}
+		bfr += n;
+		len -= n;
+	}
+	return 0;
+
+}
+
+
+/* plain read()/write() copy through a 1 MiB buffer */
+
+static long long bufferedCopy(int in, int out) {
+
+	long long total = 0;
+	ssize_t n;
+
+	if (copyBfr == NULL) { copyBfr = malloc(COPY_BFR_SIZE); }
+
+	while ((n = read(in, copyBfr, COPY_BFR_SIZE)) != 0) {
+		if (n < 0) {
+			if (errno == EINTR) { continue; }
+			return -1;
+		}
+		if (writeAll(out, copyBfr, n) < 0) { return -1; }
+		total += n;
+	}
+
+	return total;
+
+}
+
+
+/* copy everything from in to out, choosing the cheapest method the two descriptors support. Each method picks up
+   at the current file offsets, so a method that fails part way hands over to the next one. Returns the number of
+   bytes copied, or -1 with errno set */
+
+long long copyFd(int in, int out) {
+
+	struct stat inAttr, outAttr;
+	long long total = 0, moved = 0;
+	ssize_t n = -1;
+
+	if (fstat(in, &inAttr) < 0 || fstat(out, &outAttr) < 0) { return -1; }
+
+	int inIsFile = S_ISREG(inAttr.st_mode);
+	int outIsFile = S_ISREG(outAttr.st_mode);
+	int eitherIsPipe = S_ISFIFO(inAttr.st_mode) || S_ISFIFO(outAttr.st_mode);
+
+	/* file to file: copy_file_range, which may even share extents on a filesystem that supports it */
+
+	if (inIsFile && outIsFile) {
+		while ((n = copy_file_range(in, NULL, out, NULL, COPY_CHUNK, 0)) > 0) { moved += n; }
+		if (n == 0) { goto done; }
+		if (!unsupported(errno)) { return -1; }
+	}
+
+	/* file to anything: sendfile */
+
+	if (inIsFile) {
+		while ((n = sendfile(out, in, NULL, COPY_CHUNK)) > 0) { moved += n; }
+		if (n == 0) { goto done; }
+		if (!unsupported(errno)) { return -1; }
+	}
+
+	/* pipe on either side: splice, unless out appends */
+
+	if (eitherIsPipe && !isAppending(out)) {
+		while ((n = splice(in, NULL, out, NULL, COPY_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE)) > 0) { moved += n; }
+		if (n == 0) { goto done; }
+		if (!unsupported(errno)) { return -1; }
+	}
+
+	/* nothing zero-copy applies */
+
+	total = bufferedCopy(in, out);
+	if (total < 0) { return -1; }
+
+done:
+	addCopyStat(zeroCopyBytes, moved);
+	return total + moved;
+
+}
+
+
+/* splice exactly len bytes from in to out, storing in moved how many were spliced. Returns 0 or -1 */
+
+static int spliceAll(int in, int out, size_t len, size_t* moved) {
+
+	ssize_t n;
+	*moved = 0;
+	while (len > 0) {
+		n = splice(in, NULL, out, NULL, len, SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (n <= 0) {
+			if (n < 0 && errno == EINTR) { continue; }
+			return -1;
+		}
+		len -= n;
+		*moved += n;
+	}
+	return 0;
+
+}
+
+
+/* copy a pipe on in to every fd in outs without moving the data through user space. Each round tee(2) duplicates up
+   to one pipe buffer of input into a scratch pipe, which is spliced into an output, once per output but the last;
+   the last output then consumes the input with splice. Returns bytes read from in, or -1. If tee() is not supported,
+   or the first output of a round will not take a splice, the remainder is copied with buffered IO */
+
+static long long teePipe(int in, int* outs, int numOuts) {
+
+	int scratch[2];
+	long long total = 0;
+	ssize_t len = 0, n;
+	size_t moved;
+	int i, shortTee;
+
+	if (pipe2(scratch, O_CLOEXEC) < 0) { return -1; }
+
+	/* a round never takes more than the scratch pipe can hold, so every tee of that round fits */
+
+	long pipeSize = fcntl(scratch[1], F_GETPIPE_SZ);
+	if (pipeSize <= 0) { pipeSize = 65536; }
+
+	if (copyBfr == NULL) { copyBfr = malloc(COPY_BFR_SIZE); }
+
+	for (;;) {
+
+		/* first output: tee decides how much data this round covers */
+
+		len = tee(in, scratch[1], pipeSize, 0);
+		if (len == 0) { break; }
+		if (len < 0) {
+			if (errno == EINTR) { continue; }
+			if (!unsupported(errno)) { total = -1; }
+			break;
+		}
+		if (spliceAll(scratch[0], outs[0], len, &moved) < 0) {
+			/* nothing of this round has been written anywhere yet, so buffered IO can take over from here */
+			if (moved == 0 && unsupported(errno)) { len = -1; }
+			else { total = -1; }
+			break;
+		}
+
+		/* middle outputs: tee the same bytes again. A short tee leaves output i without this round's data */
+
+		shortTee = 0;
+		for (i = 1; i < numOuts - 1; i++) {
+			n = tee(in, scratch[1], len, 0);
+			if (n != len) {
+				shortTee = 1;
+				break;
+			}
+			if (spliceAll(scratch[0], outs[i], len, &moved) < 0) { total = -1; break; }
+		}
+		if (total < 0) { break; }
+
+		if (!shortTee) {
+			/* last output: consume the input */
+			if (spliceAll(in, outs[numOuts - 1], len, &moved) < 0) { total = -1; break; }
+			addCopyStat(zeroCopyBytes, len);
+		}
+		else {
+			/* finish the round through a buffer, starting at the output that missed out, and replace the scratch
+			   pipe, which may hold part of the short tee */
+			close(scratch[0]);
+			close(scratch[1]);
+			if (pipe2(scratch, O_CLOEXEC) < 0 || read(in, copyBfr, len) != len) { return -1; }
+			for (; i < numOuts; i++) {
+				if (writeAll(outs[i], copyBfr, len) < 0) { total = -1; break; }
+			}
+			if (total < 0) { break; }
+		}
+
+		total += len;
+
+	}
+
+	close(scratch[0]);
+	close(scratch[1]);
+
+	/* tee() not supported: buffered copy of the rest */
+
+	if (total >= 0 && len < 0) {
+		ssize_t r;
+		while ((r = read(in, copyBfr, COPY_BFR_SIZE)) != 0) {
+			if (r < 0) {
+				if (errno == EINTR) { continue; }
+				return -1;
+			}
+			for (i = 0; i < numOuts; i++) {
+				if (writeAll(outs[i], copyBfr, r) < 0) { return -1; }
+			}
+			total += r;
+		}
+	}
+
+	return total;
+
+}
+
+
+/* elapsed nanoseconds since a monotonic timestamp */
+
+static long long elapsed(struct timespec* start) {
+
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) * 1000000000LL + (end.tv_nsec - start->tv_nsec);
+
+}
+
+
+/* cat [file ...]: concatenate files, or stdin if none or "-", to stdout. Returns an exit status */
+
+int catFiles(char** args) {
+
+	int i, fd, status = 0;
+	long long n;
+	struct timespec start;
+	char* stdinArgs[] = {"cat", "-", NULL};
+
+	if (args[1] == NULL) { args = stdinArgs; }
+
+	fflush(stdout);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 1; args[i] != NULL; i++) {
+
+		if (strcmp(args[i], "-") == 0) {
+			fd = STDIN_FILENO;
+		}
+		else if ((fd = open(args[i], O_RDONLY | O_CLOEXEC)) < 0) {
+			fprintf(stderr, "cat: %s: %s\n", args[i], strerror(errno));
+			status = 1;
+			continue;
+		}
+
+		n = copyFd(fd, STDOUT_FILENO);
+		if (n < 0) {
+			fprintf(stderr, "cat: %s: %s\n", args[i], strerror(errno));
+			status = 1;
+		}
+		else {
+			addCopyStat(bytes, n);
+		}
+
+		if (fd != STDIN_FILENO) { close(fd); }
+
+	}
+
+	addCopyStat(nanoseconds, elapsed(&start));
+
+	return status;
+
+}
+
+
+/* tee [-a] [file ...]: copy stdin to stdout and to every file, appending with -a. Returns an exit status */
+
+int teeFiles(char** args) {
+
+	int i = 1, numOuts = 0, numFiles = 0, status = 0, append = 0;
+	int* outs;
+	long long n;
+	struct stat inAttr;
+	struct timespec start;
+
+	if (args[1] != NULL && strcmp(args[1], "-a") == 0) { append = 1; i++; }
+
+	/* one output per file operand, plus stdout */
+
+	while (args[i + numFiles] != NULL) { numFiles++; }
+	outs = malloc((numFiles + 1) * sizeof(int));
+
+	for (; args[i] != NULL; i++) {
+		outs[numOuts] = open(args[i], O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0644);
+		if (outs[numOuts] < 0) {
+			fprintf(stderr, "tee: %s: %s\n", args[i], strerror(errno));
+			status = 1;
+			continue;
+		}
+		numOuts++;
+	}
+
+	/* stdout is the last output, the one that consumes the input */
+
+	outs[numOuts++] = STDOUT_FILENO;
+
+	fflush(stdout);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	/* tee(2) needs a pipe as input, and splice needs outputs that accept it: files or pipes, not opened to append */
+
+	int spliceable = 1;
+	struct stat outAttr;
+	for (i = 0; i < numOuts; i++) {
+		if (fstat(outs[i], &outAttr) < 0 || !(S_ISREG(outAttr.st_mode) || S_ISFIFO(outAttr.st_mode))
+				|| isAppending(outs[i])) {
+			spliceable = 0;
+		}
+	}
+
+	if (fstat(STDIN_FILENO, &inAttr) == 0 && S_ISFIFO(inAttr.st_mode) && numOuts > 1 && spliceable) {
+		n = teePipe(STDIN_FILENO, outs, numOuts);
+	}
+	else if (numOuts == 1) {
+		n = copyFd(STDIN_FILENO, STDOUT_FILENO);
+	}
+	else {
+		/* input is not a pipe, so tee(2) cannot be used */
+		ssize_t r;
+		n = 0;
+		if (copyBfr == NULL) { copyBfr = malloc(COPY_BFR_SIZE); }
+		while ((r = read(STDIN_FILENO, copyBfr, COPY_BFR_SIZE)) > 0) {
+			for (i = 0; i < numOuts; i++) {
+				if (writeAll(outs[i], copyBfr, r) < 0) { status = 1; }
+			}
+			n += r;
+		}
+		if (r < 0) { n = -1; }
+	}
+
+	if (n < 0) {
+		fprintf(stderr, "tee: %s\n", strerror(errno));
+		status = 1;
+	}
+	else {
+		addCopyStat(bytes, n);
+	}
+
+	addCopyStat(nanoseconds, elapsed(&start));
+
+	for (i = 0; i < numOuts - 1; i++) { close(outs[i]); }
+	free(outs);
+
+	return status;
+
+}
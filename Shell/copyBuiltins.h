@@ -0,0 +1,39 @@
+/***********************************************************************************************
+ *	Title: Copy Builtins Declarations
+ * 	Description: Function signatures and struct definitions for the cat and tee builtins of
+ * 			smallsh, which move data with splice, tee, copy_file_range and sendfile
+ * 			where the file descriptors allow it.
+ * ********************************************************************************************/
+
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef COPY_BUILTINS_H
+#define COPY_BUILTINS_H
+
+#define COPY_BFR_SIZE (1024 * 1024)
+#define COPY_CHUNK (1024 * 1024)
+
+struct CopyStats {
+
+	long long bytes;		// total bytes written by cat and tee
+	long long zeroCopyBytes;	// part of bytes moved without a user space copy
+	long long nanoseconds;		// time spent inside cat and tee
+
+};
+
+/* shared with the children cat and tee run in, and added to atomically since background ones may run at once */
+
+extern struct CopyStats* copyStats;
+
+#define addCopyStat(field, n) __atomic_fetch_add(&copyStats->field, (n), __ATOMIC_RELAXED)
+
+void initCopyStats();
+long long copyFd(int, int);
+int catFiles(char** );
+int teeFiles(char** );
+
+#endif
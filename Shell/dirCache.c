@@ -0,0 +1,274 @@
+/****************************************************************************************************
+ *	Title: Directory Listing Cache
+ *	Description: Caches directory listings for pathname expansion. A directory is read once with
+ *			getdents64 into a single name buffer, sorted, and kept until its mtime changes,
+ *			so that several patterns against the same directory cost one stat() each rather
+ *			than a full re-read. Least recently used listings are evicted when the cache fills.
+ * *************************************************************************************************/
+
+
+#include "dirCache.h"
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+
+/* layout of the records returned by the getdents64 system call */
+
+struct linuxDirent64 {
+
+	unsigned long long d_ino;
+	long long d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+
+};
+
+struct DirCacheStats dirCacheStats = {0, 0, 0};
+
+static struct DirListing* cacheSlots[DIR_CACHE_SLOTS];
+static unsigned long useClock = 0;
+
+/* names buffer used by the sort comparator */
+
+static const char* sortNames;
+
+
+/* compare two entries by name for qsort */
+
+static int compareEntries(const void* a, const void* b) {
+
+	return strcmp(sortNames + ((const struct DirEntryRef* ) a)->nameOffset,
+			sortNames + ((const struct DirEntryRef* ) b)->nameOffset);
+
+}
+
+
+/* free a listing and everything it owns */
+
+static void freeListing(struct DirListing* listing) {
+
+	if (listing == NULL) { return; }
+	free(listing->path);
+	free(listing->entries);
+	free(listing->names);
+	free(listing);
+
+}
+
+
+/* read a whole directory with getdents64. Returns NULL if it cannot be opened */
+
+static struct DirListing* readListing(const char* path, struct stat* attributes) {
+
+	int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) { return NULL; }
+
+	struct DirListing* listing = malloc(sizeof(struct DirListing));
+	listing->path = strdup(path);
+	listing->dev = attributes->st_dev;
+	listing->ino = attributes->st_ino;
+	listing->mtime = attributes->st_mtim;
+	listing->numEntries = 0;
+	listing->lastUsed = 0;
+	listing->pins = 0;
+	listing->detached = 0;
+
+	int entryCap = 64;
+	size_t namesCap = 1024, namesSize = 0;
+	listing->entries = malloc(entryCap * sizeof(struct DirEntryRef));
+	listing->names = malloc(namesCap);
+
+	/* 64 KiB per call keeps the syscall count low for large directories */
+
+	size_t bfrSize = 64 * 1024;
+	char* bfr = malloc(bfrSize);
+	long nread, pos;
+	struct linuxDirent64* d;
+	size_t len;
+
+	while ((nread = syscall(SYS_getdents64, fd, bfr, bfrSize)) > 0) {
+
+		for (pos = 0; pos < nread; pos += d->d_reclen) {
+
+			d = (struct linuxDirent64* ) (bfr + pos);
+
+			/* skip . and .. */
+
+			if (d->d_name[0] == '.' && (d->d_name[1] == 0 || (d->d_name[1] == '.' && d->d_name[2] == 0))) {
+				continue;
+			}
+
+			len = strlen(d->d_name) + 1;
+
+			if (listing->numEntries == entryCap) {
+				entryCap *= 2;
+				listing->entries = realloc(listing->entries, entryCap * sizeof(struct DirEntryRef));
+			}
+			while (namesSize + len > namesCap) {
+				namesCap *= 2;
+				listing->names = realloc(listing->names, namesCap);
+			}
+
+			memcpy(listing->names + namesSize, d->d_name, len);
+			listing->entries[listing->numEntries].nameOffset = (unsigned int) namesSize;
+			listing->entries[listing->numEntries].type = d->d_type;
+			listing->numEntries++;
+			namesSize += len;
+
+		}
+
+	}
+
+	free(bfr);
+	close(fd);
+
+	/* sort once, so every expansion against this listing comes out in order */
+
+	sortNames = listing->names;
+	qsort(listing->entries, listing->numEntries, sizeof(struct DirEntryRef), compareEntries);
+
+	return listing;
+
+}
+
+
+/* take a listing out of the cache. It is freed now, or by dirCacheRelease() if someone still holds it */
+
+static void dropSlot(int slot) {
+
+	if (cacheSlots[slot]->pins > 0) {
+		cacheSlots[slot]->detached = 1;
+	}
+	else {
+		freeListing(cacheSlots[slot]);
+	}
+	cacheSlots[slot] = NULL;
+
+}
+
+
+/* return the listing for path, reading the directory only if it is not cached or has changed since it was read.
+   The listing is pinned and must be handed back with dirCacheRelease() */
+
+struct DirListing* dirCacheGet(const char* path) {
+
+	struct stat attributes;
+	int i, slot = -1, victim;
+
+	if (stat(path, &attributes) < 0 || !S_ISDIR(attributes.st_mode)) { return NULL; }
+
+	for (i = 0; i < DIR_CACHE_SLOTS; i++) {
+		if (cacheSlots[i] != NULL && strcmp(cacheSlots[i]->path, path) == 0) {
+			slot = i;
+			break;
+		}
+	}
+
+	if (slot >= 0) {
+
+		struct DirListing* cached = cacheSlots[slot];
+
+		/* still valid if it is the same directory and its mtime has not moved */
+
+		if (cached->dev == attributes.st_dev && cached->ino == attributes.st_ino &&
+				cached->mtime.tv_sec == attributes.st_mtim.tv_sec &&
+				cached->mtime.tv_nsec == attributes.st_mtim.tv_nsec) {
+			dirCacheStats.hits++;
+			cached->lastUsed = ++useClock;
+			cached->pins++;
+			return cached;
+		}
+
+		dirCacheStats.invalidations++;
+		dropSlot(slot);
+
+	}
+	else {
+
+		/* pick an empty slot, or evict the least recently used listing nobody is holding */
+
+		victim = -1;
+		for (i = 0; i < DIR_CACHE_SLOTS; i++) {
+			if (cacheSlots[i] == NULL) { slot = i; break; }
+			if (cacheSlots[i]->pins == 0 && (victim < 0 || cacheSlots[i]->lastUsed < cacheSlots[victim]->lastUsed)) {
+				victim = i;
+			}
+		}
+		if (slot < 0 && victim >= 0) {
+			slot = victim;
+			dropSlot(slot);
+		}
+
+	}
+
+	dirCacheStats.misses++;
+
+	struct DirListing* listing = readListing(path, &attributes);
+	if (listing == NULL) { return NULL; }
+
+	listing->lastUsed = ++useClock;
+	listing->pins = 1;
+
+	/* every slot pinned (a very deep ** walk): hand out an uncached listing */
+
+	if (slot < 0) {
+		listing->detached = 1;
+	}
+	else {
+		cacheSlots[slot] = listing;
+	}
+
+	return listing;
+
+}
+
+
+/* unpin a listing returned by dirCacheGet() */
+
+void dirCacheRelease(struct DirListing* listing) {
+
+	if (listing == NULL) { return; }
+
+	listing->pins--;
+	if (listing->pins <= 0 && listing->detached) {
+		freeListing(listing);
+	}
+
+}
+
+
+/* Boolean: is entry i of the listing a directory. Falls back to stat() when the filesystem gives no d_type, and
+   follows symbolic links */
+
+int listingIsDir(struct DirListing* listing, int i) {
+
+	unsigned char type = listing->entries[i].type;
+	if (type == DT_DIR) { return 1; }
+	if (type != DT_UNKNOWN && type != DT_LNK) { return 0; }
+
+	struct stat attributes;
+	size_t len = strlen(listing->path) + strlen(listingName(listing, i)) + 2;
+	char* full = malloc(len);
+	snprintf(full, len, "%s/%s", listing->path, listingName(listing, i));
+	int isDir = (stat(full, &attributes) == 0 && S_ISDIR(attributes.st_mode));
+	free(full);
+
+	return isDir;
+
+}
+
+
+/* drop every cached listing */
+
+void dirCacheClear() {
+
+	int i;
+	for (i = 0; i < DIR_CACHE_SLOTS; i++) {
+		if (cacheSlots[i] != NULL) { dropSlot(i); }
+	}
+
+}
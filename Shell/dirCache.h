@@ -0,0 +1,61 @@
+/***********************************************************************************************
+ *	Title: Directory Listing Cache Declarations
+ * 	Description: Function signatures and struct definitions for a small cache of directory
+ * 			listings read with getdents64. Listings are keyed by directory path and
+ * 			checked against the directory's mtime before every reuse. A listing
+ * 			returned by dirCacheGet() is pinned until dirCacheRelease() is called.
+ * ********************************************************************************************/
+
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+
+#ifndef DIR_CACHE_H
+#define DIR_CACHE_H
+
+#define DIR_CACHE_SLOTS 64
+
+struct DirEntryRef {
+
+	unsigned int nameOffset;	// offset of the name in the listing's name buffer
+	unsigned char type;		// DT_* type from getdents64
+
+};
+
+struct DirListing {
+
+	char* path;
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtime;
+	int numEntries;
+	struct DirEntryRef* entries;	// sorted by name, . and .. excluded
+	char* names;
+	unsigned long lastUsed;
+	int pins;			// callers currently iterating this listing, pinned listings are never evicted
+	int detached;			// no longer in the cache, freed when the last pin is released
+
+};
+
+struct DirCacheStats {
+
+	long hits;
+	long misses;
+	long invalidations;
+
+};
+
+extern struct DirCacheStats dirCacheStats;
+
+#define listingName(listing, i) ((listing)->names + (listing)->entries[(i)].nameOffset)
+
+struct DirListing* dirCacheGet(const char* );
+void dirCacheRelease(struct DirListing* );
+int listingIsDir(struct DirListing* , int);
+void dirCacheClear();
+
+#endif
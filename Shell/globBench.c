@@ -0,0 +1,105 @@
+/**************************************************************************************************************************
+ *	Title: Pathname expansion benchmark
+ *	Description: Times glob expansion over a large directory, with the directory cache reused across patterns and with
+ *			the cache cleared before each pattern (a fresh getdents64 read every time, as without caching).
+ *
+ *			Usage: ./globBench [directory [entries]]. The directory is created and filled with the given number
+ *			of empty files (default 100000) if it does not exist yet.
+ * ***********************************************************************************************************************/
+
+#include "globExpand.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+/* wall clock seconds */
+
+double now() {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+
+}
+
+
+/* create dir with numEntries files named file<n>.log, file<n>.txt, ... unless it already exists */
+
+void populate(const char* dir, int numEntries) {
+
+	int i, fd;
+	char path[4096];
+	const char* suffixes[] = {"log", "txt", "dat", "csv"};
+
+	if (mkdir(dir, 0755) < 0) { return; }
+
+	printf("creating %d files in %s\n", numEntries, dir); fflush(stdout);
+
+	for (i = 0; i < numEntries; i++) {
+		snprintf(path, sizeof(path), "%s/file%06d.%s", dir, i, suffixes[i % 4]);
+		fd = open(path, O_WRONLY | O_CREAT, 0644);
+		if (fd >= 0) { close(fd); }
+	}
+
+}
+
+
+/* expand every pattern rounds times. If clearEachTime, the cache is emptied before each expansion */
+
+double run(char** patterns, int numPatterns, int rounds, int clearEachTime, long* matches) {
+
+	int r, i;
+	struct StringList out;
+	double start = now();
+
+	*matches = 0;
+	dirCacheClear();
+
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < numPatterns; i++) {
+			if (clearEachTime) { dirCacheClear(); }
+			initStringList(&out);
+			*matches += expandPattern(patterns[i], &out);
+			freeStringList(&out);
+		}
+	}
+
+	return now() - start;
+
+}
+
+
+int main(int argc, char** argv) {
+
+	const char* dir = (argc > 1) ? argv[1] : "globBench.dir";
+	int numEntries = (argc > 2) ? atoi(argv[2]) : 100000;
+	int rounds = 5, i, numPatterns = 5;
+	long matchesCached, matchesUncached;
+	char* patterns[5];
+	char bfr[5][4096];
+
+	populate(dir, numEntries);
+
+	snprintf(bfr[0], 4096, "%s/*.log", dir);
+	snprintf(bfr[1], 4096, "%s/file0?9*.txt", dir);
+	snprintf(bfr[2], 4096, "%s/file[0-4]*.dat", dir);
+	snprintf(bfr[3], 4096, "%s/*7.csv", dir);
+	snprintf(bfr[4], 4096, "%s/file00000?.*", dir);
+	for (i = 0; i < numPatterns; i++) { patterns[i] = bfr[i]; }
+
+	double uncached = run(patterns, numPatterns, rounds, 1, &matchesUncached);
+	double cached = run(patterns, numPatterns, rounds, 0, &matchesCached);
+
+	int expansions = numPatterns * rounds;
+
+	printf("%d expansions of %d patterns over %s\n", expansions, numPatterns, dir);
+	printf("re-read each time: %8.2f ms total, %7.3f ms per pattern, %ld matches\n",
+		uncached * 1e3, uncached * 1e3 / expansions, matchesUncached);
+	printf("cached listing:    %8.2f ms total, %7.3f ms per pattern, %ld matches\n",
+		cached * 1e3, cached * 1e3 / expansions, matchesCached);
+	printf("cache: %ld hits, %ld misses\n", dirCacheStats.hits, dirCacheStats.misses);
+
+	return EXIT_SUCCESS;
+
+}
@@ -0,0 +1,314 @@
+/****************************************************************************************************
+ *	Title: Pathname Expansion
+ *	Description: Expands *, ?, [...] and ** patterns in smallsh arguments into sorted lists of
+ *			matching paths. Directories are listed through the directory cache, so patterns
+ *			that share a directory within a command line, or across commands, read it once.
+ *			Like other shells, a pattern with no matches is passed through literally and
+ *			wildcards do not match a leading dot.
+ * *************************************************************************************************/
+
+
+#include "globExpand.h"
+#include <dirent.h>
+#include <sys/stat.h>
+
+
+/* empty string list */
+
+void initStringList(struct StringList* list) {
+
+	list->size = 0;
+	list->capacity = 0;
+	list->items = NULL;
+
+}
+
+
+/* append a string, taking ownership of it */
+
+void appendString(struct StringList* list, char* str) {
+
+	if (list->size == list->capacity) {
+		list->capacity = (list->capacity == 0) ? 16 : list->capacity * 2;
+		list->items = realloc(list->items, list->capacity * sizeof(char* ));
+	}
+	list->items[list->size++] = str;
+
+}
+
+
+/* free the list and every string in it */
+
+void freeStringList(struct StringList* list) {
+
+	int i;
+	for (i = 0; i < list->size; i++) {
+		free(list->items[i]);
+	}
+	free(list->items);
+	initStringList(list);
+
+}
+
+
+/* Boolean: does the string contain pattern characters */
+
+int hasGlobChars(const char* str) {
+
+	return strpbrk(str, "*?[") != NULL;
+
+}
+
+
+/* match a bracket expression starting just after '['. Sets *end to the character after ']'. Returns -1 if the
+   bracket is not closed, in which case '[' is an ordinary character */
+
+static int matchBracket(const char* p, char c, const char** end) {
+
+	int negate = 0, matched = 0;
+
+	if (*p == '!' || *p == '^') { negate = 1; p++; }
+
+	/* a ']' right after the opening bracket is a literal */
+
+	const char* start = p;
+	while (*p && (*p != ']' || p == start)) {
+
+		if (p[1] == '-' && p[2] && p[2] != ']') {
+			if ((unsigned char) c >= (unsigned char) p[0] && (unsigned char) c <= (unsigned char) p[2]) { matched = 1; }
+			p += 3;
+		}
+		else {
+			if (c == *p) { matched = 1; }
+			p++;
+		}
+
+	}
+
+	if (*p != ']') { return -1; }
+
+	*end = p + 1;
+	return matched != negate;
+
+}
+
+
+/* Boolean: does name match a single path component pattern. '*' backtracks to its last position only, which is
+   enough for a pattern without '/' */
+
+int matchPattern(const char* pattern, const char* name) {
+
+	const char* p = pattern;
+	const char* n = name;
+	const char* starP = NULL;
+	const char* starN = NULL;
+	const char* end;
+	int res;
+
+	while (*n) {
+
+		if (*p == '*') {
+			starP = ++p;
+			starN = n;
+			continue;
+		}
+
+		if (*p == '?') {
+			p++; n++;
+			continue;
+		}
+
+		if (*p == '[' && (res = matchBracket(p + 1, *n, &end)) >= 0) {
+			if (res) { p = end; n++; continue; }
+		}
+		else if (*p == *n) {
+			p++; n++;
+			continue;
+		}
+
+		/* mismatch: let the last '*' absorb one more character */
+
+		if (starP == NULL) { return 0; }
+		p = starP;
+		n = ++starN;
+
+	}
+
+	while (*p == '*') { p++; }
+
+	return *p == 0;
+
+}
+
+
+/* join a directory and a name. An empty base means the working directory */
+
+static char* joinPath(const char* base, const char* name) {
+
+	size_t len = strlen(base) + strlen(name) + 2;
+	char* path = malloc(len);
+
+	if (base[0] == 0) { snprintf(path, len, "%s", name); }
+	else if (strcmp(base, "/") == 0) { snprintf(path, len, "/%s", name); }
+	else { snprintf(path, len, "%s/%s", base, name); }
+
+	return path;
+
+}
+
+
+/* recursive step: match component idx of the pattern against the entries of base */
+
+static void expandFrom(const char* base, char** comps, int numComps, int idx, struct StringList* out) {
+
+	int i, isLast = (idx == numComps - 1);
+	char* comp = comps[idx];
+	char* path;
+	struct stat attributes;
+	struct DirListing* listing;
+
+	/* literal component: no listing needed */
+
+	if (!hasGlobChars(comp)) {
+		path = joinPath(base, comp);
+		if (!isLast) {
+			expandFrom(path, comps, numComps, idx + 1, out);
+			free(path);
+		}
+		else if (lstat(path, &attributes) == 0) {
+			appendString(out, path);
+		}
+		else {
+			free(path);
+		}
+		return;
+	}
+
+	/* ** matches any number of directories, zero included. Symbolic links are not followed */
+
+	int isGlobstar = (strcmp(comp, "**") == 0);
+
+	if (isGlobstar && !isLast) {
+		expandFrom(base, comps, numComps, idx + 1, out);
+	}
+
+	listing = dirCacheGet(base[0] ? base : ".");
+	if (listing == NULL) { return; }
+
+	for (i = 0; i < listing->numEntries; i++) {
+
+		const char* name = listingName(listing, i);
+
+		/* hidden entries only match a pattern that starts with a dot */
+
+		if (name[0] == '.' && comp[0] != '.') { continue; }
+
+		if (isGlobstar) {
+			path = joinPath(base, name);
+			if (isLast) {
+				appendString(out, strdup(path));
+			}
+			if (listing->entries[i].type == DT_DIR || (listing->entries[i].type == DT_UNKNOWN && listingIsDir(listing, i))) {
+				expandFrom(path, comps, numComps, idx, out);
+			}
+			free(path);
+			continue;
+		}
+
+		if (!matchPattern(comp, name)) { continue; }
+
+		if (isLast) {
+			appendString(out, joinPath(base, name));
+		}
+		else if (listingIsDir(listing, i)) {
+			path = joinPath(base, name);
+			expandFrom(path, comps, numComps, idx + 1, out);
+			free(path);
+		}
+
+	}
+
+	dirCacheRelease(listing);
+
+}
+
+
+/* compare strings for qsort */
+
+static int compareStrings(const void* a, const void* b) {
+
+	return strcmp(*(char* const* ) a, *(char* const* ) b);
+
+}
+
+
+/* expand one pattern, appending the sorted matches to out. Returns the number of matches */
+
+int expandPattern(const char* pattern, struct StringList* out) {
+
+	int numComps = 0, first = out->size;
+	char* copy = strdup(pattern);
+	char* comps[256];
+	char* comp;
+	char* save;
+
+	/* split into components, collapsing repeated slashes */
+
+	for (comp = strtok_r(copy, "/", &save); comp != NULL && numComps < 256; comp = strtok_r(NULL, "/", &save)) {
+		comps[numComps++] = comp;
+	}
+
+	if (numComps > 0) {
+		expandFrom((pattern[0] == '/') ? "/" : "", comps, numComps, 0, out);
+	}
+
+	free(copy);
+
+	qsort(out->items + first, out->size - first, sizeof(char* ), compareStrings);
+
+	return out->size - first;
+
+}
+
+
+/* expand every argument that contains pattern characters. Returns a new NULL terminated argument array. Expanded
+   strings are owned by the owned list and stay valid until it is freed */
+
+char** expandArgs(char** args, struct StringList* owned) {
+
+	int i, j, first, numMatches, count = 0, cap = 16;
+	char** expanded = malloc(cap * sizeof(char* ));
+
+	for (i = 0; args[i] != NULL; i++) {
+
+		first = owned->size;
+		numMatches = 0;
+
+		/* operators are never expanded */
+
+		if (hasGlobChars(args[i]) && strcmp(args[i], "<") != 0 && strcmp(args[i], ">") != 0 &&
+				strcmp(args[i], "&") != 0) {
+			numMatches = expandPattern(args[i], owned);
+		}
+
+		while (count + numMatches + 2 > cap) {
+			cap *= 2;
+			expanded = realloc(expanded, cap * sizeof(char* ));
+		}
+
+		if (numMatches == 0) {
+			expanded[count++] = args[i];
+		}
+		else {
+			for (j = 0; j < numMatches; j++) {
+				expanded[count++] = owned->items[first + j];
+			}
+		}
+
+	}
+
+	expanded[count] = NULL;
+
+	return expanded;
+
+}
@@ -0,0 +1,36 @@
+/***********************************************************************************************
+ *	Title: Pathname Expansion Declarations
+ * 	Description: Function signatures and struct definitions for pathname expansion in smallsh.
+ * 			Supports *, ?, [...] and ** patterns, with sorted results.
+ * ********************************************************************************************/
+
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "dirCache.h"
+
+#ifndef GLOB_EXPAND_H
+#define GLOB_EXPAND_H
+
+/* a growable list of strings, which owns the strings it holds */
+
+struct StringList {
+
+	int size;
+	int capacity;
+	char** items;
+
+};
+
+void initStringList(struct StringList* );
+void appendString(struct StringList* , char* );
+void freeStringList(struct StringList* );
+
+int hasGlobChars(const char* );
+int matchPattern(const char* , const char* );
+int expandPattern(const char* , struct StringList* );
+char** expandArgs(char** , struct StringList* );
+
+#endif
@@ -0,0 +1,220 @@
+/****************************************************************************************************
+ *	Title: Job Table
+ *	Description: Implementation of a fixed size job table. Each command launched by smallsh runs
+ *			in its own process group, and its entry here records the group ID, whether it is
+ *			running or stopped, and the command line used to start it.
+ * *************************************************************************************************/
+
+
+#include <string.h>
+#include "jobs.h"
+
+
+/* mark every slot of the job table as free */
+
+void initJobs(struct JobTable* table) {
+
+	int i;
+	for (i = 0; i < MAX_JOBS; i++) {
+		table->jobs[i].id = 0;
+		table->jobs[i].pgid = 0;
+		table->jobs[i].state = JOB_FREE;
+		table->jobs[i].isBG = 0;
+		table->jobs[i].command[0] = 0;
+	}
+	table->size = 0;
+
+}
+
+
+/* add a job for process group pgid. The job takes the lowest job number not in use. Returns NULL if table is full */
+
+struct Job* addJob(struct JobTable* table, pid_t pgid, char** args, int isBG) {
+
+	int i, id, taken;
+	struct Job* slot = NULL;
+
+	/* find a free slot */
+
+	for (i = 0; i < MAX_JOBS && slot == NULL; i++) {
+		if (table->jobs[i].state == JOB_FREE) {
+			slot = &table->jobs[i];
+		}
+	}
+	if (slot == NULL) { return NULL; }
+
+	/* pick the lowest unused job number, like other shells do */
+
+	id = 0;
+	do {
+		id++;
+		taken = 0;
+		for (i = 0; i < MAX_JOBS; i++) {
+			if (table->jobs[i].state != JOB_FREE && table->jobs[i].id == id) {
+				taken = 1;
+			}
+		}
+	} while (taken);
+
+	slot->id = id;
+	slot->pgid = pgid;
+	slot->state = JOB_RUNNING;
+	slot->isBG = isBG;
+
+	/* store the command line for the jobs listing */
+
+	slot->command[0] = 0;
+	for (i = 0; args[i] != NULL; i++) {
+		if (strlen(slot->command) + strlen(args[i]) + 2 >= JOB_CMD_LEN) { break; }
+		if (i > 0) { strcat(slot->command, " "); }
+		strcat(slot->command, args[i]);
+	}
+
+	table->size++;
+
+	return slot;
+
+}
+
+
+/* find a job by its job number */
+
+struct Job* findJobById(struct JobTable* table, int id) {
+
+	int i;
+	for (i = 0; i < MAX_JOBS; i++) {
+		if (table->jobs[i].state != JOB_FREE && table->jobs[i].id == id) {
+			return &table->jobs[i];
+		}
+	}
+	return NULL;
+
+}
+
+
+/* find a job by its process group ID */
+
+struct Job* findJobByPgid(struct JobTable* table, pid_t pgid) {
+
+	int i;
+	for (i = 0; i < MAX_JOBS; i++) {
+		if (table->jobs[i].state != JOB_FREE && table->jobs[i].pgid == pgid) {
+			return &table->jobs[i];
+		}
+	}
+	return NULL;
+
+}
+
+
+/* resolve a job spec typed by the user: %n, %% or %+ (current job), or a bare pid. NULL spec means current job */
+
+struct Job* findJobBySpec(struct JobTable* table, char* spec) {
+
+	if (spec == NULL || strcmp(spec, "%%") == 0 || strcmp(spec, "%+") == 0) {
+		return currentJob(table);
+	}
+	if (spec[0] == '%') {
+		return findJobById(table, atoi(spec + 1));
+	}
+	return findJobByPgid(table, (pid_t) atoi(spec));
+
+}
+
+
+/* the current job is the one with the highest job number */
+
+struct Job* currentJob(struct JobTable* table) {
+
+	int i;
+	struct Job* best = NULL;
+	for (i = 0; i < MAX_JOBS; i++) {
+		if (table->jobs[i].state != JOB_FREE && (best == NULL || table->jobs[i].id > best->id)) {
+			best = &table->jobs[i];
+		}
+	}
+	return best;
+
+}
+
+
+/* release a job slot */
+
+void removeJob(struct JobTable* table, struct Job* job) {
+
+	if (job != NULL && job->state != JOB_FREE) {
+		job->state = JOB_FREE;
+		job->id = 0;
+		job->pgid = 0;
+		table->size--;
+	}
+
+}
+
+
+/* Boolean: every slot of the table is taken */
+
+int jobTableFull(struct JobTable* table) {
+
+	return table->size >= MAX_JOBS;
+
+}
+
+
+/* count jobs started in the background that have not finished, running or stopped */
+
+int countBackgroundJobs(struct JobTable* table) {
+
+	int i, count = 0;
+	for (i = 0; i < MAX_JOBS; i++) {
+		if (table->jobs[i].state != JOB_FREE && table->jobs[i].isBG) { count++; }
+	}
+	return count;
+
+}
+
+
+/* number of background jobs that are running rather than stopped */
+
+int countRunningBackgroundJobs(struct JobTable* table) {
+
+	int i, count = 0;
+	for (i = 0; i < MAX_JOBS; i++) {
+		if (table->jobs[i].state == JOB_RUNNING && table->jobs[i].isBG) { count++; }
+	}
+	return count;
+
+}
+
+
+/* print one job in the familiar "[n] state command" layout */
+
+void printJob(struct Job* job) {
+
+	printf("[%d] %d %-8s %s%s\n", job->id, (int) job->pgid,
+		(job->state == JOB_STOPPED) ? "Stopped" : "Running",
+		job->command, (job->isBG && job->state == JOB_RUNNING) ? " &" : "");
+	fflush(stdout);
+
+}
+
+
+/* print the job table */
+
+void printJobs(struct JobTable* table) {
+
+	int i, id, maxId = 0;
+	struct Job* job;
+
+	for (i = 0; i < MAX_JOBS; i++) {
+		if (table->jobs[i].state != JOB_FREE && table->jobs[i].id > maxId) { maxId = table->jobs[i].id; }
+	}
+
+	/* list in job number order */
+
+	for (id = 1; id <= maxId; id++) {
+		job = findJobById(table, id);
+		if (job != NULL) { printJob(job); }
+	}
+
+}
@@ -0,0 +1,55 @@
+/***********************************************************************************************
+ *	Title: Job Table Declarations
+ * 	Description: Function signatures and struct definitions for the job table used by smallsh
+ * 			to track each command as its own process group, so that jobs can be
+ * 			stopped, resumed in the foreground or background, and signalled by number
+ * ********************************************************************************************/
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#ifndef JOBS_H
+#define JOBS_H
+
+#define MAX_JOBS 64
+#define JOB_CMD_LEN 256
+
+/* job states */
+
+#define JOB_FREE 0
+#define JOB_RUNNING 1
+#define JOB_STOPPED 2
+
+struct Job {
+
+	int id;				// job number shown to the user as %id
+	pid_t pgid;			// process group ID, equal to the pid of the job leader
+	int state;
+	int isBG;
+	char command[JOB_CMD_LEN];
+
+};
+
+struct JobTable {
+
+	int size;
+	struct Job jobs[MAX_JOBS];
+
+};
+
+void initJobs(struct JobTable* );
+struct Job* addJob(struct JobTable* , pid_t, char** , int);
+struct Job* findJobById(struct JobTable* , int);
+struct Job* findJobByPgid(struct JobTable* , pid_t);
+struct Job* findJobBySpec(struct JobTable* , char* );
+struct Job* currentJob(struct JobTable* );
+void removeJob(struct JobTable* , struct Job* );
+int jobTableFull(struct JobTable* );
+int countBackgroundJobs(struct JobTable* );
+int countRunningBackgroundJobs(struct JobTable* );
+void printJob(struct Job* );
+void printJobs(struct JobTable* );
+
+#endif